@@ -0,0 +1,556 @@
+#include "stdafx.h"
+#include "CatalogStreamer.h"
+#include "ViewCuller.h"
+#include "MagnitudeLod.h"
+
+#include <algorithm>
+
+static const size_t kDefaultBudget = 256 * 1024 * 1024;
+static const size_t kDefaultMaxReads = 64;
+
+// A failed read is tried again after this many frames, doubled for each failure in a row
+// up to kMaxRetryDoublings times
+static const uint32_t kRetryFrames = 8;
+static const uint32_t kMaxRetryDoublings = 7;
+
+// Three floats of offset, a magnitude and a colour index per point
+static const size_t kFloatsPerPoint = 5;
+
+CatalogStreamer::CatalogStreamer() : mCatalog(NULL),
+									 mReader(NULL),
+									 mPointDataOffset(0),
+									 mBudget(kDefaultBudget),
+									 mMaxReads(kDefaultMaxReads),
+									 mUsedBytes(0),
+									 mFrame(0),
+									 mRoot(NULL),
+									 mNewest(NULL),
+									 mOldest(NULL),
+									 mNodeCount(0),
+									 mEvictedCount(0),
+									 mCuller(NULL),
+									 mMagnitudeLimit(0.0),
+									 mLoadedCount(0),
+									 mFailedCount(0),
+									 mBytesRead(0)
+{
+}
+
+CatalogStreamer::~CatalogStreamer()
+{
+	close();
+}
+
+bool CatalogStreamer::open(const PackedCatalog& inCatalog, const char* inPath, AsyncFileReader& inReader)
+{
+	close();
+	if (!inCatalog.isOpen() || !mFile.open(inPath))
+		return false;
+
+	mCatalog = &inCatalog;
+	mReader = &inReader;
+	mPointDataOffset = inCatalog.getPointDataOffset();
+	mRootInfo = inCatalog.getNode(0);
+	mRootCenter = inCatalog.getNodeCenter(0);
+	mEvictedCount = 0;
+	mLoadedCount = 0;
+	mFailedCount = 0;
+	mBytesRead = 0;
+
+	return true;
+}
+
+void CatalogStreamer::close()
+{
+	// Every read calls back, cancelled or not, before its node can go
+	for (size_t i = 0; i < mReading.size(); i++)
+		mReader->cancel(mReading[i]->ticket);
+	while (true)
+	{
+		bool reading = false;
+		for (size_t i = 0; i < mReading.size(); i++)
+			reading |= (mReading[i]->state.load(std::memory_order_acquire) == eNodeReading);
+		for (size_t i = 0; i < mCancelled.size(); i++)
+			reading |= (mCancelled[i]->state.load(std::memory_order_acquire) == eNodeReading);
+		if (!reading)
+			break;
+
+		mReader->runCompletions(NULL, NULL);
+		std::this_thread::yield();
+	}
+	mReading.clear();
+	for (size_t i = 0; i < mCancelled.size(); i++)
+		delete mCancelled[i];
+	mCancelled.clear();
+
+	while (mNewest != NULL)
+	{
+		Node* node = mNewest;
+		mNewest = node->older;
+		delete node;
+	}
+	mOldest = NULL;
+	mRoot = NULL;
+	mNodeCount = 0;
+	mUsedBytes = 0;
+	mFile.close();
+	mCatalog = NULL;
+	mReader = NULL;
+}
+
+void CatalogStreamer::update(const ViewCuller& inCuller, const TUniversalVector3& inViewer, double inMagnitudeLimit,
+							 std::vector<StreamedNodeDraw>& outDraws)
+{
+	outDraws.clear();
+	if (mCatalog == NULL)
+		return;
+
+	mFrame++;
+	mCuller = &inCuller;
+	mViewer = inViewer;
+	mMagnitudeLimit = inMagnitudeLimit;
+	mWanted.clear();
+	mRetries.clear();
+	mStack.clear();
+
+	// Over the budget, as when it was lowered, even what the last frame drew can go: the
+	// view coarsens to fit before anything is drawn. Nodes whose reads have called back
+	// are off the reading list first, as they can be evicted.
+	sweepReads();
+	if (mUsedBytes > mBudget)
+		evict(mUsedBytes - mBudget);
+
+	// The stack holds nodes already used this frame and in memory
+	Visit root = { 0, &mRootInfo, &mRootCenter, 0.0f, NULL, 0 };
+	if (isWanted(mRootInfo, mRootCenter, root.importance) && (useNode(root) != NULL))
+		mStack.push_back(root);
+
+	while (!mStack.empty())
+	{
+		Visit visit = mStack.back();
+		mStack.pop_back();
+		Node* node = (visit.parent == NULL) ? mRoot : visit.parent->children[visit.slot];
+
+		// The children in view replace the node's samples once they are all here
+		const PackedCatalogNode& info = node->info;
+		bool childrenReady = true;
+		size_t firstChildVisit = mStack.size();
+		if (info.firstChild != kNoPackedNode)
+		{
+			for (uint32_t child = 0; child < 8; child++)
+			{
+				Visit childVisit = { info.firstChild + child, &node->childInfo[child], &node->childCenters[child], 0.0f, node, child };
+				if (!isWanted(*childVisit.info, *childVisit.center, childVisit.importance))
+					continue;
+				if (useNode(childVisit) == NULL)
+					childrenReady = false;
+				else
+					mStack.push_back(childVisit);
+			}
+		}
+		if (!childrenReady)
+			mStack.resize(firstChildVisit);
+
+		StreamedNodeDraw draw;
+		draw.node = visit.node;
+		draw.pointCount = info.pointCount + (childrenReady ? 0 : info.sampleCount);
+		draw.data = &node->data;
+		if (draw.pointCount > 0)
+			outDraws.push_back(draw);
+	}
+
+	queueWanted();
+}
+
+void CatalogStreamer::getStats(CatalogStreamerStats& outStats) const
+{
+	outStats.nodeCount = mNodeCount;
+	outStats.usedBytes = mUsedBytes;
+	outStats.readingCount = mReading.size() + mCancelled.size();
+	outStats.loadedCount = mLoadedCount.load();
+	outStats.evictedCount = mEvictedCount;
+	outStats.failedCount = mFailedCount.load();
+	outStats.bytesRead = mBytesRead.load();
+}
+
+// -----------------------------------------------------------------------
+//	isWanted [protected]
+//
+//	Whether a node's subtree has points in view bright enough to draw,
+//	and if so how important it is: about the angle its cell's bounding
+//	sphere subtends, and more than any other when the viewer is inside.
+// -----------------------------------------------------------------------
+bool CatalogStreamer::isWanted(const PackedCatalogNode& inInfo, const TUniversalVector3& inCenter, float& outImportance) const
+{
+	const double kSqrt3 = 1.7320508075688772;
+
+	if (inInfo.subtreePointCount == 0)
+		return false;
+
+	TVector3d center = inCenter.toVector3d(mViewer);
+	double radius = ldexp(1.0, kUniversalOctreeRootBits - inInfo.level) * kSqrt3;
+	if (mCuller->getViewDistance(center) > radius)
+		return false;
+
+	double distance = center.Length();
+	if ((distance > radius) && (getApparentMagnitude(inInfo.brightestMagnitude, distance - radius) > mMagnitudeLimit))
+		return false;
+
+	outImportance = (float)((distance > radius) ? radius / distance : 2.0 - distance / radius);
+
+	return true;
+}
+
+// -----------------------------------------------------------------------
+//	useNode [protected]
+//
+//	Marks a node in view as used this frame, moving it to the new end of
+//	the least recently used list, or adds it to the wanted list if it
+//	has no Node yet, or to the retries if its read failed long enough
+//	ago. Returns the Node if its points are here.
+// -----------------------------------------------------------------------
+CatalogStreamer::Node* CatalogStreamer::useNode(const Visit& inVisit)
+{
+	Node* node = (inVisit.parent == NULL) ? mRoot : inVisit.parent->children[inVisit.slot];
+	if (node == NULL)
+	{
+		mWanted.push_back(inVisit);
+		return NULL;
+	}
+
+	node->lastUsed = mFrame;
+	node->importance = inVisit.importance;
+	if (node != mNewest)
+	{
+		unlinkNode(node);
+		node->older = mNewest;
+		mNewest->newer = node;
+		mNewest = node;
+	}
+
+	int state = node->state.load(std::memory_order_acquire);
+	if ((state == eNodeFailed) && (node->retryFrame != 0) && ((int32_t)(mFrame - node->retryFrame) >= 0))
+		mRetries.push_back(node);
+
+	return (state == eNodeResident) ? node : NULL;
+}
+
+// -----------------------------------------------------------------------
+//	sweepReads [protected]
+//
+//	Takes the nodes whose reads have called back off the reading list,
+//	and sets when failed ones are read again.
+// -----------------------------------------------------------------------
+void CatalogStreamer::sweepReads()
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < mReading.size(); i++)
+	{
+		Node* node = mReading[i];
+		int state = node->state.load(std::memory_order_acquire);
+		if (state == eNodeReading)
+			mReading[kept++] = node;
+		else if (state == eNodeFailed)
+		{
+			node->retryFrame = mFrame + (kRetryFrames << std::min(node->failures, kMaxRetryDoublings));
+			node->failures++;
+		}
+	}
+	mReading.resize(kept);
+}
+
+// -----------------------------------------------------------------------
+//	queueWanted [protected]
+//
+//	Cancels the reads of nodes that went out of view, and frees the
+//	cancelled nodes whose reads have called back; nodes whose reads
+//	called back during the frame are left for the next sweepReads().
+//	Then reads the failed nodes that are due again, which already count
+//	against the budget, and the most important of the nodes wanted this
+//	frame that the read limit and the budget have room for, evicting to
+//	make it.
+// -----------------------------------------------------------------------
+void CatalogStreamer::queueWanted()
+{
+	struct Order
+	{
+		static bool visit(const Visit& inA, const Visit& inB) { return inA.importance > inB.importance; };
+	};
+
+	size_t kept = 0;
+	for (size_t i = 0; i < mReading.size(); i++)
+	{
+		Node* node = mReading[i];
+		if ((node->lastUsed == mFrame) || (node->state.load(std::memory_order_acquire) != eNodeReading))
+			mReading[kept++] = node;
+		else
+		{
+			mReader->cancel(node->ticket);
+			detachNode(node);
+			mCancelled.push_back(node);
+		}
+	}
+	mReading.resize(kept);
+
+	kept = 0;
+	for (size_t i = 0; i < mCancelled.size(); i++)
+	{
+		Node* node = mCancelled[i];
+		if (node->state.load(std::memory_order_acquire) == eNodeReading)
+			mCancelled[kept++] = node;
+		else
+		{
+			mUsedBytes -= node->bytes;
+			delete node;
+		}
+	}
+	mCancelled.resize(kept);
+
+	size_t reading = mReading.size() + mCancelled.size();
+	size_t room = (mMaxReads > reading) ? mMaxReads - reading : 0;
+	mReads.clear();
+	size_t firstRead = mReading.size();
+	for (size_t i = 0; (i < mRetries.size()) && (room > 0); i++, room--)
+	{
+		Node* node = mRetries[i];
+		node->state.store(eNodeReading);
+		node->retryFrame = 0;
+		node->block.resize(node->info.dataSize);
+		mReading.push_back(node);
+		mReads.push_back(getRead(node, node->importance));
+	}
+
+	if (mWanted.size() < room)
+		room = mWanted.size();
+	if (room > 0)
+	{
+		std::partial_sort(mWanted.begin(), mWanted.begin() + room, mWanted.end(), Order::visit);
+
+		size_t wantedBytes = 0;
+		for (size_t i = 0; i < room; i++)
+			wantedBytes += ((size_t)mWanted[i].info->pointCount + mWanted[i].info->sampleCount) * kFloatsPerPoint * sizeof(float) + sizeof(Node);
+		if (mUsedBytes + wantedBytes > mBudget)
+			evict(mUsedBytes + wantedBytes - mBudget);
+	}
+
+	for (size_t i = 0; i < room; i++)
+	{
+		const Visit& visit = mWanted[i];
+		size_t bytes = ((size_t)visit.info->pointCount + visit.info->sampleCount) * kFloatsPerPoint * sizeof(float) + sizeof(Node);
+		if (mUsedBytes + bytes > mBudget)
+			break;
+
+		Node* node = new Node;
+		node->index = visit.node;
+		node->state.store(eNodeReading);
+		node->info = *visit.info;
+		node->bytes = bytes;
+		node->lastUsed = mFrame;
+		node->failures = 0;
+		node->retryFrame = 0;
+		node->importance = visit.importance;
+		node->parent = visit.parent;
+		node->slot = visit.slot;
+		for (uint32_t child = 0; child < 8; child++)
+			node->children[child] = NULL;
+		node->childCount = 0;
+		node->newer = NULL;
+		node->older = mNewest;
+		if (mNewest != NULL)
+			mNewest->newer = node;
+		else
+			mOldest = node;
+		mNewest = node;
+		node->owner = this;
+		node->ticket = kNoAsyncRead;
+		node->block.resize(node->info.dataSize);
+
+		if (visit.parent == NULL)
+			mRoot = node;
+		else
+		{
+			visit.parent->children[visit.slot] = node;
+			visit.parent->childCount++;
+		}
+		mNodeCount++;
+		mUsedBytes += bytes;
+		mReading.push_back(node);
+		mReads.push_back(getRead(node, visit.importance));
+	}
+
+	if (!mReads.empty())
+	{
+		mTickets.resize(mReads.size());
+		mReader->submit(&mReads[0], mReads.size(), &mTickets[0]);
+		for (size_t i = 0; i < mTickets.size(); i++)
+			mReading[firstRead + i]->ticket = mTickets[i];
+	}
+}
+
+// -----------------------------------------------------------------------
+//	getRead [protected]
+//
+//	The read of a node's block, which must have its size. Nodes the
+//	viewer is inside are what the view is waiting on most.
+// -----------------------------------------------------------------------
+AsyncRead CatalogStreamer::getRead(Node* inNode, float inImportance)
+{
+	AsyncRead read;
+	read.file = &mFile;
+	read.offset = mPointDataOffset + inNode->info.dataOffset;
+	read.size = inNode->block.size();
+	read.buffer = inNode->block.empty() ? NULL : &inNode->block[0];
+	read.priority = (inImportance > 1.0f) ? eReadUrgent : eReadNormal;
+	read.callback = readDone;
+	read.context = inNode;
+
+	return read;
+}
+
+// -----------------------------------------------------------------------
+//	evict [protected]
+//
+//	Drops nodes not used this frame, and without children in memory,
+//	until inBytes are free. The least recently used list is walked from
+//	its old end a frame's worth at a time, least important first; a
+//	parent is always used with or after its children. A child the viewer
+//	is nearer the centre of can be more important than its parent, so a
+//	frame's nodes are gone over again while that frees more.
+// -----------------------------------------------------------------------
+void CatalogStreamer::evict(size_t inBytes)
+{
+	struct Order
+	{
+		static bool importance(const Node* inA, const Node* inB) { return inA->importance < inB->importance; };
+	};
+
+	size_t freed = 0;
+	Node* node = mOldest;
+	while ((freed < inBytes) && (node != NULL) && (node->lastUsed != mFrame))
+	{
+		mCandidates.clear();
+		uint32_t frame = node->lastUsed;
+		for (; (node != NULL) && (node->lastUsed == frame); node = node->newer)
+			mCandidates.push_back(node);
+		std::sort(mCandidates.begin(), mCandidates.end(), Order::importance);
+
+		bool dropped = true;
+		while (dropped && (freed < inBytes))
+		{
+			dropped = false;
+			for (size_t i = 0; (i < mCandidates.size()) && (freed < inBytes); i++)
+			{
+				Node* candidate = mCandidates[i];
+				if (candidate == NULL)
+					continue;
+				int state = candidate->state.load(std::memory_order_acquire);
+				if ((candidate->childCount > 0) || ((state != eNodeResident) && (state != eNodeFailed)))
+					continue;
+
+				freed += candidate->bytes;
+				dropNode(candidate);
+				mCandidates[i] = NULL;
+				mEvictedCount++;
+				dropped = true;
+			}
+		}
+	}
+}
+
+// -----------------------------------------------------------------------
+//	unlinkNode [protected]
+//
+//	Takes a node out of the least recently used list.
+// -----------------------------------------------------------------------
+void CatalogStreamer::unlinkNode(Node* inNode)
+{
+	if (inNode->newer != NULL)
+		inNode->newer->older = inNode->older;
+	else
+		mNewest = inNode->older;
+	if (inNode->older != NULL)
+		inNode->older->newer = inNode->newer;
+	else
+		mOldest = inNode->newer;
+	inNode->newer = NULL;
+	inNode->older = NULL;
+}
+
+// -----------------------------------------------------------------------
+//	detachNode [protected]
+//
+//	Takes a node without children with Nodes out of the tree and the
+//	least recently used list.
+// -----------------------------------------------------------------------
+void CatalogStreamer::detachNode(Node* inNode)
+{
+	if (inNode->parent == NULL)
+		mRoot = NULL;
+	else
+	{
+		inNode->parent->children[inNode->slot] = NULL;
+		inNode->parent->childCount--;
+	}
+
+	unlinkNode(inNode);
+	mNodeCount--;
+}
+
+// -----------------------------------------------------------------------
+//	dropNode [protected]
+//
+//	Frees a node in memory or failed, without children with Nodes.
+// -----------------------------------------------------------------------
+void CatalogStreamer::dropNode(Node* inNode)
+{
+	detachNode(inNode);
+	mUsedBytes -= inNode->bytes;
+	delete inNode;
+}
+
+// -----------------------------------------------------------------------
+//	readDone [protected]
+//
+//	The callback of a node's read, run as a job: decodes the points, and
+//	copies what update() needs to look at the node's children, so update()
+//	never touches the mapping. The node may have been cancelled, and its
+//	state is the last of it touched, as update() may free it then.
+// -----------------------------------------------------------------------
+void CatalogStreamer::readDone(void* ioContext, AsyncReadStatus inStatus)
+{
+	Node* node = (Node*)ioContext;
+	CatalogStreamer* owner = node->owner;
+	const PackedCatalogNode& info = node->info;
+	size_t count = (size_t)info.pointCount + info.sampleCount;
+
+	bool loaded = (inStatus == eReadDone);
+	if (loaded)
+	{
+		node->points.resize(count * kFloatsPerPoint);
+		float* points = node->points.empty() ? NULL : &node->points[0];
+		if (count > 0)
+			loaded = !node->block.empty() && PackedCatalog::decodeBlock(info, &node->block[0], 1.0, points, points + count * 3, points + count * 4);
+		owner->mBytesRead += node->block.size();
+
+		node->data.offsets = points;
+		node->data.magnitudes = points + count * 3;
+		node->data.colourIndices = points + count * 4;
+		node->data.count = (uint32_t)count;
+		node->data.origin = owner->mCatalog->getNodeOrigin(node->index);
+		if (info.firstChild != kNoPackedNode)
+		{
+			for (uint32_t child = 0; child < 8; child++)
+			{
+				node->childInfo[child] = owner->mCatalog->getNode(info.firstChild + child);
+				node->childCenters[child] = owner->mCatalog->getNodeCenter(info.firstChild + child);
+			}
+		}
+	}
+	std::vector<uint8_t>().swap(node->block);
+
+	if (loaded)
+		owner->mLoadedCount++;
+	else if (inStatus != eReadCancelled)
+		owner->mFailedCount++;
+	node->state.store(loaded ? eNodeResident : eNodeFailed, std::memory_order_release);
+}
@@ -0,0 +1,230 @@
+//----------------------------------------------------------------------
+//	File:		CatalogStreamer.h
+//
+//	Contains:	Out-of-core streaming of a packed catalogue's points: nodes
+//				read from disk as they come into view and dropped again to
+//				stay within a memory budget.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "PackedCatalog.h"
+#include "AsyncFileReader.h"
+
+//----------------------------------------------------------------------
+//	Struct:		StreamedNodeData
+//
+//	Purpose:	The decoded points of a node in memory, as
+//				PackedCatalog::decodeNode() gives them: its own points,
+//				then its samples.
+//
+//----------------------------------------------------------------------
+struct StreamedNodeData
+{
+	const float*		offsets;			// x, y, z per point, mm from origin
+	const float*		magnitudes;			// Absolute, NaN if unknown
+	const float*		colourIndices;		// NaN if unknown
+	uint32_t			count;
+	TUniversalVector3	origin;
+};
+
+//----------------------------------------------------------------------
+//	Struct:		StreamedNodeDraw
+//
+//	Purpose:	A node CatalogStreamer::update() has ready to draw, and how
+//				many of its decoded points to draw: its own, or its own and
+//				its samples when they stand in for its children. The data
+//				lasts until the next update().
+//
+//----------------------------------------------------------------------
+struct StreamedNodeDraw
+{
+	uint32_t				node;
+	uint32_t				pointCount;
+	const StreamedNodeData*	data;
+};
+
+//----------------------------------------------------------------------
+//	Struct:		CatalogStreamerStats
+//
+//	Purpose:	What is in memory, and what has been read and dropped since
+//				open().
+//
+//----------------------------------------------------------------------
+struct CatalogStreamerStats
+{
+	size_t			nodeCount;				// In memory or being read
+	size_t			usedBytes;
+	size_t			readingCount;
+	size_t			loadedCount;
+	size_t			evictedCount;
+	size_t			failedCount;
+	uint64_t		bytesRead;
+};
+
+//----------------------------------------------------------------------
+//	Class:		CatalogStreamer
+//
+//	Purpose:	Draws a packed catalogue far larger than memory. Only the
+//				catalogue's node tables are used in place; each node's
+//				points are read from the file by an AsyncFileReader when
+//				the node comes into view, decoded in the read's callback,
+//				and kept until the memory budget needs the room.
+//
+//				update() walks the octree down from the root, once a
+//				frame, and never waits for a read. A node's children are
+//				only looked at once the node is in memory, and are drawn
+//				in its place once all those in view have arrived; until
+//				then the node is drawn with its samples, the brightest
+//				points of its subtree, so the view coarsens rather than
+//				having holes. The walk only touches the root and what the
+//				callbacks copied with each node, never the mapped file, so
+//				it can't stall on a page fault either.
+//
+//				The most important of the nodes wanted, by the angle their
+//				cells subtend, are read first, and those holding up the
+//				view from inside them are urgent. Reads are cancelled when
+//				their nodes go out of view. When the budget is full,
+//				nodes not drawn this frame are dropped, least recently
+//				drawn and then least important first; a node is only
+//				dropped after its children. Nodes are only read if the
+//				budget has room for them, so it is only ever exceeded
+//				when lowered; then the next update() drops what the last
+//				frame drew, and draws coarser. A node whose read fails is
+//				drawn as if it weren't there yet and read again while it
+//				is wanted, after a number of frames that doubles with each
+//				failure.
+//
+//----------------------------------------------------------------------
+class CatalogStreamer
+{
+	public:
+		CatalogStreamer();
+		~CatalogStreamer();
+
+		// Streams inCatalog, which must stay open until close(), reading its points from
+		// inPath with inReader, whose owner runs its completions. Returns false if the file
+		// can't be opened.
+		bool			open(const PackedCatalog& inCatalog, const char* inPath, AsyncFileReader& inReader);
+		// Cancels reads, waits for them, running inReader's completions on this thread, and
+		// frees everything. Callbacks already handed to jobs must have finished.
+		void			close();
+
+		void			setMemoryBudget(size_t inBytes) { mBudget = inBytes; };
+		size_t			getMemoryBudget() const { return mBudget; };
+		// At most this many nodes are read at a time
+		void			setMaxReads(size_t inCount) { mMaxReads = inCount; };
+
+		// Replaces outDraws with the nodes to draw for inCuller's view from inViewer, leaving
+		// out subtrees whose brightest point would be fainter than inMagnitudeLimit
+		// (apparent), and queues the reads that would refine the view
+		void			update(const ViewCuller& inCuller, const TUniversalVector3& inViewer, double inMagnitudeLimit,
+							   std::vector<StreamedNodeDraw>& outDraws);
+
+		void			getStats(CatalogStreamerStats& outStats) const;
+
+	protected:
+		enum NodeState
+		{
+			eNodeReading,
+			eNodeResident,
+			eNodeFailed
+		};
+
+		struct Node
+		{
+			uint32_t				index;
+			std::atomic<int>		state;
+			PackedCatalogNode		info;
+			size_t					bytes;
+			uint32_t				lastUsed;			// Frame
+			uint32_t				failures;			// Reads that failed in a row
+			uint32_t				retryFrame;			// When a failed node is read again, 0 until set
+			float					importance;
+			Node*					parent;
+			uint32_t				slot;				// Among its parent's children
+			Node*					children[8];		// Those with Nodes of their own
+			uint32_t				childCount;
+			Node*					newer;				// Least recently used list
+			Node*					older;
+			CatalogStreamer*		owner;
+			AsyncReadTicket			ticket;
+
+			// Filled in by readDone()
+			std::vector<uint8_t>	block;				// Until decoded
+			std::vector<float>		points;
+			StreamedNodeData		data;
+			PackedCatalogNode		childInfo[8];
+			TUniversalVector3		childCenters[8];
+		};
+
+		struct Visit
+		{
+			uint32_t					node;
+			const PackedCatalogNode*	info;
+			const TUniversalVector3*	center;
+			float						importance;
+			Node*						parent;			// NULL for the root
+			uint32_t					slot;
+		};
+
+		bool			isWanted(const PackedCatalogNode& inInfo, const TUniversalVector3& inCenter, float& outImportance) const;
+		Node*			useNode(const Visit& inVisit);
+		void			sweepReads();
+		void			queueWanted();
+		AsyncRead		getRead(Node* inNode, float inImportance);
+		void			evict(size_t inBytes);
+		void			unlinkNode(Node* inNode);
+		void			detachNode(Node* inNode);
+		void			dropNode(Node* inNode);
+
+		static void		readDone(void* ioContext, AsyncReadStatus inStatus);
+
+		const PackedCatalog*	mCatalog;
+		AsyncFileReader*		mReader;
+		ReadOnlyFile			mFile;
+		uint64_t				mPointDataOffset;
+		PackedCatalogNode		mRootInfo;
+		TUniversalVector3		mRootCenter;
+
+		size_t					mBudget;
+		size_t					mMaxReads;
+		size_t					mUsedBytes;
+		uint32_t				mFrame;
+		Node*					mRoot;
+		Node*					mNewest;
+		Node*					mOldest;
+		size_t					mNodeCount;
+		size_t					mEvictedCount;
+
+		// The frame's view, and scratch reused between frames
+		const ViewCuller*		mCuller;
+		TUniversalVector3		mViewer;
+		double					mMagnitudeLimit;
+		std::vector<Visit>		mStack;
+		std::vector<Visit>		mWanted;
+		std::vector<Node*>		mRetries;			// Failed nodes wanted again
+		std::vector<Node*>		mCandidates;
+		std::vector<AsyncRead>	mReads;
+		std::vector<AsyncReadTicket>	mTickets;
+
+		// Nodes being read, and those no longer wanted whose reads haven't called back
+		std::vector<Node*>		mReading;
+		std::vector<Node*>		mCancelled;
+
+		// Counted by readDone()
+		std::atomic<size_t>		mLoadedCount;
+		std::atomic<size_t>		mFailedCount;
+		std::atomic<uint64_t>	mBytesRead;
+
+	private:
+		CatalogStreamer(const CatalogStreamer&);
+		CatalogStreamer&	operator=(const CatalogStreamer&);
+};
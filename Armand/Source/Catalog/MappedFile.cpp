@@ -0,0 +1,108 @@
+#include "stdafx.h"
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile() : mOpen(false),
+						   mData(NULL),
+						   mSize(0)
+#ifdef _WIN32
+						   , mFile(INVALID_HANDLE_VALUE),
+						   mMapping(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char* inPath)
+{
+	close();
+
+#ifdef _WIN32
+	mFile = CreateFileA(inPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFile, &size))
+	{
+		close();
+		return false;
+	}
+	mSize = (size_t)size.QuadPart;
+
+	// A file of no bytes can't be mapped, but there is nothing to read either
+	if (mSize > 0)
+	{
+		mMapping = CreateFileMapping(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mMapping != NULL)
+			mData = (const char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+		if (mData == NULL)
+		{
+			close();
+			return false;
+		}
+	}
+#else
+	int file = ::open(inPath, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(file, &status) != 0)
+	{
+		::close(file);
+		return false;
+	}
+	mSize = (size_t)status.st_size;
+
+	if (mSize > 0)
+	{
+		void* data = mmap(NULL, mSize, PROT_READ, MAP_PRIVATE, file, 0);
+		if (data == MAP_FAILED)
+		{
+			::close(file);
+			mSize = 0;
+			return false;
+		}
+		madvise(data, mSize, MADV_SEQUENTIAL);
+		mData = (const char*)data;
+	}
+
+	// The mapping keeps the file open
+	::close(file);
+#endif
+
+	mOpen = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (mData != NULL)
+		UnmapViewOfFile(mData);
+	if (mMapping != NULL)
+		CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+	mMapping = NULL;
+	mFile = INVALID_HANDLE_VALUE;
+#else
+	if (mData != NULL)
+		munmap((void*)mData, mSize);
+#endif
+
+	mOpen = false;
+	mData = NULL;
+	mSize = 0;
+}
@@ -0,0 +1,51 @@
+//----------------------------------------------------------------------
+//	File:		MappedFile.h
+//
+//	Contains:	Read-only memory mapping of a whole file, on Windows and
+//				POSIX.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+
+//----------------------------------------------------------------------
+//	Class:		MappedFile
+//
+//	Purpose:	Maps a file into memory read-only, so catalogues are parsed
+//				straight out of the page cache without being copied into
+//				buffers first. The mapping lasts until close() or the
+//				destructor.
+//
+//----------------------------------------------------------------------
+class MappedFile
+{
+	public:
+		MappedFile();
+		~MappedFile();
+
+		// Returns false if the file can't be opened or mapped
+		bool			open(const char* inPath);
+		void			close();
+
+		bool			isOpen() const { return mOpen; };
+		const char*		getData() const { return mData; };
+		size_t			getSize() const { return mSize; };
+
+	protected:
+		bool			mOpen;
+		const char*		mData;				// NULL for an empty file
+		size_t			mSize;
+
+#ifdef _WIN32
+		HANDLE			mFile;
+		HANDLE			mMapping;
+#endif
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile&		operator=(const MappedFile&);
+};
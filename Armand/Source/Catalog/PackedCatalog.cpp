@@ -0,0 +1,315 @@
+#include "stdafx.h"
+#include "PackedCatalog.h"
+#include "ViewCuller.h"
+#include "MagnitudeLod.h"
+#include "PointCodec.h"
+
+#include <string.h>
+#include <limits>
+
+PackedCatalog::PackedCatalog()
+{
+	close();
+}
+
+bool PackedCatalog::open(const char* inPath)
+{
+	close();
+	if (!mFile.open(inPath))
+		return false;
+
+	const PackedCatalogHeader* header = (const PackedCatalogHeader*)mFile.getData();
+	if ((mFile.getSize() < sizeof(PackedCatalogHeader)) ||
+		(memcmp(header->magic, kPackedCatalogMagic, sizeof(kPackedCatalogMagic)) != 0) ||
+		(header->version != kPackedCatalogVersion) ||
+		(header->headerSize != sizeof(PackedCatalogHeader)) ||
+		(header->nodeCount == 0) || (header->nodeCount >= kNoPackedNode) ||
+		(header->pointCount >= kNoPackedNode))
+	{
+		close();
+		return false;
+	}
+
+	for (int section = 0; section < ePackedSectionCount; section++)
+	{
+		const PackedCatalogSection& entry = header->sections[section];
+		if (((entry.offset % kPackedCatalogAlignment) != 0) || (entry.offset > mFile.getSize()) ||
+			(entry.size > mFile.getSize() - entry.offset))
+		{
+			close();
+			return false;
+		}
+	}
+
+	mHeader = header;
+	mNodeCount = (size_t)header->nodeCount;
+	mPointCount = (size_t)header->pointCount;
+
+	mNodes = (const PackedCatalogNode*)getSection(ePackedNodes, sizeof(PackedCatalogNode), mNodeCount);
+	const uint64_t* centers = (const uint64_t*)getSection(ePackedNodeCenters, sizeof(uint64_t) * 6, mNodeCount);
+	const uint64_t* origins = (const uint64_t*)getSection(ePackedNodeOrigins, sizeof(uint64_t) * 6, mNodeCount);
+	mPointData = (const uint8_t*)getSection(ePackedPointData, 1, header->sections[ePackedPointData].size);
+	mPointDataSize = header->sections[ePackedPointData].size;
+	mLabelOffsets = (const uint32_t*)getSection(ePackedLabelOffsets, sizeof(uint32_t), mPointCount);
+	mLabels = (const char*)getSection(ePackedLabels, 1, header->sections[ePackedLabels].size);
+	mLabelsSize = (size_t)header->sections[ePackedLabels].size;
+	mSourceRows = (const uint32_t*)getSection(ePackedSourceRows, sizeof(uint32_t), mPointCount);
+
+	if ((mNodes == NULL) || (centers == NULL) || (origins == NULL) ||
+		((mPointCount > 0) && ((mPointData == NULL) || (mLabelOffsets == NULL) || (mSourceRows == NULL))))
+	{
+		close();
+		return false;
+	}
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mCenterLo[axis] = centers + axis * mNodeCount;
+		mCenterHi[axis] = (const int64_t*)(centers + (3 + axis) * mNodeCount);
+		mOriginLo[axis] = origins + axis * mNodeCount;
+		mOriginHi[axis] = (const int64_t*)(origins + (3 + axis) * mNodeCount);
+	}
+
+	return true;
+}
+
+void PackedCatalog::close()
+{
+	mFile.close();
+	mHeader = NULL;
+	mNodeCount = 0;
+	mPointCount = 0;
+	mNodes = NULL;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mCenterLo[axis] = NULL;
+		mCenterHi[axis] = NULL;
+		mOriginLo[axis] = NULL;
+		mOriginHi[axis] = NULL;
+	}
+	mPointData = NULL;
+	mPointDataSize = 0;
+	mLabelOffsets = NULL;
+	mLabels = NULL;
+	mLabelsSize = 0;
+	mSourceRows = NULL;
+}
+
+void PackedCatalog::getNodeCenters(UniversalPointArrays& outCenters) const
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		outCenters.lo[axis] = mCenterLo[axis];
+		outCenters.hi[axis] = mCenterHi[axis];
+	}
+	outCenters.count = mNodeCount;
+}
+
+TUniversalVector3 PackedCatalog::getNodeCenter(uint32_t inNode) const
+{
+	UniversalCoord axes[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		axes[axis].table[0] = (ttmath::uint)mCenterLo[axis][inNode];
+		axes[axis].table[1] = (ttmath::uint)mCenterHi[axis][inNode];
+	}
+
+	return TUniversalVector3(axes[0], axes[1], axes[2]);
+}
+
+double PackedCatalog::getNodeHalfWidth(uint32_t inNode) const
+{
+	return ldexp(1.0, kUniversalOctreeRootBits - mNodes[inNode].level);
+}
+
+void PackedCatalog::getNodeOrigins(UniversalPointArrays& outOrigins) const
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		outOrigins.lo[axis] = mOriginLo[axis];
+		outOrigins.hi[axis] = mOriginHi[axis];
+	}
+	outOrigins.count = mNodeCount;
+}
+
+TUniversalVector3 PackedCatalog::getNodeOrigin(uint32_t inNode) const
+{
+	UniversalCoord axes[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		axes[axis].table[0] = (ttmath::uint)mOriginLo[axis][inNode];
+		axes[axis].table[1] = (ttmath::uint)mOriginHi[axis][inNode];
+	}
+
+	return TUniversalVector3(axes[0], axes[1], axes[2]);
+}
+
+const char* PackedCatalog::getLabel(uint32_t inPoint) const
+{
+	uint32_t offset = mLabelOffsets[inPoint];
+	if ((offset == kNoPackedLabel) || (offset >= mLabelsSize))
+		return NULL;
+
+	return mLabels + offset;
+}
+
+uint64_t PackedCatalog::getPointDataOffset() const
+{
+	return (mHeader != NULL) ? mHeader->sections[ePackedPointData].offset : 0;
+}
+
+const PackedPointBlock* PackedCatalog::getNodeData(uint32_t inNode) const
+{
+	const PackedCatalogNode& entry = mNodes[inNode];
+	if ((entry.pointCount + entry.sampleCount == 0) || (entry.dataOffset > mPointDataSize) ||
+		(entry.dataSize > mPointDataSize - entry.dataOffset))
+		return NULL;
+
+	return (const PackedPointBlock*)(mPointData + entry.dataOffset);
+}
+
+bool PackedCatalog::decodeNode(uint32_t inNode, double inScale, float* outXYZ, float* outMagnitudes,
+							   float* outColourIndices) const
+{
+	const PackedCatalogNode& entry = mNodes[inNode];
+	if (entry.pointCount + entry.sampleCount == 0)
+		return true;
+
+	const PackedPointBlock* block = getNodeData(inNode);
+
+	return (block != NULL) && decodeBlock(entry, block, inScale, outXYZ, outMagnitudes, outColourIndices);
+}
+
+bool PackedCatalog::decodeBlock(const PackedCatalogNode& inNode, const void* inBlock, double inScale, float* outXYZ,
+								float* outMagnitudes, float* outColourIndices)
+{
+	const PackedCatalogNode& entry = inNode;
+	size_t count = (size_t)entry.pointCount + entry.sampleCount;
+	if (count == 0)
+		return true;
+
+	const PackedPointBlock* block = (const PackedPointBlock*)inBlock;
+	size_t positionSize = count * ((entry.positionBits == 16) ? sizeof(int16_t) * 3 : sizeof(uint64_t));
+	if ((entry.dataSize < sizeof(PackedPointBlock)) || ((entry.positionBits != 16) && (entry.positionBits != 21)) ||
+		(block->magnitudeCount > entry.pointCount) || (block->sampleMagnitudeCount > entry.sampleCount) ||
+		((uint64_t)sizeof(PackedPointBlock) + positionSize + block->magnitudeBytes > entry.dataSize))
+		return false;
+
+	const uint8_t* positions = (const uint8_t*)(block + 1);
+	if (outXYZ != NULL)
+	{
+		float scale = (float)(entry.offsetScale * inScale);
+		if (entry.positionBits == 16)
+			decodePointOffsets16((const int16_t*)positions, count, scale, outXYZ);
+		else
+			decodePointOffsets21((const uint64_t*)positions, count, scale, outXYZ);
+	}
+
+	if ((outMagnitudes == NULL) && (outColourIndices == NULL))
+		return true;
+
+	// Nodes rarely hold more points than this, so the values are decoded on the stack
+	const size_t kStackValues = 1024;
+	uint32_t stackValues[kStackValues];
+	std::vector<uint32_t> heapValues;
+	uint32_t* values = stackValues;
+	if (count + 1 > kStackValues)
+	{
+		heapValues.resize(count + 1);
+		values = &heapValues[0];
+	}
+
+	const uint8_t* magnitudes = positions + positionSize;
+	if (outMagnitudes != NULL)
+	{
+		size_t known = block->magnitudeCount + block->sampleMagnitudeCount;
+		if (decodeStreamVByte(magnitudes, block->magnitudeBytes, known, values) != block->magnitudeBytes)
+			return false;
+
+		// The own points then the samples
+		const uint32_t* runValues[2] = { values, values + block->magnitudeCount };
+		size_t runKnown[2] = { block->magnitudeCount, block->sampleMagnitudeCount };
+		float* runMagnitudes[2] = { outMagnitudes, outMagnitudes + entry.pointCount };
+		size_t runCount[2] = { entry.pointCount, entry.sampleCount };
+		for (int run = 0; run < 2; run++)
+		{
+			if (runKnown[run] > 0)
+			{
+				int32_t first = zigzagDecode(runValues[run][0]);
+				runMagnitudes[run][0] = first * kPackedValueStep;
+				decodeDeltaValues(runValues[run] + 1, runKnown[run] - 1, first, kPackedValueStep, runMagnitudes[run] + 1);
+			}
+			for (size_t i = runKnown[run]; i < runCount[run]; i++)
+				runMagnitudes[run][i] = std::numeric_limits<float>::quiet_NaN();
+		}
+	}
+
+	if (outColourIndices != NULL)
+	{
+		const uint8_t* colours = magnitudes + block->magnitudeBytes;
+		size_t size = entry.dataSize - (size_t)(colours - (const uint8_t*)block);
+		if (decodeStreamVByte(colours, size, count + 1, values) != size)
+			return false;
+		decodeBaseValues(values + 1, count, zigzagDecode(values[0]), kPackedValueStep, outColourIndices);
+	}
+
+	return true;
+}
+
+size_t PackedCatalog::cullNodes(const ViewCuller& inCuller, const TUniversalVector3& inViewer, double inMagnitudeLimit,
+								std::vector<uint32_t>& outNodes) const
+{
+	outNodes.clear();
+	if (mNodes == NULL)
+		return 0;
+
+	const double kSqrt3 = 1.7320508075688772;
+
+	mStack.clear();
+	mStack.push_back(0);
+	while (!mStack.empty())
+	{
+		uint32_t node = mStack.back();
+		mStack.pop_back();
+
+		const PackedCatalogNode& entry = mNodes[node];
+		if (entry.subtreePointCount == 0)
+			continue;
+
+		// Points lie in their cell, so the cell's bounding sphere holds the whole subtree
+		TVector3d center = getNodeCenter(node).toVector3d(inViewer);
+		double radius = getNodeHalfWidth(node) * kSqrt3;
+		if (inCuller.getViewDistance(center) > radius)
+			continue;
+
+		double distance = center.Length();
+		if ((distance > radius) && (getApparentMagnitude(entry.brightestMagnitude, distance - radius) > inMagnitudeLimit))
+			continue;
+
+		if (entry.pointCount > 0)
+			outNodes.push_back(node);
+
+		if (entry.firstChild != kNoPackedNode)
+		{
+			for (uint32_t child = 0; child < 8; child++)
+				mStack.push_back(entry.firstChild + child);
+		}
+	}
+
+	return outNodes.size();
+}
+
+// -----------------------------------------------------------------------
+//	getSection [protected]
+//
+//	A section holding inCount elements of inElementSize bytes, or NULL
+//	if it is smaller than that.
+// -----------------------------------------------------------------------
+const void* PackedCatalog::getSection(PackedCatalogSectionId inSection, uint64_t inElementSize, uint64_t inCount) const
+{
+	const PackedCatalogSection& entry = ((const PackedCatalogHeader*)mFile.getData())->sections[inSection];
+	if ((inCount == 0) || (entry.size / inElementSize < inCount))
+		return NULL;
+
+	return mFile.getData() + entry.offset;
+}
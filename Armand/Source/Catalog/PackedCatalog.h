@@ -0,0 +1,237 @@
+//----------------------------------------------------------------------
+//	File:		PackedCatalog.h
+//
+//	Contains:	The preprocessed binary catalogue format, and its reader:
+//				memory mapped and used in place, without parsing.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "MappedFile.h"
+#include "UniversalVector.h"
+#include "UniversalPointBatch.h"
+
+class ViewCuller;
+
+const char kPackedCatalogMagic[8] = { 'A', 'R', 'M', 'C', 'A', 'T', 0, 0 };
+const uint32_t kPackedCatalogVersion = 3;
+
+// Every section starts on a page, so each can be mapped or handed to GL on its own
+const uint64_t kPackedCatalogAlignment = 4096;
+
+// Magnitudes and colour indices are stored in steps of this
+const float kPackedValueStep = 0.01f;
+
+const uint32_t kNoPackedNode = 0xffffffff;
+const uint32_t kNoPackedLabel = 0xffffffff;
+
+enum PackedCatalogSectionId
+{
+	ePackedNodes,				// PackedCatalogNode per node
+	ePackedNodeCenters,			// Cell centres: x, y, z low words then x, y, z high words, nodeCount each
+	ePackedNodeOrigins,			// What the offsets of a node's points are from, split the same way
+	ePackedPointData,			// PackedPointBlock per node with points, at its dataOffset
+	ePackedLabelOffsets,		// uint32_t per point into ePackedLabels, kNoPackedLabel for none
+	ePackedLabels,				// 0 terminated strings
+	ePackedSourceRows,			// uint32_t per point: its row in the source catalogue
+	ePackedSectionCount
+};
+
+//----------------------------------------------------------------------
+//	Struct:		PackedCatalogSection
+//
+//	Purpose:	Where a section lies in the file, in bytes.
+//
+//----------------------------------------------------------------------
+struct PackedCatalogSection
+{
+	uint64_t		offset;
+	uint64_t		size;
+};
+
+//----------------------------------------------------------------------
+//	Struct:		PackedCatalogHeader
+//
+//	Purpose:	The start of the file. Everything is little endian.
+//
+//----------------------------------------------------------------------
+struct PackedCatalogHeader
+{
+	char					magic[8];
+	uint32_t				version;
+	uint32_t				headerSize;			// sizeof(PackedCatalogHeader)
+	uint64_t				nodeCount;
+	uint64_t				pointCount;
+	PackedCatalogSection	sections[ePackedSectionCount];
+};
+
+//----------------------------------------------------------------------
+//	Struct:		PackedCatalogNode
+//
+//	Purpose:	A node of the catalogue's octree, as UniversalOctree built
+//				it. Children are 8 contiguous nodes in octant order. The
+//				points of a node's whole subtree are contiguous, its own
+//				first.
+//
+//				The node's own points are stored as offsets from its
+//				origin, the centre of their bounding box, so they are as
+//				precise as the points are close together rather than as
+//				the cell is small: a lone point in a large cell is exact.
+//				Offsets take 16 bits unless that would put them further
+//				from the points than the writer's tolerance, then 21.
+//
+//				An interior node also holds samples: copies of the
+//				brightest points of its descendants, which can be drawn
+//				instead of its children when they aren't at hand. They
+//				are decoded after the node's own points, and have no
+//				entries in the per-point arrays.
+//
+//----------------------------------------------------------------------
+struct PackedCatalogNode
+{
+	uint32_t		firstChild;				// kNoPackedNode for a leaf
+	uint32_t		parent;					// kNoPackedNode for the root
+	uint32_t		firstPoint;
+	uint32_t		pointCount;				// The node's own points
+	uint32_t		subtreePointCount;		// Its own and all its descendants'
+	int32_t			level;					// The cell is 2^(kUniversalOctreeRootBits + 1 - level) mm wide
+	float			brightestMagnitude;		// Absolute, over the subtree; -FLT_MAX if any is unknown
+	float			offsetScale;			// mm per step of the offsets
+	uint64_t		dataOffset;				// Of its PackedPointBlock, into ePackedPointData
+	uint32_t		dataSize;				// Bytes, 0 without points
+	uint32_t		sampleCount;
+	uint32_t		positionBits;			// Of each offset: 16 or 21
+	uint32_t		reserved;
+};
+
+//----------------------------------------------------------------------
+//	Struct:		PackedPointBlock
+//
+//	Purpose:	A node's own points then its samples, compressed. The
+//				struct is followed by the offsets from the node's origin,
+//				in steps of its offsetScale: int16_t x, y, z per point for
+//				16 bits, or a uint64_t from packPointOffset21() per point
+//				for 21. Then two Stream VByte streams, the second running
+//				to the end of the block.
+//
+//				The own points and the samples are each in order of
+//				absolute magnitude, brightest first, those without one
+//				last. The first stream has a value for each of the first
+//				magnitudeCount own points, whose magnitudes are known, in
+//				steps of kPackedValueStep: the first zigzag coded, then
+//				the difference of each from the one before. The first
+//				sampleMagnitudeCount samples follow in the same way. The
+//				second stream has the least colour index, zigzag coded,
+//				then each point's less that plus 1, or 0 if it's unknown.
+//				Both are within half a step of the source.
+//
+//----------------------------------------------------------------------
+struct PackedPointBlock
+{
+	uint32_t		magnitudeCount;
+	uint32_t		sampleMagnitudeCount;
+	uint32_t		magnitudeBytes;			// Of the first stream
+	uint32_t		reserved;
+};
+
+//----------------------------------------------------------------------
+//	Class:		PackedCatalog
+//
+//	Purpose:	A catalogue written by writePackedCatalog(), mapped read
+//				only. open() checks the header and section table and
+//				nothing else, so it takes the same time whatever the size
+//				of the catalogue; pages are read from disk as they are
+//				first touched, which is only for the nodes and points that
+//				are drawn.
+//
+//				Points are in octree order, so the points of any subtree
+//				are one contiguous range of every per-point array. A
+//				node's points are compressed in one block, which is all
+//				that has to be read to draw it: decodeNode() turns it into
+//				the float offsets from the node's origin that are drawn,
+//				as with UniversalOctreeOffsets. The offsets are within
+//				half a step of the exact positions. A node's points are
+//				brightest first, so those brighter than a magnitude limit
+//				are a prefix of them.
+//
+//----------------------------------------------------------------------
+class PackedCatalog
+{
+	public:
+		PackedCatalog();
+
+		// Returns false if the file can't be mapped or isn't a valid packed catalogue
+		bool			open(const char* inPath);
+		void			close();
+		bool			isOpen() const { return mHeader != NULL; };
+
+		size_t			getNodeCount() const { return mNodeCount; };
+		size_t			getPointCount() const { return mPointCount; };
+
+		const PackedCatalogNode*	getNodes() const { return mNodes; };
+		const PackedCatalogNode&	getNode(uint32_t inNode) const { return mNodes[inNode]; };
+
+		// The centres of the nodes' cells, exactly
+		void			getNodeCenters(UniversalPointArrays& outCenters) const;
+		TUniversalVector3	getNodeCenter(uint32_t inNode) const;
+		// Half the width of the node's cell, mm
+		double			getNodeHalfWidth(uint32_t inNode) const;
+
+		// What the offsets of the nodes' points are from, exactly
+		void			getNodeOrigins(UniversalPointArrays& outOrigins) const;
+		TUniversalVector3	getNodeOrigin(uint32_t inNode) const;
+
+		// Per point
+		const uint32_t*	getSourceRows() const { return mSourceRows; };
+		// NULL if the point has no label
+		const char*		getLabel(uint32_t inPoint) const;
+
+		// Where ePackedPointData starts in the file, for reading blocks without the mapping
+		uint64_t		getPointDataOffset() const;
+		// The compressed points of a node, NULL if it has none
+		const PackedPointBlock*	getNodeData(uint32_t inNode) const;
+		// Decodes the node's points then its samples into 3 * (pointCount + sampleCount)
+		// offsets from its origin, in mm times inScale, and as many absolute magnitudes and
+		// colour indices, NaN where unknown. Any of the outputs may be NULL. Returns false
+		// if the block is damaged. Safe to call from several threads at once.
+		bool			decodeNode(uint32_t inNode, double inScale, float* outXYZ, float* outMagnitudes,
+								   float* outColourIndices) const;
+		// As decodeNode(), from the node's dataSize bytes at inBlock
+		static bool		decodeBlock(const PackedCatalogNode& inNode, const void* inBlock, double inScale, float* outXYZ,
+									float* outMagnitudes, float* outColourIndices);
+
+		// Replaces outNodes with the nodes holding points that inCuller's view from inViewer
+		// takes in, leaving out subtrees whose brightest point would be fainter than
+		// inMagnitudeLimit (apparent). Only the nodes and their centres are read.
+		size_t			cullNodes(const ViewCuller& inCuller, const TUniversalVector3& inViewer, double inMagnitudeLimit,
+								  std::vector<uint32_t>& outNodes) const;
+
+	protected:
+		const void*		getSection(PackedCatalogSectionId inSection, uint64_t inElementSize, uint64_t inCount) const;
+
+		MappedFile					mFile;
+		const PackedCatalogHeader*	mHeader;
+		size_t						mNodeCount;
+		size_t						mPointCount;
+
+		const PackedCatalogNode*	mNodes;
+		const uint64_t*				mCenterLo[3];
+		const int64_t*				mCenterHi[3];
+		const uint64_t*				mOriginLo[3];
+		const int64_t*				mOriginHi[3];
+		const uint8_t*				mPointData;
+		uint64_t					mPointDataSize;
+		const uint32_t*				mLabelOffsets;
+		const char*					mLabels;
+		size_t						mLabelsSize;
+		const uint32_t*				mSourceRows;
+
+		// Scratch, reused between calls
+		mutable std::vector<uint32_t>	mStack;
+};
@@ -0,0 +1,539 @@
+#include "stdafx.h"
+#include "PackedCatalogWriter.h"
+#include "UniversalOctree.h"
+#include "UniversalSpaceKey.h"
+#include "PointCodec.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <limits>
+#include <algorithm>
+
+// Writes inSize bytes, then zeros up to the next section boundary, and records where they went
+static bool writeSection(FILE* inFile, uint64_t& ioPosition, const void* inData, uint64_t inSize,
+						 PackedCatalogSection& outSection)
+{
+	static const char kZeros[kPackedCatalogAlignment] = { 0 };
+
+	outSection.offset = ioPosition;
+	outSection.size = inSize;
+	if ((inSize > 0) && (fwrite(inData, 1, (size_t)inSize, inFile) != inSize))
+		return false;
+
+	uint64_t padding = (kPackedCatalogAlignment - inSize % kPackedCatalogAlignment) % kPackedCatalogAlignment;
+	if ((padding > 0) && (fwrite(kZeros, 1, (size_t)padding, inFile) != padding))
+		return false;
+	ioPosition += inSize + padding;
+
+	return true;
+}
+
+static inline UniversalCoord getCoord(const UniversalPointArrays& inPoints, int inAxis, uint32_t inIndex)
+{
+	UniversalCoord result;
+	result.table[0] = (ttmath::uint)inPoints.lo[inAxis][inIndex];
+	result.table[1] = (ttmath::uint)inPoints.hi[inAxis][inIndex];
+
+	return result;
+}
+
+// The largest error of offsets up to inMaxOffset (mm) in inSteps steps as decoded: half a
+// step, and the rounding of the float product
+static inline double getOffsetError(double inMaxOffset, int32_t inSteps)
+{
+	return inMaxOffset * (0.501 / inSteps + 6e-8);
+}
+
+// Half the widest extent of a node's own points along any axis, mm
+static double getNodeSpan(const UniversalOctree& inOctree, const UniversalPointArrays& inPoints, uint32_t inNode)
+{
+	double span = 0.0;
+	ObjectIndex first = inOctree.getNodeFirstObject(inNode);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		UniversalCoord low = getCoord(inPoints, axis, first);
+		UniversalCoord high = low;
+		for (ObjectIndex object = inOctree.getNextObject(first); object != kNoObject; object = inOctree.getNextObject(object))
+		{
+			UniversalCoord value = getCoord(inPoints, axis, object);
+			if (value < low)
+				low = value;
+			if (value > high)
+				high = value;
+		}
+		high.Sub(low);
+		span = std::max(span, universalCoordToDouble(high) * 0.5);
+	}
+
+	return span;
+}
+
+static inline int32_t quantiseOffset(double inOffset, double inScale, int32_t inSteps)
+{
+	double steps = floor(inOffset / inScale + 0.5);
+	if (steps > inSteps)
+		steps = inSteps;
+	else if (steps < -inSteps)
+		steps = -inSteps;
+
+	return (int32_t)steps;
+}
+
+// In steps of kPackedValueStep, limited so that differences fit in 32 bits
+static inline int32_t quantiseValue(float inValue)
+{
+	const double kLimit = 1 << 30;
+
+	double steps = floor(inValue / (double)kPackedValueStep + 0.5);
+	if (steps > kLimit)
+		steps = kLimit;
+	else if (steps < -kLimit)
+		steps = -kLimit;
+
+	return (int32_t)steps;
+}
+
+// Source rows in order of absolute magnitude, those without one last
+class MagnitudeOrder
+{
+	public:
+		MagnitudeOrder(const float* inMagnitudes) : mMagnitudes(inMagnitudes) {};
+
+		bool operator()(uint32_t inA, uint32_t inB) const
+		{
+			if (mMagnitudes == NULL)
+				return false;
+
+			float a = mMagnitudes[inA];
+			float b = mMagnitudes[inB];
+			if (b != b)
+				return (a == a);
+
+			return (a < b);
+		};
+
+	protected:
+		const float*	mMagnitudes;
+};
+
+// The values of a run of points in order of magnitude for the first stream of a
+// PackedPointBlock, returning how many have a magnitude; outMagnitudes, which may be
+// NULL, gets the magnitudes as they will be decoded
+static uint32_t getMagnitudeValues(const float* inMagnitudes, const uint32_t* inRows, size_t inCount,
+								   std::vector<uint32_t>& ioValues, float* outMagnitudes)
+{
+	uint32_t known = 0;
+	int32_t previous = 0;
+	for (size_t i = 0; (i < inCount) && (inMagnitudes != NULL); i++)
+	{
+		float magnitude = inMagnitudes[inRows[i]];
+		if (magnitude != magnitude)
+			break;
+		int32_t value = quantiseValue(magnitude);
+		ioValues.push_back((known == 0) ? zigzagEncode(value) : (uint32_t)(value - previous));
+		if (outMagnitudes != NULL)
+			outMagnitudes[i] = value * kPackedValueStep;
+		previous = value;
+		known++;
+	}
+
+	return known;
+}
+
+// Appends a Stream VByte encoding of inValues to ioBytes, returning its size
+static uint32_t appendStreamVByte(const std::vector<uint32_t>& inValues, size_t inCount, std::vector<uint8_t>& ioBytes)
+{
+	size_t start = ioBytes.size();
+	ioBytes.resize(start + getStreamVByteMaxSize(inCount));
+	size_t size = encodeStreamVByte(inCount > 0 ? &inValues[0] : NULL, inCount, &ioBytes[start]);
+	ioBytes.resize(start + size);
+
+	return (uint32_t)size;
+}
+
+bool writePackedCatalog(const char* inPath, const PackedCatalogSource& inSource, uint32_t inMaxPointsPerNode,
+						double inTolerance, PackedCatalogWriteStats* outStats)
+{
+	UniversalOctree octree(inMaxPointsPerNode);
+	octree.build(inSource.positions, NULL);
+
+	// Leaves whose points are too far apart for 21-bit offsets to keep within inTolerance
+	// are split, and their children in turn, as far as the tree goes
+	for (uint32_t node = 0; node < octree.getNodeCount(); node++)
+	{
+		if ((octree.getNodeFirstChild(node) == kNoOctreeNode) && (octree.getNodeObjectCount(node) > 1) &&
+			(getOffsetError(getNodeSpan(octree, inSource.positions, node), kPointOffset21Steps) > inTolerance))
+			octree.splitLeaf(node);
+	}
+
+	// Nodes are renumbered breadth first, which keeps children contiguous
+	std::vector<uint32_t> packedNode(octree.getNodeCount(), kNoPackedNode);
+	std::vector<uint32_t> octreeNode;
+	octreeNode.reserve(octree.getNodeCount());
+	if (octree.getNodeCount() > 0)
+	{
+		packedNode[0] = 0;
+		octreeNode.push_back(0);
+	}
+	for (size_t i = 0; i < octreeNode.size(); i++)
+	{
+		uint32_t firstChild = octree.getNodeFirstChild(octreeNode[i]);
+		if (firstChild == kNoOctreeNode)
+			continue;
+		for (uint32_t child = 0; child < 8; child++)
+		{
+			packedNode[firstChild + child] = (uint32_t)octreeNode.size();
+			octreeNode.push_back(firstChild + child);
+		}
+	}
+
+	// Without any points there is still an empty root, centred on the origin
+	size_t nodeCount = octreeNode.empty() ? 1 : octreeNode.size();
+	std::vector<PackedCatalogNode> nodes(nodeCount);
+	memset(&nodes[0], 0, nodeCount * sizeof(PackedCatalogNode));
+	nodes[0].firstChild = kNoPackedNode;
+	nodes[0].parent = kNoPackedNode;
+	nodes[0].brightestMagnitude = FLT_MAX;
+	nodes[0].offsetScale = 0.0f;
+	for (size_t i = 0; i < octreeNode.size(); i++)
+	{
+		uint32_t node = octreeNode[i];
+		PackedCatalogNode& entry = nodes[i];
+		uint32_t firstChild = octree.getNodeFirstChild(node);
+		uint32_t parent = octree.getNodeParent(node);
+		entry.firstChild = (firstChild == kNoOctreeNode) ? kNoPackedNode : packedNode[firstChild];
+		entry.parent = (parent == kNoOctreeNode) ? kNoPackedNode : packedNode[parent];
+		entry.pointCount = octree.getNodeObjectCount(node);
+		entry.subtreePointCount = octree.getNodeSubtreeObjectCount(node);
+		entry.level = octree.getNodeLevel(node);
+		entry.brightestMagnitude = FLT_MAX;
+		entry.offsetScale = 0.0f;
+	}
+
+	// Points go depth first, a node's own before its children's, so every subtree's
+	// points are contiguous
+	std::vector<uint32_t> stack(1, 0);
+	uint32_t nextPoint = 0;
+	while (!stack.empty())
+	{
+		PackedCatalogNode& entry = nodes[stack.back()];
+		stack.pop_back();
+		entry.firstPoint = nextPoint;
+		nextPoint += entry.pointCount;
+		if (entry.firstChild != kNoPackedNode)
+		{
+			for (uint32_t child = 8; child-- > 0; )
+				stack.push_back(entry.firstChild + child);
+		}
+	}
+	size_t pointCount = nextPoint;
+
+	// Within a node, points are in order of magnitude, and of Morton code where that's
+	// the same
+	std::vector<uint32_t> order;
+	getUniversalSpaceKeyOrder(inSource.positions, eSpaceCurveMorton, order);
+	std::vector<uint32_t> nextInNode(nodeCount);
+	for (size_t i = 0; i < nodeCount; i++)
+		nextInNode[i] = nodes[i].firstPoint;
+
+	const float kUnknown = std::numeric_limits<float>::quiet_NaN();
+	std::vector<float> magnitudes(pointCount, kUnknown);
+	std::vector<uint32_t> labelOffsets(pointCount, kNoPackedLabel);
+	std::vector<char> labels;
+	std::vector<uint32_t> sourceRows(pointCount);
+	std::vector<uint32_t> pointNode(pointCount);
+	double maxOffsetError = 0.0;
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		ObjectIndex object = order[i];
+		uint32_t octreeIndex = octree.getObjectNode(object);
+		if (octreeIndex == kNoOctreeNode)
+			continue;
+
+		uint32_t node = packedNode[octreeIndex];
+		uint32_t point = nextInNode[node]++;
+		pointNode[point] = node;
+		sourceRows[point] = object;
+	}
+	MagnitudeOrder magnitudeOrder(inSource.absoluteMagnitudes);
+	for (size_t node = 0; node < nodeCount; node++)
+	{
+		std::vector<uint32_t>::iterator first = sourceRows.begin() + nodes[node].firstPoint;
+		std::stable_sort(first, first + nodes[node].pointCount, magnitudeOrder);
+	}
+
+	// Interior nodes also get copies of the brightest points below them, so they can be
+	// drawn in place of children that aren't there yet. A quarter of a node's worth adds
+	// about an eighth to a full tree. Children come after their parents.
+	size_t samplesPerNode = (inMaxPointsPerNode + 3) / 4;
+	std::vector<std::vector<uint32_t> > brightest(nodeCount);
+	std::vector<std::vector<uint32_t> > samples(nodeCount);
+	for (size_t node = nodeCount; node-- > 0; )
+	{
+		PackedCatalogNode& entry = nodes[node];
+		std::vector<uint32_t>& below = samples[node];
+		if (entry.firstChild != kNoPackedNode)
+		{
+			for (uint32_t child = entry.firstChild; child < entry.firstChild + 8; child++)
+			{
+				below.insert(below.end(), brightest[child].begin(), brightest[child].end());
+				std::vector<uint32_t>().swap(brightest[child]);
+			}
+			std::stable_sort(below.begin(), below.end(), magnitudeOrder);
+			if (below.size() > samplesPerNode)
+				below.resize(samplesPerNode);
+			entry.sampleCount = (uint32_t)below.size();
+		}
+
+		std::vector<uint32_t>& subtree = brightest[node];
+		subtree.assign(sourceRows.begin() + entry.firstPoint, sourceRows.begin() + entry.firstPoint + entry.pointCount);
+		subtree.insert(subtree.end(), below.begin(), below.end());
+		std::stable_sort(subtree.begin(), subtree.end(), magnitudeOrder);
+		if (subtree.size() > samplesPerNode)
+			subtree.resize(samplesPerNode);
+	}
+	std::vector<uint32_t>().swap(brightest[0]);
+
+	// Each node's points as offsets from the middle of their bounding box, exactly, then
+	// rounded to steps just large enough to reach the farthest. The steps are 16 bits
+	// where that keeps within inTolerance, else 21.
+	std::vector<uint64_t> origins(nodeCount * 6, 0);
+	std::vector<double> pointOffsets;
+	std::vector<uint8_t> pointData;
+	std::vector<int16_t> offsets16;
+	std::vector<uint64_t> offsets21;
+	std::vector<uint32_t> values;
+	std::vector<uint32_t> rows;
+	size_t wideNodeCount = 0;
+	size_t overToleranceNodeCount = 0;
+	size_t overTolerancePointCount = 0;
+	size_t sampleCount = 0;
+	for (size_t node = 0; node < nodeCount; node++)
+	{
+		uint32_t first = nodes[node].firstPoint;
+		uint32_t ownCount = nodes[node].pointCount;
+		rows.assign(sourceRows.begin() + first, sourceRows.begin() + first + ownCount);
+		rows.insert(rows.end(), samples[node].begin(), samples[node].end());
+		std::vector<uint32_t>().swap(samples[node]);
+		uint32_t count = (uint32_t)rows.size();
+		if (count == 0)
+			continue;
+		sampleCount += count - ownCount;
+
+		pointOffsets.resize(count * 3);
+		double maxOffset = 0.0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			UniversalCoord low = getCoord(inSource.positions, axis, rows[0]);
+			UniversalCoord high = low;
+			for (uint32_t point = 1; point < count; point++)
+			{
+				UniversalCoord value = getCoord(inSource.positions, axis, rows[point]);
+				if (value < low)
+					low = value;
+				if (value > high)
+					high = value;
+			}
+
+			UniversalCoord origin = low;
+			origin.Add(high);
+			origin.DivInt(2);
+			origins[axis * nodeCount + node] = (uint64_t)origin.table[0];
+			origins[(3 + axis) * nodeCount + node] = (uint64_t)origin.table[1];
+
+			for (uint32_t point = 0; point < count; point++)
+			{
+				UniversalCoord offset = getCoord(inSource.positions, axis, rows[point]);
+				offset.Sub(origin);
+				double value = universalCoordToDouble(offset);
+				pointOffsets[point * 3 + axis] = value;
+				if (fabs(value) > maxOffset)
+					maxOffset = fabs(value);
+			}
+		}
+
+		// The float scale must not come out smaller, or the farthest offset won't fit. Leaves
+		// that even 21 bits are too coarse for were split above, so what's left is counted:
+		// points on the deepest level, and interior nodes' own.
+		int32_t steps = (getOffsetError(maxOffset, kPointOffset16Steps) <= inTolerance) ? kPointOffset16Steps : kPointOffset21Steps;
+		float scale = (float)(maxOffset / steps);
+		if (scale < maxOffset / steps)
+			scale *= 1.0000002f;
+		nodes[node].offsetScale = scale;
+		nodes[node].positionBits = (steps == kPointOffset16Steps) ? 16 : 21;
+
+		// Errors are of the offsets as decoded, float product and all, and only the node's
+		// own points are held to inTolerance; samples are copies of points kept below
+		int32_t quantised[3] = { 0, 0, 0 };
+		uint32_t overTolerance = 0;
+		double pointError = 0.0;
+		offsets16.clear();
+		offsets21.clear();
+		for (uint32_t i = 0; i < count * 3; i++)
+		{
+			if (scale > 0.0f)
+				quantised[i % 3] = quantiseOffset(pointOffsets[i], scale, steps);
+			if (i < ownCount * 3)
+			{
+				double error = fabs((double)((float)quantised[i % 3] * scale) - pointOffsets[i]);
+				if (error > pointError)
+					pointError = error;
+				if (i % 3 == 2)
+				{
+					if (pointError > maxOffsetError)
+						maxOffsetError = pointError;
+					if (pointError > inTolerance)
+						overTolerance++;
+					pointError = 0.0;
+				}
+			}
+
+			if (steps == kPointOffset16Steps)
+				offsets16.push_back((int16_t)quantised[i % 3]);
+			else if (i % 3 == 2)
+				offsets21.push_back(packPointOffset21(quantised[0], quantised[1], quantised[2]));
+		}
+
+		// Magnitudes as differences from the next brighter, colour indices from the least
+		PackedPointBlock block;
+		memset(&block, 0, sizeof(block));
+		values.clear();
+		block.magnitudeCount = getMagnitudeValues(inSource.absoluteMagnitudes, &rows[0], ownCount, values,
+												  (ownCount > 0) ? &magnitudes[first] : NULL);
+		block.sampleMagnitudeCount = getMagnitudeValues(inSource.absoluteMagnitudes, &rows[0] + ownCount, count - ownCount,
+														values, NULL);
+
+		size_t blockStart = pointData.size();
+		pointData.resize(blockStart + sizeof(PackedPointBlock));
+		if (steps == kPointOffset16Steps)
+			pointData.insert(pointData.end(), (const uint8_t*)&offsets16[0], (const uint8_t*)(&offsets16[0] + offsets16.size()));
+		else
+			pointData.insert(pointData.end(), (const uint8_t*)&offsets21[0], (const uint8_t*)(&offsets21[0] + offsets21.size()));
+		block.magnitudeBytes = appendStreamVByte(values, values.size(), pointData);
+
+		bool hasColour = false;
+		int32_t colourBase = 0;
+		for (uint32_t point = 0; point < count; point++)
+		{
+			float colour = (inSource.colourIndices != NULL) ? inSource.colourIndices[rows[point]] : kUnknown;
+			if (colour != colour)
+				continue;
+			int32_t value = quantiseValue(colour);
+			if (!hasColour || (value < colourBase))
+				colourBase = value;
+			hasColour = true;
+		}
+		values.assign(1, zigzagEncode(colourBase));
+		for (uint32_t point = 0; point < count; point++)
+		{
+			float colour = (inSource.colourIndices != NULL) ? inSource.colourIndices[rows[point]] : kUnknown;
+			values.push_back((colour == colour) ? (uint32_t)(quantiseValue(colour) - colourBase) + 1 : 0);
+		}
+		appendStreamVByte(values, values.size(), pointData);
+
+		// Blocks start on 8 bytes, for the 21-bit offsets
+		memcpy(&pointData[blockStart], &block, sizeof(block));
+		nodes[node].dataOffset = blockStart;
+		nodes[node].dataSize = (uint32_t)(pointData.size() - blockStart);
+		pointData.resize((pointData.size() + 7) & ~(size_t)7, 0);
+		if (steps != kPointOffset16Steps)
+			wideNodeCount++;
+		if (overTolerance > 0)
+		{
+			overToleranceNodeCount++;
+			overTolerancePointCount += overTolerance;
+		}
+	}
+
+	// Labels in point order, so those of a subtree are together too
+	if ((inSource.labelOffsets != NULL) && (inSource.labels != NULL))
+	{
+		for (size_t point = 0; point < pointCount; point++)
+		{
+			uint32_t offset = inSource.labelOffsets[sourceRows[point]];
+			if (offset == kNoPackedLabel)
+				continue;
+			const char* label = inSource.labels + offset;
+			labelOffsets[point] = (uint32_t)labels.size();
+			labels.insert(labels.end(), label, label + strlen(label) + 1);
+		}
+	}
+
+	// Brightest of each subtree, as decoded; children come after their parents
+	for (size_t point = 0; point < pointCount; point++)
+	{
+		float magnitude = (magnitudes[point] == magnitudes[point]) ? magnitudes[point] : -FLT_MAX;
+		PackedCatalogNode& entry = nodes[pointNode[point]];
+		if (magnitude < entry.brightestMagnitude)
+			entry.brightestMagnitude = magnitude;
+	}
+	for (size_t i = nodeCount; i-- > 1; )
+	{
+		PackedCatalogNode& parent = nodes[nodes[i].parent];
+		if (nodes[i].brightestMagnitude < parent.brightestMagnitude)
+			parent.brightestMagnitude = nodes[i].brightestMagnitude;
+	}
+
+	// Node centres, split into words
+	std::vector<uint64_t> centers(nodeCount * 6, 0);
+	for (size_t i = 0; i < octreeNode.size(); i++)
+	{
+		TUniversalVector3 center = octree.getNodeCenter(octreeNode[i]);
+		const UniversalCoord* axes[3] = { &center.x, &center.y, &center.z };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			centers[axis * nodeCount + i] = (uint64_t)axes[axis]->table[0];
+			centers[(3 + axis) * nodeCount + i] = (uint64_t)axes[axis]->table[1];
+		}
+	}
+
+	FILE* file = fopen(inPath, "wb");
+	if (file == NULL)
+		return false;
+
+	PackedCatalogHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kPackedCatalogMagic, sizeof(header.magic));
+	header.version = kPackedCatalogVersion;
+	header.headerSize = sizeof(PackedCatalogHeader);
+	header.nodeCount = nodeCount;
+	header.pointCount = pointCount;
+
+	PackedCatalogSection headerSection;
+	uint64_t position = 0;
+	bool written = writeSection(file, position, &header, sizeof(header), headerSection) &&
+				   writeSection(file, position, &nodes[0], nodeCount * sizeof(PackedCatalogNode), header.sections[ePackedNodes]) &&
+				   writeSection(file, position, &centers[0], centers.size() * sizeof(uint64_t), header.sections[ePackedNodeCenters]) &&
+				   writeSection(file, position, &origins[0], origins.size() * sizeof(uint64_t), header.sections[ePackedNodeOrigins]) &&
+				   writeSection(file, position, pointData.empty() ? NULL : &pointData[0], pointData.size(), header.sections[ePackedPointData]) &&
+				   writeSection(file, position, labelOffsets.empty() ? NULL : &labelOffsets[0], pointCount * sizeof(uint32_t), header.sections[ePackedLabelOffsets]) &&
+				   writeSection(file, position, labels.empty() ? NULL : &labels[0], labels.size(), header.sections[ePackedLabels]) &&
+				   writeSection(file, position, sourceRows.empty() ? NULL : &sourceRows[0], pointCount * sizeof(uint32_t), header.sections[ePackedSourceRows]);
+
+	// The section table is only known now
+	written = written && (fseek(file, 0, SEEK_SET) == 0) && (fwrite(&header, sizeof(header), 1, file) == 1);
+	written = (fclose(file) == 0) && written;
+	if (!written)
+	{
+		remove(inPath);
+		return false;
+	}
+
+	if (outStats != NULL)
+	{
+		outStats->nodeCount = nodeCount;
+		outStats->pointCount = pointCount;
+		outStats->sampleCount = sampleCount;
+		outStats->droppedCount = inSource.positions.count - pointCount;
+		outStats->fileSize = position;
+		outStats->pointDataSize = pointData.size();
+		outStats->wideNodeCount = wideNodeCount;
+		outStats->maxOffsetError = maxOffsetError;
+		outStats->overToleranceNodeCount = overToleranceNodeCount;
+		outStats->overTolerancePointCount = overTolerancePointCount;
+	}
+
+	return true;
+}
@@ -0,0 +1,60 @@
+//----------------------------------------------------------------------
+//	File:		PackedCatalogWriter.h
+//
+//	Contains:	Conversion of a catalogue into the packed binary format
+//				PackedCatalog reads, done offline.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include "PackedCatalog.h"
+
+//----------------------------------------------------------------------
+//	Struct:		PackedCatalogSource
+//
+//	Purpose:	The catalogue to pack, indexed by source row. Any of the
+//				pointers but the positions may be NULL.
+//
+//----------------------------------------------------------------------
+struct PackedCatalogSource
+{
+	UniversalPointArrays	positions;
+	const float*			absoluteMagnitudes;
+	const float*			colourIndices;
+	const uint32_t*			labelOffsets;		// Into labels, kNoPackedLabel for none
+	const char*				labels;				// 0 terminated strings
+};
+
+//----------------------------------------------------------------------
+//	Struct:		PackedCatalogWriteStats
+//
+//	Purpose:	What writePackedCatalog() wrote.
+//
+//----------------------------------------------------------------------
+struct PackedCatalogWriteStats
+{
+	size_t			nodeCount;
+	size_t			pointCount;
+	size_t			sampleCount;			// Copies in interior nodes
+	size_t			droppedCount;			// Outside the octree's root cell
+	uint64_t		fileSize;
+	uint64_t		pointDataSize;			// Bytes of compressed points
+	size_t			wideNodeCount;			// With 21-bit offsets
+	double			maxOffsetError;			// mm, of the decoded offsets of nodes' own points
+	size_t			overToleranceNodeCount;	// With points beyond the tolerance even at 21 bits
+	size_t			overTolerancePointCount;
+};
+
+// Builds a UniversalOctree over inSource's positions, at most inMaxPointsPerNode to a
+// node where it can split, and writes the nodes and points to inPath, points in octree
+// order. Interior nodes also get copies of the brightest points of their subtrees, a
+// quarter of inMaxPointsPerNode. A node's offsets take 16 bits if that keeps them within
+// inTolerance (mm) of the points, and 21 otherwise. Leaves too wide for even 21 are split
+// further; nodes still too wide, which only the deepest level can have, are written anyway
+// and counted in outStats, which the caller should check. outStats may be NULL. Returns
+// false if the file can't be written.
+bool	writePackedCatalog(const char* inPath, const PackedCatalogSource& inSource, uint32_t inMaxPointsPerNode,
+						   double inTolerance, PackedCatalogWriteStats* outStats);
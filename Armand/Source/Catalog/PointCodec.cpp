@@ -0,0 +1,322 @@
+#include "stdafx.h"
+#include "PointCodec.h"
+
+#include <string.h>
+#include <limits>
+
+#if defined(_M_X64) || defined(__x86_64__)
+	#define POINT_CODEC_SSE
+	#include <emmintrin.h>
+	#include <tmmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
+
+#ifdef __GNUC__
+	#define SSSE3_TARGET __attribute__((target("ssse3")))
+#else
+	#define SSSE3_TARGET
+#endif
+
+static const int32_t kOffset21Bias = 1 << 20;
+static const uint64_t kOffset21Mask = (1 << 21) - 1;
+
+// ---------------------------------------------------------------------------
+// StreamVByteTables
+//
+//	For each control byte, the bytes its 4 values take, and the pshufb mask
+//	spreading them into 4 words. Filled before main(), so never raced.
+// ---------------------------------------------------------------------------
+struct StreamVByteTables
+{
+	uint8_t		lengths[256];
+	uint8_t		shuffles[256][16];
+
+	StreamVByteTables()
+	{
+		for (int key = 0; key < 256; key++)
+		{
+			uint8_t next = 0;
+			for (int value = 0; value < 4; value++)
+			{
+				int length = ((key >> (value * 2)) & 3) + 1;
+				for (int byte = 0; byte < 4; byte++)
+					shuffles[key][value * 4 + byte] = (byte < length) ? next++ : 0x80;
+			}
+			lengths[key] = next;
+		}
+	}
+};
+
+static const StreamVByteTables sStreamVByteTables;
+
+void decodePointOffsets16Scalar(const int16_t* inOffsets, size_t inCount, float inScale, float* outXYZ)
+{
+	for (size_t i = 0; i < inCount * 3; i++)
+		outXYZ[i] = inOffsets[i] * inScale;
+}
+
+void decodePointOffsets21Scalar(const uint64_t* inOffsets, size_t inCount, float inScale, float* outXYZ)
+{
+	for (size_t i = 0; i < inCount; i++)
+	{
+		uint64_t packed = inOffsets[i];
+		outXYZ[i * 3] = ((int32_t)(packed & kOffset21Mask) - kOffset21Bias) * inScale;
+		outXYZ[i * 3 + 1] = ((int32_t)((packed >> 21) & kOffset21Mask) - kOffset21Bias) * inScale;
+		outXYZ[i * 3 + 2] = ((int32_t)((packed >> 42) & kOffset21Mask) - kOffset21Bias) * inScale;
+	}
+}
+
+size_t getStreamVByteMaxSize(size_t inCount)
+{
+	return (inCount + 3) / 4 + inCount * 4;
+}
+
+size_t encodeStreamVByte(const uint32_t* inValues, size_t inCount, uint8_t* outBytes)
+{
+	size_t controlSize = (inCount + 3) / 4;
+	uint8_t* data = outBytes + controlSize;
+	memset(outBytes, 0, controlSize);
+	for (size_t i = 0; i < inCount; i++)
+	{
+		uint32_t value = inValues[i];
+		int length = (value < (1u << 8)) ? 1 : (value < (1u << 16)) ? 2 : (value < (1u << 24)) ? 3 : 4;
+		outBytes[i / 4] |= (uint8_t)((length - 1) << ((i % 4) * 2));
+		for (int byte = 0; byte < length; byte++)
+			*data++ = (uint8_t)(value >> (byte * 8));
+	}
+
+	return (size_t)(data - outBytes);
+}
+
+// ---------------------------------------------------------------------------
+// decodeStreamVByteFrom
+//
+//	Decodes values inFirst to inCount, whose control bytes start at
+//	inControl and data at inData. Returns the end of their data, or NULL
+//	if that would pass inEnd.
+// ---------------------------------------------------------------------------
+static const uint8_t* decodeStreamVByteFrom(const uint8_t* inControl, const uint8_t* inData, const uint8_t* inEnd,
+											size_t inFirst, size_t inCount, uint32_t* outValues)
+{
+	for (size_t i = inFirst; i < inCount; i++)
+	{
+		int length = ((inControl[i / 4] >> ((i % 4) * 2)) & 3) + 1;
+		if (inEnd - inData < length)
+			return NULL;
+
+		uint32_t value = 0;
+		for (int byte = 0; byte < length; byte++)
+			value |= (uint32_t)inData[byte] << (byte * 8);
+		outValues[i] = value;
+		inData += length;
+	}
+
+	return inData;
+}
+
+size_t decodeStreamVByteScalar(const uint8_t* inBytes, size_t inSize, size_t inCount, uint32_t* outValues)
+{
+	size_t controlSize = (inCount + 3) / 4;
+	if (inSize < controlSize)
+		return 0;
+
+	const uint8_t* end = decodeStreamVByteFrom(inBytes, inBytes + controlSize, inBytes + inSize, 0, inCount, outValues);
+
+	return (end == NULL) ? 0 : (size_t)(end - inBytes);
+}
+
+#ifdef POINT_CODEC_SSE
+
+bool pointCodecHasSSSE3()
+{
+	static int sHasSSSE3 = -1;
+	if (sHasSSSE3 < 0)
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		sHasSSSE3 = ((info[2] & (1 << 9)) != 0) ? 1 : 0;
+#else
+		sHasSSSE3 = __builtin_cpu_supports("ssse3") ? 1 : 0;
+#endif
+	}
+
+	return (sHasSSSE3 == 1);
+}
+
+// SSE2 is always there on x64, so the offsets need no check
+void decodePointOffsets16(const int16_t* inOffsets, size_t inCount, float inScale, float* outXYZ)
+{
+	__m128 scale = _mm_set1_ps(inScale);
+	size_t count = inCount * 3;
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		// Sign extend by putting each short in the top half of a word and shifting it down
+		__m128i offsets = _mm_loadu_si128((const __m128i*)(inOffsets + i));
+		__m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(offsets, offsets), 16);
+		__m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(offsets, offsets), 16);
+		_mm_storeu_ps(outXYZ + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+		_mm_storeu_ps(outXYZ + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+	}
+	for (; i < count; i++)
+		outXYZ[i] = inOffsets[i] * inScale;
+}
+
+// The low words of the 64-bit lanes of inA then inB
+static inline __m128i packLowWords(__m128i inA, __m128i inB)
+{
+	return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(inA), _mm_castsi128_ps(inB), _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+void decodePointOffsets21(const uint64_t* inOffsets, size_t inCount, float inScale, float* outXYZ)
+{
+	__m128 scale = _mm_set1_ps(inScale);
+	__m128i mask = _mm_set1_epi64x(kOffset21Mask);
+	__m128i bias = _mm_set1_epi32(kOffset21Bias);
+	size_t i = 0;
+
+	// Each point is stored as 4 floats and the next overwrites the 4th, so there must
+	// be a point after the 4
+	for (; i + 4 < inCount; i += 4)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(inOffsets + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(inOffsets + i + 2));
+		__m128i x = packLowWords(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+		__m128i y = packLowWords(_mm_and_si128(_mm_srli_epi64(a, 21), mask), _mm_and_si128(_mm_srli_epi64(b, 21), mask));
+		__m128i z = packLowWords(_mm_and_si128(_mm_srli_epi64(a, 42), mask), _mm_and_si128(_mm_srli_epi64(b, 42), mask));
+
+		__m128 points[4];
+		points[0] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x, bias)), scale);
+		points[1] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(y, bias)), scale);
+		points[2] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(z, bias)), scale);
+		points[3] = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(points[0], points[1], points[2], points[3]);
+		for (int point = 0; point < 4; point++)
+			_mm_storeu_ps(outXYZ + (i + point) * 3, points[point]);
+	}
+	decodePointOffsets21Scalar(inOffsets + i, inCount - i, inScale, outXYZ + i * 3);
+}
+
+SSSE3_TARGET static size_t decodeStreamVByteSSSE3(const uint8_t* inBytes, size_t inSize, size_t inCount, uint32_t* outValues)
+{
+	size_t controlSize = (inCount + 3) / 4;
+	if (inSize < controlSize)
+		return 0;
+
+	const uint8_t* control = inBytes;
+	const uint8_t* data = inBytes + controlSize;
+	const uint8_t* end = inBytes + inSize;
+
+	// A group's 16 byte load may read past its own bytes, but not past the stream
+	size_t i = 0;
+	for (; (i + 4 <= inCount) && (end - data >= 16); i += 4)
+	{
+		uint8_t key = *control++;
+		__m128i bytes = _mm_loadu_si128((const __m128i*)data);
+		__m128i shuffle = _mm_loadu_si128((const __m128i*)sStreamVByteTables.shuffles[key]);
+		_mm_storeu_si128((__m128i*)(outValues + i), _mm_shuffle_epi8(bytes, shuffle));
+		data += sStreamVByteTables.lengths[key];
+	}
+
+	data = decodeStreamVByteFrom(inBytes, data, end, i, inCount, outValues);
+
+	return (data == NULL) ? 0 : (size_t)(data - inBytes);
+}
+
+size_t decodeStreamVByte(const uint8_t* inBytes, size_t inSize, size_t inCount, uint32_t* outValues)
+{
+	if (pointCodecHasSSSE3())
+		return decodeStreamVByteSSSE3(inBytes, inSize, inCount, outValues);
+	else
+		return decodeStreamVByteScalar(inBytes, inSize, inCount, outValues);
+}
+
+void decodeDeltaValues(const uint32_t* inValues, size_t inCount, int32_t inBase, float inStep, float* outValues)
+{
+	__m128 step = _mm_set1_ps(inStep);
+	__m128i running = _mm_set1_epi32(inBase);
+	size_t i = 0;
+	for (; i + 4 <= inCount; i += 4)
+	{
+		// Prefix sum of the 4 in two shifted adds, then the sum so far
+		__m128i values = _mm_loadu_si128((const __m128i*)(inValues + i));
+		values = _mm_add_epi32(values, _mm_slli_si128(values, 4));
+		values = _mm_add_epi32(values, _mm_slli_si128(values, 8));
+		values = _mm_add_epi32(values, running);
+		_mm_storeu_ps(outValues + i, _mm_mul_ps(_mm_cvtepi32_ps(values), step));
+		running = _mm_shuffle_epi32(values, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+
+	int32_t value = _mm_cvtsi128_si32(running);
+	for (; i < inCount; i++)
+	{
+		value += (int32_t)inValues[i];
+		outValues[i] = value * inStep;
+	}
+}
+
+void decodeBaseValues(const uint32_t* inValues, size_t inCount, int32_t inBase, float inStep, float* outValues)
+{
+	__m128 step = _mm_set1_ps(inStep);
+	__m128i base = _mm_set1_epi32(inBase - 1);
+	__m128 unknown = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+	size_t i = 0;
+	for (; i + 4 <= inCount; i += 4)
+	{
+		__m128i values = _mm_loadu_si128((const __m128i*)(inValues + i));
+		__m128 missing = _mm_castsi128_ps(_mm_cmpeq_epi32(values, _mm_setzero_si128()));
+		__m128 result = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(values, base)), step);
+		_mm_storeu_ps(outValues + i, _mm_or_ps(_mm_andnot_ps(missing, result), _mm_and_ps(missing, unknown)));
+	}
+	for (; i < inCount; i++)
+	{
+		outValues[i] = (inValues[i] == 0) ? std::numeric_limits<float>::quiet_NaN() :
+											(inBase + (int32_t)inValues[i] - 1) * inStep;
+	}
+}
+
+#else
+
+bool pointCodecHasSSSE3()
+{
+	return false;
+}
+
+void decodePointOffsets16(const int16_t* inOffsets, size_t inCount, float inScale, float* outXYZ)
+{
+	decodePointOffsets16Scalar(inOffsets, inCount, inScale, outXYZ);
+}
+
+void decodePointOffsets21(const uint64_t* inOffsets, size_t inCount, float inScale, float* outXYZ)
+{
+	decodePointOffsets21Scalar(inOffsets, inCount, inScale, outXYZ);
+}
+
+size_t decodeStreamVByte(const uint8_t* inBytes, size_t inSize, size_t inCount, uint32_t* outValues)
+{
+	return decodeStreamVByteScalar(inBytes, inSize, inCount, outValues);
+}
+
+void decodeDeltaValues(const uint32_t* inValues, size_t inCount, int32_t inBase, float inStep, float* outValues)
+{
+	int32_t value = inBase;
+	for (size_t i = 0; i < inCount; i++)
+	{
+		value += (int32_t)inValues[i];
+		outValues[i] = value * inStep;
+	}
+}
+
+void decodeBaseValues(const uint32_t* inValues, size_t inCount, int32_t inBase, float inStep, float* outValues)
+{
+	for (size_t i = 0; i < inCount; i++)
+	{
+		outValues[i] = (inValues[i] == 0) ? std::numeric_limits<float>::quiet_NaN() :
+											(inBase + (int32_t)inValues[i] - 1) * inStep;
+	}
+}
+
+#endif
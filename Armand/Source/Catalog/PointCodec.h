@@ -0,0 +1,71 @@
+//----------------------------------------------------------------------
+//	File:		PointCodec.h
+//
+//	Contains:	Encoding and SIMD decoding of the compressed point data in
+//				packed catalogues: quantised offsets, and integer streams in
+//				Stream VByte.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Offsets are signed steps, at most this many either way
+const int32_t kPointOffset16Steps = 32767;
+const int32_t kPointOffset21Steps = (1 << 20) - 1;
+
+//----------------------------------------------------------------------
+//	Function:	packPointOffset21
+//
+//	Purpose:	Three 21-bit offsets in one word: x in bits 0-20, y in
+//				21-41, z in 42-62, each biased by 2^20.
+//----------------------------------------------------------------------
+inline uint64_t packPointOffset21(int32_t inX, int32_t inY, int32_t inZ)
+{
+	const int32_t kBias = 1 << 20;
+
+	return (uint64_t)(uint32_t)(inX + kBias) | ((uint64_t)(uint32_t)(inY + kBias) << 21) |
+		   ((uint64_t)(uint32_t)(inZ + kBias) << 42);
+}
+
+// Signed values as small unsigned ones: 0, -1, 1, -2 to 0, 1, 2, 3
+inline uint32_t zigzagEncode(int32_t inValue)
+{
+	return ((uint32_t)inValue << 1) ^ (uint32_t)(inValue >> 31);
+}
+
+inline int32_t zigzagDecode(uint32_t inValue)
+{
+	return (int32_t)(inValue >> 1) ^ -(int32_t)(inValue & 1);
+}
+
+// Offsets times inScale as x,y,z float triples (3 * inCount floats); 16-bit offsets are
+// x,y,z triples too
+void	decodePointOffsets16(const int16_t* inOffsets, size_t inCount, float inScale, float* outXYZ);
+void	decodePointOffsets21(const uint64_t* inOffsets, size_t inCount, float inScale, float* outXYZ);
+
+// Stream VByte: a control byte for every 4 values, 2 bits each giving its length (1 to 4
+// bytes), then the values' bytes. Small values take one byte, and a group of 4 decodes
+// with one shuffle.
+size_t	getStreamVByteMaxSize(size_t inCount);
+// Returns the bytes written
+size_t	encodeStreamVByte(const uint32_t* inValues, size_t inCount, uint8_t* outBytes);
+// Decodes inCount values from the inSize bytes at inBytes. Returns the bytes read, 0 if
+// inSize is too small.
+size_t	decodeStreamVByte(const uint8_t* inBytes, size_t inSize, size_t inCount, uint32_t* outValues);
+
+// Values from decodeStreamVByte() to floats: inBase plus the running sum of the values,
+// times inStep
+void	decodeDeltaValues(const uint32_t* inValues, size_t inCount, int32_t inBase, float inStep, float* outValues);
+// inBase plus each value less 1, times inStep; 0 stands for NaN
+void	decodeBaseValues(const uint32_t* inValues, size_t inCount, int32_t inBase, float inStep, float* outValues);
+
+// The individual paths, for testing and benchmarking
+void	decodePointOffsets16Scalar(const int16_t* inOffsets, size_t inCount, float inScale, float* outXYZ);
+void	decodePointOffsets21Scalar(const uint64_t* inOffsets, size_t inCount, float inScale, float* outXYZ);
+size_t	decodeStreamVByteScalar(const uint8_t* inBytes, size_t inSize, size_t inCount, uint32_t* outValues);
+bool	pointCodecHasSSSE3();
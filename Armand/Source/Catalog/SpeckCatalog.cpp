@@ -0,0 +1,655 @@
+#include "stdafx.h"
+#include "SpeckCatalog.h"
+#include "MappedFile.h"
+#include "JobSystem.h"
+#include "UniversalCoord.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits>
+
+// Smallest chunk worth a job of its own, bytes
+static const size_t kMinChunkSize = 256 * 1024;
+// Chunks per thread, so threads that finish early can steal
+static const size_t kChunksPerThread = 8;
+// Decimal digits a uint64_t always holds
+static const int kMaxMantissaDigits = 19;
+
+static const double kPowersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+									   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+//----------------------------------------------------------------------
+//	Struct:		SpeckDecimal
+//
+//	Purpose:	A number as written: up to 19 significant digits and a
+//				power of ten.
+//
+//----------------------------------------------------------------------
+struct SpeckDecimal
+{
+	uint64_t		mantissa;
+	int				exponent;
+	bool			negative;
+	bool			truncated;				// More than kMaxMantissaDigits significant digits
+	const char*		begin;
+	const char*		end;
+};
+
+//----------------------------------------------------------------------
+//	Struct:		SpeckConversion
+//
+//	Purpose:	What converting decimals to millimetres needs, set up once
+//				per file.
+//
+//----------------------------------------------------------------------
+struct SpeckConversion
+{
+	UniversalCoord			unit;
+	double					unitMillimetres;
+	UniversalCoord			powers[kMaxMantissaDigits + 1];			// 10^k
+	UniversalCoord			halfPowers[kMaxMantissaDigits + 1];		// 10^k / 2, for rounding
+	UniversalCoordDivider	dividers[kMaxMantissaDigits + 1];		// By 10^k
+
+	SpeckConversion(const UniversalLiteral& inUnit)
+	{
+		unit = universalCoordFromLiteral(inUnit);
+		unitMillimetres = universalCoordToDouble(unit);
+
+		powers[0] = 1;
+		halfPowers[0] = 0;
+		for (int k = 1; k <= kMaxMantissaDigits; k++)
+		{
+			powers[k] = powers[k - 1];
+			powers[k].MulInt(10);
+			halfPowers[k] = powers[k];
+			halfPowers[k].DivInt(2);
+			dividers[k].SetDivisor(powers[k]);
+		}
+	}
+};
+
+static inline bool isSpace(char inChar)
+{
+	return (inChar == ' ') || (inChar == '\t') || (inChar == '\r');
+}
+
+static inline bool isDigit(char inChar)
+{
+	return (unsigned)(inChar - '0') < 10;
+}
+
+// Rows start with a number; everything else is a header line or a comment
+static inline bool isRowStart(char inChar)
+{
+	return isDigit(inChar) || (inChar == '-') || (inChar == '+') || (inChar == '.');
+}
+
+static inline const char* skipSpaces(const char* inPos, const char* inEnd)
+{
+	while ((inPos < inEnd) && isSpace(*inPos))
+		inPos++;
+
+	return inPos;
+}
+
+static inline const char* skipToken(const char* inPos, const char* inEnd)
+{
+	while ((inPos < inEnd) && !isSpace(*inPos))
+		inPos++;
+
+	return inPos;
+}
+
+static inline const char* findLineEnd(const char* inPos, const char* inEnd)
+{
+	const char* lineEnd = (const char*)memchr(inPos, '\n', inEnd - inPos);
+
+	return (lineEnd == NULL) ? inEnd : lineEnd;
+}
+
+// Reads a whole number from a header line
+static bool parseInteger(const char*& ioPos, const char* inEnd, int& outValue)
+{
+	const char* p = ioPos;
+	bool negative = (p < inEnd) && (*p == '-');
+	if (negative)
+		p++;
+	if ((p >= inEnd) || !isDigit(*p))
+		return false;
+
+	int value = 0;
+	for (; (p < inEnd) && isDigit(*p); p++)
+	{
+		if (value < 100000000)
+			value = value * 10 + (*p - '0');
+	}
+	outValue = negative ? -value : value;
+	ioPos = p;
+
+	return true;
+}
+
+// Whether a line is a row, following mesh blocks when inSkipBlocks. Rows inside a block
+// are mesh vertices rather than objects.
+static bool isRow(const char* inLine, const char* inLineEnd, int& ioDepth, bool inSkipBlocks)
+{
+	bool row = (inLine < inLineEnd) && isRowStart(*inLine) && (ioDepth == 0);
+	if (inSkipBlocks)
+	{
+		for (const char* c = inLine; c < inLineEnd; c++)
+		{
+			if (*c == '#')
+				break;
+			if (*c == '{')
+			{
+				ioDepth++;
+				row = false;
+			}
+			else if ((*c == '}') && (ioDepth > 0))
+			{
+				ioDepth--;
+				row = false;
+			}
+		}
+	}
+
+	return row;
+}
+
+// Reads a number ending at a space or inEnd, leaving ioPos after it. On failure ioPos
+// is left after the bad token.
+static bool parseDecimal(const char*& ioPos, const char* inEnd, SpeckDecimal& outDecimal)
+{
+	const char* p = ioPos;
+	outDecimal.begin = p;
+	outDecimal.mantissa = 0;
+	outDecimal.exponent = 0;
+	outDecimal.negative = false;
+	outDecimal.truncated = false;
+
+	if ((p < inEnd) && ((*p == '-') || (*p == '+')))
+	{
+		outDecimal.negative = (*p == '-');
+		p++;
+	}
+
+	int digits = 0;
+	bool anyDigits = false;
+	for (; (p < inEnd) && isDigit(*p); p++)
+	{
+		anyDigits = true;
+		unsigned digit = *p - '0';
+		if (digits < kMaxMantissaDigits)
+		{
+			outDecimal.mantissa = outDecimal.mantissa * 10 + digit;
+			if (outDecimal.mantissa != 0)
+				digits++;
+		}
+		else
+		{
+			outDecimal.exponent++;
+			outDecimal.truncated |= (digit != 0);
+		}
+	}
+	if ((p < inEnd) && (*p == '.'))
+	{
+		for (p++; (p < inEnd) && isDigit(*p); p++)
+		{
+			anyDigits = true;
+			unsigned digit = *p - '0';
+			if (digits < kMaxMantissaDigits)
+			{
+				outDecimal.mantissa = outDecimal.mantissa * 10 + digit;
+				outDecimal.exponent--;
+				if (outDecimal.mantissa != 0)
+					digits++;
+			}
+			else
+				outDecimal.truncated |= (digit != 0);
+		}
+	}
+	if (anyDigits && (p < inEnd) && ((*p == 'e') || (*p == 'E')))
+	{
+		const char* e = p + 1;
+		bool negativeExponent = false;
+		if ((e < inEnd) && ((*e == '-') || (*e == '+')))
+		{
+			negativeExponent = (*e == '-');
+			e++;
+		}
+		if ((e < inEnd) && isDigit(*e))
+		{
+			int exponent = 0;
+			for (; (e < inEnd) && isDigit(*e); e++)
+			{
+				if (exponent < 10000)
+					exponent = exponent * 10 + (*e - '0');
+			}
+			outDecimal.exponent += negativeExponent ? -exponent : exponent;
+			p = e;
+		}
+	}
+
+	if (!anyDigits || ((p < inEnd) && !isSpace(*p)))
+	{
+		ioPos = skipToken(p, inEnd);
+		return false;
+	}
+
+	outDecimal.end = p;
+	ioPos = p;
+
+	return true;
+}
+
+static double decimalToDouble(const SpeckDecimal& inDecimal)
+{
+	double value;
+	if (!inDecimal.truncated && (inDecimal.mantissa < (1ull << 53)) && (inDecimal.exponent >= -22) && (inDecimal.exponent <= 22))
+	{
+		// Both operands are exact, so one rounding, as strtod()
+		value = (double)inDecimal.mantissa;
+		if (inDecimal.exponent < 0)
+			value /= kPowersOfTen[-inDecimal.exponent];
+		else
+			value *= kPowersOfTen[inDecimal.exponent];
+
+		return inDecimal.negative ? -value : value;
+	}
+
+	char buffer[64];
+	size_t length = inDecimal.end - inDecimal.begin;
+	if (length < sizeof(buffer))
+	{
+		memcpy(buffer, inDecimal.begin, length);
+		buffer[length] = 0;
+		return strtod(buffer, NULL);
+	}
+
+	value = (double)inDecimal.mantissa * pow(10.0, inDecimal.exponent);
+
+	return inDecimal.negative ? -value : value;
+}
+
+// Rounds inDecimal units to the nearest millimetre. False if it is out of range.
+static bool decimalToCoord(const SpeckDecimal& inDecimal, const SpeckConversion& inConversion, UniversalCoord& outCoord)
+{
+	UniversalCoord value;
+	value.table[0] = (ttmath::uint)inDecimal.mantissa;
+	value.table[1] = 0;
+
+	bool overflow = (value.Mul(inConversion.unit) != 0);
+	if (!overflow && (inDecimal.exponent > 0))
+	{
+		for (int exponent = inDecimal.exponent; !overflow && (exponent > 0); exponent -= kMaxMantissaDigits)
+			overflow = (value.Mul(inConversion.powers[(exponent < kMaxMantissaDigits) ? exponent : kMaxMantissaDigits]) != 0);
+	}
+	else if (!overflow && (inDecimal.exponent < 0))
+	{
+		// Exact apart from the last division, which rounds
+		int exponent = -inDecimal.exponent;
+		for (; exponent > kMaxMantissaDigits; exponent -= kMaxMantissaDigits)
+			inConversion.dividers[kMaxMantissaDigits].Div(value);
+		value.Add(inConversion.halfPowers[exponent]);
+		inConversion.dividers[exponent].Div(value);
+	}
+
+	if (overflow)
+	{
+		double millimetres = decimalToDouble(inDecimal) * inConversion.unitMillimetres;
+		if (!(fabs(millimetres) < 1.7e38))
+			return false;
+
+		outCoord = universalCoordFromDouble(millimetres);
+		return true;
+	}
+
+	if (inDecimal.negative)
+		value.ChangeSign();
+	outCoord = value;
+
+	return true;
+}
+
+SpeckCatalog::SpeckCatalog() : mTextureVariable(-1),
+							   mCount(0),
+							   mBadRowCount(0)
+{
+}
+
+bool SpeckCatalog::load(const char* inPath, const UniversalLiteral& inUnit, JobSystem* inJobSystem)
+{
+	MappedFile file;
+	if (!file.open(inPath))
+	{
+		clear();
+		return false;
+	}
+
+	parse(file.getData(), file.getSize(), inUnit, inJobSystem);
+
+	return true;
+}
+
+void SpeckCatalog::parse(const char* inData, size_t inSize, const UniversalLiteral& inUnit, JobSystem* inJobSystem)
+{
+	clear();
+	if (inSize == 0)
+		return;
+
+	const char* end = inData + inSize;
+	const char* rows = parseHeader(inData, end);
+
+	// Split the rows into chunks beginning at line starts
+	size_t threadCount = (inJobSystem != NULL) ? inJobSystem->getThreadCount() : 1;
+	size_t chunkCount = (size_t)(end - rows) / kMinChunkSize;
+	if (chunkCount > threadCount * kChunksPerThread)
+		chunkCount = threadCount * kChunksPerThread;
+	if ((chunkCount == 0) || (threadCount == 1))
+		chunkCount = 1;
+
+	std::vector<Chunk> chunks(chunkCount);
+	const char* chunkBegin = rows;
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		const char* chunkEnd = end;
+		if (i + 1 < chunkCount)
+		{
+			chunkEnd = rows + (end - rows) * (i + 1) / chunkCount;
+			if (chunkEnd < chunkBegin)
+				chunkEnd = chunkBegin;
+			chunkEnd = findLineEnd(chunkEnd, end);
+			if (chunkEnd < end)
+				chunkEnd++;
+		}
+		chunks[i].begin = chunkBegin;
+		chunks[i].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+
+	if (chunkCount > 1)
+	{
+		inJobSystem->parallelFor(chunkCount, 1, [&](size_t inBegin, size_t inEnd) {
+			for (size_t i = inBegin; i < inEnd; i++)
+				countRows(chunks[i]);
+		});
+	}
+	else
+		countRows(chunks[0]);
+
+	// Mesh blocks can span chunks, so they are followed from the top on one thread
+	bool skipBlocks = false;
+	for (size_t i = 0; i < chunkCount; i++)
+		skipBlocks |= chunks[i].hasBlocks;
+	if (skipBlocks)
+	{
+		chunks.resize(1);
+		chunks[0].begin = rows;
+		chunks[0].end = end;
+		chunks[0].rowCount = 0;
+		int depth = 0;
+		for (const char* line = rows; line < end; )
+		{
+			const char* lineEnd = findLineEnd(line, end);
+			if (isRow(skipSpaces(line, lineEnd), lineEnd, depth, true))
+				chunks[0].rowCount++;
+			line = lineEnd + 1;
+		}
+	}
+
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		chunks[i].firstRow = mCount;
+		mCount += chunks[i].rowCount;
+	}
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mLo[axis].resize(mCount);
+		mHi[axis].resize(mCount);
+	}
+	mColumns.resize(mVariables.size());
+	for (size_t v = 0; v < mColumns.size(); v++)
+		mColumns[v].resize(mCount);
+	mLabelOffsets.resize(mCount);
+
+	if (mCount == 0)
+		return;
+
+	SpeckConversion conversion(inUnit);
+	if (chunks.size() > 1)
+	{
+		inJobSystem->parallelFor(chunks.size(), 1, [&](size_t inBegin, size_t inEnd) {
+			for (size_t i = inBegin; i < inEnd; i++)
+				parseRows(chunks[i], conversion, false);
+		});
+	}
+	else
+		parseRows(chunks[0], conversion, skipBlocks);
+
+	// Join the chunks' labels
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		mBadRowCount += chunks[i].badRowCount;
+
+		uint32_t base = (uint32_t)mLabels.size();
+		if ((base > 0) && !chunks[i].labels.empty())
+		{
+			for (size_t row = chunks[i].firstRow; row < chunks[i].firstRow + chunks[i].rowCount; row++)
+			{
+				if (mLabelOffsets[row] != kNoSpeckLabel)
+					mLabelOffsets[row] += base;
+			}
+		}
+		mLabels.insert(mLabels.end(), chunks[i].labels.begin(), chunks[i].labels.end());
+	}
+}
+
+void SpeckCatalog::clear()
+{
+	mVariables.clear();
+	mTextureVariable = -1;
+	mTextures.clear();
+	mCount = 0;
+	mBadRowCount = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mLo[axis].clear();
+		mHi[axis].clear();
+	}
+	mColumns.clear();
+	mLabelOffsets.clear();
+	mLabels.clear();
+}
+
+void SpeckCatalog::getPositions(UniversalPointArrays& outPoints) const
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		outPoints.lo[axis] = mLo[axis].empty() ? NULL : &mLo[axis][0];
+		outPoints.hi[axis] = mHi[axis].empty() ? NULL : &mHi[axis][0];
+	}
+	outPoints.count = mCount;
+}
+
+int SpeckCatalog::findVariable(const char* inName) const
+{
+	for (size_t v = 0; v < mVariables.size(); v++)
+	{
+		if (mVariables[v] == inName)
+			return (int)v;
+	}
+
+	return -1;
+}
+
+// -----------------------------------------------------------------------
+//	parseHeader [protected]
+//
+//	Reads datavar, texturevar and texture lines up to the first row
+//	outside a mesh block and returns where that row starts.
+// -----------------------------------------------------------------------
+const char* SpeckCatalog::parseHeader(const char* inBegin, const char* inEnd)
+{
+	int depth = 0;
+	const char* line = inBegin;
+	while (line < inEnd)
+	{
+		const char* lineEnd = findLineEnd(line, inEnd);
+		const char* p = skipSpaces(line, lineEnd);
+		int lineDepth = depth;
+		if (isRow(p, lineEnd, depth, true))
+			return line;
+
+		if (lineDepth == 0)
+		{
+			const char* keyword = p;
+			const char* keywordEnd = skipToken(p, lineEnd);
+			size_t keywordLength = keywordEnd - keyword;
+			p = skipSpaces(keywordEnd, lineEnd);
+
+			if ((keywordLength == 7) && (memcmp(keyword, "datavar", 7) == 0))
+			{
+				int index;
+				if (parseInteger(p, lineEnd, index) && (index >= 0) && (index < 4096))
+				{
+					const char* name = skipSpaces(p, lineEnd);
+					if ((size_t)index >= mVariables.size())
+						mVariables.resize(index + 1);
+					mVariables[index].assign(name, skipToken(name, lineEnd));
+				}
+			}
+			else if ((keywordLength == 10) && (memcmp(keyword, "texturevar", 10) == 0))
+			{
+				int index;
+				if (parseInteger(p, lineEnd, index))
+					mTextureVariable = index;
+			}
+			else if ((keywordLength == 7) && (memcmp(keyword, "texture", 7) == 0))
+			{
+				// texture [-flags] number file
+				while ((p < lineEnd) && (*p == '-'))
+					p = skipSpaces(skipToken(p, lineEnd), lineEnd);
+				int number;
+				if (parseInteger(p, lineEnd, number))
+				{
+					const char* file = skipSpaces(p, lineEnd);
+					SpeckTexture texture;
+					texture.number = number;
+					texture.file.assign(file, skipToken(file, lineEnd));
+					mTextures.push_back(texture);
+				}
+			}
+		}
+
+		line = lineEnd + 1;
+	}
+
+	return inEnd;
+}
+
+// -----------------------------------------------------------------------
+//	countRows [protected]
+//
+//	Counts a chunk's rows and notes whether it has mesh blocks.
+// -----------------------------------------------------------------------
+void SpeckCatalog::countRows(Chunk& ioChunk) const
+{
+	size_t length = ioChunk.end - ioChunk.begin;
+	ioChunk.hasBlocks = (memchr(ioChunk.begin, '{', length) != NULL) || (memchr(ioChunk.begin, '}', length) != NULL);
+	ioChunk.rowCount = 0;
+	ioChunk.badRowCount = 0;
+
+	int depth = 0;
+	for (const char* line = ioChunk.begin; line < ioChunk.end; )
+	{
+		const char* lineEnd = findLineEnd(line, ioChunk.end);
+		if (isRow(skipSpaces(line, lineEnd), lineEnd, depth, false))
+			ioChunk.rowCount++;
+		line = lineEnd + 1;
+	}
+}
+
+// -----------------------------------------------------------------------
+//	parseRows [protected]
+//
+//	Converts a chunk's rows into the arrays, from ioChunk.firstRow on.
+// -----------------------------------------------------------------------
+void SpeckCatalog::parseRows(Chunk& ioChunk, const SpeckConversion& inConversion, bool inSkipBlocks)
+{
+	const float kMissing = std::numeric_limits<float>::quiet_NaN();
+	size_t variableCount = mColumns.size();
+	std::vector<float*> columns(variableCount);
+	for (size_t v = 0; v < variableCount; v++)
+		columns[v] = &mColumns[v][0];
+
+	size_t row = ioChunk.firstRow;
+	size_t rowEnd = ioChunk.firstRow + ioChunk.rowCount;
+	int depth = 0;
+	for (const char* line = ioChunk.begin; (line < ioChunk.end) && (row < rowEnd); )
+	{
+		const char* lineEnd = findLineEnd(line, ioChunk.end);
+		const char* p = skipSpaces(line, lineEnd);
+		if (!isRow(p, lineEnd, depth, inSkipBlocks))
+		{
+			line = lineEnd + 1;
+			continue;
+		}
+
+		// Position
+		bool good = true;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			SpeckDecimal decimal;
+			UniversalCoord coord;
+			p = skipSpaces(p, lineEnd);
+			if (good && parseDecimal(p, lineEnd, decimal) && decimalToCoord(decimal, inConversion, coord))
+			{
+				mLo[axis][row] = (uint64_t)coord.table[0];
+				mHi[axis][row] = (int64_t)coord.table[1];
+			}
+			else
+				good = false;
+		}
+		if (!good)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				mLo[axis][row] = 0;
+				mHi[axis][row] = 0;
+			}
+			ioChunk.badRowCount++;
+		}
+
+		// Data, up to the label
+		for (size_t v = 0; v < variableCount; v++)
+		{
+			SpeckDecimal decimal;
+			p = skipSpaces(p, lineEnd);
+			if ((p < lineEnd) && (*p != '#') && parseDecimal(p, lineEnd, decimal))
+				columns[v][row] = (float)decimalToDouble(decimal);
+			else
+				columns[v][row] = kMissing;
+		}
+
+		// The label, offset within the chunk's labels for now
+		mLabelOffsets[row] = kNoSpeckLabel;
+		const char* label = (const char*)memchr(p, '#', lineEnd - p);
+		if (label != NULL)
+		{
+			const char* labelEnd = lineEnd;
+			label = skipSpaces(label + 1, lineEnd);
+			while ((labelEnd > label) && isSpace(labelEnd[-1]))
+				labelEnd--;
+			if (labelEnd > label)
+			{
+				mLabelOffsets[row] = (uint32_t)ioChunk.labels.size();
+				ioChunk.labels.insert(ioChunk.labels.end(), label, labelEnd);
+				ioChunk.labels.push_back(0);
+			}
+		}
+
+		row++;
+		line = lineEnd + 1;
+	}
+}
@@ -0,0 +1,129 @@
+//----------------------------------------------------------------------
+//	File:		SpeckCatalog.h
+//
+//	Contains:	Loader for Digital Universe .speck catalogues: memory
+//				mapped and parsed in parallel into structure-of-arrays
+//				columns and 128-bit positions.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "UniversalLiteral.h"
+#include "UniversalPointBatch.h"
+
+class JobSystem;
+struct SpeckConversion;
+
+const uint32_t kNoSpeckLabel = 0xffffffff;
+
+//----------------------------------------------------------------------
+//	Struct:		SpeckTexture
+//
+//	Purpose:	A "texture" line of the header: the number the texturevar
+//				column refers to and the image file.
+//
+//----------------------------------------------------------------------
+struct SpeckTexture
+{
+	int				number;
+	std::string		file;
+};
+
+//----------------------------------------------------------------------
+//	Class:		SpeckCatalog
+//
+//	Purpose:	The objects of a .speck file. Each row is x y z in the
+//				file's unit followed by one value per datavar, then an
+//				optional # label.
+//
+//				Positions are converted straight from the decimal text to
+//				millimetres: the digits times the unit literal, divided by
+//				the power of ten, in 128-bit integers, so a position is as
+//				exact as the file rather than as exact as a double. The
+//				data columns are floats, NaN where a row is short.
+//
+//				The file is mapped rather than read and its rows split into
+//				line-aligned chunks. One pass over the chunks counts rows,
+//				so each chunk knows where its rows go, and a second parses
+//				them into the final arrays; both run on a JobSystem when one
+//				is given. No line is ever copied into a string. Files with
+//				mesh blocks ({ ... }), which rows inside must not be read as
+//				objects, are parsed on one thread.
+//
+//----------------------------------------------------------------------
+class SpeckCatalog
+{
+	public:
+		SpeckCatalog();
+
+		// inUnit is the length of one unit of the file's positions, e.g. kUniversalParsec.
+		// inJobSystem, which may be NULL, parses in parallel. Returns false if the file
+		// can't be opened.
+		bool			load(const char* inPath, const UniversalLiteral& inUnit, JobSystem* inJobSystem);
+
+		// As load(), from inSize bytes at inData
+		void			parse(const char* inData, size_t inSize, const UniversalLiteral& inUnit, JobSystem* inJobSystem);
+
+		void			clear();
+
+		size_t			getCount() const { return mCount; };
+
+		// Rows whose position couldn't be read; they are at the origin
+		size_t			getBadRowCount() const { return mBadRowCount; };
+
+		// Views the positions, which stay valid until the catalogue changes
+		void			getPositions(UniversalPointArrays& outPoints) const;
+
+		// Datavar names, by column
+		const std::vector<std::string>&	getVariables() const { return mVariables; };
+		// The column of the datavar called inName, -1 if none
+		int				findVariable(const char* inName) const;
+		// getCount() values of column inVariable
+		const float*	getColumn(size_t inVariable) const { return mColumns[inVariable].empty() ? NULL : &mColumns[inVariable][0]; };
+
+		// The column of the texturevar, -1 if none
+		int				getTextureVariable() const { return mTextureVariable; };
+		const std::vector<SpeckTexture>&	getTextures() const { return mTextures; };
+
+		// The text after a row's #, NULL if it has none
+		const char*		getLabel(size_t inRow) const { return (mLabelOffsets[inRow] == kNoSpeckLabel) ? NULL : &mLabels[mLabelOffsets[inRow]]; };
+		// Every row's label as an offset into getLabels(), kNoSpeckLabel for none
+		const uint32_t*	getLabelOffsets() const { return mLabelOffsets.empty() ? NULL : &mLabelOffsets[0]; };
+		// The labels, each ending in a 0
+		const char*		getLabels() const { return mLabels.empty() ? NULL : &mLabels[0]; };
+
+	protected:
+		struct Chunk
+		{
+			const char*		begin;
+			const char*		end;
+			size_t			firstRow;
+			size_t			rowCount;
+			size_t			badRowCount;
+			bool			hasBlocks;				// Has a { or }
+			std::vector<char>	labels;
+		};
+
+		const char*		parseHeader(const char* inBegin, const char* inEnd);
+		void			countRows(Chunk& ioChunk) const;
+		void			parseRows(Chunk& ioChunk, const SpeckConversion& inConversion, bool inSkipBlocks);
+
+		std::vector<std::string>	mVariables;
+		int				mTextureVariable;
+		std::vector<SpeckTexture>	mTextures;
+
+		size_t			mCount;
+		size_t			mBadRowCount;
+		std::vector<uint64_t>	mLo[3];
+		std::vector<int64_t>	mHi[3];
+		std::vector<std::vector<float> >	mColumns;
+		std::vector<uint32_t>	mLabelOffsets;
+		std::vector<char>		mLabels;
+};
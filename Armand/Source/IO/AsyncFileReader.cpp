@@ -0,0 +1,623 @@
+#include "stdafx.h"
+#include "AsyncFileReader.h"
+#include "JobSystem.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef __linux__
+#define ASYNC_READER_RING
+#endif
+
+#ifdef ASYNC_READER_RING
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+// A finished read's callback, as a job
+struct AsyncReadCompletion
+{
+	AsyncReadCallback	callback;
+	void*				context;
+	AsyncReadStatus		status;
+};
+
+#ifdef ASYNC_READER_RING
+// The user data of the poll that wakes the ring's thread; reads carry their Request
+static const uint64_t kWakeData = 0;
+
+// The largest piece of a read the kernel is given at once
+static const size_t kMaxRingRead = 1 << 30;
+
+//----------------------------------------------------------------------
+//	Struct:		AsyncFileReader::Ring
+//
+//	Purpose:	An io_uring, set up and driven with the bare system calls.
+//				Only the ring's thread touches it once open.
+//
+//----------------------------------------------------------------------
+struct AsyncFileReader::Ring
+{
+	int					fd;
+	int					wakeFd;				// An eventfd wake() writes to
+	void*				sqMap;
+	size_t				sqMapSize;
+	void*				cqMap;
+	size_t				cqMapSize;
+	io_uring_sqe*		sqes;
+	size_t				sqesSize;
+	unsigned*			sqHead;
+	unsigned*			sqTail;
+	unsigned*			sqArray;
+	unsigned			sqMask;
+	unsigned			sqEntries;
+	unsigned			sqLocalTail;		// Entries filled, not yet handed over
+	unsigned			toSubmit;
+	unsigned*			cqHead;
+	unsigned*			cqTail;
+	unsigned			cqMask;
+	io_uring_cqe*		cqes;
+
+	bool				open(unsigned inEntries);
+	void				close();
+	io_uring_sqe*		getEntry();
+	void				startRead(Request* inRequest);
+	void				armWake();
+	void				enter(unsigned inWaitFor);
+};
+
+// ---------------------------------------------------------------------------
+// AsyncFileReader::Ring::open
+//
+//	Fails on kernels before 5.6, which have no IORING_OP_READ, as well as
+//	where io_uring is missing or not allowed.
+// ---------------------------------------------------------------------------
+bool AsyncFileReader::Ring::open(unsigned inEntries)
+{
+	sqMap = MAP_FAILED;
+	cqMap = MAP_FAILED;
+	sqes = (io_uring_sqe*)MAP_FAILED;
+	wakeFd = -1;
+
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	fd = (int)syscall(__NR_io_uring_setup, inEntries, &params);
+	if (fd < 0)
+		return false;
+
+	const unsigned kProbeOps = 256;
+	io_uring_probe* probe = (io_uring_probe*)calloc(1, sizeof(io_uring_probe) + kProbeOps * sizeof(io_uring_probe_op));
+	bool canRead = (probe != NULL) && (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, kProbeOps) >= 0) &&
+				   (probe->last_op >= IORING_OP_READ) && ((probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0);
+	free(probe);
+	if (!canRead)
+	{
+		close();
+		return false;
+	}
+
+	sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool singleMap = ((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+	if (singleMap)
+		sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+	sqMap = mmap(NULL, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	cqMap = singleMap ? sqMap : mmap(NULL, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	sqes = (io_uring_sqe*)mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	wakeFd = eventfd(0, EFD_CLOEXEC);
+	if ((sqMap == MAP_FAILED) || (cqMap == MAP_FAILED) || (sqes == MAP_FAILED) || (wakeFd < 0))
+	{
+		close();
+		return false;
+	}
+
+	char* sq = (char*)sqMap;
+	sqHead = (unsigned*)(sq + params.sq_off.head);
+	sqTail = (unsigned*)(sq + params.sq_off.tail);
+	sqArray = (unsigned*)(sq + params.sq_off.array);
+	sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+	sqEntries = params.sq_entries;
+	sqLocalTail = *sqTail;
+	toSubmit = 0;
+
+	char* cq = (char*)cqMap;
+	cqHead = (unsigned*)(cq + params.cq_off.head);
+	cqTail = (unsigned*)(cq + params.cq_off.tail);
+	cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+	cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFileReader::Ring::close
+// ---------------------------------------------------------------------------
+void AsyncFileReader::Ring::close()
+{
+	if (sqes != MAP_FAILED)
+		munmap(sqes, sqesSize);
+	if ((cqMap != MAP_FAILED) && (cqMap != sqMap))
+		munmap(cqMap, cqMapSize);
+	if (sqMap != MAP_FAILED)
+		munmap(sqMap, sqMapSize);
+	if (wakeFd >= 0)
+		::close(wakeFd);
+	if (fd >= 0)
+		::close(fd);
+	sqMap = MAP_FAILED;
+	cqMap = MAP_FAILED;
+	sqes = (io_uring_sqe*)MAP_FAILED;
+	wakeFd = -1;
+	fd = -1;
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFileReader::Ring::getEntry
+//
+//	The next submission entry, cleared. The ring has room for every read
+//	in flight and the wake poll, so it is never full.
+// ---------------------------------------------------------------------------
+io_uring_sqe* AsyncFileReader::Ring::getEntry()
+{
+	unsigned index = sqLocalTail & sqMask;
+	sqArray[index] = index;
+	sqLocalTail++;
+	toSubmit++;
+
+	io_uring_sqe* entry = &sqes[index];
+	memset(entry, 0, sizeof(*entry));
+
+	return entry;
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFileReader::Ring::startRead
+//
+//	Reads what is left of a request: all of it, or the rest after a short
+//	read.
+// ---------------------------------------------------------------------------
+void AsyncFileReader::Ring::startRead(Request* inRequest)
+{
+	const AsyncRead& read = inRequest->read;
+	io_uring_sqe* entry = getEntry();
+	entry->opcode = IORING_OP_READ;
+	entry->fd = read.file->getDescriptor();
+	entry->off = read.offset + inRequest->done;
+	entry->addr = (uint64_t)(uintptr_t)((char*)read.buffer + inRequest->done);
+	entry->len = (unsigned)std::min(read.size - inRequest->done, kMaxRingRead);
+	entry->user_data = (uint64_t)(uintptr_t)inRequest;
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFileReader::Ring::armWake
+//
+//	Polls the eventfd, so that wake() ends the thread's wait in enter().
+//	A poll only fires once, so this is done again after each wake.
+// ---------------------------------------------------------------------------
+void AsyncFileReader::Ring::armWake()
+{
+	io_uring_sqe* entry = getEntry();
+	entry->opcode = IORING_OP_POLL_ADD;
+	entry->fd = wakeFd;
+	entry->poll_events = POLLIN;
+	entry->user_data = kWakeData;
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFileReader::Ring::enter
+//
+//	Hands the kernel every entry filled since the last call, in one
+//	system call, and waits until inWaitFor completions are ready.
+// ---------------------------------------------------------------------------
+void AsyncFileReader::Ring::enter(unsigned inWaitFor)
+{
+	__atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+
+	int submitted = (int)syscall(__NR_io_uring_enter, fd, toSubmit, inWaitFor, (inWaitFor > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	if (submitted > 0)
+		toSubmit -= (unsigned)submitted;
+}
+#else
+struct AsyncFileReader::Ring
+{
+};
+#endif
+
+AsyncFileReader::AsyncFileReader() : mRunning(false),
+									 mQueueDepth(0),
+									 mRing(NULL),
+									 mQuit(false),
+									 mNextTicket(kNoAsyncRead),
+									 mInFlight(0)
+{
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+	stop();
+}
+
+void AsyncFileReader::start(unsigned inQueueDepth, unsigned inThreadCount, bool inUseRing)
+{
+	stop();
+
+	Ring* ring = NULL;
+	unsigned queueDepth = std::max(inQueueDepth, 1u);
+#ifdef ASYNC_READER_RING
+	if (inUseRing)
+	{
+		// Room for every read in flight, and the wake poll
+		ring = new Ring;
+		if (!ring->open(queueDepth + 1))
+		{
+			delete ring;
+			ring = NULL;
+		}
+	}
+#endif
+	if (ring == NULL)
+		queueDepth = std::max(inThreadCount, 1u);
+
+	// Set up with the mutex held, so that submit() only sees the reader running once
+	// its threads are there to wake
+	std::lock_guard<std::mutex> lock(mMutex);
+	mQuit = false;
+	mInFlight = 0;
+	memset(&mStats, 0, sizeof(mStats));
+	mQueueDepth = queueDepth;
+	mRing = ring;
+	if (ring != NULL)
+		mThreads.push_back(std::thread(&AsyncFileReader::ringLoop, this));
+	else
+	{
+		for (unsigned i = 0; i < queueDepth; i++)
+			mThreads.push_back(std::thread(&AsyncFileReader::poolLoop, this));
+	}
+	mRunning = true;
+}
+
+void AsyncFileReader::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (!mRunning || mQuit)
+			return;
+
+		mQuit = true;
+		for (int priority = 0; priority < eReadPriorityCount; priority++)
+		{
+			for (size_t i = 0; i < mQueued[priority].size(); i++)
+			{
+				Request* request = mQueued[priority][i];
+				request->status = eReadCancelled;
+				mUnfinished.erase(request->ticket);
+				mFinished.push_back(request);
+				mStats.cancelledCount++;
+			}
+			mQueued[priority].clear();
+		}
+		wake();
+	}
+
+	for (size_t i = 0; i < mThreads.size(); i++)
+		mThreads[i].join();
+	mThreads.clear();
+
+	// With mQuit set nothing wakes the ring any more, and its thread is gone
+	Ring* ring = NULL;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		ring = mRing;
+		mRing = NULL;
+		mRunning = false;
+	}
+#ifdef ASYNC_READER_RING
+	if (ring != NULL)
+	{
+		ring->close();
+		delete ring;
+	}
+#endif
+
+	runCompletions(NULL, NULL);
+}
+
+bool AsyncFileReader::isRunning() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mRunning;
+}
+
+bool AsyncFileReader::isUsingRing() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return (mRing != NULL);
+}
+
+void AsyncFileReader::submit(const AsyncRead* inReads, size_t inCount, AsyncReadTicket* outTickets)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	bool queued = false;
+	for (size_t i = 0; i < inCount; i++)
+	{
+		Request* request = new Request;
+		request->read = inReads[i];
+		request->ticket = ++mNextTicket;
+		request->status = eReadDone;
+		request->cancelled = false;
+		request->done = 0;
+		if (outTickets != NULL)
+			outTickets[i] = request->ticket;
+		mStats.submittedCount++;
+
+		const ReadOnlyFile* file = request->read.file;
+		if (!mRunning || mQuit || (file == NULL) || !file->isOpen() ||
+			(request->read.offset > file->getSize()) || (request->read.size > file->getSize() - request->read.offset))
+		{
+			request->status = eReadFailed;
+			mFinished.push_back(request);
+			mStats.failedCount++;
+			continue;
+		}
+		if (request->read.size == 0)
+		{
+			mFinished.push_back(request);
+			mStats.doneCount++;
+			continue;
+		}
+
+		int priority = std::min(std::max((int)request->read.priority, 0), eReadPriorityCount - 1);
+		mQueued[priority].push_back(request);
+		mUnfinished[request->ticket] = request;
+		queued = true;
+	}
+
+	// Only queued while running, so the ring is still open
+	if (queued)
+		wake();
+}
+
+bool AsyncFileReader::cancel(AsyncReadTicket inTicket)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::unordered_map<AsyncReadTicket, Request*>::iterator found = mUnfinished.find(inTicket);
+	if (found == mUnfinished.end())
+		return false;
+
+	Request* request = found->second;
+	int priority = std::min(std::max((int)request->read.priority, 0), eReadPriorityCount - 1);
+	std::deque<Request*>& queue = mQueued[priority];
+	std::deque<Request*>::iterator queued = std::find(queue.begin(), queue.end(), request);
+	if (queued == queue.end())
+	{
+		// In flight, so the reading thread finishes it
+		request->cancelled = true;
+		return true;
+	}
+
+	queue.erase(queued);
+	mUnfinished.erase(found);
+	request->status = eReadCancelled;
+	mFinished.push_back(request);
+	mStats.cancelledCount++;
+
+	return true;
+}
+
+void AsyncFileReader::runCompletions(JobSystem* inJobs, JobCounter* inCounter)
+{
+	assert((inJobs == NULL) || (inJobs->getCurrentThread() == 0));
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mCompleting.swap(mFinished);
+	}
+
+	for (size_t i = 0; i < mCompleting.size(); i++)
+	{
+		Request* request = mCompleting[i];
+		AsyncReadCompletion completion = { request->read.callback, request->read.context, request->status };
+		delete request;
+
+		if (completion.callback == NULL)
+			continue;
+		if (inJobs != NULL)
+			inJobs->run(runCallback, &completion, sizeof(completion), inCounter);
+		else
+			runCallback(&completion);
+	}
+	mCompleting.clear();
+}
+
+void AsyncFileReader::getStats(AsyncFileReaderStats& outStats) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	outStats = mStats;
+	outStats.queuedCount = 0;
+	for (int priority = 0; priority < eReadPriorityCount; priority++)
+		outStats.queuedCount += mQueued[priority].size();
+	outStats.inFlightCount = mInFlight;
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFileReader::takeNext											  [protected]
+//
+//	The oldest queued read of the most urgent class, counted as in flight.
+//	Called with the mutex held.
+// ---------------------------------------------------------------------------
+AsyncFileReader::Request* AsyncFileReader::takeNext()
+{
+	for (int priority = 0; priority < eReadPriorityCount; priority++)
+	{
+		if (!mQueued[priority].empty())
+		{
+			Request* request = mQueued[priority].front();
+			mQueued[priority].pop_front();
+			mInFlight++;
+			mStats.maxInFlightCount = std::max(mStats.maxInFlightCount, mInFlight);
+
+			return request;
+		}
+	}
+
+	return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFileReader::finish												  [protected]
+//
+//	Hands a read that was in flight to the next runCompletions().
+// ---------------------------------------------------------------------------
+void AsyncFileReader::finish(Request* inRequest, AsyncReadStatus inStatus)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mInFlight--;
+	mUnfinished.erase(inRequest->ticket);
+	inRequest->status = inRequest->cancelled ? eReadCancelled : inStatus;
+	mFinished.push_back(inRequest);
+
+	if (inRequest->status == eReadDone)
+		mStats.doneCount++;
+	else if (inRequest->status == eReadFailed)
+		mStats.failedCount++;
+	else
+		mStats.cancelledCount++;
+	mStats.bytesRead += inRequest->done;
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFileReader::wake												  [protected]
+//
+//	Called with the mutex held, while running or by stop() as it sets
+//	mQuit. The ring is only closed once its thread has gone, and mQuit
+//	keeps submit() from waking it after that.
+// ---------------------------------------------------------------------------
+void AsyncFileReader::wake()
+{
+#ifdef ASYNC_READER_RING
+	if (mRing != NULL)
+	{
+		uint64_t one = 1;
+		ssize_t written = write(mRing->wakeFd, &one, sizeof(one));
+		(void)written;
+		return;
+	}
+#endif
+
+	mCondition.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFileReader::poolLoop											  [protected]
+//
+//	A thread of the pool: one blocking read at a time, the most urgent
+//	first, until stop().
+// ---------------------------------------------------------------------------
+void AsyncFileReader::poolLoop()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		Request* request = takeNext();
+		if (request == NULL)
+		{
+			if (mQuit)
+				break;
+			mCondition.wait(lock);
+			continue;
+		}
+
+		lock.unlock();
+		const AsyncRead& read = request->read;
+		bool done = read.file->read(read.offset, read.size, read.buffer);
+		request->done = done ? read.size : 0;
+		finish(request, done ? eReadDone : eReadFailed);
+		lock.lock();
+	}
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFileReader::ringLoop											  [protected]
+//
+//	The ring's thread. Each time round it starts as many queued reads as
+//	the queue depth has room for, hands them to the kernel along with any
+//	to carry on after short reads, and sleeps until something finishes or
+//	wake() is called. After stop() it waits for the reads in flight.
+// ---------------------------------------------------------------------------
+void AsyncFileReader::ringLoop()
+{
+#ifdef ASYNC_READER_RING
+	Ring& ring = *mRing;
+	std::vector<Request*> batch;
+
+	ring.armWake();
+	while (true)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mQuit && (mInFlight == 0))
+				break;
+
+			Request* request = NULL;
+			while ((mInFlight < mQueueDepth) && ((request = takeNext()) != NULL))
+				batch.push_back(request);
+		}
+		for (size_t i = 0; i < batch.size(); i++)
+			ring.startRead(batch[i]);
+		batch.clear();
+
+		ring.enter(1);
+
+		unsigned head = *ring.cqHead;
+		unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++)
+		{
+			const io_uring_cqe& completion = ring.cqes[head & ring.cqMask];
+			if (completion.user_data == kWakeData)
+			{
+				uint64_t count;
+				ssize_t bytesRead = read(ring.wakeFd, &count, sizeof(count));
+				(void)bytesRead;
+				ring.armWake();
+				continue;
+			}
+
+			Request* request = (Request*)(uintptr_t)completion.user_data;
+			int result = completion.res;
+			if ((result == -EINTR) || (result == -EAGAIN))
+				ring.startRead(request);
+			else if (result <= 0)
+				finish(request, eReadFailed);
+			else
+			{
+				request->done += (size_t)result;
+				if (request->done < request->read.size)
+					ring.startRead(request);
+				else
+					finish(request, eReadDone);
+			}
+		}
+		__atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+	}
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFileReader::runCallback											  [protected]
+//
+//	Runs a finished request's callback on one of the job threads.
+// ---------------------------------------------------------------------------
+void AsyncFileReader::runCallback(void* ioData)
+{
+	const AsyncReadCompletion& completion = *(const AsyncReadCompletion*)ioData;
+	completion.callback(completion.context, completion.status);
+}
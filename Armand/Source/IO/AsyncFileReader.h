@@ -0,0 +1,186 @@
+//----------------------------------------------------------------------
+//	File:		AsyncFileReader.h
+//
+//	Contains:	Asynchronous reads from ReadOnlyFiles: queued by priority,
+//				cancellable, and done through io_uring on Linux or a pool
+//				of reading threads elsewhere, with callbacks run as jobs.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "ReadOnlyFile.h"
+
+class JobSystem;
+class JobCounter;
+
+// Reads start most urgent class first, and in the order submitted within a class
+enum AsyncReadPriority
+{
+	eReadUrgent,					// Holding up what is drawn now
+	eReadNormal,
+	eReadPrefetch,					// Might be wanted soon
+	eReadPriorityCount
+};
+
+enum AsyncReadStatus
+{
+	eReadDone,
+	eReadFailed,
+	eReadCancelled
+};
+
+// Called once for every read submitted
+typedef void (*AsyncReadCallback)(void* ioContext, AsyncReadStatus inStatus);
+
+// Names a read to cancel it; never kNoAsyncRead
+typedef uint64_t AsyncReadTicket;
+const AsyncReadTicket kNoAsyncRead = 0;
+
+//----------------------------------------------------------------------
+//	Struct:		AsyncRead
+//
+//	Purpose:	A read for AsyncFileReader::submit(). The file and the
+//				buffer must last until the callback.
+//
+//----------------------------------------------------------------------
+struct AsyncRead
+{
+	const ReadOnlyFile*	file;
+	uint64_t			offset;
+	size_t				size;
+	void*				buffer;
+	AsyncReadPriority	priority;
+	AsyncReadCallback	callback;
+	void*				context;
+};
+
+//----------------------------------------------------------------------
+//	Struct:		AsyncFileReaderStats
+//
+//	Purpose:	Reads since start(), and how deep the queue to the disk
+//				has been.
+//
+//----------------------------------------------------------------------
+struct AsyncFileReaderStats
+{
+	size_t			submittedCount;
+	size_t			doneCount;
+	size_t			failedCount;
+	size_t			cancelledCount;
+	size_t			queuedCount;			// Now, not yet started
+	size_t			inFlightCount;			// Now
+	size_t			maxInFlightCount;
+	uint64_t		bytesRead;
+};
+
+//----------------------------------------------------------------------
+//	Class:		AsyncFileReader
+//
+//	Purpose:	Reads pieces of files without tying up a thread for each.
+//				Reads are queued in priority classes and started in
+//				batches, as many at a time as the queue depth allows, so
+//				an NVMe drive sees enough of them at once to run at full
+//				speed.
+//
+//				On Linux one thread drives an io_uring: each batch goes
+//				to the kernel in one system call, which then waits for
+//				whichever read finishes first. Elsewhere, or without
+//				io_uring, a pool of threads each makes one blocking read
+//				at a time.
+//
+//				A read can be cancelled until it finishes: one not yet
+//				started is dropped from the queue, and one in flight
+//				finishes into its buffer but reports eReadCancelled.
+//				Either way every read gets its callback exactly once, by
+//				runCompletions(), which the owner calls on the job
+//				system's thread 0, once a frame say. The callbacks run as
+//				jobs, so decoding what was read is spread over the cores
+//				and never done on the reading thread.
+//
+//				submit() and cancel() may be called from any thread, even
+//				while the owner stops the reader: the ring and the running
+//				state only change with the mutex held, and the ring is
+//				only closed once nothing can wake it.
+//
+//----------------------------------------------------------------------
+class AsyncFileReader
+{
+	public:
+		AsyncFileReader();
+		~AsyncFileReader();
+
+		// Starts reading, with io_uring and inQueueDepth reads in flight if inUseRing and
+		// the system has it, otherwise on inThreadCount threads
+		void			start(unsigned inQueueDepth = 64, unsigned inThreadCount = 4, bool inUseRing = true);
+		// Cancels what hasn't started, waits for what has, and runs all callbacks not yet
+		// run on this thread
+		void			stop();
+
+		bool			isRunning() const;
+		bool			isUsingRing() const;
+
+		// Queues inCount reads with one wake of the reading thread, writing their tickets
+		// to outTickets unless it is NULL. Reads submitted while stopped fail.
+		void			submit(const AsyncRead* inReads, size_t inCount, AsyncReadTicket* outTickets);
+
+		// Returns false if the read has already finished
+		bool			cancel(AsyncReadTicket inTicket);
+
+		// Runs the callbacks of reads finished since the last call as jobs on inJobs,
+		// counted by inCounter, or on this thread if inJobs is NULL. With inJobs, must be
+		// called on its thread 0.
+		void			runCompletions(JobSystem* inJobs, JobCounter* inCounter);
+
+		void			getStats(AsyncFileReaderStats& outStats) const;
+
+	protected:
+		struct Request
+		{
+			AsyncRead			read;
+			AsyncReadTicket		ticket;
+			AsyncReadStatus		status;
+			bool				cancelled;			// While in flight
+			size_t				done;				// Bytes read so far
+		};
+
+		struct Ring;
+
+		Request*		takeNext();
+		void			finish(Request* inRequest, AsyncReadStatus inStatus);
+		void			wake();
+		void			poolLoop();
+		void			ringLoop();
+
+		static void		runCallback(void* ioData);
+
+		std::vector<std::thread>	mThreads;
+		std::vector<Request*>	mCompleting;		// runCompletions()'s, reused
+
+		mutable std::mutex		mMutex;				// Guards everything below
+		bool					mRunning;
+		unsigned				mQueueDepth;
+		Ring*					mRing;
+		std::condition_variable	mCondition;			// For the pool
+		bool					mQuit;
+		AsyncReadTicket			mNextTicket;
+		std::deque<Request*>	mQueued[eReadPriorityCount];
+		std::unordered_map<AsyncReadTicket, Request*>	mUnfinished;
+		std::vector<Request*>	mFinished;
+		size_t					mInFlight;
+		AsyncFileReaderStats	mStats;
+
+	private:
+		AsyncFileReader(const AsyncFileReader&);
+		AsyncFileReader&	operator=(const AsyncFileReader&);
+};
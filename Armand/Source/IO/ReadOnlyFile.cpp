@@ -0,0 +1,110 @@
+#include "stdafx.h"
+#include "ReadOnlyFile.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+ReadOnlyFile::ReadOnlyFile() : mOpen(false),
+							   mSize(0),
+#ifdef _WIN32
+							   mFile(INVALID_HANDLE_VALUE)
+#else
+							   mFile(-1)
+#endif
+{
+}
+
+ReadOnlyFile::~ReadOnlyFile()
+{
+	close();
+}
+
+bool ReadOnlyFile::open(const char* inPath)
+{
+	close();
+
+#ifdef _WIN32
+	mFile = CreateFileA(inPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFile, &size))
+	{
+		close();
+		return false;
+	}
+	mSize = (uint64_t)size.QuadPart;
+#else
+	mFile = ::open(inPath, O_RDONLY);
+	if (mFile < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(mFile, &status) != 0)
+	{
+		close();
+		return false;
+	}
+	mSize = (uint64_t)status.st_size;
+	posix_fadvise(mFile, 0, 0, POSIX_FADV_RANDOM);
+#endif
+
+	mOpen = true;
+	return true;
+}
+
+void ReadOnlyFile::close()
+{
+#ifdef _WIN32
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+	mFile = INVALID_HANDLE_VALUE;
+#else
+	if (mFile >= 0)
+		::close(mFile);
+	mFile = -1;
+#endif
+
+	mOpen = false;
+	mSize = 0;
+}
+
+bool ReadOnlyFile::read(uint64_t inOffset, size_t inSize, void* outData) const
+{
+	if (!mOpen || (inOffset > mSize) || (inSize > mSize - inOffset))
+		return false;
+
+	// Reads may come back short, so carry on from where each stopped
+	char* data = (char*)outData;
+	while (inSize > 0)
+	{
+#ifdef _WIN32
+		OVERLAPPED position;
+		memset(&position, 0, sizeof(position));
+		position.Offset = (DWORD)inOffset;
+		position.OffsetHigh = (DWORD)(inOffset >> 32);
+		DWORD chunk = (inSize > 0x40000000) ? 0x40000000 : (DWORD)inSize;
+		DWORD bytesRead = 0;
+		if (!ReadFile(mFile, data, chunk, &bytesRead, &position) || (bytesRead == 0))
+			return false;
+#else
+		ssize_t bytesRead = pread(mFile, data, inSize, (off_t)inOffset);
+		if ((bytesRead < 0) && (errno == EINTR))
+			continue;
+		if (bytesRead <= 0)
+			return false;
+#endif
+		data += bytesRead;
+		inOffset += bytesRead;
+		inSize -= bytesRead;
+	}
+
+	return true;
+}
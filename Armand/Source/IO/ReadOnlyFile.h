@@ -0,0 +1,60 @@
+//----------------------------------------------------------------------
+//	File:		ReadOnlyFile.h
+//
+//	Contains:	Reads from any position of a file, from several threads
+//				at once, on Windows and POSIX.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//----------------------------------------------------------------------
+//	Class:		ReadOnlyFile
+//
+//	Purpose:	A file read in pieces into buffers of the caller's, for
+//				data too large to keep mapped in memory. Each read names
+//				its own position, so there is no file pointer to share
+//				and any number of threads may read at once.
+//
+//----------------------------------------------------------------------
+class ReadOnlyFile
+{
+	public:
+		ReadOnlyFile();
+		~ReadOnlyFile();
+
+		// Returns false if the file can't be opened
+		bool			open(const char* inPath);
+		void			close();
+
+		bool			isOpen() const { return mOpen; };
+		uint64_t		getSize() const { return mSize; };
+
+		// Reads inSize bytes at inOffset into outData. Returns false if they can't all be
+		// read.
+		bool			read(uint64_t inOffset, size_t inSize, void* outData) const;
+
+#ifndef _WIN32
+		// For reads that don't go through read(), such as AsyncFileReader's
+		int				getDescriptor() const { return mFile; };
+#endif
+
+	protected:
+		bool			mOpen;
+		uint64_t		mSize;
+
+#ifdef _WIN32
+		HANDLE			mFile;
+#else
+		int				mFile;
+#endif
+
+	private:
+		ReadOnlyFile(const ReadOnlyFile&);
+		ReadOnlyFile&	operator=(const ReadOnlyFile&);
+};
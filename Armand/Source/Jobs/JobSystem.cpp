@@ -0,0 +1,476 @@
+#include "stdafx.h"
+#include "JobSystem.h"
+#include <assert.h>
+#include <emmintrin.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#define JOB_THREAD_LOCAL	__declspec(thread)
+#else
+#define JOB_THREAD_LOCAL	__thread
+#endif
+
+// How long an idle thread keeps looking for work before it sleeps
+static const int kSpinCount = 2048;
+
+struct Job
+{
+	// First, so jobs can keep pointers, 64-bit integers and doubles in it
+	union
+	{
+		char		data[kJobDataSize];
+		uint64_t	dataWord;
+		double		dataDouble;
+		void*		dataPointer;
+	};
+	JobFunction		function;
+	JobCounter*		counter;
+	Job*			next;					// In a JobCounter's waiting list
+	std::atomic<bool>	inUse;
+	bool			fromHeap;				// The ring slot was still in use
+};
+
+// The JobSystem the calling thread belongs to, if any, and its index there
+static JOB_THREAD_LOCAL const JobSystem* sThreadSystem = NULL;
+static JOB_THREAD_LOCAL unsigned sThreadIndex = 0;
+
+// A piece of a parallelFor
+struct JobRange
+{
+	struct Loop
+	{
+		JobSystem*			system;
+		JobRangeFunction	function;
+		void*				data;
+		size_t				grain;
+		JobCounter*			counter;
+	};
+
+	const Loop*		loop;
+	size_t			begin;
+	size_t			end;
+};
+
+JobCounter::JobCounter() : mCount(0),
+						   mLock(false),
+						   mWaiting(NULL)
+{
+}
+
+JobSystem::JobSystem(unsigned inThreadCount) : mQuit(false),
+											   mSleeping(0)
+{
+	if (inThreadCount == 0)
+		inThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (unsigned i = 0; i < inThreadCount; i++)
+	{
+		Thread* thread = new Thread;
+		thread->deque.top = 0;
+		thread->deque.bottom = 0;
+		thread->jobs = new Job[kJobsPerThread];
+		for (uint32_t job = 0; job < kJobsPerThread; job++)
+			thread->jobs[job].inUse = false;
+		thread->nextJob = 0;
+		thread->executed = 0;
+		thread->stolen = 0;
+		thread->random = 0x9E3779B97F4A7C15ull * (i + 1);
+		mThreads.push_back(thread);
+	}
+
+	sThreadSystem = this;
+	sThreadIndex = 0;
+	for (unsigned i = 1; i < inThreadCount; i++)
+		mThreads[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mQuit = true;
+	}
+	mSleepCondition.notify_all();
+
+	for (size_t i = 0; i < mThreads.size(); i++)
+	{
+		if (mThreads[i]->thread.joinable())
+			mThreads[i]->thread.join();
+		delete [] mThreads[i]->jobs;
+		delete mThreads[i];
+	}
+
+	if (sThreadSystem == this)
+		sThreadSystem = NULL;
+}
+
+void JobSystem::run(JobFunction inFunction, const void* inData, size_t inDataSize, JobCounter* inCounter)
+{
+	assert(getCurrentThread() != kNoJobThread);
+
+	push(allocateJob(inFunction, inData, inDataSize, inCounter));
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::runAfter
+//
+//	The dependency's lock is taken to add to its waiting list and by finish()
+//	to empty it, and the count is checked under the lock both times, so a job
+//	is either pushed here or released by the last job to finish.
+// ---------------------------------------------------------------------------
+void JobSystem::runAfter(JobCounter& inDependency, JobFunction inFunction, const void* inData, size_t inDataSize,
+						 JobCounter* inCounter)
+{
+	assert(getCurrentThread() != kNoJobThread);
+
+	Job* job = allocateJob(inFunction, inData, inDataSize, inCounter);
+
+	while (inDependency.mLock.exchange(true, std::memory_order_acquire))
+		_mm_pause();
+	bool waiting = (inDependency.mCount.load() > 0);
+	if (waiting)
+	{
+		job->next = inDependency.mWaiting;
+		inDependency.mWaiting = job;
+	}
+	inDependency.mLock.store(false, std::memory_order_release);
+
+	if (!waiting)
+		push(job);
+}
+
+void JobSystem::wait(JobCounter& inCounter)
+{
+	unsigned thread = getCurrentThread();
+	assert(thread != kNoJobThread);
+
+	while (!inCounter.isDone())
+	{
+		Job* job = findJob(thread);
+		if (job != NULL)
+			execute(job, thread);
+		else
+			_mm_pause();
+	}
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::parallelFor
+//
+//	Each range job pushes its upper half as a new job and goes on with the
+//	lower half until it is no bigger than the grain. Thieves take the oldest,
+//	biggest halves and split those in turn, so the work spreads out in
+//	log2(count / grain) steps however many threads there are.
+// ---------------------------------------------------------------------------
+void JobSystem::parallelFor(size_t inCount, size_t inGrain, JobRangeFunction inFunction, void* inData)
+{
+	assert(getCurrentThread() != kNoJobThread);
+
+	if (inCount == 0)
+		return;
+	if (inGrain == 0)
+		inGrain = 1;
+	if (inCount <= inGrain || mThreads.size() == 1)
+	{
+		inFunction(0, inCount, inData);
+		return;
+	}
+
+	JobCounter counter;
+	JobRange::Loop loop = { this, inFunction, inData, inGrain, &counter };
+	JobRange range = { &loop, 0, inCount };
+	runRange(&range);
+	wait(counter);
+}
+
+void JobSystem::getStats(JobSystemStats& outStats) const
+{
+	outStats.executed.resize(mThreads.size());
+	outStats.stolen.resize(mThreads.size());
+	for (size_t i = 0; i < mThreads.size(); i++)
+	{
+		outStats.executed[i] = mThreads[i]->executed;
+		outStats.stolen[i] = mThreads[i]->stolen;
+	}
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::allocateJob												  [protected]
+//
+//	Jobs come from the calling thread's ring. A stolen job may still be
+//	waiting to run on another thread when the ring comes round to it again, as
+//	may one waiting on a counter; the job is then allocated on the heap and
+//	deleted once it has run.
+// ---------------------------------------------------------------------------
+Job* JobSystem::allocateJob(JobFunction inFunction, const void* inData, size_t inDataSize, JobCounter* inCounter)
+{
+	Thread* thread = mThreads[getCurrentThread()];
+	Job* job = &thread->jobs[thread->nextJob++ & (kJobsPerThread - 1)];
+	if (job->inUse.load(std::memory_order_acquire))
+	{
+		job = new Job;
+		job->fromHeap = true;
+	}
+	else
+		job->fromHeap = false;
+	job->inUse.store(true, std::memory_order_relaxed);
+	job->function = inFunction;
+	job->counter = inCounter;
+	job->next = NULL;
+	if (inDataSize > 0)
+		memcpy(job->data, inData, std::min(inDataSize, kJobDataSize));
+
+	if (inCounter != NULL)
+		inCounter->mCount++;
+
+	return job;
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::push														  [protected]
+//
+//	After the job is visible, a thread going to sleep either sees it or has
+//	already counted itself in mSleeping: both sides write and then read with
+//	sequentially consistent ordering. Taking the mutex before notifying makes
+//	sure a thread that has counted itself is really waiting.
+// ---------------------------------------------------------------------------
+void JobSystem::push(Job* inJob)
+{
+	unsigned threadIndex = getCurrentThread();
+	Deque& deque = mThreads[threadIndex]->deque;
+
+	int64_t bottom = deque.bottom.load(std::memory_order_relaxed);
+	int64_t top = deque.top.load(std::memory_order_acquire);
+	if (bottom - top >= (int64_t)kJobsPerThread)
+	{
+		execute(inJob, threadIndex);
+		return;
+	}
+	deque.jobs[bottom & (kJobsPerThread - 1)].store(inJob, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	deque.bottom.store(bottom + 1, std::memory_order_relaxed);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (mSleeping.load() > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mSleepMutex);
+		}
+		mSleepCondition.notify_one();
+	}
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::pop														  [protected]
+//
+//	Takes the newest job from the bottom of the calling thread's own deque.
+//	Only for the last job does the owner race thieves, on top.
+// ---------------------------------------------------------------------------
+Job* JobSystem::pop(Deque& ioDeque)
+{
+	int64_t bottom = ioDeque.bottom.load(std::memory_order_relaxed) - 1;
+	ioDeque.bottom.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t top = ioDeque.top.load(std::memory_order_relaxed);
+
+	Job* job = NULL;
+	if (top <= bottom)
+	{
+		job = ioDeque.jobs[bottom & (kJobsPerThread - 1)].load(std::memory_order_relaxed);
+		if (top == bottom)
+		{
+			if (!ioDeque.top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				job = NULL;
+			ioDeque.bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+	}
+	else
+		ioDeque.bottom.store(bottom + 1, std::memory_order_relaxed);
+
+	return job;
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::steal														  [protected]
+//
+//	Takes the oldest job from the top of another thread's deque, or NULL if
+//	it is empty or another thread got there first.
+// ---------------------------------------------------------------------------
+Job* JobSystem::steal(Deque& ioDeque)
+{
+	int64_t top = ioDeque.top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t bottom = ioDeque.bottom.load(std::memory_order_acquire);
+	if (top >= bottom)
+		return NULL;
+
+	Job* job = ioDeque.jobs[top & (kJobsPerThread - 1)].load(std::memory_order_relaxed);
+	if (!ioDeque.top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return NULL;
+
+	return job;
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::findJob													  [protected]
+//
+//	The thread's own newest job, or else one stolen from the others, starting
+//	from a random one so that thieves spread out.
+// ---------------------------------------------------------------------------
+Job* JobSystem::findJob(unsigned inThread)
+{
+	Thread* thread = mThreads[inThread];
+	Job* job = pop(thread->deque);
+	if (job != NULL)
+		return job;
+
+	unsigned threadCount = (unsigned)mThreads.size();
+	thread->random ^= thread->random << 13;
+	thread->random ^= thread->random >> 7;
+	thread->random ^= thread->random << 17;
+	unsigned first = (unsigned)(thread->random % threadCount);
+	for (unsigned i = 0; i < threadCount; i++)
+	{
+		unsigned victim = (first + i) % threadCount;
+		if (victim == inThread)
+			continue;
+
+		job = steal(mThreads[victim]->deque);
+		if (job != NULL)
+		{
+			thread->stolen++;
+			return job;
+		}
+	}
+
+	return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::execute													  [protected]
+// ---------------------------------------------------------------------------
+void JobSystem::execute(Job* inJob, unsigned inThread)
+{
+	JobCounter* counter = inJob->counter;
+	inJob->function(inJob->data);
+	mThreads[inThread]->executed++;
+
+	if (inJob->fromHeap)
+		delete inJob;
+	else
+		inJob->inUse.store(false, std::memory_order_release);
+
+	if (counter != NULL)
+		finish(counter);
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::finish													  [protected]
+//
+//	The last job to finish releases the jobs waiting on the counter. It takes
+//	the counter to zero under the lock, and isDone() waits for the lock too,
+//	so a counter on a waiting thread's stack is not released while this still
+//	uses it. Jobs that are clearly not the last just count down.
+// ---------------------------------------------------------------------------
+void JobSystem::finish(JobCounter* inCounter)
+{
+	int32_t count = inCounter->mCount.load();
+	while (count > 1)
+	{
+		if (inCounter->mCount.compare_exchange_weak(count, count - 1))
+			return;
+	}
+
+	while (inCounter->mLock.exchange(true, std::memory_order_acquire))
+		_mm_pause();
+	Job* waiting = NULL;
+	if (--inCounter->mCount == 0)
+	{
+		waiting = inCounter->mWaiting;
+		inCounter->mWaiting = NULL;
+	}
+	inCounter->mLock.store(false, std::memory_order_release);
+
+	while (waiting != NULL)
+	{
+		Job* next = waiting->next;
+		push(waiting);
+		waiting = next;
+	}
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::workerLoop												  [protected]
+// ---------------------------------------------------------------------------
+void JobSystem::workerLoop(unsigned inThread)
+{
+	sThreadSystem = this;
+	sThreadIndex = inThread;
+
+	int idle = 0;
+	while (!mQuit.load())
+	{
+		Job* job = findJob(inThread);
+		if (job != NULL)
+		{
+			execute(job, inThread);
+			idle = 0;
+		}
+		else if (++idle < kSpinCount)
+		{
+			_mm_pause();
+		}
+		else
+		{
+			std::unique_lock<std::mutex> lock(mSleepMutex);
+			mSleeping++;
+			while (!mQuit.load() && !hasQueuedJobs())
+				mSleepCondition.wait(lock);
+			mSleeping--;
+			idle = 0;
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::hasQueuedJobs												  [protected]
+// ---------------------------------------------------------------------------
+bool JobSystem::hasQueuedJobs() const
+{
+	for (size_t i = 0; i < mThreads.size(); i++)
+	{
+		const Deque& deque = mThreads[i]->deque;
+		if (deque.bottom.load() > deque.top.load())
+			return true;
+	}
+
+	return false;
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::getCurrentThread
+// ---------------------------------------------------------------------------
+unsigned JobSystem::getCurrentThread() const
+{
+	return (sThreadSystem == this) ? sThreadIndex : kNoJobThread;
+}
+
+// ---------------------------------------------------------------------------
+// JobSystem::runRange													  [protected]
+// ---------------------------------------------------------------------------
+void JobSystem::runRange(void* ioData)
+{
+	JobRange range = *(const JobRange*)ioData;
+	const JobRange::Loop& loop = *range.loop;
+
+	while (range.end - range.begin > loop.grain)
+	{
+		JobRange upper = range;
+		upper.begin = range.begin + (range.end - range.begin) / 2;
+		range.end = upper.begin;
+		loop.system->run(runRange, &upper, sizeof(upper), loop.counter);
+	}
+
+	loop.function(range.begin, range.end, loop.data);
+}
@@ -0,0 +1,186 @@
+//----------------------------------------------------------------------
+//	File:		JobSystem.h
+//
+//	Contains:	Work-stealing job scheduler: per-thread deques, dependency
+//				counters and parallel-for over index ranges.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+struct Job;
+
+// Jobs get a copy of this many bytes of data to work on, aligned for pointers,
+// 64-bit integers and doubles
+const size_t kJobDataSize = 32;
+
+// JobSystem::getCurrentThread() on a thread that is not one of the system's
+const unsigned kNoJobThread = 0xffffffff;
+
+typedef void (*JobFunction)(void* ioData);
+typedef void (*JobRangeFunction)(size_t inBegin, size_t inEnd, void* inData);
+
+//----------------------------------------------------------------------
+//	Class:		JobCounter
+//
+//	Purpose:	Counts unfinished jobs. Every job run with a counter adds
+//				one to it and takes it away again when it is done, so a
+//				counter at zero means everything run with it has finished.
+//				JobSystem::wait() helps with jobs until a counter gets there;
+//				JobSystem::runAfter() holds a job back until it does.
+//
+//				A counter must outlive the jobs run with it.
+//
+//----------------------------------------------------------------------
+class JobCounter
+{
+	public:
+		JobCounter();
+
+		bool			isDone() const { return (mCount.load() == 0) && !mLock.load(); };
+
+	protected:
+		friend class JobSystem;
+
+		std::atomic<int32_t>	mCount;
+		std::atomic<bool>		mLock;
+		Job*					mWaiting;		// Jobs to run when mCount reaches zero
+};
+
+//----------------------------------------------------------------------
+//	Struct:		JobSystemStats
+//
+//	Purpose:	Jobs run by every thread since the system started, and how
+//				many of those it took from other threads' deques.
+//
+//----------------------------------------------------------------------
+struct JobSystemStats
+{
+	std::vector<size_t>	executed;
+	std::vector<size_t>	stolen;
+};
+
+//----------------------------------------------------------------------
+//	Class:		JobSystem
+//
+//	Purpose:	Runs small jobs on one thread per core. Each thread pushes
+//				the jobs it creates onto the bottom of its own deque and takes
+//				them back from there, newest first, so related work stays in
+//				its cache; threads that run out steal the oldest jobs from the
+//				top of the others' deques, which are usually the biggest
+//				pieces of a split range. Idle threads sleep until work is
+//				pushed.
+//
+//				The thread that creates the system is thread 0 and takes part
+//				in the work whenever it waits. Jobs are created by that thread
+//				or by other jobs, from a ring of kJobsPerThread per thread; a
+//				thread whose deque is full runs new jobs straight away. Each
+//				thread remembers which system it belongs to, so run(),
+//				runAfter(), wait() and parallelFor() assert that they are
+//				called on one of this system's threads rather than pushing
+//				onto a deque some other thread owns.
+//
+//				Only the standard library's threads and atomics are used, so
+//				the same code runs on Windows and Linux.
+//
+//----------------------------------------------------------------------
+class JobSystem
+{
+	public:
+		static const uint32_t	kJobsPerThread = 4096;
+
+		// inThreadCount includes the calling thread; 0 means one per hardware thread
+		JobSystem(unsigned inThreadCount = 0);
+		~JobSystem();
+
+		unsigned		getThreadCount() const { return (unsigned)mThreads.size(); };
+
+		// The calling thread's index in this system, or kNoJobThread if it is not one of its threads
+		unsigned		getCurrentThread() const;
+
+		// Runs inFunction on a copy of inDataSize (at most kJobDataSize) bytes of inData.
+		// inCounter, which may be NULL, counts the job until it has finished.
+		void			run(JobFunction inFunction, const void* inData, size_t inDataSize, JobCounter* inCounter);
+
+		// As run(), once inDependency has reached zero
+		void			runAfter(JobCounter& inDependency, JobFunction inFunction, const void* inData, size_t inDataSize,
+								 JobCounter* inCounter);
+
+		// Runs jobs on this thread until inCounter reaches zero
+		void			wait(JobCounter& inCounter);
+
+		// Calls inFunction over [0, inCount) in ranges of at most inGrain indices, spread
+		// across the threads, and returns when all of them are done
+		void			parallelFor(size_t inCount, size_t inGrain, JobRangeFunction inFunction, void* inData);
+
+		template<class Function>
+		void			parallelFor(size_t inCount, size_t inGrain, const Function& inFunction);
+
+		void			getStats(JobSystemStats& outStats) const;
+
+	protected:
+		// Chase-Lev deque: the owner pushes and pops at the bottom, others steal from the top
+		struct Deque
+		{
+			std::atomic<int64_t>	top;
+			char					padTop[64];			// Keeps thieves off the owner's cache line
+			std::atomic<int64_t>	bottom;
+			char					padBottom[64];
+			std::atomic<Job*>		jobs[kJobsPerThread];
+		};
+
+		struct Thread
+		{
+			Deque					deque;
+			Job*					jobs;				// Ring of kJobsPerThread
+			uint32_t				nextJob;
+			size_t					executed;
+			size_t					stolen;
+			uint64_t				random;				// Picks whom to steal from
+			std::thread				thread;
+		};
+
+		Job*			allocateJob(JobFunction inFunction, const void* inData, size_t inDataSize, JobCounter* inCounter);
+		void			push(Job* inJob);
+		Job*			pop(Deque& ioDeque);
+		Job*			steal(Deque& ioDeque);
+		Job*			findJob(unsigned inThread);
+		void			execute(Job* inJob, unsigned inThread);
+		void			finish(JobCounter* inCounter);
+		void			workerLoop(unsigned inThread);
+		bool			hasQueuedJobs() const;
+
+		static void		runRange(void* ioData);
+
+		std::vector<Thread*>	mThreads;
+		std::atomic<bool>		mQuit;
+
+		// Sleeping threads
+		std::mutex				mSleepMutex;
+		std::condition_variable	mSleepCondition;
+		std::atomic<int32_t>	mSleeping;
+};
+
+// Calls inFunction(begin, end) on each range
+template<class Function>
+static void jobSystemCallFunction(size_t inBegin, size_t inEnd, void* inData)
+{
+	(*(const Function*)inData)(inBegin, inEnd);
+}
+
+template<class Function>
+void JobSystem::parallelFor(size_t inCount, size_t inGrain, const Function& inFunction)
+{
+	parallelFor(inCount, inGrain, jobSystemCallFunction<Function>, (void*)&inFunction);
+}
@@ -35,3 +35,4 @@ using namespace std;		// Use the STL namespace; std
 //#include <gl/glu.h>			// Header file for the GLu32 library
 
 #include "VectorTemplates.h"
+#include "UniversalVector.h"
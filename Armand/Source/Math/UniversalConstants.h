@@ -0,0 +1,44 @@
+//----------------------------------------------------------------------
+//	File:		UniversalConstants.h
+//
+//	Contains:	Unit lengths in millimetres, exact as universal coordinates
+//				and as doubles.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include "UniversalLiteral.h"
+
+// Unit lengths in millimetres (IAU definitions). The astronomical unit and the light-year are
+// exact; parsecs (648000 / pi AU) are rounded to the nearest millimetre.
+//
+// The literals are written as words so that every compiler initialises them statically; where
+// user-defined literals are available the words are checked against the decimal values below.
+UNIVERSAL_CONSTEXPR const UniversalLiteral kUniversalAU				= { 0x0000880ef7f135e0ull, 0 };					// 149597870700000
+UNIVERSAL_CONSTEXPR const UniversalLiteral kUniversalLightYear		= { 0x834b443d5de45e00ull, 0 };					// 9460730472580800000
+UNIVERSAL_CONSTEXPR const UniversalLiteral kUniversalKilolightYear	= { 0xde028fb6c40f3000ull, 0x200 };				// 9460730472580800000000
+UNIVERSAL_CONSTEXPR const UniversalLiteral kUniversalMegalightYear	= { 0x3a0161eddb538000ull, 0x7d363 };			// 9460730472580800000000000
+UNIVERSAL_CONSTEXPR const UniversalLiteral kUniversalGigalightYear	= { 0x95668920be2c0000ull, 0x1e91bb9a };		// 9460730472580800000000000000
+UNIVERSAL_CONSTEXPR const UniversalLiteral kUniversalParsec			= { 0xac394a1e11cb4655ull, 0x1 };				// 30856775814913672789
+UNIVERSAL_CONSTEXPR const UniversalLiteral kUniversalKiloparsec		= { 0xbfc98575820abc93ull, 0x688 };				// 30856775814913672789139
+UNIVERSAL_CONSTEXPR const UniversalLiteral kUniversalMegaparsec		= { 0x2b315303f9f09fb4ull, 0x19862d };			// 30856775814913672789139380
+UNIVERSAL_CONSTEXPR const UniversalLiteral kUniversalGigaparsec		= { 0xb8ac478853efd57aull, 0x63b42070 };		// 30856775814913672789139379578
+
+const double kMillimetresPerAU = 149597870700000.0;
+const double kMillimetresPerLightYear = 9460730472580800000.0;
+const double kMillimetresPerParsec = 3.0856775814913673e19;
+
+#ifdef UNIVERSAL_LITERALS
+static_assert(universalLiteralEqual(kUniversalAU, 149597870700000_mm), "kUniversalAU");
+static_assert(universalLiteralEqual(kUniversalLightYear, 9460730472580800000_mm), "kUniversalLightYear");
+static_assert(universalLiteralEqual(kUniversalKilolightYear, 9460730472580800000000_mm), "kUniversalKilolightYear");
+static_assert(universalLiteralEqual(kUniversalMegalightYear, 9460730472580800000000000_mm), "kUniversalMegalightYear");
+static_assert(universalLiteralEqual(kUniversalGigalightYear, 9460730472580800000000000000_mm), "kUniversalGigalightYear");
+static_assert(universalLiteralEqual(kUniversalParsec, 30856775814913672789_mm), "kUniversalParsec");
+static_assert(universalLiteralEqual(kUniversalKiloparsec, 30856775814913672789139_mm), "kUniversalKiloparsec");
+static_assert(universalLiteralEqual(kUniversalMegaparsec, 30856775814913672789139380_mm), "kUniversalMegaparsec");
+static_assert(universalLiteralEqual(kUniversalGigaparsec, 30856775814913672789139379578_mm), "kUniversalGigaparsec");
+#endif
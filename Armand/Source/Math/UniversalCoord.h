@@ -0,0 +1,115 @@
+//----------------------------------------------------------------------
+//	File:		UniversalCoord.h
+//
+//	Contains:	128-bit integer type for universal coordinates and its
+//				conversions.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <math.h>
+#include <ttmath/ttmathint.h>
+#include <ttmath/ttmathdivider.h>
+#include "UniversalConstants.h"
+
+// One unit of a universal coordinate is one millimetre. The observable Universe has a radius
+// of roughly 4.7e29 mm, which needs 100 bits, so a signed 128-bit integer covers it with
+// plenty to spare. On x64 ttmath needs 2 words to represent 128 bits.
+typedef ttmath::Int<2> UniversalCoord;
+
+// Divides many coordinates by the same value, e.g. a unit length, much faster than Div()
+typedef ttmath::IntDivider<2> UniversalCoordDivider;
+
+//----------------------------------------------------------------------
+//	Function:	universalCoordToDouble
+//
+//	Purpose:	Converts a universal coordinate to the nearest double.
+//----------------------------------------------------------------------
+inline double universalCoordToDouble(const UniversalCoord& inValue)
+{
+	return inValue.ToDouble();
+}
+
+//----------------------------------------------------------------------
+//	Function:	universalCoordToUnits
+//
+//	Purpose:	Converts a universal coordinate to another unit, e.g.
+//				kMillimetresPerLightYear. Dividing by the unit length rounds
+//				better than multiplying by its reciprocal.
+//----------------------------------------------------------------------
+inline double universalCoordToUnits(const UniversalCoord& inValue, double inMillimetresPerUnit)
+{
+	return inValue.ToDouble() / inMillimetresPerUnit;
+}
+
+inline double universalCoordToLightYears(const UniversalCoord& inValue)
+{
+	return universalCoordToUnits(inValue, kMillimetresPerLightYear);
+}
+
+inline double universalCoordToParsecs(const UniversalCoord& inValue)
+{
+	return universalCoordToUnits(inValue, kMillimetresPerParsec);
+}
+
+//----------------------------------------------------------------------
+//	Function:	universalCoordFromDouble
+//
+//	Purpose:	Rounds a double to the nearest universal coordinate.
+//				|inValue| must be smaller than 2^127.
+//----------------------------------------------------------------------
+inline UniversalCoord universalCoordFromDouble(double inValue)
+{
+	UniversalCoord result;
+	result.FromDouble((inValue < 0.0) ? -floor(-inValue + 0.5) : floor(inValue + 0.5));
+
+	return result;
+}
+
+//----------------------------------------------------------------------
+//	Function:	universalCoordFromLiteral
+//
+//	Purpose:	Copies a compile-time literal into a universal coordinate:
+//				two word stores, no parsing or multiplication at runtime.
+//----------------------------------------------------------------------
+inline UniversalCoord universalCoordFromLiteral(const UniversalLiteral& inValue)
+{
+	UniversalCoord result;
+#ifdef TTMATH_PLATFORM64
+	result.table[0] = inValue.lo;
+	result.table[1] = (ttmath::uint)inValue.hi;
+#else
+	// Int<2> only has 64 bits here
+	result.table[0] = (ttmath::uint)inValue.lo;
+	result.table[1] = (ttmath::uint)(inValue.lo >> 32);
+#endif
+
+	return result;
+}
+
+//----------------------------------------------------------------------
+//	Function:	universalCoordFromUnits
+//
+//	Purpose:	inCount whole units, e.g. kUniversalParsec, exactly.
+//----------------------------------------------------------------------
+inline UniversalCoord universalCoordFromUnits(ttmath::sint inCount, const UniversalLiteral& inUnit)
+{
+	UniversalCoord result = universalCoordFromLiteral(inUnit);
+	result.MulInt(inCount);
+
+	return result;
+}
+
+//----------------------------------------------------------------------
+//	Function:	universalCoordDivider
+//
+//	Purpose:	A divider by a unit length, e.g. kUniversalParsec. Div()
+//				gives whole units and the remaining millimetres, exactly.
+//----------------------------------------------------------------------
+inline UniversalCoordDivider universalCoordDivider(const UniversalLiteral& inUnit)
+{
+	return UniversalCoordDivider(universalCoordFromLiteral(inUnit));
+}
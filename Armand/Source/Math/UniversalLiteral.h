@@ -0,0 +1,137 @@
+//----------------------------------------------------------------------
+//	File:		UniversalLiteral.h
+//
+//	Contains:	Compile-time 128-bit integer literals for universal
+//				coordinates.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+// constexpr and user-defined literals need Visual Studio 2015 (or any C++11 compiler). With
+// older compilers the functions below still work, at runtime, and the constants in
+// UniversalConstants.h are still initialised statically because they are plain aggregates.
+#if (defined(_MSC_VER) && (_MSC_VER >= 1900)) || (!defined(_MSC_VER) && (__cplusplus >= 201103L))
+	#define UNIVERSAL_LITERALS
+	#define UNIVERSAL_CONSTEXPR constexpr
+#else
+	#define UNIVERSAL_CONSTEXPR
+#endif
+
+//----------------------------------------------------------------------
+//	Struct:		UniversalLiteral
+//
+//	Purpose:	A signed 128-bit value laid out like the words of a
+//				UniversalCoord. Unlike ttmath::Int it is an aggregate, so it can
+//				be built at compile time and never needs a constructor to run.
+//				universalCoordFromLiteral() turns it into a UniversalCoord.
+//
+//----------------------------------------------------------------------
+struct UniversalLiteral
+{
+	uint64_t	lo;		// table[0]
+	int64_t		hi;		// table[1]
+};
+
+UNIVERSAL_CONSTEXPR inline UniversalLiteral universalLiteral(uint64_t inLo, int64_t inHi)
+{
+	return UniversalLiteral{ inLo, inHi };
+}
+
+// Reached only for bad input. They are not constexpr, so in a constant expression they turn
+// the mistake into a compile error naming them.
+inline UniversalLiteral universalLiteralBadDigit()
+{
+	assert(false);
+	return universalLiteral(0, 0);
+}
+
+inline UniversalLiteral universalLiteralOutOfRange()
+{
+	assert(false);
+	return universalLiteral(0, 0);
+}
+
+// High word of inLo * inFactor, inFactor < 2^32
+UNIVERSAL_CONSTEXPR inline uint64_t universalLiteralMulHigh(uint64_t inLo, uint32_t inFactor)
+{
+	return ((inLo >> 32) * inFactor + (((inLo & 0xffffffffull) * inFactor) >> 32)) >> 32;
+}
+
+UNIVERSAL_CONSTEXPR inline uint64_t universalLiteralMulAddCarry(uint64_t inLo, uint32_t inFactor, uint32_t inAdd)
+{
+	return universalLiteralMulHigh(inLo, inFactor) + ((inLo * inFactor + inAdd < inLo * inFactor) ? 1 : 0);
+}
+
+//----------------------------------------------------------------------
+//	Function:	universalLiteralMulAdd
+//
+//	Purpose:	inValue * inFactor + inAdd for a non-negative inValue. The
+//				result must stay below 2^127.
+//----------------------------------------------------------------------
+UNIVERSAL_CONSTEXPR inline UniversalLiteral universalLiteralMulAdd(const UniversalLiteral& inValue, uint32_t inFactor, uint32_t inAdd)
+{
+	return (inValue.hi < 0) ? universalLiteralOutOfRange() :
+		   ((uint64_t)inValue.hi > (0x7fffffffffffffffull - universalLiteralMulAddCarry(inValue.lo, inFactor, inAdd)) / (inFactor ? inFactor : 1)) ? universalLiteralOutOfRange() :
+		   universalLiteral(inValue.lo * inFactor + inAdd,
+							(int64_t)((uint64_t)inValue.hi * inFactor + universalLiteralMulAddCarry(inValue.lo, inFactor, inAdd)));
+}
+
+UNIVERSAL_CONSTEXPR inline UniversalLiteral universalLiteralMul(const UniversalLiteral& inValue, uint32_t inFactor)
+{
+	return universalLiteralMulAdd(inValue, inFactor, 0);
+}
+
+UNIVERSAL_CONSTEXPR inline UniversalLiteral universalLiteralNegate(const UniversalLiteral& inValue)
+{
+	return universalLiteral(0 - inValue.lo, (int64_t)(0 - (uint64_t)inValue.hi - ((inValue.lo != 0) ? 1 : 0)));
+}
+
+UNIVERSAL_CONSTEXPR inline bool universalLiteralEqual(const UniversalLiteral& a, const UniversalLiteral& b)
+{
+	return (a.lo == b.lo) && (a.hi == b.hi);
+}
+
+UNIVERSAL_CONSTEXPR inline UniversalLiteral universalLiteralParseDigits(const char* inDigits, const UniversalLiteral& inValue)
+{
+	return (*inDigits == '\0') ? inValue :
+		   (*inDigits == '\'') ? universalLiteralParseDigits(inDigits + 1, inValue) :	// C++14 digit separator
+		   ((*inDigits < '0') || (*inDigits > '9')) ? universalLiteralBadDigit() :
+		   universalLiteralParseDigits(inDigits + 1, universalLiteralMulAdd(inValue, 10, (uint32_t)(*inDigits - '0')));
+}
+
+//----------------------------------------------------------------------
+//	Function:	universalLiteralFromDecimal
+//
+//	Purpose:	Parses an optionally signed decimal string. In a constant
+//				expression, bad digits and values outside +/-(2^127 - 1) fail
+//				to compile.
+//----------------------------------------------------------------------
+UNIVERSAL_CONSTEXPR inline UniversalLiteral universalLiteralFromDecimal(const char* inString)
+{
+	return (*inString == '-') ? universalLiteralNegate(universalLiteralParseDigits(inString + 1, universalLiteral(0, 0))) :
+		   (*inString == '+') ? universalLiteralParseDigits(inString + 1, universalLiteral(0, 0)) :
+		   universalLiteralParseDigits(inString, universalLiteral(0, 0));
+}
+
+#ifdef UNIVERSAL_LITERALS
+
+// Millimetre literals of any length, e.g. 30856775814913672789_mm. As a raw literal operator
+// it sees the digits themselves, so values beyond unsigned long long are fine. Write -5_mm for
+// negative values.
+constexpr UniversalLiteral operator"" _mm(const char* inDigits)
+{
+	return universalLiteralParseDigits(inDigits, universalLiteral(0, 0));
+}
+
+constexpr UniversalLiteral operator-(const UniversalLiteral& inValue)
+{
+	return universalLiteralNegate(inValue);
+}
+
+#endif
@@ -0,0 +1,190 @@
+#include "stdafx.h"
+#include "UniversalPointBatch.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+	#define UNIVERSAL_POINT_BATCH_AVX2
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
+
+#ifdef __GNUC__
+	#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+	#define AVX2_TARGET
+#endif
+
+static const double kTwoToThe64 = 18446744073709551616.0;
+
+// ---------------------------------------------------------------------------
+// viewerRelativeComponent
+//
+//	((inLo, inHi) - (inOriginLo, inOriginHi)) * scale as a double, where inHighScale is
+//	2^64 * inLowScale. The AVX2 path evaluates exactly the same expression.
+//	The difference is rebalanced so that its low word is signed:
+//		value = hi * 2^64 + (int64_t)lo
+//	Anything that fits in 64 bits then has hi == 0 and converts with a single rounding,
+//	and larger values never suffer cancellation between the two words.
+// ---------------------------------------------------------------------------
+static inline double viewerRelativeComponent(uint64_t inLo, int64_t inHi, uint64_t inOriginLo, int64_t inOriginHi,
+											 double inHighScale, double inLowScale)
+{
+	uint64_t lo = inLo - inOriginLo;
+	uint64_t hi = (uint64_t)inHi - (uint64_t)inOriginHi - (inLo < inOriginLo ? 1 : 0);
+	hi += (lo >> 63);
+
+	return (double)(int64_t)hi * inHighScale + (double)(int64_t)lo * inLowScale;
+}
+
+void convertToViewerRelativeScalar(const UniversalPointArrays& inPoints, const UniversalPointOrigin& inOrigin,
+								   double inScale, float* outXYZ)
+{
+	double highScale = kTwoToThe64 * inScale;
+	for (size_t i = 0; i < inPoints.count; i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			outXYZ[i * 3 + axis] = (float)viewerRelativeComponent(inPoints.lo[axis][i], inPoints.hi[axis][i],
+																  inOrigin.lo[axis], inOrigin.hi[axis],
+																  highScale, inScale);
+		}
+	}
+}
+
+#ifdef UNIVERSAL_POINT_BATCH_AVX2
+
+bool convertToViewerRelativeHasAVX2()
+{
+	static int sHasAVX2 = -1;
+	if (sHasAVX2 < 0)
+	{
+#ifdef _MSC_VER
+		// AVX2 needs the CPU feature bit and the OS saving the YMM registers
+		int info[4];
+		__cpuid(info, 0);
+		bool hasAVX2 = false;
+		if (info[0] >= 7)
+		{
+			__cpuid(info, 1);
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+			if (osxsave && avx && ((_xgetbv(0) & 6) == 6))
+			{
+				__cpuidex(info, 7, 0);
+				hasAVX2 = (info[1] & (1 << 5)) != 0;
+			}
+		}
+		sHasAVX2 = hasAVX2 ? 1 : 0;
+#else
+		sHasAVX2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+#endif
+	}
+
+	return (sHasAVX2 == 1);
+}
+
+// Signed 64-bit integers to double for the whole int64 range. AVX2 has no instruction for
+// this (it arrived with AVX-512DQ), so the two halves are placed into the mantissas of
+// magic doubles and recombined.
+AVX2_TARGET static inline __m256d int64ToDouble(__m256i inValue)
+{
+	__m256i high = _mm256_srai_epi32(inValue, 16);
+	high = _mm256_blend_epi16(high, _mm256_setzero_si256(), 0x33);
+	high = _mm256_add_epi64(high, _mm256_castpd_si256(_mm256_set1_pd(442721857769029238784.0)));	// 3 * 2^67
+	__m256i low = _mm256_blend_epi16(inValue, _mm256_castpd_si256(_mm256_set1_pd(4503599627370496.0)), 0x88);	// 2^52
+	__m256d result = _mm256_sub_pd(_mm256_castsi256_pd(high), _mm256_set1_pd(442726361368656609280.0));	// 3 * 2^67 + 2^52
+	return _mm256_add_pd(result, _mm256_castsi256_pd(low));
+}
+
+// Four lanes of viewerRelativeComponent()
+AVX2_TARGET static inline __m128 viewerRelativeComponent4(const uint64_t* inLo, const int64_t* inHi,
+														  __m256i inOriginLo, __m256i inOriginHi,
+														  __m256d inHighScale, __m256d inLowScale)
+{
+	const __m256i kSignBit = _mm256_set1_epi64x((int64_t)0x8000000000000000ull);
+
+	__m256i lo = _mm256_loadu_si256((const __m256i*)inLo);
+	__m256i hi = _mm256_loadu_si256((const __m256i*)inHi);
+
+	// Unsigned lo < originLo gives an all ones (-1) borrow
+	__m256i borrow = _mm256_cmpgt_epi64(_mm256_xor_si256(inOriginLo, kSignBit), _mm256_xor_si256(lo, kSignBit));
+	__m256i diffLo = _mm256_sub_epi64(lo, inOriginLo);
+	__m256i diffHi = _mm256_add_epi64(_mm256_sub_epi64(hi, inOriginHi), borrow);
+	diffHi = _mm256_add_epi64(diffHi, _mm256_srli_epi64(diffLo, 63));
+
+	__m256d value = _mm256_add_pd(_mm256_mul_pd(int64ToDouble(diffHi), inHighScale),
+								  _mm256_mul_pd(int64ToDouble(diffLo), inLowScale));
+	return _mm256_cvtpd_ps(value);
+}
+
+AVX2_TARGET static void convertToViewerRelativeAVX2(const UniversalPointArrays& inPoints, const UniversalPointOrigin& inOrigin,
+													 double inScale, float* outXYZ)
+{
+	__m256i originLo[3], originHi[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		originLo[axis] = _mm256_set1_epi64x((int64_t)inOrigin.lo[axis]);
+		originHi[axis] = _mm256_set1_epi64x(inOrigin.hi[axis]);
+	}
+	__m256d highScale = _mm256_set1_pd(kTwoToThe64 * inScale);
+	__m256d lowScale = _mm256_set1_pd(inScale);
+
+	size_t i = 0;
+	for ( ; i + 4 <= inPoints.count; i += 4)
+	{
+		__m128 x = viewerRelativeComponent4(inPoints.lo[0] + i, inPoints.hi[0] + i, originLo[0], originHi[0], highScale, lowScale);
+		__m128 y = viewerRelativeComponent4(inPoints.lo[1] + i, inPoints.hi[1] + i, originLo[1], originHi[1], highScale, lowScale);
+		__m128 z = viewerRelativeComponent4(inPoints.lo[2] + i, inPoints.hi[2] + i, originLo[2], originHi[2], highScale, lowScale);
+
+		// Transpose x0x1x2x3 y0y1y2y3 z0z1z2z3 into x0y0z0x1 y1z1x2y2 z2x3y3z3
+		__m128 xy01 = _mm_unpacklo_ps(x, y);
+		__m128 xy23 = _mm_unpackhi_ps(x, y);
+		__m128 yz01 = _mm_unpacklo_ps(y, z);
+		__m128 yz23 = _mm_unpackhi_ps(y, z);
+		__m128 zx01 = _mm_unpacklo_ps(z, x);
+		__m128 zx23 = _mm_unpackhi_ps(z, x);
+
+		float* out = outXYZ + i * 3;
+		_mm_storeu_ps(out,     _mm_shuffle_ps(xy01, zx01, _MM_SHUFFLE(3, 0, 1, 0)));
+		_mm_storeu_ps(out + 4, _mm_shuffle_ps(yz01, xy23, _MM_SHUFFLE(1, 0, 3, 2)));
+		_mm_storeu_ps(out + 8, _mm_shuffle_ps(zx23, yz23, _MM_SHUFFLE(3, 2, 3, 0)));
+	}
+
+	// Remaining points
+	if (i < inPoints.count)
+	{
+		UniversalPointArrays tail = inPoints;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			tail.lo[axis] += i;
+			tail.hi[axis] += i;
+		}
+		tail.count = inPoints.count - i;
+		convertToViewerRelativeScalar(tail, inOrigin, inScale, outXYZ + i * 3);
+	}
+}
+
+void convertToViewerRelative(const UniversalPointArrays& inPoints, const UniversalPointOrigin& inOrigin,
+							 double inScale, float* outXYZ)
+{
+	if (convertToViewerRelativeHasAVX2())
+		convertToViewerRelativeAVX2(inPoints, inOrigin, inScale, outXYZ);
+	else
+		convertToViewerRelativeScalar(inPoints, inOrigin, inScale, outXYZ);
+}
+
+#else
+
+bool convertToViewerRelativeHasAVX2()
+{
+	return false;
+}
+
+void convertToViewerRelative(const UniversalPointArrays& inPoints, const UniversalPointOrigin& inOrigin,
+							 double inScale, float* outXYZ)
+{
+	convertToViewerRelativeScalar(inPoints, inOrigin, inScale, outXYZ);
+}
+
+#endif
@@ -0,0 +1,54 @@
+//----------------------------------------------------------------------
+//	File:		UniversalPointBatch.h
+//
+//	Contains:	Batched conversion of 128-bit universal coordinates to
+//				viewer-relative float32 positions.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//----------------------------------------------------------------------
+//	Struct:		UniversalPointArrays
+//
+//	Purpose:	Structure-of-arrays view over 128-bit universal coordinates.
+//				Each axis is split into its two ttmath words: the low word
+//				(table[0]) and the signed high word (table[1]). The arrays are
+//				not owned.
+//
+//----------------------------------------------------------------------
+struct UniversalPointArrays
+{
+	const uint64_t*	lo[3];		// x, y, z low words
+	const int64_t*	hi[3];		// x, y, z high words
+	size_t			count;
+};
+
+//----------------------------------------------------------------------
+//	Struct:		UniversalPointOrigin
+//
+//	Purpose:	The position everything is made relative to (normally the viewer),
+//				split into words the same way.
+//
+//----------------------------------------------------------------------
+struct UniversalPointOrigin
+{
+	uint64_t		lo[3];
+	int64_t			hi[3];
+};
+
+// Computes (point - inOrigin) * inScale for every point with exact 128-bit subtraction
+// and writes packed x,y,z float32 triples to outXYZ (3 * count floats), ready for a VBO.
+// Uses AVX2 when the CPU has it.
+void	convertToViewerRelative(const UniversalPointArrays& inPoints, const UniversalPointOrigin& inOrigin,
+								double inScale, float* outXYZ);
+
+// The individual paths, for testing and benchmarking
+void	convertToViewerRelativeScalar(const UniversalPointArrays& inPoints, const UniversalPointOrigin& inOrigin,
+									  double inScale, float* outXYZ);
+bool	convertToViewerRelativeHasAVX2();
@@ -0,0 +1,522 @@
+#include "stdafx.h"
+#include "UniversalSpaceKey.h"
+#include <string.h>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__)
+	#define UNIVERSAL_SPACE_KEY_BMI2
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+#ifdef __GNUC__
+	#define BMI2_TARGET __attribute__((target("bmi2")))
+#else
+	#define BMI2_TARGET
+#endif
+
+static const uint64_t kSignBit = 0x8000000000000000ull;
+
+// Every third bit of a word, starting at bit 0, 1 or 2: 22, 21 and 21 bits
+static const uint64_t kEveryThirdBit[3] = { 0x9249249249249249ull, 0x2492492492492492ull, 0x4924924924924924ull };
+
+// ---------------------------------------------------------------------------
+// Key layout
+//
+//	The 64 bits of one ttmath word of each axis fill 3 key words. Key bit 3i + a
+//	is bit i of axis a (x = 0), so the bits of an axis start at bit 0, 1 or 2 of
+//	each key word in turn. kKeyLayout[k][a] is where the bits of axis a start in
+//	key word k and which bit of the axis word comes first.
+// ---------------------------------------------------------------------------
+struct KeyLayout
+{
+	int				firstBit;
+	int				axisShift;
+};
+
+static const KeyLayout kKeyLayout[3][3] =
+{
+	{ { 0, 0 },  { 1, 0 },  { 2, 0 } },
+	{ { 2, 22 }, { 0, 21 }, { 1, 21 } },
+	{ { 1, 43 }, { 2, 43 }, { 0, 42 } }
+};
+
+// ---------------------------------------------------------------------------
+// Tables
+//
+//	sSpread:	a byte with its bits spread 3 apart
+//	sHilbert:	for a state of the Hilbert curve and the Morton digits of 2
+//				levels (6 bits, the coarser level on top), the Hilbert digits
+//				in bits 0-5 and the next state times 64 above them, ready to
+//				index the table with. sHilbertInverse goes the other way.
+//
+//	Built once before main() by the constructor of sTables.
+// ---------------------------------------------------------------------------
+static const uint32_t kHilbertStateCount = 24;
+
+static uint32_t sSpread[256];
+static uint16_t sHilbert[kHilbertStateCount * 64];
+static uint16_t sHilbertInverse[kHilbertStateCount * 64];
+
+static inline uint32_t rotateRight3(uint32_t inBits, uint32_t inCount)
+{
+	inCount %= 3;
+	return ((inBits >> inCount) | (inBits << (3 - inCount))) & 7;
+}
+
+static inline uint32_t rotateLeft3(uint32_t inBits, uint32_t inCount)
+{
+	inCount %= 3;
+	return ((inBits << inCount) | (inBits >> (3 - inCount))) & 7;
+}
+
+static inline uint32_t gray3(uint32_t inBits)
+{
+	return inBits ^ (inBits >> 1);
+}
+
+static inline uint32_t trailingOnes(uint32_t inBits)
+{
+	uint32_t count = 0;
+	for ( ; inBits & 1; inBits >>= 1)
+		count++;
+
+	return count;
+}
+
+// ---------------------------------------------------------------------------
+// hilbertStep
+//
+//	One level of the 3D Hilbert curve after Hamilton ("Compact Hilbert
+//	Indices", 2006). The state is the entry corner e and direction d of the
+//	current cell, index e * 3 + d. Going forward inDigit is the octant (Morton
+//	digit) and the result is the Hilbert digit; going back it's the opposite.
+// ---------------------------------------------------------------------------
+static uint32_t hilbertStep(uint32_t& ioState, uint32_t inDigit, bool inForward)
+{
+	uint32_t entry = ioState / 3;
+	uint32_t direction = ioState % 3;
+
+	uint32_t w, octant;
+	if (inForward)
+	{
+		octant = inDigit;
+		uint32_t l = rotateRight3(octant ^ entry, direction + 1);
+		w = l ^ (l >> 1) ^ (l >> 2);		// Inverse Gray code
+	}
+	else
+	{
+		w = inDigit;
+		octant = rotateLeft3(gray3(w), direction + 1) ^ entry;
+	}
+
+	uint32_t wEntry = (w == 0) ? 0 : gray3(2 * ((w - 1) / 2));
+	uint32_t wDirection = (w == 0) ? 0 : (w & 1) ? trailingOnes(w) % 3 : trailingOnes(w - 1) % 3;
+	entry ^= rotateLeft3(wEntry, direction + 1);
+	direction = (direction + wDirection + 1) % 3;
+	ioState = entry * 3 + direction;
+
+	return inForward ? w : octant;
+}
+
+static struct UniversalSpaceKeyTables
+{
+	UniversalSpaceKeyTables()
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			sSpread[i] = 0;
+			for (int bit = 0; bit < 8; bit++)
+				sSpread[i] |= ((i >> bit) & 1) << (3 * bit);
+		}
+
+		for (uint32_t state = 0; state < kHilbertStateCount; state++)
+		{
+			for (uint32_t digits = 0; digits < 64; digits++)
+			{
+				uint32_t forwardState = state, inverseState = state;
+				uint32_t high = hilbertStep(forwardState, digits >> 3, true);
+				uint32_t low = hilbertStep(forwardState, digits & 7, true);
+				sHilbert[state * 64 + digits] = (uint16_t)(((high << 3) | low) | (forwardState << 6));
+
+				high = hilbertStep(inverseState, digits >> 3, false);
+				low = hilbertStep(inverseState, digits & 7, false);
+				sHilbertInverse[state * 64 + digits] = (uint16_t)(((high << 3) | low) | (inverseState << 6));
+			}
+		}
+	}
+} sTables;
+
+// ---------------------------------------------------------------------------
+// Morton keys, table path
+// ---------------------------------------------------------------------------
+
+// The low 22 - (inFirstBit != 0) bits of inBits spread into every third bit from inFirstBit
+static inline uint64_t depositTable(uint64_t inBits, int inFirstBit)
+{
+	uint64_t bits = inBits & ((inFirstBit == 0) ? 0x3fffff : 0x1fffff);
+	uint64_t spread = (uint64_t)sSpread[bits & 0xff] | ((uint64_t)sSpread[(bits >> 8) & 0xff] << 24) |
+					  ((uint64_t)sSpread[bits >> 16] << 48);
+
+	return spread << inFirstBit;
+}
+
+// Every third bit of inWord from inFirstBit, gathered. Shifts and masks do this faster
+// than the 8 lookups a table would take.
+static inline uint64_t gatherEveryThirdBit(uint64_t inWord, int inFirstBit)
+{
+	uint64_t bits = (inWord >> inFirstBit) & kEveryThirdBit[0];
+	bits = (bits ^ (bits >> 2)) & 0x30c30c30c30c30c3ull;
+	bits = (bits ^ (bits >> 4)) & 0xf00f00f00f00f00full;
+	bits = (bits ^ (bits >> 8)) & 0x00ff0000ff0000ffull;
+	bits = (bits ^ (bits >> 16)) & 0xffff00000000ffffull;
+	bits = (bits ^ (bits >> 32)) & 0x3fffff;
+
+	return bits;
+}
+
+static inline void mortonEncodeTable(const uint64_t inAxes[3][2], UniversalSpaceKey& outKey)
+{
+	for (int half = 0; half < 2; half++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			uint64_t word = 0;
+			for (int axis = 0; axis < 3; axis++)
+				word |= depositTable(inAxes[axis][half] >> kKeyLayout[k][axis].axisShift, kKeyLayout[k][axis].firstBit);
+			outKey.word[half * 3 + k] = word;
+		}
+	}
+}
+
+static inline void mortonDecodeTable(const UniversalSpaceKey& inKey, uint64_t outAxes[3][2])
+{
+	for (int half = 0; half < 2; half++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			uint64_t value = 0;
+			for (int k = 0; k < 3; k++)
+				value |= gatherEveryThirdBit(inKey.word[half * 3 + k], kKeyLayout[k][axis].firstBit) << kKeyLayout[k][axis].axisShift;
+			outAxes[axis][half] = value;
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+// hilbertTransform
+//
+//	Turns Morton keys into Hilbert keys (or back, with sHilbertInverse) by
+//	walking the curve down from the coarsest level, 2 levels at a time. The
+//	levels of a key depend on each other, the keys don't: kHilbertLanes keys
+//	are walked side by side so their table lookups overlap.
+// ---------------------------------------------------------------------------
+static const size_t kHilbertLanes = 4;
+
+static inline void hilbertTransform(const uint16_t* inTable, UniversalSpaceKey ioKeys[kHilbertLanes])
+{
+	UniversalSpaceKey result[kHilbertLanes];
+	memset(result, 0, sizeof(result));
+
+	uint32_t state[kHilbertLanes] = { 0, 0, 0, 0 };
+	for (int offset = 384 - 6; offset >= 0; offset -= 6)
+	{
+		// 6 bit groups straddle key words here and there
+		int word = offset >> 6;
+		int shift = offset & 63;
+		if ((shift <= 58) || (word == 5))
+		{
+			for (size_t lane = 0; lane < kHilbertLanes; lane++)
+			{
+				uint32_t entry = inTable[state[lane] | (uint32_t)((ioKeys[lane].word[word] >> shift) & 63)];
+				result[lane].word[word] |= (uint64_t)(entry & 63) << shift;
+				state[lane] = entry & ~63u;
+			}
+		}
+		else
+		{
+			for (size_t lane = 0; lane < kHilbertLanes; lane++)
+			{
+				uint64_t digits = (ioKeys[lane].word[word] >> shift) | (ioKeys[lane].word[word + 1] << (64 - shift));
+				uint32_t entry = inTable[state[lane] | (uint32_t)(digits & 63)];
+				result[lane].word[word] |= (uint64_t)(entry & 63) << shift;
+				result[lane].word[word + 1] |= (uint64_t)(entry & 63) >> (64 - shift);
+				state[lane] = entry & ~63u;
+			}
+		}
+	}
+
+	memcpy(ioKeys, result, sizeof(result));
+}
+
+// ---------------------------------------------------------------------------
+// Points to and from biased axis words: [axis][0] is the low word, [axis][1]
+// the high word with its sign bit flipped.
+// ---------------------------------------------------------------------------
+static inline void getAxes(const UniversalPointArrays& inPoints, size_t inIndex, uint64_t outAxes[3][2])
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		outAxes[axis][0] = inPoints.lo[axis][inIndex];
+		outAxes[axis][1] = (uint64_t)inPoints.hi[axis][inIndex] ^ kSignBit;
+	}
+}
+
+static inline void setAxes(const uint64_t inAxes[3][2], size_t inIndex, uint64_t* outLo[3], int64_t* outHi[3])
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		outLo[axis][inIndex] = inAxes[axis][0];
+		outHi[axis][inIndex] = (int64_t)(inAxes[axis][1] ^ kSignBit);
+	}
+}
+
+void encodeUniversalSpaceKeysTable(const UniversalPointArrays& inPoints, UniversalSpaceCurve inCurve,
+								   UniversalSpaceKey* outKeys)
+{
+	for (size_t begin = 0; begin < inPoints.count; begin += kHilbertLanes)
+	{
+		size_t count = std::min(kHilbertLanes, inPoints.count - begin);
+		UniversalSpaceKey keys[kHilbertLanes];
+		if (count < kHilbertLanes)
+			memset(keys, 0, sizeof(keys));
+		for (size_t lane = 0; lane < count; lane++)
+		{
+			uint64_t axes[3][2];
+			getAxes(inPoints, begin + lane, axes);
+			mortonEncodeTable(axes, keys[lane]);
+		}
+		if (inCurve == eSpaceCurveHilbert)
+			hilbertTransform(sHilbert, keys);
+		memcpy(outKeys + begin, keys, count * sizeof(UniversalSpaceKey));
+	}
+}
+
+void decodeUniversalSpaceKeysTable(const UniversalSpaceKey* inKeys, size_t inCount, UniversalSpaceCurve inCurve,
+								   uint64_t* outLo[3], int64_t* outHi[3])
+{
+	for (size_t begin = 0; begin < inCount; begin += kHilbertLanes)
+	{
+		size_t count = std::min(kHilbertLanes, inCount - begin);
+		UniversalSpaceKey keys[kHilbertLanes];
+		if (count < kHilbertLanes)
+			memset(keys, 0, sizeof(keys));
+		memcpy(keys, inKeys + begin, count * sizeof(UniversalSpaceKey));
+		if (inCurve == eSpaceCurveHilbert)
+			hilbertTransform(sHilbertInverse, keys);
+		for (size_t lane = 0; lane < count; lane++)
+		{
+			uint64_t axes[3][2];
+			mortonDecodeTable(keys[lane], axes);
+			setAxes(axes, begin + lane, outLo, outHi);
+		}
+	}
+}
+
+#ifdef UNIVERSAL_SPACE_KEY_BMI2
+
+bool universalSpaceKeyHasBMI2()
+{
+	static int sHasBMI2 = -1;
+	if (sHasBMI2 < 0)
+	{
+		// PDEP and PEXT are microcoded on AMD before Zen 3 (family 19h), slower than the tables
+		uint32_t info[4] = { 0, 0, 0, 0 };
+		char vendor[13];
+#ifdef _MSC_VER
+		__cpuid((int*)info, 0);
+#else
+		__cpuid(0, info[0], info[1], info[2], info[3]);
+#endif
+		uint32_t maxLeaf = info[0];
+		memcpy(vendor, &info[1], 4);
+		memcpy(vendor + 4, &info[3], 4);
+		memcpy(vendor + 8, &info[2], 4);
+		vendor[12] = 0;
+
+		bool hasBMI2 = false;
+		if (maxLeaf >= 7)
+		{
+#ifdef _MSC_VER
+			__cpuid((int*)info, 1);
+#else
+			__cpuid(1, info[0], info[1], info[2], info[3]);
+#endif
+			uint32_t family = ((info[0] >> 8) & 0xf) + (((info[0] >> 8) & 0xf) == 0xf ? ((info[0] >> 20) & 0xff) : 0);
+			bool slowBMI2 = (strcmp(vendor, "AuthenticAMD") == 0) && (family < 0x19);
+
+#ifdef _MSC_VER
+			__cpuidex((int*)info, 7, 0);
+#else
+			__cpuid_count(7, 0, info[0], info[1], info[2], info[3]);
+#endif
+			hasBMI2 = ((info[1] & (1 << 8)) != 0) && !slowBMI2;
+		}
+		sHasBMI2 = hasBMI2 ? 1 : 0;
+	}
+
+	return (sHasBMI2 == 1);
+}
+
+BMI2_TARGET static inline void mortonEncodeBMI2(const uint64_t inAxes[3][2], UniversalSpaceKey& outKey)
+{
+	for (int half = 0; half < 2; half++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			uint64_t word = 0;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const KeyLayout& layout = kKeyLayout[k][axis];
+				word |= _pdep_u64(inAxes[axis][half] >> layout.axisShift, kEveryThirdBit[layout.firstBit]);
+			}
+			outKey.word[half * 3 + k] = word;
+		}
+	}
+}
+
+BMI2_TARGET static inline void mortonDecodeBMI2(const UniversalSpaceKey& inKey, uint64_t outAxes[3][2])
+{
+	for (int half = 0; half < 2; half++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			uint64_t value = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				const KeyLayout& layout = kKeyLayout[k][axis];
+				value |= _pext_u64(inKey.word[half * 3 + k], kEveryThirdBit[layout.firstBit]) << layout.axisShift;
+			}
+			outAxes[axis][half] = value;
+		}
+	}
+}
+
+BMI2_TARGET static void encodeUniversalSpaceKeysBMI2(const UniversalPointArrays& inPoints, UniversalSpaceCurve inCurve,
+													 UniversalSpaceKey* outKeys)
+{
+	for (size_t begin = 0; begin < inPoints.count; begin += kHilbertLanes)
+	{
+		size_t count = std::min(kHilbertLanes, inPoints.count - begin);
+		UniversalSpaceKey keys[kHilbertLanes];
+		if (count < kHilbertLanes)
+			memset(keys, 0, sizeof(keys));
+		for (size_t lane = 0; lane < count; lane++)
+		{
+			uint64_t axes[3][2];
+			getAxes(inPoints, begin + lane, axes);
+			mortonEncodeBMI2(axes, keys[lane]);
+		}
+		if (inCurve == eSpaceCurveHilbert)
+			hilbertTransform(sHilbert, keys);
+		memcpy(outKeys + begin, keys, count * sizeof(UniversalSpaceKey));
+	}
+}
+
+BMI2_TARGET static void decodeUniversalSpaceKeysBMI2(const UniversalSpaceKey* inKeys, size_t inCount, UniversalSpaceCurve inCurve,
+													 uint64_t* outLo[3], int64_t* outHi[3])
+{
+	for (size_t begin = 0; begin < inCount; begin += kHilbertLanes)
+	{
+		size_t count = std::min(kHilbertLanes, inCount - begin);
+		UniversalSpaceKey keys[kHilbertLanes];
+		if (count < kHilbertLanes)
+			memset(keys, 0, sizeof(keys));
+		memcpy(keys, inKeys + begin, count * sizeof(UniversalSpaceKey));
+		if (inCurve == eSpaceCurveHilbert)
+			hilbertTransform(sHilbertInverse, keys);
+		for (size_t lane = 0; lane < count; lane++)
+		{
+			uint64_t axes[3][2];
+			mortonDecodeBMI2(keys[lane], axes);
+			setAxes(axes, begin + lane, outLo, outHi);
+		}
+	}
+}
+
+void encodeUniversalSpaceKeys(const UniversalPointArrays& inPoints, UniversalSpaceCurve inCurve,
+							  UniversalSpaceKey* outKeys)
+{
+	if (universalSpaceKeyHasBMI2())
+		encodeUniversalSpaceKeysBMI2(inPoints, inCurve, outKeys);
+	else
+		encodeUniversalSpaceKeysTable(inPoints, inCurve, outKeys);
+}
+
+void decodeUniversalSpaceKeys(const UniversalSpaceKey* inKeys, size_t inCount, UniversalSpaceCurve inCurve,
+							  uint64_t* outLo[3], int64_t* outHi[3])
+{
+	if (universalSpaceKeyHasBMI2())
+		decodeUniversalSpaceKeysBMI2(inKeys, inCount, inCurve, outLo, outHi);
+	else
+		decodeUniversalSpaceKeysTable(inKeys, inCount, inCurve, outLo, outHi);
+}
+
+#else
+
+bool universalSpaceKeyHasBMI2()
+{
+	return false;
+}
+
+void encodeUniversalSpaceKeys(const UniversalPointArrays& inPoints, UniversalSpaceCurve inCurve,
+							  UniversalSpaceKey* outKeys)
+{
+	encodeUniversalSpaceKeysTable(inPoints, inCurve, outKeys);
+}
+
+void decodeUniversalSpaceKeys(const UniversalSpaceKey* inKeys, size_t inCount, UniversalSpaceCurve inCurve,
+							  uint64_t* outLo[3], int64_t* outHi[3])
+{
+	decodeUniversalSpaceKeysTable(inKeys, inCount, inCurve, outLo, outHi);
+}
+
+#endif
+
+struct KeyedIndex
+{
+	UniversalSpaceKey	key;
+	uint32_t			index;
+};
+
+static bool keyedIndexBefore(const KeyedIndex& a, const KeyedIndex& b)
+{
+	return a.key < b.key;
+}
+
+void getUniversalSpaceKeyOrder(const UniversalPointArrays& inPoints, UniversalSpaceCurve inCurve,
+							   std::vector<uint32_t>& outOrder)
+{
+	// Keys are made in blocks so the points are read once, in order
+	const size_t kBlockCount = 256;
+	UniversalSpaceKey keys[kBlockCount];
+
+	std::vector<KeyedIndex> keyed(inPoints.count);
+	for (size_t begin = 0; begin < inPoints.count; begin += kBlockCount)
+	{
+		UniversalPointArrays block = inPoints;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			block.lo[axis] += begin;
+			block.hi[axis] += begin;
+		}
+		block.count = std::min(kBlockCount, inPoints.count - begin);
+		encodeUniversalSpaceKeys(block, inCurve, keys);
+
+		for (size_t i = 0; i < block.count; i++)
+		{
+			keyed[begin + i].key = keys[i];
+			keyed[begin + i].index = (uint32_t)(begin + i);
+		}
+	}
+
+	std::sort(keyed.begin(), keyed.end(), keyedIndexBefore);
+
+	outOrder.resize(inPoints.count);
+	for (size_t i = 0; i < inPoints.count; i++)
+		outOrder[i] = keyed[i].index;
+}
@@ -0,0 +1,109 @@
+//----------------------------------------------------------------------
+//	File:		UniversalSpaceKey.h
+//
+//	Contains:	Morton and Hilbert keys over 128-bit universal coordinates
+//				for sorting and bucketing objects by locality.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "UniversalPointBatch.h"
+
+//----------------------------------------------------------------------
+//	Struct:		UniversalSpaceKey
+//
+//	Purpose:	384-bit space-filling curve key: 3 bits for every one of the
+//				128 bits of each axis. word[0] holds the least significant
+//				bits, so level i of the curve (counting from the finest) is
+//				bits 3i to 3i + 2.
+//
+//				Coordinates are made unsigned by flipping their sign bit, which
+//				keeps their order. Any prefix of a key is the key of the
+//				enclosing cell on a coarser grid, so sorting by the top bits
+//				alone (getUniversalSpaceKeyTop()) buckets by cells.
+//
+//----------------------------------------------------------------------
+struct UniversalSpaceKey
+{
+	uint64_t		word[6];
+};
+
+inline bool operator<(const UniversalSpaceKey& a, const UniversalSpaceKey& b)
+{
+	for (int i = 5; i > 0; i--)
+	{
+		if (a.word[i] != b.word[i])
+			return a.word[i] < b.word[i];
+	}
+
+	return a.word[0] < b.word[0];
+}
+
+inline bool operator==(const UniversalSpaceKey& a, const UniversalSpaceKey& b)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (a.word[i] != b.word[i])
+			return false;
+	}
+
+	return true;
+}
+
+// The top 64 bits of the key: the cell on level 21 of the curve plus one bit
+inline uint64_t getUniversalSpaceKeyTop(const UniversalSpaceKey& inKey)
+{
+	return inKey.word[5];
+}
+
+enum UniversalSpaceCurve
+{
+	eSpaceCurveMorton,		// Z order: cheap, but jumps across the cell at every level
+	eSpaceCurveHilbert		// Consecutive keys are always adjacent cells
+};
+
+// Keys for every point of inPoints, written to outKeys (inPoints.count keys).
+// Uses BMI2 (PDEP) when the CPU has it and it is fast, tables otherwise.
+void	encodeUniversalSpaceKeys(const UniversalPointArrays& inPoints, UniversalSpaceCurve inCurve,
+								 UniversalSpaceKey* outKeys);
+
+// The points back from inCount keys, split into words as in UniversalPointArrays
+void	decodeUniversalSpaceKeys(const UniversalSpaceKey* inKeys, size_t inCount, UniversalSpaceCurve inCurve,
+								 uint64_t* outLo[3], int64_t* outHi[3]);
+
+// Indices of inPoints in curve order: traversing them in this order, or reordering a
+// catalog by it, keeps neighbours in space close in memory and on disk.
+void	getUniversalSpaceKeyOrder(const UniversalPointArrays& inPoints, UniversalSpaceCurve inCurve,
+								  std::vector<uint32_t>& outOrder);
+
+// The individual paths, for testing and benchmarking
+void	encodeUniversalSpaceKeysTable(const UniversalPointArrays& inPoints, UniversalSpaceCurve inCurve,
+									  UniversalSpaceKey* outKeys);
+void	decodeUniversalSpaceKeysTable(const UniversalSpaceKey* inKeys, size_t inCount, UniversalSpaceCurve inCurve,
+									  uint64_t* outLo[3], int64_t* outHi[3]);
+bool	universalSpaceKeyHasBMI2();
+
+//----------------------------------------------------------------------
+//	Function:	getUniversalSpaceKey
+//
+//	Purpose:	Key of a single point. inPoint is a TUniversalVector3, or
+//				anything else with x, y and z ttmath::Int<2> members.
+//----------------------------------------------------------------------
+template<class UniversalVector>
+UniversalSpaceKey getUniversalSpaceKey(const UniversalVector& inPoint, UniversalSpaceCurve inCurve)
+{
+	uint64_t lo[3] = { inPoint.x.table[0], inPoint.y.table[0], inPoint.z.table[0] };
+	int64_t hi[3] = { (int64_t)inPoint.x.table[1], (int64_t)inPoint.y.table[1], (int64_t)inPoint.z.table[1] };
+	UniversalPointArrays point = { { &lo[0], &lo[1], &lo[2] }, { &hi[0], &hi[1], &hi[2] }, 1 };
+
+	UniversalSpaceKey result;
+	encodeUniversalSpaceKeys(point, inCurve, &result);
+
+	return result;
+}
@@ -0,0 +1,121 @@
+//----------------------------------------------------------------------
+//	File:		UniversalSplit.h
+//
+//	Contains:	Split encoding of universal coordinates into floats so the
+//				vertex shader can make positions relative to the viewer.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include "UniversalCoord.h"
+
+// Each universal coordinate is sent to the GPU as kUniversalSplitChunkCount floats:
+//
+//		value = c0 + c1 * 2^24 + c2 * 2^48 + c3 * 2^72 + c4 * 2^96
+//
+// Every chunk is an integer in [-2^23, 2^23), so it is exact in a float, and so is the
+// difference between a vertex chunk and the matching viewer chunk. The vertex shader subtracts
+// the viewer chunk by chunk and sums the differences from the top. Near the viewer the higher
+// differences are zero and the offset is exact; further away the error is a few float ulps of
+// the distance, which is all a float position can hold anyway. 5 chunks cover +/-2^119 mm,
+// far beyond the radius of the observable Universe (~2^99 mm).
+const int kUniversalSplitChunkCount = 5;
+const int kUniversalSplitChunkBits = 24;
+const float kUniversalSplitChunkScale = 16777216.0f;	// 2^kUniversalSplitChunkBits
+
+//----------------------------------------------------------------------
+//	Struct:		UniversalSplitVertex
+//
+//	Purpose:	Vertex attributes of a split position: one x,y,z triple per
+//				chunk (attribute aUniversalChunk0 holds chunk[0] and so on).
+//				The viewer is split the same way for uViewerChunks.
+//
+//----------------------------------------------------------------------
+struct UniversalSplitVertex
+{
+	float	chunk[kUniversalSplitChunkCount][3];
+};
+
+//----------------------------------------------------------------------
+//	Function:	splitUniversalCoord
+//
+//	Purpose:	Splits one coordinate into chunks. Returns false if the value
+//				needs more than kUniversalSplitChunkCount chunks.
+//----------------------------------------------------------------------
+inline bool splitUniversalCoord(const UniversalCoord& inValue, float outChunks[kUniversalSplitChunkCount])
+{
+	const int kWordBits = TTMATH_BITS_PER_UINT;
+
+	UniversalCoord rest(inValue);
+	for (int i = 0; i < kUniversalSplitChunkCount; i++)
+	{
+		// The lowest bits, sign extended. Taking them out leaves a multiple of 2^24 which
+		// is shifted down exactly.
+		ttmath::sint chunk = (ttmath::sint)(rest.table[0] << (kWordBits - kUniversalSplitChunkBits)) >> (kWordBits - kUniversalSplitChunkBits);
+		outChunks[i] = (float)chunk;
+
+		rest.Sub(UniversalCoord(chunk));
+		rest.Rcr(kUniversalSplitChunkBits, rest.IsSign() ? 1 : 0);
+	}
+
+	return rest.IsZero();
+}
+
+inline bool splitUniversalCoords(const UniversalCoord& inX, const UniversalCoord& inY, const UniversalCoord& inZ,
+								 UniversalSplitVertex& outVertex)
+{
+	const UniversalCoord* axes[3] = { &inX, &inY, &inZ };
+
+	bool result = true;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float chunks[kUniversalSplitChunkCount];
+		result &= splitUniversalCoord(*axes[axis], chunks);
+		for (int i = 0; i < kUniversalSplitChunkCount; i++)
+			outVertex.chunk[i][axis] = chunks[i];
+	}
+
+	return result;
+}
+
+//----------------------------------------------------------------------
+//	Function:	universalSplitRelativeToViewer
+//
+//	Purpose:	CPU reference of the shader function in kUniversalSplitGLSL.
+//				Performs the same float operations in the same order, so
+//				the results can be compared with the GPU bit for bit.
+//----------------------------------------------------------------------
+inline void universalSplitRelativeToViewer(const UniversalSplitVertex& inVertex, const UniversalSplitVertex& inViewer,
+										   float outOffset[3])
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		int i = kUniversalSplitChunkCount - 1;
+		float offset = inVertex.chunk[i][axis] - inViewer.chunk[i][axis];
+		for (i--; i >= 0; i--)
+			offset = offset * kUniversalSplitChunkScale + (inVertex.chunk[i][axis] - inViewer.chunk[i][axis]);
+
+		outOffset[axis] = offset;
+	}
+}
+
+// GLSL for vertex shaders. Insert it after the shader's #version line (4.00 or later, for
+// the precise qualifier: without it compilers are free to reassociate the sum, which undoes
+// the cancellation of the viewer's chunks) and call universalRelativeToViewer() with the chunk
+// attributes; the result is in millimetres.
+const char kUniversalSplitGLSL[] =
+	"uniform vec3 uViewerChunks[5];\n"
+	"\n"
+	"vec3 universalRelativeToViewer(vec3 inChunk0, vec3 inChunk1, vec3 inChunk2, vec3 inChunk3, vec3 inChunk4)\n"
+	"{\n"
+	"	const float kChunkScale = 16777216.0;\n"
+	"	precise vec3 offset = inChunk4 - uViewerChunks[4];\n"
+	"	offset = offset * kChunkScale + (inChunk3 - uViewerChunks[3]);\n"
+	"	offset = offset * kChunkScale + (inChunk2 - uViewerChunks[2]);\n"
+	"	offset = offset * kChunkScale + (inChunk1 - uViewerChunks[1]);\n"
+	"	offset = offset * kChunkScale + (inChunk0 - uViewerChunks[0]);\n"
+	"	return offset;\n"
+	"}\n";
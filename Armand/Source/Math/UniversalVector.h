@@ -0,0 +1,152 @@
+//----------------------------------------------------------------------
+//	File:		UniversalVector.h
+//
+//	Contains:	128-bit integer vector type for universal coordinates.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include "UniversalCoord.h"
+#include "VectorTemplates.h"
+
+//----------------------------------------------------------------------
+//	Class:		TUniversalVector3
+//
+//	Purpose:	3-component vector of universal coordinates (millimetres).
+//				Addition, subtraction and integer scaling are exact. Positions are
+//				only converted to floating point after the viewer has been subtracted,
+//				so precision is kept wherever the viewer goes.
+//
+//----------------------------------------------------------------------
+class TUniversalVector3
+{
+	public:
+		inline TUniversalVector3();
+		inline TUniversalVector3(const UniversalCoord&, const UniversalCoord&, const UniversalCoord&);
+		inline explicit TUniversalVector3(const TVector3d&);
+
+		inline TUniversalVector3& operator+=(const TUniversalVector3&);
+		inline TUniversalVector3& operator-=(const TUniversalVector3&);
+		inline TUniversalVector3& operator*=(ttmath::sint);
+		inline TUniversalVector3& operator/=(ttmath::sint);
+		inline TUniversalVector3 operator-() const;
+		inline TUniversalVector3 operator+() const;
+
+		// (this - inOrigin) * inScale, computed exactly before the conversion
+		inline TVector3d toVector3d(const TUniversalVector3& inOrigin, double inScale = 1.0) const;
+		inline TVector3f toVector3f(const TUniversalVector3& inOrigin, double inScale = 1.0) const;
+		inline TVector3d toVector3d(double inScale = 1.0) const;
+
+		UniversalCoord x, y, z;
+};
+
+inline TUniversalVector3::TUniversalVector3() : x(0), y(0), z(0)
+{
+}
+
+inline TUniversalVector3::TUniversalVector3(const UniversalCoord& inX, const UniversalCoord& inY, const UniversalCoord& inZ) : x(inX), y(inY), z(inZ)
+{
+}
+
+inline TUniversalVector3::TUniversalVector3(const TVector3d& a)
+{
+	x = universalCoordFromDouble(a.x);
+	y = universalCoordFromDouble(a.y);
+	z = universalCoordFromDouble(a.z);
+}
+
+inline TUniversalVector3& TUniversalVector3::operator+=(const TUniversalVector3& a)
+{
+	x.Add(a.x); y.Add(a.y); z.Add(a.z);
+	return *this;
+}
+
+inline TUniversalVector3& TUniversalVector3::operator-=(const TUniversalVector3& a)
+{
+	x.Sub(a.x); y.Sub(a.y); z.Sub(a.z);
+	return *this;
+}
+
+inline TUniversalVector3& TUniversalVector3::operator*=(ttmath::sint s)
+{
+	x.MulInt(s); y.MulInt(s); z.MulInt(s);
+	return *this;
+}
+
+inline TUniversalVector3& TUniversalVector3::operator/=(ttmath::sint s)
+{
+	x.DivInt(s); y.DivInt(s); z.DivInt(s);
+	return *this;
+}
+
+inline TUniversalVector3 TUniversalVector3::operator-() const
+{
+	return TUniversalVector3(-x, -y, -z);
+}
+
+inline TUniversalVector3 TUniversalVector3::operator+() const
+{
+	return *this;
+}
+
+inline TVector3d TUniversalVector3::toVector3d(const TUniversalVector3& inOrigin, double inScale) const
+{
+	UniversalCoord dx(x), dy(y), dz(z);
+	dx.Sub(inOrigin.x);
+	dy.Sub(inOrigin.y);
+	dz.Sub(inOrigin.z);
+
+	return TVector3d(universalCoordToDouble(dx) * inScale,
+					 universalCoordToDouble(dy) * inScale,
+					 universalCoordToDouble(dz) * inScale);
+}
+
+inline TVector3f TUniversalVector3::toVector3f(const TUniversalVector3& inOrigin, double inScale) const
+{
+	TVector3d v = toVector3d(inOrigin, inScale);
+	return TVector3f((GLfloat)v.x, (GLfloat)v.y, (GLfloat)v.z);
+}
+
+inline TVector3d TUniversalVector3::toVector3d(double inScale) const
+{
+	return TVector3d(universalCoordToDouble(x) * inScale,
+					 universalCoordToDouble(y) * inScale,
+					 universalCoordToDouble(z) * inScale);
+}
+
+inline TUniversalVector3 operator+(const TUniversalVector3& a, const TUniversalVector3& b)
+{
+	TUniversalVector3 result(a);
+	return result += b;
+}
+
+inline TUniversalVector3 operator-(const TUniversalVector3& a, const TUniversalVector3& b)
+{
+	TUniversalVector3 result(a);
+	return result -= b;
+}
+
+inline TUniversalVector3 operator*(ttmath::sint s, const TUniversalVector3& v)
+{
+	TUniversalVector3 result(v);
+	return result *= s;
+}
+
+inline TUniversalVector3 operator*(const TUniversalVector3& v, ttmath::sint s)
+{
+	TUniversalVector3 result(v);
+	return result *= s;
+}
+
+inline bool operator==(const TUniversalVector3& a, const TUniversalVector3& b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+inline bool operator!=(const TUniversalVector3& a, const TUniversalVector3& b)
+{
+	return a.x != b.x || a.y != b.y || a.z != b.z;
+}
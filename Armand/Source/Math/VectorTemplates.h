@@ -1016,6 +1016,7 @@ typedef TVector3Template<GLdouble> TVector3d;
 
 typedef TMatrix2Template<GLfloat> TMatrix2f;
 typedef TMatrix3Template<GLfloat> TMatrix3f;
+typedef TMatrix3Template<GLdouble> TMatrix3d;
 typedef TMatrix4Template<GLfloat> TMatrix4f;
 
 typedef TPolar3Template<GLfloat> TPolar3f;
@@ -3,6 +3,14 @@
 
 bool OpenGLWindow::sEnabledGLExtensions = false;
 
+// Vertical field of view of the perspective projection, in degrees
+const double kFieldOfViewY = 45.0;
+
+// Hover picks look this many pixels around the mouse, visiting no more than this many
+// octree nodes a frame
+const double kHoverTolerance = 3.0;
+const size_t kHoverNodeBudget = 2000;
+
 OpenGLWindow::OpenGLWindow() : mCreated(false),
 							   mGLInitialized(false),
 							   mHasMultisampleBuffer(false),
@@ -16,8 +24,11 @@ OpenGLWindow::OpenGLWindow() : mCreated(false),
 							   mAverageRenderedFrameRate(1.0/60.0),
 							   mLastKeyboardResponseSeconds(0.0),
 							   mLastMouseMoveSeconds(0.0),
+							   mMouseButtonDown(false),
 							   mGazePolar(1.0, 0.0, 0.0),
 							   mLightPolar(1.0, 0.0, kHalfPi),
+							   mPickOctree(NULL),
+							   mHoveredObject(kNoObject),
 							   mShowCoordinateAxes(true)
 {
 	// Get the high resolution counter's accuracy
@@ -26,6 +37,8 @@ OpenGLWindow::OpenGLWindow() : mCreated(false),
 	memset(mKeys, 0, sizeof(mKeys));
 	mLastMousePosition.x = 0;
 	mLastMousePosition.y = 0;
+
+	mPicker.setNodeBudget(kHoverNodeBudget);
 }
 
 OpenGLWindow::~OpenGLWindow()
@@ -72,12 +85,48 @@ void OpenGLWindow::mouseEvent(WORD inXPos, WORD inYPos, bool inCtrlDown, bool in
 	mLastMouseMoveSeconds = currentSeconds;
 	mLastMousePosition.x = inXPos;
 	mLastMousePosition.y = inYPos;
+	mMouseButtonDown = inLeftDown || inMiddleDown || inRightDown;
 
 
 	// Dispatch mouse event to OpenGLRender module
 //	mouseEventCallback((unsigned int)inXPos, (unsigned int)inYPos, inCtrlDown, inShiftDown, inLeftDown, inMiddleDown, inRightDown);
 }
 
+void OpenGLWindow::setPickOctree(const UniversalOctree* inOctree)
+{
+	mPickOctree = inOctree;
+	mPicker.invalidate();
+	mHoveredObject = kNoObject;
+}
+
+// ---------------------------------------------------------------------------
+// OpenGLWindow::updateHover											  [protected]
+//
+//	Picks along the mouse position, in the directions the modelview rotation
+//	of render() gives the view. The picker starts again by itself when the
+//	mouse, the view or the viewer moved, and otherwise carries on from the
+//	last frame until it has an answer.
+// ---------------------------------------------------------------------------
+void OpenGLWindow::updateHover()
+{
+	if ((mPickOctree == NULL) || mMouseButtonDown)
+	{
+		mHoveredObject = kNoObject;
+		return;
+	}
+
+	double cosLatitude = cos(mGazePolar.fLatitude), sinLatitude = sin(mGazePolar.fLatitude);
+	double cosLongitude = cos(mGazePolar.fLongitude), sinLongitude = sin(mGazePolar.fLongitude);
+	TVector3d gaze(cosLatitude * sinLongitude, -sinLatitude, -cosLatitude * cosLongitude);
+	TVector3d up(sinLatitude * sinLongitude, cosLatitude, -sinLatitude * cosLongitude);
+	mPicker.setPerspective(gaze, up, kFieldOfViewY * kRadPerDegree, mWindowSize.cx, mWindowSize.cy);
+
+	PickResult result;
+	if (mPicker.pick(*mPickOctree, mViewerLocation, mLastMousePosition.x, mLastMousePosition.y, kHoverTolerance,
+					 ePickBrightest, result))
+		mHoveredObject = result.object;
+}
+
 void OpenGLWindow::mouseWheelEvent(double inWheelDelta)
 {
 	// Dispatch mouse wheel event to OpenGLRender module
@@ -143,8 +192,7 @@ void OpenGLWindow::handleKeys()
 		// Update the position by the current viewer speed
 		TVector3d forwardVector = mGazeVector * mViewerSpeed.x;
 		TVector3d strafeDirection = getStrafeVector() * mViewerSpeed.y;
-		mViewerLocation += forwardVector;
-		mViewerLocation += strafeDirection;
+		mViewerLocation += TUniversalVector3((forwardVector + strafeDirection) * kMillimetresPerGLUnit);
 
 		// Decrease the speed every frame
 		const double kBrakingFactor = 0.05;
@@ -651,7 +699,7 @@ void OpenGLWindow::resizeGLScene(GLsizei inWidth, GLsizei inHeight)		// Resize a
 
 	// Calculate the aspect ratio of the window
 	GLfloat aspectRatio = (GLfloat)mWindowSize.cx / (GLfloat)mWindowSize.cy;
-	gluPerspective(45.0f, aspectRatio, 0.1f, 200.0f);
+	gluPerspective((GLfloat)kFieldOfViewY, aspectRatio, 0.1f, 200.0f);
 
 	glMatrixMode(GL_MODELVIEW);							// Select the modelview matrix
 	glLoadIdentity();									// Reset the modelview matrix
@@ -733,8 +781,13 @@ void OpenGLWindow::render()								// Here's where we do all the drawing
 	glRotated(mGazePolar.fLatitude * kDegPerRadian, 1.0f, 0.0f, 0.0f);
 	glRotated(mGazePolar.fLongitude * kDegPerRadian, 0.0f, 1.0f, 0.0f);
 
-	// Translate to observer's position
-	glTranslated(-mViewerLocation.x, -mViewerLocation.y, -mViewerLocation.z);
+	// Translate to observer's position. The universal origin is moved relative to the viewer
+	// in 128-bit integers, only the difference is converted to floating point.
+	TVector3d originRelativeToViewer = TUniversalVector3().toVector3d(mViewerLocation, kGLUnitsPerMillimetre);
+	glTranslated(originRelativeToViewer.x, originRelativeToViewer.y, originRelativeToViewer.z);
+
+	// Look for the object under the mouse
+	updateHover();
 
 	// Call the render function
 //	openGLRenderCallback();
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "ObjectPicker.h"
+
 #define			kPiDefine				3.14159265358979323846	// pi base unit used to calculate others
 const double	kPi						= kPiDefine;
 const double	kOneOverPi				= 1.0/kPiDefine;
@@ -12,6 +14,11 @@ const double	k3PiBy2					= 3.0*kPiDefine/2.0;
 const double	kRadPerDegree			= kPiDefine/180.0;
 const double	kDegPerRadian			= 180.0/kPiDefine;
 
+// The viewer always sits at the OpenGL origin. Universal coordinates (millimetres) are
+// converted to OpenGL units (metres) only after the viewer location has been subtracted.
+const double	kGLUnitsPerMillimetre	= 0.001;
+const double	kMillimetresPerGLUnit	= 1000.0;
+
 class OpenGLWindow
 {
 	public:
@@ -39,13 +46,21 @@ class OpenGLWindow
 		void			keyboardKeyDown(WPARAM inKey);
 		void			keyboardKeyUp(WPARAM inKey);
 		bool*			getKeys() { return mKeys; };
+		TVector2i		getMousePosition() const { return mLastMousePosition; };	// For picking, see ObjectPicker
+
+		// Hover picking: while no button is down, render() looks for the object of inOctree
+		// under the mouse, spending at most a slice of each frame on it. Set the picker's
+		// magnitudes and offsets through getPicker().
+		void			setPickOctree(const UniversalOctree* inOctree);
+		ObjectPicker&	getPicker() { return mPicker; };
+		ObjectIndex		getHoveredObject() const { return mHoveredObject; };
 		
 		// Viewer state
 		void			getGazeAngles(double& ioAzimuth, double& ioAltitude) const;
 		TVector3d		getGazeVector() const { return mGazeVector; };
 		TVector3d		getStrafeVector() const;
-		TVector3d		getViewerLocation() const { return mViewerLocation; };
-		void			setViewerLocation(const TVector3d inViewerLocation) { mViewerLocation = inViewerLocation; };
+		TUniversalVector3	getViewerLocation() const { return mViewerLocation; };
+		void			setViewerLocation(const TUniversalVector3& inViewerLocation) { mViewerLocation = inViewerLocation; };
 		void			setViewerDirection(const TVector3d inViewerDirection);
 
 		// Harness state
@@ -63,6 +78,7 @@ class OpenGLWindow
 		void			renderCoordinateAxes() const;
 		double			getCurrentSeconds() const;
 		void			handleKeys();
+		void			updateHover();
 		void			DecelerateFunction(TVector2d& ioVector, const double inBrakingFactor);
 
 		bool			mCreated;
@@ -93,12 +109,18 @@ class OpenGLWindow
 		// Mouse input
 		double			mLastMouseMoveSeconds;
 		TVector2i		mLastMousePosition;
+		bool			mMouseButtonDown;
 		TPolar3d		mGazePolar;
 		TVector3d		mGazeVector;
 		TPolar3d		mLightPolar;
 		TVector3f		mLightVector;
 
-		TVector3d		mViewerLocation;
+		TUniversalVector3	mViewerLocation;	// Millimetres
+
+		// Hover picking
+		ObjectPicker		mPicker;
+		const UniversalOctree*	mPickOctree;
+		ObjectIndex			mHoveredObject;
 
 		bool			mShowCoordinateAxes;
 		TVector3f		mClearColor;
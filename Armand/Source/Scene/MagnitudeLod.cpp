@@ -0,0 +1,138 @@
+#include "stdafx.h"
+#include "MagnitudeLod.h"
+#include <float.h>
+#include <algorithm>
+
+MagnitudeLod::MagnitudeLod() : mMagnitudeLimit(6.5),
+							   mAggregateAngle(0.002)
+{
+}
+
+void MagnitudeLod::clear()
+{
+	mBrightest.clear();
+	mLuminosity.clear();
+	mColour.clear();
+	mCentroid.clear();
+}
+
+// ---------------------------------------------------------------------------
+// MagnitudeLod::rebuild
+//
+//	Children are always created after their parent, so walking the nodes
+//	backwards finishes every subtree before the node above it.
+// ---------------------------------------------------------------------------
+void MagnitudeLod::rebuild(const UniversalOctree& inOctree, const float* inAbsoluteMagnitudes, const float* inColours)
+{
+	const size_t nodeCount = inOctree.getNodeCount();
+	mBrightest.assign(nodeCount, FLT_MAX);
+	mLuminosity.assign(nodeCount, 0.0);
+	mColour.assign(nodeCount * 3, 1.0f);
+	mCentroid.assign(nodeCount * 3, 0.0f);
+
+	// Luminosity-weighted sums of the colours and of the positions relative to the node
+	std::vector<double> colourSum(nodeCount * 3, 0.0);
+	std::vector<double> positionSum(nodeCount * 3, 0.0);
+
+	for (size_t i = nodeCount; i-- > 0; )
+	{
+		uint32_t node = (uint32_t)i;
+		if (inOctree.getNodeSubtreeObjectCount(node) == 0)
+			continue;
+
+		float brightest = FLT_MAX;
+		double luminosity = 0.0;
+		double colour[3] = { 0.0, 0.0, 0.0 };
+		TVector3d position;
+
+		for (ObjectIndex object = inOctree.getNodeFirstObject(node); object != kNoObject; object = inOctree.getNextObject(object))
+		{
+			float magnitude = inAbsoluteMagnitudes[object];
+			double objectLuminosity = pow(10.0, -0.4 * magnitude);
+			brightest = std::min(brightest, magnitude);
+			luminosity += objectLuminosity;
+			for (int channel = 0; channel < 3; channel++)
+				colour[channel] += objectLuminosity * (inColours ? inColours[object * 3 + channel] : 1.0f);
+			position += objectLuminosity * inOctree.getObjectOffset(object);
+		}
+
+		uint32_t firstChild = inOctree.getNodeFirstChild(node);
+		if (firstChild != kNoOctreeNode)
+		{
+			TUniversalVector3 center = inOctree.getNodeCenter(node);
+			for (uint32_t child = firstChild; child < firstChild + 8; child++)
+			{
+				if (mLuminosity[child] == 0.0)
+					continue;
+
+				// The child's sums are relative to its own centre
+				TVector3d childOffset = inOctree.getNodeCenter(child).toVector3d(center);
+				brightest = std::min(brightest, mBrightest[child]);
+				luminosity += mLuminosity[child];
+				for (int channel = 0; channel < 3; channel++)
+					colour[channel] += colourSum[child * 3 + channel];
+				position += TVector3d(positionSum[child * 3], positionSum[child * 3 + 1], positionSum[child * 3 + 2]);
+				position += mLuminosity[child] * childOffset;
+			}
+		}
+
+		mBrightest[node] = brightest;
+		mLuminosity[node] = luminosity;
+		if (luminosity > 0.0)
+		{
+			colourSum[node * 3] = colour[0];
+			colourSum[node * 3 + 1] = colour[1];
+			colourSum[node * 3 + 2] = colour[2];
+			positionSum[node * 3] = position.x;
+			positionSum[node * 3 + 1] = position.y;
+			positionSum[node * 3 + 2] = position.z;
+
+			for (int channel = 0; channel < 3; channel++)
+				mColour[node * 3 + channel] = (float)(colour[channel] / luminosity);
+			mCentroid[node * 3] = (float)(position.x / luminosity);
+			mCentroid[node * 3 + 1] = (float)(position.y / luminosity);
+			mCentroid[node * 3 + 2] = (float)(position.z / luminosity);
+		}
+	}
+}
+
+double MagnitudeLod::getLimitDistance(uint32_t inNode) const
+{
+	if (mLuminosity[inNode] == 0.0)
+		return 0.0;
+
+	return 10.0 * kMillimetresPerParsec * pow(10.0, 0.2 * (mMagnitudeLimit - mBrightest[inNode]));
+}
+
+double MagnitudeLod::getAggregateLimitDistance(uint32_t inNode) const
+{
+	if (mLuminosity[inNode] == 0.0)
+		return 0.0;
+
+	// Luminosity is 10^(-0.4 M), so 10^(0.2 (limit - M)) = 10^(0.2 limit) * sqrt(luminosity)
+	return 10.0 * kMillimetresPerParsec * pow(10.0, 0.2 * mMagnitudeLimit) * sqrt(mLuminosity[inNode]);
+}
+
+void MagnitudeLod::getAggregatePoints(const UniversalOctree& inOctree, const std::vector<uint32_t>& inNodes,
+									  const TUniversalVector3& inViewer, double inScale,
+									  std::vector<MagnitudeLodPoint>& outPoints) const
+{
+	for (size_t i = 0; i < inNodes.size(); i++)
+	{
+		uint32_t node = inNodes[i];
+		const float* centroid = getNodeCentroid(node);
+		TVector3d position = inOctree.getNodeCenter(node).toVector3d(inViewer);
+		position += TVector3d(centroid[0], centroid[1], centroid[2]);
+
+		MagnitudeLodPoint point;
+		point.position[0] = (float)(position.x * inScale);
+		point.position[1] = (float)(position.y * inScale);
+		point.position[2] = (float)(position.z * inScale);
+		point.apparentMagnitude = (float)getApparentMagnitude(-2.5 * log10(mLuminosity[node]), position.Length());
+		point.colour[0] = mColour[node * 3];
+		point.colour[1] = mColour[node * 3 + 1];
+		point.colour[2] = mColour[node * 3 + 2];
+		point.node = node;
+		outPoints.push_back(point);
+	}
+}
@@ -0,0 +1,106 @@
+//----------------------------------------------------------------------
+//	File:		MagnitudeLod.h
+//
+//	Contains:	Per-node brightness aggregates over a UniversalOctree, for
+//				skipping faint subtrees and drawing distant ones as one
+//				point.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include "UniversalOctree.h"
+#include "UniversalConstants.h"
+
+// Apparent magnitude of an object of absolute magnitude inAbsoluteMagnitude inDistance mm away
+inline double getApparentMagnitude(double inAbsoluteMagnitude, double inDistance)
+{
+	return inAbsoluteMagnitude + 5.0 * log10(inDistance / (10.0 * kMillimetresPerParsec));
+}
+
+//----------------------------------------------------------------------
+//	Struct:		MagnitudeLodPoint
+//
+//	Purpose:	A subtree drawn as a single point: at the luminosity-weighted
+//				centre of its objects, as bright as all of them together, in
+//				their luminosity-weighted colour.
+//
+//----------------------------------------------------------------------
+struct MagnitudeLodPoint
+{
+	float			position[3];		// Relative to the viewer, scaled
+	float			apparentMagnitude;
+	float			colour[3];
+	uint32_t		node;
+};
+
+//----------------------------------------------------------------------
+//	Class:		MagnitudeLod
+//
+//	Purpose:	For every node of an octree, the absolute magnitude of the
+//				brightest object in its subtree and the subtree's total
+//				luminosity, colour and centre of light.
+//
+//				Nothing in a subtree is brighter than its brightest object,
+//				so once the nearest point of the node's loose bounds is
+//				beyond getLimitDistance() the whole subtree is fainter than
+//				the magnitude limit and can be skipped. A subtree whose bounds
+//				subtend less than the aggregate angle is drawn as one
+//				MagnitudeLodPoint instead of its objects, if their summed
+//				light is above the limit, so a distant cluster of stars too
+//				faint to see one by one still shows as a point. That keeps the
+//				number of points drawn bounded by the size of the sky rather
+//				than the size of the catalogue.
+//
+//				VisibleNodeSet applies both rules while it culls, given
+//				setMagnitudeLod(). Call rebuild() after the octree changes.
+//
+//----------------------------------------------------------------------
+class MagnitudeLod
+{
+	public:
+		MagnitudeLod();
+
+		void			clear();
+
+		// inAbsoluteMagnitudes and inColours (r,g,b triples, or NULL for white) are
+		// indexed by ObjectIndex, like the octree's objects
+		void			rebuild(const UniversalOctree& inOctree, const float* inAbsoluteMagnitudes, const float* inColours);
+
+		// The faintest apparent magnitude drawn; 6.5 by default
+		void			setMagnitudeLimit(double inMagnitude) { mMagnitudeLimit = inMagnitude; };
+		double			getMagnitudeLimit() const { return mMagnitudeLimit; };
+
+		// Subtrees smaller than this (radians, seen from the viewer) become one point;
+		// 0.002 by default, about a pixel and a half across a 60 degree, 1920 pixel view
+		void			setAggregateAngle(double inAngle) { mAggregateAngle = inAngle; };
+		double			getAggregateAngle() const { return mAggregateAngle; };
+
+		float			getNodeBrightestMagnitude(uint32_t inNode) const { return mBrightest[inNode]; };
+		double			getNodeLuminosity(uint32_t inNode) const { return mLuminosity[inNode]; };
+		const float*	getNodeColour(uint32_t inNode) const { return &mColour[inNode * 3]; };
+		// Centre of light relative to the node's centre, in mm
+		const float*	getNodeCentroid(uint32_t inNode) const { return &mCentroid[inNode * 3]; };
+
+		// The distance (mm) beyond which everything in the node is fainter than the limit,
+		// and the one beyond which even all of it together is
+		double			getLimitDistance(uint32_t inNode) const;
+		double			getAggregateLimitDistance(uint32_t inNode) const;
+
+		// Appends a point for each of inNodes as seen from inViewer, positions scaled by inScale
+		void			getAggregatePoints(const UniversalOctree& inOctree, const std::vector<uint32_t>& inNodes,
+										   const TUniversalVector3& inViewer, double inScale,
+										   std::vector<MagnitudeLodPoint>& outPoints) const;
+
+	protected:
+		double						mMagnitudeLimit;
+		double						mAggregateAngle;
+
+		// Per node
+		std::vector<float>			mBrightest;			// Absolute magnitude
+		std::vector<double>			mLuminosity;		// In units of an absolute magnitude 0 object
+		std::vector<float>			mColour;
+		std::vector<float>			mCentroid;
+};
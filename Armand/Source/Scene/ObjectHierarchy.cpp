@@ -0,0 +1,210 @@
+#include "stdafx.h"
+#include "ObjectHierarchy.h"
+#include <assert.h>
+#include <algorithm>
+
+ObjectHierarchy::ObjectHierarchy() : mBreadthFirst(true)
+{
+	mLevelBegin.push_back(0);
+}
+
+void ObjectHierarchy::reserve(size_t inObjectCount)
+{
+	mParent.reserve(inObjectCount);
+	mFirstChild.reserve(inObjectCount);
+	mNextSibling.reserve(inObjectCount);
+	mChildCount.reserve(inObjectCount);
+	mDepth.reserve(inObjectCount);
+	mType.reserve(inObjectCount);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mLocalOriginLo[axis].reserve(inObjectCount);
+		mLocalOriginHi[axis].reserve(inObjectCount);
+	}
+	mLocalRotation.reserve(inObjectCount);
+}
+
+void ObjectHierarchy::clear()
+{
+	mParent.clear();
+	mFirstChild.clear();
+	mNextSibling.clear();
+	mChildCount.clear();
+	mDepth.clear();
+	mType.clear();
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mLocalOriginLo[axis].clear();
+		mLocalOriginHi[axis].clear();
+	}
+	mLocalRotation.clear();
+
+	mBreadthFirst = true;
+	mLevelBegin.assign(1, 0);
+}
+
+ObjectIndex ObjectHierarchy::addObject(ObjectIndex inParent, ObjectType inType,
+									   const TUniversalVector3& inLocalOrigin, const ObjectRotation& inLocalRotation)
+{
+	// There is one Universe and everything else hangs off it
+	if (inParent == kNoObject)
+	{
+		assert(mParent.empty());
+		if (!mParent.empty())
+			return kNoObject;
+	}
+	else if (inParent >= getCount())
+	{
+		assert(false);
+		return kNoObject;
+	}
+
+	ObjectIndex object = (ObjectIndex)mParent.size();
+	uint32_t depth = 0;
+	if (inParent != kNoObject)
+	{
+		depth = mDepth[inParent] + 1;
+		assert(depth <= 0xff);
+	}
+
+	// The new object goes to the front of its parent's child list
+	mParent.push_back(inParent);
+	mFirstChild.push_back(kNoObject);
+	mNextSibling.push_back((inParent != kNoObject) ? mFirstChild[inParent] : kNoObject);
+	mChildCount.push_back(0);
+	mDepth.push_back((uint8_t)depth);
+	mType.push_back((uint8_t)inType);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mLocalOriginLo[axis].push_back(0);
+		mLocalOriginHi[axis].push_back(0);
+	}
+	mLocalRotation.push_back(inLocalRotation);
+	setLocalOrigin(object, inLocalOrigin);
+
+	if (inParent != kNoObject)
+	{
+		mFirstChild[inParent] = object;
+		mChildCount[inParent]++;
+	}
+
+	// The Universe alone is in breadth-first order, anything appended later may not be
+	if (object == 0)
+		mLevelBegin.push_back(1);
+	else
+		mBreadthFirst = false;
+
+	return object;
+}
+
+TUniversalVector3 ObjectHierarchy::getLocalOrigin(ObjectIndex inObject) const
+{
+	TUniversalVector3 result;
+	UniversalCoord* axes[3] = { &result.x, &result.y, &result.z };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		axes[axis]->table[0] = mLocalOriginLo[axis][inObject];
+		axes[axis]->table[1] = (ttmath::uint)mLocalOriginHi[axis][inObject];
+	}
+
+	return result;
+}
+
+void ObjectHierarchy::setLocalOrigin(ObjectIndex inObject, const TUniversalVector3& inLocalOrigin)
+{
+	const UniversalCoord* axes[3] = { &inLocalOrigin.x, &inLocalOrigin.y, &inLocalOrigin.z };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mLocalOriginLo[axis][inObject] = axes[axis]->table[0];
+		mLocalOriginHi[axis][inObject] = (int64_t)axes[axis]->table[1];
+	}
+}
+
+UniversalPointArrays ObjectHierarchy::getLocalOrigins() const
+{
+	UniversalPointArrays result;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		result.lo[axis] = mLocalOriginLo[axis].empty() ? NULL : &mLocalOriginLo[axis][0];
+		result.hi[axis] = mLocalOriginHi[axis].empty() ? NULL : &mLocalOriginHi[axis][0];
+	}
+	result.count = getCount();
+
+	return result;
+}
+
+// ---------------------------------------------------------------------------
+// ObjectHierarchy::permute											  [protected]
+//
+//	Reorders one table so that new element i is old element inOrder[i]. One
+//	temporary table per call, swapped in afterwards.
+// ---------------------------------------------------------------------------
+template<class T>
+void ObjectHierarchy::permute(std::vector<T>& ioTable, const std::vector<ObjectIndex>& inOrder)
+{
+	std::vector<T> result(ioTable.size());
+	for (size_t i = 0; i < inOrder.size(); i++)
+		result[i] = ioTable[inOrder[i]];
+
+	ioTable.swap(result);
+}
+
+void ObjectHierarchy::sortBreadthFirst(std::vector<ObjectIndex>* outNewIndices)
+{
+	const size_t count = getCount();
+
+	// Old indices in breadth-first order. Every object descends from the Universe.
+	std::vector<ObjectIndex> order;
+	order.reserve(count);
+	if (count > 0)
+		order.push_back(0);
+	for (size_t head = 0; head < order.size(); head++)
+	{
+		size_t first = order.size();
+		for (ObjectIndex child = mFirstChild[order[head]]; child != kNoObject; child = mNextSibling[child])
+			order.push_back(child);
+
+		// Child lists are newest first; keep the order the objects were added in
+		std::reverse(order.begin() + first, order.end());
+	}
+	assert(order.size() == count);
+
+	std::vector<ObjectIndex> newIndices(count);
+	for (size_t i = 0; i < count; i++)
+		newIndices[order[i]] = (ObjectIndex)i;
+
+	permute(mParent, order);
+	permute(mChildCount, order);
+	permute(mDepth, order);
+	permute(mType, order);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		permute(mLocalOriginLo[axis], order);
+		permute(mLocalOriginHi[axis], order);
+	}
+	permute(mLocalRotation, order);
+
+	// Relink. Walking backwards makes every child list ascending.
+	mFirstChild.assign(count, kNoObject);
+	mNextSibling.assign(count, kNoObject);
+	for (size_t i = count; i-- > 1;)
+	{
+		ObjectIndex parent = newIndices[mParent[i]];
+		mParent[i] = parent;
+		mNextSibling[i] = mFirstChild[parent];
+		mFirstChild[parent] = (ObjectIndex)i;
+	}
+
+	// Depths never decrease in breadth-first order
+	mLevelBegin.assign(1, 0);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (mDepth[i] == mLevelBegin.size() - 1)
+			mLevelBegin.push_back((ObjectIndex)i);
+		mLevelBegin.back() = (ObjectIndex)i + 1;
+	}
+	mBreadthFirst = true;
+
+	if (outNewIndices != NULL)
+		outNewIndices->swap(newIndices);
+}
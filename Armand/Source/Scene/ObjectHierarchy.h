@@ -0,0 +1,170 @@
+//----------------------------------------------------------------------
+//	File:		ObjectHierarchy.h
+//
+//	Contains:	Flat, index based store of the object hierarchy:
+//				Universe -> galaxy group -> galaxy -> star -> planet -> moon.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "UniversalVector.h"
+#include "UniversalPointBatch.h"
+
+// Objects are referred to by their index in the hierarchy's tables. 32 bits covers the tens
+// of millions of objects we expect with plenty to spare and halves the size of the links.
+typedef uint32_t ObjectIndex;
+const ObjectIndex kNoObject = 0xffffffff;
+
+enum ObjectType
+{
+	eObjectUniverse = 0,
+	eObjectGalaxyGroup,
+	eObjectGalaxy,
+	eObjectNebula,
+	eObjectStarCluster,
+	eObjectBlackHole,
+	eObjectStar,
+	eObjectPlanet,
+	eObjectComet,
+	eObjectAsteroid,
+	eObjectProbe,
+	eObjectMoon,
+	eObjectSatellite
+};
+
+//----------------------------------------------------------------------
+//	Struct:		ObjectRotation
+//
+//	Purpose:	Unit quaternion taking a vector in an object's coordinate
+//				system to its parent's. Doubles, because it is applied to
+//				offsets as large as the object's children are far away.
+//
+//----------------------------------------------------------------------
+struct ObjectRotation
+{
+	double			w, x, y, z;
+};
+
+const ObjectRotation kObjectRotationIdentity = { 1.0, 0.0, 0.0, 0.0 };
+
+//----------------------------------------------------------------------
+//	Class:		ObjectHierarchy
+//
+//	Purpose:	Every object attribute lives in its own contiguous table
+//				(structure of arrays), indexed by ObjectIndex. Nodes are links
+//				between indices, never pointers, so there is no allocation per
+//				object and a pass over one attribute only touches that
+//				attribute's memory.
+//
+//				Objects are appended in any order below an existing parent.
+//				sortBreadthFirst() then renumbers them so that every level of
+//				the tree is one contiguous range, parents come before their
+//				children and the children of an object are contiguous. In that
+//				order a breadth-first traversal is a linear scan.
+//
+//----------------------------------------------------------------------
+class ObjectHierarchy
+{
+	public:
+		ObjectHierarchy();
+
+		void			reserve(size_t inObjectCount);
+		void			clear();
+
+		// Adds the Universe object (which must be the first object) when inParent is
+		// kNoObject, otherwise a child of inParent. Returns the new object's index.
+		ObjectIndex		addObject(ObjectIndex inParent, ObjectType inType,
+								  const TUniversalVector3& inLocalOrigin,
+								  const ObjectRotation& inLocalRotation = kObjectRotationIdentity);
+
+		size_t			getCount() const { return mParent.size(); };
+		ObjectIndex		getRoot() const { return mParent.empty() ? kNoObject : 0; };
+
+		// Links. Until sortBreadthFirst() siblings are listed newest first.
+		ObjectIndex		getParent(ObjectIndex inObject) const { return mParent[inObject]; };
+		ObjectIndex		getFirstChild(ObjectIndex inObject) const { return mFirstChild[inObject]; };
+		ObjectIndex		getNextSibling(ObjectIndex inObject) const { return mNextSibling[inObject]; };
+		uint32_t		getChildCount(ObjectIndex inObject) const { return mChildCount[inObject]; };
+		uint32_t		getDepth(ObjectIndex inObject) const { return mDepth[inObject]; };
+		ObjectType		getType(ObjectIndex inObject) const { return (ObjectType)mType[inObject]; };
+
+		// Position of the object's origin in its parent's coordinate system (millimetres)
+		TUniversalVector3	getLocalOrigin(ObjectIndex inObject) const;
+		void			setLocalOrigin(ObjectIndex inObject, const TUniversalVector3& inLocalOrigin);
+
+		const ObjectRotation&	getLocalRotation(ObjectIndex inObject) const { return mLocalRotation[inObject]; };
+		void			setLocalRotation(ObjectIndex inObject, const ObjectRotation& inLocalRotation) { mLocalRotation[inObject] = inLocalRotation; };
+
+		// The local origins as word arrays, e.g. for convertToViewerRelative(). Valid until
+		// objects are added or sorted.
+		UniversalPointArrays	getLocalOrigins() const;
+
+		// Breadth-first order. Adding objects breaks it, sort once the hierarchy is built.
+		// outNewIndices, if given, receives the new index of every old index.
+		bool			isBreadthFirst() const { return mBreadthFirst; };
+		void			sortBreadthFirst(std::vector<ObjectIndex>* outNewIndices = NULL);
+
+		// Levels are only known in breadth-first order: level n is [getLevelBegin(n), getLevelEnd(n))
+		size_t			getLevelCount() const { return mBreadthFirst ? mLevelBegin.size() - 1 : 0; };
+		ObjectIndex		getLevelBegin(size_t inLevel) const { return mLevelBegin[inLevel]; };
+		ObjectIndex		getLevelEnd(size_t inLevel) const { return mLevelBegin[inLevel + 1]; };
+
+		// Calls inVisitor(ObjectIndex) for inFirst and all its descendants, level by level
+		template<class Visitor>
+		void			visitBreadthFirst(ObjectIndex inFirst, Visitor inVisitor) const;
+
+	protected:
+		template<class T>
+		static void		permute(std::vector<T>& ioTable, const std::vector<ObjectIndex>& inOrder);
+
+		// Links
+		std::vector<ObjectIndex>	mParent;
+		std::vector<ObjectIndex>	mFirstChild;
+		std::vector<ObjectIndex>	mNextSibling;
+		std::vector<uint32_t>		mChildCount;
+		std::vector<uint8_t>		mDepth;
+		std::vector<uint8_t>		mType;
+
+		// Local frame. The origins are split into their ttmath words (table[0], table[1]) per axis.
+		std::vector<uint64_t>		mLocalOriginLo[3];
+		std::vector<int64_t>		mLocalOriginHi[3];
+		std::vector<ObjectRotation>	mLocalRotation;
+
+		bool						mBreadthFirst;
+		std::vector<ObjectIndex>	mLevelBegin;		// getLevelCount() + 1 entries
+
+		mutable std::vector<ObjectIndex>	mVisitQueue;	// Reused by visitBreadthFirst()
+};
+
+template<class Visitor>
+void ObjectHierarchy::visitBreadthFirst(ObjectIndex inFirst, Visitor inVisitor) const
+{
+	if (inFirst >= getCount())
+		return;
+
+	// In breadth-first order the whole tree is a linear scan
+	if (mBreadthFirst && (inFirst == getRoot()))
+	{
+		ObjectIndex count = (ObjectIndex)getCount();
+		for (ObjectIndex i = 0; i < count; i++)
+			inVisitor(i);
+		return;
+	}
+
+	mVisitQueue.clear();
+	mVisitQueue.push_back(inFirst);
+	for (size_t head = 0; head < mVisitQueue.size(); head++)
+	{
+		ObjectIndex object = mVisitQueue[head];
+		inVisitor(object);
+
+		for (ObjectIndex child = mFirstChild[object]; child != kNoObject; child = mNextSibling[child])
+			mVisitQueue.push_back(child);
+	}
+}
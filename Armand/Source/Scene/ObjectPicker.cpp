@@ -0,0 +1,381 @@
+#include "stdafx.h"
+#include "ObjectPicker.h"
+#include <float.h>
+#include <algorithm>
+
+static const double kSqrtThree = 1.7320508075688772;
+
+// Angle between two unit vectors, accurate for the small ones a pixel subtends
+static double getAngleBetween(const TVector3d& inA, const TVector3d& inB)
+{
+	return atan2((inA ^ inB).Length(), inA * inB);
+}
+
+static bool isSameVector(const TVector3d& inA, const TVector3d& inB)
+{
+	return (inA.x == inB.x) && (inA.y == inB.y) && (inA.z == inB.z);
+}
+
+ObjectPicker::ObjectPicker() : mProjection(eViewCullPerspective),
+							   mGaze(0.0, 0.0, -1.0),
+							   mRight(1.0, 0.0, 0.0),
+							   mUp(0.0, 1.0, 0.0),
+							   mHalfAperture(0.0),
+							   mTanHalfFieldOfViewY(1.0),
+							   mWidth(1.0),
+							   mHeight(1.0),
+							   mAbsoluteMagnitudes(NULL),
+							   mLod(NULL),
+							   mOffsets(NULL),
+							   mNodeBudget(0),
+							   mQueryValid(false),
+							   mX(0.0),
+							   mY(0.0),
+							   mTolerance(0.0),
+							   mMode(ePickNearest),
+							   mBestKey(DBL_MAX)
+{
+	memset(&mResult, 0, sizeof(mResult));
+	mResult.object = kNoObject;
+}
+
+void ObjectPicker::setFisheye(const TVector3d& inGaze, const TVector3d& inUp, double inAperture,
+							  int inWidth, int inHeight)
+{
+	TVector3d gaze = inGaze;
+	gaze.Normalize();
+	TVector3d right = gaze ^ inUp;
+	right.Normalize();
+	TVector3d up = right ^ gaze;
+
+	if ((mProjection != eViewCullFisheye) || !isSameVector(gaze, mGaze) || !isSameVector(up, mUp) ||
+		(0.5 * inAperture != mHalfAperture) || (inWidth != mWidth) || (inHeight != mHeight))
+		mQueryValid = false;
+
+	mProjection = eViewCullFisheye;
+	mGaze = gaze;
+	mRight = right;
+	mUp = up;
+	mHalfAperture = 0.5 * inAperture;
+	mWidth = std::max(inWidth, 1);
+	mHeight = std::max(inHeight, 1);
+}
+
+void ObjectPicker::setPerspective(const TVector3d& inGaze, const TVector3d& inUp, double inFieldOfViewY,
+								  int inWidth, int inHeight)
+{
+	TVector3d gaze = inGaze;
+	gaze.Normalize();
+	TVector3d right = gaze ^ inUp;
+	right.Normalize();
+	TVector3d up = right ^ gaze;
+	double tanHalfFieldOfViewY = tan(0.5 * inFieldOfViewY);
+
+	if ((mProjection != eViewCullPerspective) || !isSameVector(gaze, mGaze) || !isSameVector(up, mUp) ||
+		(tanHalfFieldOfViewY != mTanHalfFieldOfViewY) || (inWidth != mWidth) || (inHeight != mHeight))
+		mQueryValid = false;
+
+	mProjection = eViewCullPerspective;
+	mGaze = gaze;
+	mRight = right;
+	mUp = up;
+	mTanHalfFieldOfViewY = tanHalfFieldOfViewY;
+	mWidth = std::max(inWidth, 1);
+	mHeight = std::max(inHeight, 1);
+}
+
+// ---------------------------------------------------------------------------
+// ObjectPicker::getRay
+//
+//	Positions are taken at pixel centres. A fisheye maps the angle from the
+//	gaze linearly to the distance from the middle of the window, reaching
+//	half the aperture at the edge of the inscribed circle.
+// ---------------------------------------------------------------------------
+bool ObjectPicker::getRay(double inX, double inY, TVector3d& outDirection) const
+{
+	double x = inX + 0.5 - 0.5 * mWidth;
+	double y = 0.5 * mHeight - (inY + 0.5);
+
+	if (mProjection == eViewCullPerspective)
+	{
+		double scale = 2.0 * mTanHalfFieldOfViewY / mHeight;
+		outDirection = mGaze + (x * scale) * mRight + (y * scale) * mUp;
+		outDirection.Normalize();
+		return true;
+	}
+
+	double domeRadius = 0.5 * std::min(mWidth, mHeight);
+	double radius = sqrt(x * x + y * y);
+	if (radius > domeRadius)
+		return false;
+	if (radius == 0.0)
+	{
+		outDirection = mGaze;
+		return true;
+	}
+
+	double angle = radius / domeRadius * mHalfAperture;
+	outDirection = cos(angle) * mGaze + (sin(angle) / radius) * (x * mRight + y * mUp);
+	return true;
+}
+
+bool ObjectPicker::getScreenPosition(const TVector3d& inDirection, double& outX, double& outY) const
+{
+	TVector3d direction = inDirection;
+	direction.Normalize();
+	double along = direction * mGaze;
+	double x = direction * mRight;
+	double y = direction * mUp;
+
+	if (mProjection == eViewCullPerspective)
+	{
+		if (along <= 0.0)
+			return false;
+
+		double scale = 2.0 * mTanHalfFieldOfViewY / mHeight;
+		x /= along * scale;
+		y /= along * scale;
+		outX = x + 0.5 * mWidth - 0.5;
+		outY = 0.5 * mHeight - y - 0.5;
+		return (fabs(x) <= 0.5 * mWidth) && (fabs(y) <= 0.5 * mHeight);
+	}
+
+	double across = sqrt(x * x + y * y);
+	double angle = atan2(across, along);
+	if (angle > mHalfAperture)
+		return false;
+
+	double radius = angle / mHalfAperture * 0.5 * std::min(mWidth, mHeight);
+	double scale = (across > 0.0) ? radius / across : 0.0;
+	outX = x * scale + 0.5 * mWidth - 0.5;
+	outY = 0.5 * mHeight - y * scale - 0.5;
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// ObjectPicker::getConeAngle
+//
+//	The widest angle to the rays inTolerance pixels away on either axis, so
+//	the cone covers the whole square around the position. Never less than
+//	half a pixel.
+// ---------------------------------------------------------------------------
+double ObjectPicker::getConeAngle(double inX, double inY, double inTolerance) const
+{
+	TVector3d ray;
+	if (!getRay(inX, inY, ray))
+		return 0.0;
+
+	const double offsets[4][2] = { { 1.0, 0.0 }, { -1.0, 0.0 }, { 0.0, 1.0 }, { 0.0, -1.0 } };
+	double tolerance = std::max(inTolerance, 0.5);
+	double angle = 0.0;
+	for (int i = 0; i < 4; i++)
+	{
+		TVector3d neighbour;
+		if (getRay(inX + offsets[i][0] * tolerance, inY + offsets[i][1] * tolerance, neighbour))
+			angle = std::max(angle, getAngleBetween(ray, neighbour));
+	}
+
+	return angle;
+}
+
+void ObjectPicker::setOffsets(const UniversalOctreeOffsets* inOffsets)
+{
+	mOffsets = inOffsets;
+	mQueryValid = false;
+}
+
+void ObjectPicker::setMagnitudes(const float* inAbsoluteMagnitudes, const MagnitudeLod* inLod)
+{
+	mAbsoluteMagnitudes = inAbsoluteMagnitudes;
+	mLod = inLod;
+	mQueryValid = false;
+}
+
+bool ObjectPicker::pick(const UniversalOctree& inOctree, const TUniversalVector3& inViewer,
+						double inX, double inY, double inTolerance, PickMode inMode, PickResult& outResult)
+{
+	if (!mQueryValid || (inViewer != mViewer) || (inX != mX) || (inY != mY) || (inTolerance != mTolerance) ||
+		(inMode != mMode))
+		startQuery(inOctree, inViewer, inX, inY, inTolerance, inMode);
+
+	size_t visited = 0;
+	while (!mHeap.empty())
+	{
+		if ((mNodeBudget > 0) && (visited >= mNodeBudget))
+		{
+			outResult = mResult;
+			return false;
+		}
+
+		// Nothing left can beat the best so far
+		if (mHeap.front().key >= mBestKey)
+		{
+			mHeap.clear();
+			break;
+		}
+
+		uint32_t node = mHeap.front().node;
+		std::pop_heap(mHeap.begin(), mHeap.end());
+		mHeap.pop_back();
+		visited++;
+		mResult.nodesVisited++;
+
+		TVector3d center = inOctree.getNodeCenter(node).toVector3d(mViewer);
+		testObjects(inOctree, node, center);
+		pushChildren(inOctree, node, center);
+	}
+
+	outResult = mResult;
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// ObjectPicker::startQuery												  [protected]
+// ---------------------------------------------------------------------------
+void ObjectPicker::startQuery(const UniversalOctree& inOctree, const TUniversalVector3& inViewer,
+							  double inX, double inY, double inTolerance, PickMode inMode)
+{
+	mQueryValid = true;
+	mViewer = inViewer;
+	mX = inX;
+	mY = inY;
+	mTolerance = inTolerance;
+	mMode = inMode;
+	mBestKey = DBL_MAX;
+	memset(&mResult, 0, sizeof(mResult));
+	mResult.object = kNoObject;
+	mHeap.clear();
+
+	// Outside a fisheye's dome there is nothing to pick
+	if (!getRay(inX, inY, mRay) || (inOctree.getNodeCount() == 0))
+		return;
+
+	mCone.setFisheye(mRay, 2.0 * getConeAngle(inX, inY, inTolerance));
+
+	HeapEntry root;
+	root.key = -DBL_MAX;
+	root.node = 0;
+	mHeap.push_back(root);
+}
+
+// ---------------------------------------------------------------------------
+// ObjectPicker::testObjects											  [protected]
+//
+//	An object counts if its sphere reaches into the cone. Objects are no more
+//	than half their node's width in radius, so most are turned down on their
+//	centres before their radii are looked up. Of two equally good objects the
+//	one nearer the ray wins.
+// ---------------------------------------------------------------------------
+void ObjectPicker::testObjects(const UniversalOctree& inOctree, uint32_t inNode, const TVector3d& inNodeCenter)
+{
+	double maxRadius = 0.5 * inOctree.getNodeWidth(inNode);
+	uint32_t slot = mOffsets ? mOffsets->getSlot(inNode) : kNoOffsetSlot;
+	if (slot != kNoOffsetSlot)
+	{
+		// The node's offsets are contiguous, where the octree's objects are scattered
+		const float* offsets = mOffsets->getOffsets() + mOffsets->getSlotFirst(slot) * 3;
+		const ObjectIndex* objects = mOffsets->getPointObjects() + mOffsets->getSlotFirst(slot);
+		double scale = 1.0 / mOffsets->getScale();
+		for (uint32_t i = 0; i < mOffsets->getSlotPointCount(slot); i++)
+		{
+			TVector3d position = inNodeCenter + TVector3d(offsets[i * 3] * scale, offsets[i * 3 + 1] * scale,
+														  offsets[i * 3 + 2] * scale);
+			testObject(inOctree, objects[i], position, maxRadius);
+		}
+	}
+	else
+	{
+		for (ObjectIndex object = inOctree.getNodeFirstObject(inNode); object != kNoObject; object = inOctree.getNextObject(object))
+			testObject(inOctree, object, inNodeCenter + inOctree.getObjectOffset(object), maxRadius);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// ObjectPicker::testObject												  [protected]
+// ---------------------------------------------------------------------------
+void ObjectPicker::testObject(const UniversalOctree& inOctree, ObjectIndex inObject, const TVector3d& inPosition,
+							  double inMaxRadius)
+{
+	mResult.objectsTested++;
+	double coneDistance = mCone.getViewDistance(inPosition);
+	if (coneDistance > inMaxRadius)
+		return;
+	double radius = inOctree.getObjectRadius(inObject);
+	if (coneDistance > radius)
+		return;
+
+	double range = inPosition.Length();
+	double distance = std::max(range - radius, 0.0);
+	double key = distance;
+	if (isByMagnitude())
+		key = getApparentMagnitude(mAbsoluteMagnitudes[inObject], std::max(range, 1.0));
+
+	double angle = (range > 0.0) ? getAngleBetween(mRay, inPosition * (1.0 / range)) : 0.0;
+	if ((key < mBestKey) || ((key == mBestKey) && (angle < mResult.angle)))
+	{
+		mBestKey = key;
+		mResult.object = inObject;
+		mResult.distance = distance;
+		mResult.apparentMagnitude = isByMagnitude() ? key : 0.0;
+		mResult.angle = angle;
+	}
+}
+
+// ---------------------------------------------------------------------------
+// ObjectPicker::getNodeKey												  [protected]
+//
+//	The best any object in the node's subtree could do. Without a MagnitudeLod
+//	the brightest search has no bound and visits every node in the cone.
+// ---------------------------------------------------------------------------
+double ObjectPicker::getNodeKey(uint32_t inNode, double inNearest) const
+{
+	if (!isByMagnitude())
+		return std::max(inNearest, 0.0);
+
+	if ((mLod == NULL) || (inNearest <= 0.0))
+		return -DBL_MAX;
+
+	return getApparentMagnitude(mLod->getNodeBrightestMagnitude(inNode), inNearest);
+}
+
+// ---------------------------------------------------------------------------
+// ObjectPicker::pushChildren											  [protected]
+//
+//	Child centres are the parent's exact centre moved a quarter of its width
+//	along each axis, in double: the rounding is far smaller than the loose
+//	bounds, and it saves a 128-bit subtraction for each child that is never
+//	visited.
+// ---------------------------------------------------------------------------
+void ObjectPicker::pushChildren(const UniversalOctree& inOctree, uint32_t inNode, const TVector3d& inNodeCenter)
+{
+	uint32_t firstChild = inOctree.getNodeFirstChild(inNode);
+	if (firstChild == kNoOctreeNode)
+		return;
+
+	double childWidth = 0.5 * inOctree.getNodeWidth(inNode);
+	double quarter = 0.5 * childWidth;
+
+	// Objects lie within the node's loose bounds: a cube twice the cell's width
+	double radius = kSqrtThree * childWidth;
+	for (uint32_t octant = 0; octant < 8; octant++)
+	{
+		uint32_t child = firstChild + octant;
+		if (inOctree.getNodeSubtreeObjectCount(child) == 0)
+			continue;
+
+		TVector3d center = inNodeCenter + TVector3d((octant & 1) ? quarter : -quarter,
+													(octant & 2) ? quarter : -quarter,
+													(octant & 4) ? quarter : -quarter);
+		if (mCone.getViewDistance(center) > radius)
+			continue;
+
+		HeapEntry entry;
+		entry.key = getNodeKey(child, center.Length() - radius);
+		entry.node = child;
+		if (entry.key >= mBestKey)
+			continue;
+
+		mHeap.push_back(entry);
+		std::push_heap(mHeap.begin(), mHeap.end());
+	}
+}
@@ -0,0 +1,152 @@
+//----------------------------------------------------------------------
+//	File:		ObjectPicker.h
+//
+//	Contains:	Screen to universe picking: rays through window pixels for
+//				the fisheye and perspective projections, and the nearest or
+//				brightest object in a cone around one.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include "ViewCuller.h"
+#include "MagnitudeLod.h"
+
+enum PickMode
+{
+	ePickNearest,			// The object nearest the viewer
+	ePickBrightest			// The object of least apparent magnitude
+};
+
+//----------------------------------------------------------------------
+//	Struct:		PickResult
+//
+//	Purpose:	What ObjectPicker::pick() found, kNoObject if nothing.
+//
+//----------------------------------------------------------------------
+struct PickResult
+{
+	ObjectIndex		object;
+	double			distance;				// From the viewer to the object's surface, mm
+	double			apparentMagnitude;		// ePickBrightest only
+	double			angle;					// Of the object's centre from the ray, radians
+	size_t			nodesVisited;			// Over all the calls for this query
+	size_t			objectsTested;
+};
+
+//----------------------------------------------------------------------
+//	Class:		ObjectPicker
+//
+//	Purpose:	Finds what is under the mouse. The projection is set as on a
+//				ViewCuller, with the size of the window: a perspective view
+//				as gluPerspective() draws it, or an equidistant fisheye whose
+//				dome fills the circle inscribed in the window, as dome
+//				masters are drawn. getRay() turns a window position, as
+//				OpenGLWindow::mouseEvent() gets it (pixels from the top left),
+//				into a direction on the world axes; getScreenPosition() goes
+//				back.
+//
+//				pick() searches a cone around the ray, as wide as the pixel
+//				tolerance there, best first: nodes come off a heap ordered by
+//				the nearest their loose bounds can be, or with a MagnitudeLod
+//				by the brightest their brightest object could appear, and the
+//				search stops once no node left can beat the best object found.
+//				Only nodes the cone passes through are visited, so the time
+//				depends on what lies along the ray rather than on how many
+//				objects are loaded.
+//
+//				For hover highlighting a node budget keeps pick() from taking
+//				more than a slice of a frame. When it runs out pick() returns
+//				false; calling it again with the same query carries on where
+//				it stopped. Call invalidate() after the octree changes.
+//
+//----------------------------------------------------------------------
+class ObjectPicker
+{
+	public:
+		ObjectPicker();
+
+		// As ViewCuller, for a window inWidth by inHeight pixels
+		void			setFisheye(const TVector3d& inGaze, const TVector3d& inUp, double inAperture,
+								   int inWidth, int inHeight);
+		void			setPerspective(const TVector3d& inGaze, const TVector3d& inUp, double inFieldOfViewY,
+									   int inWidth, int inHeight);
+
+		// Direction (unit, world axes) through window position inX, inY. False outside a
+		// fisheye's dome.
+		bool			getRay(double inX, double inY, TVector3d& outDirection) const;
+		// Window position of inDirection. False if it is not in view.
+		bool			getScreenPosition(const TVector3d& inDirection, double& outX, double& outY) const;
+		// Half angle of the cone inTolerance pixels around inX, inY
+		double			getConeAngle(double inX, double inY, double inTolerance) const;
+
+		// Absolute magnitudes indexed by ObjectIndex, for ePickBrightest, which picks the
+		// nearest object without them. inLod, which may be NULL, lets whole subtrees be
+		// passed over.
+		void			setMagnitudes(const float* inAbsoluteMagnitudes, const MagnitudeLod* inLod);
+
+		// Reads object positions from inOffsets, which may be NULL, rather than from the
+		// octree: much faster over a large catalogue. It must be up to date with the octree.
+		void			setOffsets(const UniversalOctreeOffsets* inOffsets);
+
+		// Nodes visited by one call of pick(), 0 for no limit (the default)
+		void			setNodeBudget(size_t inBudget) { mNodeBudget = inBudget; };
+
+		// Searches for the object under window position inX, inY, within inTolerance
+		// pixels. Returns true when the search is done and outResult final; false when
+		// the node budget ran out, with the best object so far in outResult.
+		bool			pick(const UniversalOctree& inOctree, const TUniversalVector3& inViewer,
+							 double inX, double inY, double inTolerance, PickMode inMode, PickResult& outResult);
+
+		// The next pick() starts afresh
+		void			invalidate() { mQueryValid = false; };
+
+	protected:
+		struct HeapEntry
+		{
+			double			key;				// Nearest distance or brightest magnitude possible
+			uint32_t		node;
+
+			bool			operator<(const HeapEntry& inOther) const { return key > inOther.key; };
+		};
+
+		void			startQuery(const UniversalOctree& inOctree, const TUniversalVector3& inViewer,
+								   double inX, double inY, double inTolerance, PickMode inMode);
+		void			testObjects(const UniversalOctree& inOctree, uint32_t inNode, const TVector3d& inNodeCenter);
+		void			testObject(const UniversalOctree& inOctree, ObjectIndex inObject, const TVector3d& inPosition,
+								   double inMaxRadius);
+		double			getNodeKey(uint32_t inNode, double inNearest) const;
+		void			pushChildren(const UniversalOctree& inOctree, uint32_t inNode, const TVector3d& inNodeCenter);
+		// ePickBrightest falls back to ePickNearest without magnitudes
+		bool			isByMagnitude() const { return (mMode == ePickBrightest) && (mAbsoluteMagnitudes != NULL); };
+
+		// Projection
+		ViewCullProjection	mProjection;
+		TVector3d		mGaze;
+		TVector3d		mRight;
+		TVector3d		mUp;
+		double			mHalfAperture;			// Fisheye
+		double			mTanHalfFieldOfViewY;	// Perspective
+		double			mWidth;
+		double			mHeight;
+
+		const float*		mAbsoluteMagnitudes;
+		const MagnitudeLod*	mLod;
+		const UniversalOctreeOffsets*	mOffsets;
+		size_t			mNodeBudget;
+
+		// The query in progress
+		bool			mQueryValid;
+		TUniversalVector3	mViewer;
+		double			mX;
+		double			mY;
+		double			mTolerance;
+		PickMode		mMode;
+		ViewCuller		mCone;					// A fisheye as wide as the cone
+		TVector3d		mRay;
+		double			mBestKey;
+		PickResult		mResult;
+		std::vector<HeapEntry>	mHeap;
+};
@@ -0,0 +1,322 @@
+#include "stdafx.h"
+#include "ObjectTransforms.h"
+#include "JobSystem.h"
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+
+// Ranges smaller than this are not worth waking the other threads for
+static const ObjectIndex kParallelObjectCount = 4096;
+
+// Objects in each job of a split range
+static const size_t kParallelGrain = 1024;
+
+static const uint32_t kNoSpin = 0xffffffff;
+
+static inline UniversalCoord universalCoordFromWords(uint64_t inLo, int64_t inHi)
+{
+	UniversalCoord result;
+	result.table[0] = inLo;
+	result.table[1] = (ttmath::uint)inHi;
+
+	return result;
+}
+
+ObjectTransforms::ObjectTransforms(const ObjectHierarchy& inHierarchy) : mHierarchy(inHierarchy),
+																		 mJobs(NULL),
+																		 mSpinTolerance(0.0),
+																		 mSeconds(0.0),
+																		 mLastUpdateObjectCount(0),
+																		 mLastUpdateSpinCount(0)
+{
+	rebuild();
+}
+
+void ObjectTransforms::rebuild(const std::vector<ObjectIndex>* inNewIndices)
+{
+	const size_t count = mHierarchy.getCount();
+
+	mFrame.resize(count);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mOriginLo[axis].resize(count);
+		mOriginHi[axis].resize(count);
+	}
+
+	// In breadth-first order the children of all objects before i are exactly
+	// [1, 1 + their number), so that is where the children of i start
+	mChildBegin.resize(count + 1);
+	ObjectIndex childBegin = 1;
+	for (size_t i = 0; i < count; i++)
+	{
+		mChildBegin[i] = childBegin;
+		childBegin += mHierarchy.getChildCount((ObjectIndex)i);
+	}
+	mChildBegin[count] = (ObjectIndex)count;
+
+	// Everything descends from the Universe
+	mChanged.assign(count, 0);
+	mChangedObjects.clear();
+	if (count > 0)
+		markLocalChanged(mHierarchy.getRoot());
+
+	mSpinIndex.assign(count, kNoSpin);
+	for (size_t i = 0; i < mSpins.size(); i++)
+	{
+		if (inNewIndices != NULL)
+			mSpins[i].object = (*inNewIndices)[mSpins[i].object];
+		mSpinIndex[mSpins[i].object] = (uint32_t)i;
+		mSpins[i].appliedAngle = HUGE_VAL;
+	}
+}
+
+void ObjectTransforms::markLocalChanged(ObjectIndex inObject)
+{
+	if (mChanged[inObject] == 0)
+	{
+		mChanged[inObject] = 1;
+		mChangedObjects.push_back(inObject);
+	}
+}
+
+void ObjectTransforms::setSpin(ObjectIndex inObject, double inRadiansPerSecond, double inAngleAtEpoch)
+{
+	uint32_t index = mSpinIndex[inObject];
+	if ((inRadiansPerSecond == 0.0) && (inAngleAtEpoch == 0.0))
+	{
+		// Remove it, moving the last spin into its place
+		if (index != kNoSpin)
+		{
+			mSpins[index] = mSpins.back();
+			mSpinIndex[mSpins[index].object] = index;
+			mSpins.pop_back();
+			mSpinIndex[inObject] = kNoSpin;
+		}
+		return;
+	}
+
+	if (index == kNoSpin)
+	{
+		index = (uint32_t)mSpins.size();
+		mSpins.push_back(Spin());
+		mSpins[index].object = inObject;
+		mSpinIndex[inObject] = index;
+	}
+
+	Spin& spin = mSpins[index];
+	spin.radiansPerSecond = inRadiansPerSecond;
+	spin.angleAtEpoch = inAngleAtEpoch;
+	spin.appliedAngle = HUGE_VAL;
+}
+
+void ObjectTransforms::update(double inSeconds)
+{
+	assert(mHierarchy.isBreadthFirst());
+	assert(mFrame.size() == mHierarchy.getCount());
+
+	mLastUpdateObjectCount = 0;
+	mLastUpdateSpinCount = 0;
+
+	bool framesChanged = !mChangedObjects.empty();
+	if (framesChanged)
+	{
+		// Breadth-first order sorts the changed objects by level
+		std::sort(mChangedObjects.begin(), mChangedObjects.end());
+
+		mRanges.clear();
+		size_t nextChanged = 0;
+		while (!mRanges.empty() || (nextChanged < mChangedObjects.size()))
+		{
+			// Descendants of the levels above, plus the objects changed on this level
+			uint32_t depth = mHierarchy.getDepth(mRanges.empty() ? mChangedObjects[nextChanged] : mRanges[0].begin);
+			for (; (nextChanged < mChangedObjects.size()) && (mHierarchy.getDepth(mChangedObjects[nextChanged]) == depth); nextChanged++)
+			{
+				Range range = { mChangedObjects[nextChanged], mChangedObjects[nextChanged] + 1 };
+				mRanges.push_back(range);
+			}
+			std::sort(mRanges.begin(), mRanges.end(), rangeBeginsBefore);
+
+			mNextRanges.clear();
+			Range merged = mRanges[0];
+			for (size_t i = 1; i <= mRanges.size(); i++)
+			{
+				if ((i < mRanges.size()) && (mRanges[i].begin <= merged.end))
+				{
+					merged.end = std::max(merged.end, mRanges[i].end);
+					continue;
+				}
+
+				updateRange(merged.begin, merged.end);
+				mLastUpdateObjectCount += merged.end - merged.begin;
+
+				Range children = { mChildBegin[merged.begin], mChildBegin[merged.end] };
+				if (children.begin < children.end)
+				{
+					if (!mNextRanges.empty() && (mNextRanges.back().end == children.begin))
+						mNextRanges.back().end = children.end;
+					else
+						mNextRanges.push_back(children);
+				}
+
+				if (i < mRanges.size())
+					merged = mRanges[i];
+			}
+			mRanges.swap(mNextRanges);
+		}
+
+		for (size_t i = 0; i < mChangedObjects.size(); i++)
+			mChanged[mChangedObjects[i]] = 0;
+		mChangedObjects.clear();
+	}
+
+	bool timeMoved = (inSeconds != mSeconds);
+	mSeconds = inSeconds;
+	if (framesChanged || timeMoved)
+		updateSpins(framesChanged);
+}
+
+// ---------------------------------------------------------------------------
+// ObjectTransforms::rangeBeginsBefore								  [protected]
+// ---------------------------------------------------------------------------
+bool ObjectTransforms::rangeBeginsBefore(const Range& a, const Range& b)
+{
+	return a.begin < b.begin;
+}
+
+// ---------------------------------------------------------------------------
+// ObjectTransforms::updateRange									  [protected]
+//
+//	Objects on one level only depend on their parents, which are all up to
+//	date, so the range can be split across threads in any way.
+// ---------------------------------------------------------------------------
+void ObjectTransforms::updateRange(ObjectIndex inBegin, ObjectIndex inEnd)
+{
+	if ((mJobs == NULL) || (inEnd - inBegin < kParallelObjectCount))
+	{
+		for (ObjectIndex i = inBegin; i < inEnd; i++)
+			updateObject(i);
+		return;
+	}
+
+	mJobs->parallelFor(inEnd - inBegin, kParallelGrain, [&](size_t inRangeBegin, size_t inRangeEnd) {
+		for (size_t i = inRangeBegin; i < inRangeEnd; i++)
+			updateObject(inBegin + (ObjectIndex)i);
+	});
+}
+
+void ObjectTransforms::updateObject(ObjectIndex inObject)
+{
+	const ObjectRotation& localRotation = mHierarchy.getLocalRotation(inObject);
+	TUniversalVector3 localOrigin = mHierarchy.getLocalOrigin(inObject);
+
+	ObjectIndex parent = mHierarchy.getParent(inObject);
+	if (parent == kNoObject)
+	{
+		const UniversalCoord* axes[3] = { &localOrigin.x, &localOrigin.y, &localOrigin.z };
+		mFrame[inObject] = localRotation;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			mOriginLo[axis][inObject] = axes[axis]->table[0];
+			mOriginHi[axis][inObject] = (int64_t)axes[axis]->table[1];
+		}
+		return;
+	}
+
+	const ObjectRotation& parentFrame = mFrame[parent];
+	mFrame[inObject] = objectRotationMultiply(parentFrame, localRotation);
+
+	// Most objects (stars in a galaxy, say) sit in an unrotated frame. Their offsets are
+	// added exactly; rotated offsets go through doubles.
+	UniversalCoord offset[3] = { localOrigin.x, localOrigin.y, localOrigin.z };
+	if (!objectRotationIsIdentity(parentFrame))
+	{
+		TVector3d rotated = objectRotationApply(parentFrame, localOrigin.toVector3d());
+		offset[0] = universalCoordFromDouble(rotated.x);
+		offset[1] = universalCoordFromDouble(rotated.y);
+		offset[2] = universalCoordFromDouble(rotated.z);
+	}
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		UniversalCoord origin = universalCoordFromWords(mOriginLo[axis][parent], mOriginHi[axis][parent]);
+		origin.Add(offset[axis]);
+		mOriginLo[axis][inObject] = origin.table[0];
+		mOriginHi[axis][inObject] = (int64_t)origin.table[1];
+	}
+}
+
+// ---------------------------------------------------------------------------
+// ObjectTransforms::updateSpins									  [protected]
+//
+//	inForce recomputes every body because frames underneath them may have
+//	changed; otherwise only spins whose angle moved past the tolerance.
+// ---------------------------------------------------------------------------
+void ObjectTransforms::updateSpins(bool inForce)
+{
+	size_t updated = 0;
+	if ((mJobs == NULL) || (mSpins.size() < kParallelObjectCount))
+	{
+		updated = updateSpinRange(0, mSpins.size(), inForce);
+	}
+	else
+	{
+		// Each job adds the count of its range once
+		std::atomic<size_t> parallelUpdated(0);
+		mJobs->parallelFor(mSpins.size(), kParallelGrain, [&](size_t inBegin, size_t inEnd) {
+			parallelUpdated += updateSpinRange(inBegin, inEnd, inForce);
+		});
+		updated = parallelUpdated;
+	}
+
+	mLastUpdateSpinCount = updated;
+}
+
+// ---------------------------------------------------------------------------
+// ObjectTransforms::updateSpinRange								  [protected]
+//
+//	Returns the number of spins in [inBegin, inEnd) it turned.
+// ---------------------------------------------------------------------------
+size_t ObjectTransforms::updateSpinRange(size_t inBegin, size_t inEnd, bool inForce)
+{
+	size_t updated = 0;
+	for (size_t i = inBegin; i < inEnd; i++)
+	{
+		Spin& spin = mSpins[i];
+		double angle = spin.angleAtEpoch + spin.radiansPerSecond * mSeconds;
+		if (inForce || !(fabs(angle - spin.appliedAngle) <= mSpinTolerance))
+		{
+			spin.body = objectRotationMultiply(mFrame[spin.object], objectRotationAboutUp(angle));
+			spin.appliedAngle = angle;
+			updated++;
+		}
+	}
+
+	return updated;
+}
+
+ObjectRotation ObjectTransforms::getBody(ObjectIndex inObject) const
+{
+	uint32_t index = mSpinIndex[inObject];
+
+	return (index != kNoSpin) ? mSpins[index].body : mFrame[inObject];
+}
+
+TUniversalVector3 ObjectTransforms::getOrigin(ObjectIndex inObject) const
+{
+	return TUniversalVector3(universalCoordFromWords(mOriginLo[0][inObject], mOriginHi[0][inObject]),
+							 universalCoordFromWords(mOriginLo[1][inObject], mOriginHi[1][inObject]),
+							 universalCoordFromWords(mOriginLo[2][inObject], mOriginHi[2][inObject]));
+}
+
+UniversalPointArrays ObjectTransforms::getOrigins() const
+{
+	UniversalPointArrays result;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		result.lo[axis] = mOriginLo[axis].empty() ? NULL : &mOriginLo[axis][0];
+		result.hi[axis] = mOriginHi[axis].empty() ? NULL : &mOriginHi[axis][0];
+	}
+	result.count = mFrame.size();
+
+	return result;
+}
@@ -0,0 +1,175 @@
+//----------------------------------------------------------------------
+//	File:		ObjectTransforms.h
+//
+//	Contains:	Propagation of local transforms down the object hierarchy
+//				to universal frames and origins, recomputing only what
+//				changed.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include "ObjectHierarchy.h"
+
+class JobSystem;
+
+//----------------------------------------------------------------------
+//	Function:	objectRotationMultiply
+//
+//	Purpose:	a * b: applies b, then a. For a parent's frame a and a
+//				child's local rotation b this is the child's frame.
+//----------------------------------------------------------------------
+inline ObjectRotation objectRotationMultiply(const ObjectRotation& a, const ObjectRotation& b)
+{
+	ObjectRotation result;
+	result.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+	result.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+	result.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+	result.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+
+	return result;
+}
+
+inline ObjectRotation objectRotationAboutUp(double inAngle)
+{
+	ObjectRotation result = { cos(0.5 * inAngle), 0.0, 0.0, sin(0.5 * inAngle) };
+	return result;
+}
+
+inline bool objectRotationIsIdentity(const ObjectRotation& inRotation)
+{
+	return (inRotation.w == 1.0) && (inRotation.x == 0.0) && (inRotation.y == 0.0) && (inRotation.z == 0.0);
+}
+
+inline TVector3d objectRotationApply(const ObjectRotation& inRotation, const TVector3d& inVector)
+{
+	// v + 2w(q x v) + 2q x (q x v)
+	TVector3d q(inRotation.x, inRotation.y, inRotation.z);
+	TVector3d t = (q ^ inVector) * 2.0;
+
+	return inVector + t * inRotation.w + (q ^ t);
+}
+
+inline TMatrix3d objectRotationToMatrix(const ObjectRotation& inRotation)
+{
+	double w = inRotation.w, x = inRotation.x, y = inRotation.y, z = inRotation.z;
+
+	return TMatrix3d(TVector3d(1.0 - 2.0 * (y * y + z * z), 2.0 * (x * y - w * z), 2.0 * (x * z + w * y)),
+					 TVector3d(2.0 * (x * y + w * z), 1.0 - 2.0 * (x * x + z * z), 2.0 * (y * z - w * x)),
+					 TVector3d(2.0 * (x * z - w * y), 2.0 * (y * z + w * x), 1.0 - 2.0 * (x * x + y * y)));
+}
+
+//----------------------------------------------------------------------
+//	Class:		ObjectTransforms
+//
+//	Purpose:	Universal transforms of every object in an ObjectHierarchy:
+//
+//				frame	- rotation from the object's coordinate system to the
+//						  Universe's: parent frame * local rotation. The
+//						  object's children live in this frame.
+//				origin	- the object's origin in universal coordinates:
+//						  parent origin + parent frame * local origin.
+//				body	- frame * spin about the local up (z) axis at the
+//						  current time, for objects that spin. The spin only
+//						  turns the body; children don't follow it.
+//
+//				update() recomputes the subtrees of the objects passed to
+//				markLocalChanged() since the last update, and the bodies of
+//				spinning objects if the time moved, nothing else. A frame with
+//				no edits and time frozen costs next to nothing.
+//
+//				The hierarchy must be in breadth-first order. Then the
+//				descendants of an object on any level form one contiguous
+//				range, so a dirty subtree is processed level by level as
+//				ranges, each split across the threads of the JobSystem given
+//				to setJobSystem() when it is large.
+//
+//----------------------------------------------------------------------
+class ObjectTransforms
+{
+	public:
+		ObjectTransforms(const ObjectHierarchy& inHierarchy);
+
+		// Sizes the tables for the hierarchy and marks everything changed. Call after
+		// objects have been added and the hierarchy sorted again, with the indices
+		// sortBreadthFirst() returned so the spins follow their objects.
+		void			rebuild(const std::vector<ObjectIndex>* inNewIndices = NULL);
+
+		// Spreads large updates over inJobs's threads, or keeps them on the calling thread if
+		// inJobs is NULL (the default). update() must then be called on one of inJobs's threads.
+		void			setJobSystem(JobSystem* inJobs) { mJobs = inJobs; };
+
+		// Call after changing an object's local origin or rotation in the hierarchy
+		void			markLocalChanged(ObjectIndex inObject);
+
+		// Spin about the local up axis: angle = inAngleAtEpoch + inRadiansPerSecond * seconds.
+		// A rate of zero with a zero angle removes the spin.
+		void			setSpin(ObjectIndex inObject, double inRadiansPerSecond, double inAngleAtEpoch);
+
+		// Spins are not recomputed until their angle has moved by more than this
+		// (default 0, every time change). Trades exactness for fewer updates when time
+		// moves slowly.
+		void			setSpinTolerance(double inRadians) { mSpinTolerance = inRadians; };
+
+		// Brings everything up to date for inSeconds since the epoch
+		void			update(double inSeconds);
+
+		// Results, valid after update()
+		const ObjectRotation&	getFrame(ObjectIndex inObject) const { return mFrame[inObject]; };
+		TMatrix3d		getFrameMatrix(ObjectIndex inObject) const { return objectRotationToMatrix(mFrame[inObject]); };
+		ObjectRotation	getBody(ObjectIndex inObject) const;
+		TMatrix3d		getBodyMatrix(ObjectIndex inObject) const { return objectRotationToMatrix(getBody(inObject)); };
+		TUniversalVector3	getOrigin(ObjectIndex inObject) const;
+		UniversalPointArrays	getOrigins() const;
+
+		// Objects whose frame and origin the last update() recomputed, and spins it turned
+		size_t			getLastUpdateObjectCount() const { return mLastUpdateObjectCount; };
+		size_t			getLastUpdateSpinCount() const { return mLastUpdateSpinCount; };
+
+	protected:
+		struct Spin
+		{
+			ObjectIndex		object;
+			double			radiansPerSecond;
+			double			angleAtEpoch;
+			double			appliedAngle;
+			ObjectRotation	body;
+		};
+
+		struct Range
+		{
+			ObjectIndex		begin, end;
+		};
+
+		static bool		rangeBeginsBefore(const Range& a, const Range& b);
+		void			updateRange(ObjectIndex inBegin, ObjectIndex inEnd);
+		void			updateObject(ObjectIndex inObject);
+		void			updateSpins(bool inForce);
+		size_t			updateSpinRange(size_t inBegin, size_t inEnd, bool inForce);
+
+		const ObjectHierarchy&		mHierarchy;
+		JobSystem*					mJobs;
+
+		std::vector<ObjectRotation>	mFrame;
+		std::vector<uint64_t>		mOriginLo[3];
+		std::vector<int64_t>		mOriginHi[3];
+
+		// mChildBegin[i] is where the children of object i start, or would start if it had
+		// any; the children of the range [b, e) are then [mChildBegin[b], mChildBegin[e]).
+		std::vector<ObjectIndex>	mChildBegin;
+
+		std::vector<uint8_t>		mChanged;
+		std::vector<ObjectIndex>	mChangedObjects;
+		std::vector<Range>			mRanges;
+		std::vector<Range>			mNextRanges;
+
+		std::vector<uint32_t>		mSpinIndex;		// Per object, into mSpins
+		std::vector<Spin>			mSpins;
+		double						mSpinTolerance;
+		double						mSeconds;
+
+		size_t						mLastUpdateObjectCount;
+		size_t						mLastUpdateSpinCount;
+};
@@ -0,0 +1,849 @@
+#include "stdafx.h"
+#include "UniversalOctree.h"
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <functional>
+
+static const uint64_t kOffsetHi = 3ull << (kUniversalOctreeRootBits - 64);		// 3 * 2^kUniversalOctreeRootBits
+static const double kTwoToThe64 = 18446744073709551616.0;
+static const double kSqrt3 = 1.7320508075688772;
+
+// ---------------------------------------------------------------------------
+// 128-bit helpers for UniversalOctreeCoord
+// ---------------------------------------------------------------------------
+static inline UniversalOctreeCoord octreeCoord(uint64_t inLo, uint64_t inHi)
+{
+	UniversalOctreeCoord result = { inLo, inHi };
+	return result;
+}
+
+// 2^inBit
+static inline UniversalOctreeCoord octreePowerOfTwo(int inBit)
+{
+	return (inBit >= 64) ? octreeCoord(0, 1ull << (inBit - 64)) : octreeCoord(1ull << inBit, 0);
+}
+
+static inline UniversalOctreeCoord octreeAdd(const UniversalOctreeCoord& a, const UniversalOctreeCoord& b)
+{
+	UniversalOctreeCoord result;
+	result.lo = a.lo + b.lo;
+	result.hi = a.hi + b.hi + ((result.lo < a.lo) ? 1 : 0);
+
+	return result;
+}
+
+static inline UniversalOctreeCoord octreeSub(const UniversalOctreeCoord& a, const UniversalOctreeCoord& b)
+{
+	UniversalOctreeCoord result;
+	result.lo = a.lo - b.lo;
+	result.hi = a.hi - b.hi - ((a.lo < b.lo) ? 1 : 0);
+
+	return result;
+}
+
+static inline bool octreeLess(const UniversalOctreeCoord& a, const UniversalOctreeCoord& b)
+{
+	return (a.hi < b.hi) || ((a.hi == b.hi) && (a.lo < b.lo));
+}
+
+static inline bool octreeEqual(const UniversalOctreeCoord& a, const UniversalOctreeCoord& b)
+{
+	return (a.hi == b.hi) && (a.lo == b.lo);
+}
+
+static inline int octreeBit(const UniversalOctreeCoord& inValue, int inBit)
+{
+	return (int)(((inBit >= 64) ? (inValue.hi >> (inBit - 64)) : (inValue.lo >> inBit)) & 1);
+}
+
+// inValue with bits below inBits cleared
+static inline UniversalOctreeCoord octreeClearBelow(const UniversalOctreeCoord& inValue, int inBits)
+{
+	if (inBits >= 64)
+		return octreeCoord(0, (inBits >= 128) ? 0 : (inValue.hi & ~((1ull << (inBits - 64)) - 1)));
+
+	return octreeCoord(inValue.lo & ~((1ull << inBits) - 1), inValue.hi);
+}
+
+// (double)(a - b) with the difference taken exactly. The low word is made signed (as in
+// UniversalPointBatch) so small differences convert with a single rounding.
+static inline double octreeDifference(const UniversalOctreeCoord& a, const UniversalOctreeCoord& b)
+{
+	UniversalOctreeCoord d = octreeSub(a, b);
+	d.hi += (d.lo >> 63);
+
+	return (double)(int64_t)d.hi * kTwoToThe64 + (double)(int64_t)d.lo;
+}
+
+// Distance from inValue to [inLower, inUpper], 0 inside. Only the difference to the nearer
+// face is converted, so a cell's width never cancels against the query's distance from it.
+static inline double octreeDistanceOutside(const UniversalOctreeCoord& inValue, const UniversalOctreeCoord& inLower,
+										   const UniversalOctreeCoord& inUpper)
+{
+	if (octreeLess(inValue, inLower))
+		return octreeDifference(inLower, inValue);
+	if (octreeLess(inUpper, inValue))
+		return octreeDifference(inValue, inUpper);
+
+	return 0.0;
+}
+
+// Width of a cell on inLevel
+static inline int octreeCellBits(int inLevel)
+{
+	return kUniversalOctreeRootBits + 1 - inLevel;
+}
+
+static inline double octreeCellWidth(int inLevel)
+{
+	return ldexp(1.0, octreeCellBits(inLevel));
+}
+
+// Returns false if inValue is outside the root cell
+static inline bool octreeCoordFromUniversal(const UniversalCoord& inValue, UniversalOctreeCoord& outCoord)
+{
+	int64_t hi = (int64_t)inValue.table[1];
+	outCoord.lo = inValue.table[0];
+	outCoord.hi = (uint64_t)hi + kOffsetHi;
+
+	const int64_t kRootHi = (int64_t)1 << (kUniversalOctreeRootBits - 64);
+	return (hi >= -kRootHi) && (hi < kRootHi);
+}
+
+// For query bounds: anything beyond the representable range is pulled in to its edge
+static inline UniversalOctreeCoord octreeCoordSaturated(const UniversalCoord& inValue)
+{
+	UniversalOctreeCoord result;
+	int64_t hi = (int64_t)inValue.table[1];
+	if (hi < -(int64_t)kOffsetHi)
+		return octreeCoord(0, 0);
+
+	result.lo = inValue.table[0];
+	result.hi = (uint64_t)hi + kOffsetHi;
+
+	return result;
+}
+
+static inline void octreeCoordsFromVector(const TUniversalVector3& inVector, UniversalOctreeCoord outCoords[3])
+{
+	outCoords[0] = octreeCoordSaturated(inVector.x);
+	outCoords[1] = octreeCoordSaturated(inVector.y);
+	outCoords[2] = octreeCoordSaturated(inVector.z);
+}
+
+// Deepest level whose cells are at least 2 * inRadius wide
+static inline int octreeLevelForRadius(double inRadius)
+{
+	if (!(inRadius > 1.0))
+		return kUniversalOctreeMaxLevel;
+
+	int exponent;
+	double mantissa = frexp(inRadius, &exponent);
+	int ceilLog2 = (mantissa > 0.5) ? exponent : exponent - 1;
+
+	return std::max(0, std::min(kUniversalOctreeMaxLevel, kUniversalOctreeRootBits - ceilLog2));
+}
+
+UniversalOctree::UniversalOctree(uint32_t inMaxObjectsPerNode) : mMaxObjectsPerNode(std::max(inMaxObjectsPerNode, (uint32_t)1)),
+																 mObjectCount(0),
+																 mTrackChanges(false)
+{
+}
+
+void UniversalOctree::clear()
+{
+	mNodes.clear();
+	mObjectCount = 0;
+	mNodeChanged.clear();
+	mChangedNodes.clear();
+	mObjectNode.assign(mObjectNode.size(), kNoOctreeNode);
+}
+
+uint32_t UniversalOctree::createRoot()
+{
+	Node root;
+	for (int axis = 0; axis < 3; axis++)
+		root.min[axis] = octreeCoord(0, kOffsetHi - (1ull << (kUniversalOctreeRootBits - 64)));
+	root.firstChild = kNoOctreeNode;
+	root.parent = kNoOctreeNode;
+	root.firstObject = kNoObject;
+	root.objectCount = 0;
+	root.subtreeObjectCount = 0;
+	root.level = 0;
+	mNodes.push_back(root);
+
+	return 0;
+}
+
+void UniversalOctree::reserveObject(ObjectIndex inObject)
+{
+	if (inObject < mObjectNode.size())
+		return;
+
+	size_t count = inObject + 1;
+	mObjectNode.resize(count, kNoOctreeNode);
+	mObjectNext.resize(count);
+	mObjectPrevious.resize(count);
+	for (int axis = 0; axis < 3; axis++)
+		mObjectCenter[axis].resize(count);
+	mObjectRadius.resize(count);
+	mObjectLevel.resize(count);
+}
+
+void UniversalOctree::setObject(ObjectIndex inObject, const UniversalOctreeCoord inCenter[3], double inRadius)
+{
+	for (int axis = 0; axis < 3; axis++)
+		mObjectCenter[axis][inObject] = inCenter[axis];
+	mObjectRadius[inObject] = inRadius;
+	mObjectLevel[inObject] = (uint8_t)octreeLevelForRadius(inRadius);
+}
+
+// ---------------------------------------------------------------------------
+// UniversalOctree::threadObject									  [protected]
+//
+//	Puts inObject at the front of the list of inNode, leaving the counts
+//	above it alone.
+// ---------------------------------------------------------------------------
+void UniversalOctree::threadObject(ObjectIndex inObject, uint32_t inNode)
+{
+	Node& node = mNodes[inNode];
+	mObjectPrevious[inObject] = kNoObject;
+	mObjectNext[inObject] = node.firstObject;
+	if (node.firstObject != kNoObject)
+		mObjectPrevious[node.firstObject] = inObject;
+	node.firstObject = inObject;
+	node.objectCount++;
+	mObjectNode[inObject] = inNode;
+}
+
+void UniversalOctree::linkObject(ObjectIndex inObject, uint32_t inNode)
+{
+	threadObject(inObject, inNode);
+	markNodeChanged(inNode);
+	for (uint32_t n = inNode; n != kNoOctreeNode; n = mNodes[n].parent)
+		mNodes[n].subtreeObjectCount++;
+	mObjectCount++;
+}
+
+void UniversalOctree::unlinkObject(ObjectIndex inObject)
+{
+	uint32_t nodeIndex = mObjectNode[inObject];
+	Node& node = mNodes[nodeIndex];
+	ObjectIndex next = mObjectNext[inObject];
+	ObjectIndex previous = mObjectPrevious[inObject];
+	if (previous != kNoObject)
+		mObjectNext[previous] = next;
+	else
+		node.firstObject = next;
+	if (next != kNoObject)
+		mObjectPrevious[next] = previous;
+	node.objectCount--;
+	mObjectNode[inObject] = kNoOctreeNode;
+	markNodeChanged(nodeIndex);
+
+	for (uint32_t n = nodeIndex; n != kNoOctreeNode; n = mNodes[n].parent)
+		mNodes[n].subtreeObjectCount--;
+	mObjectCount--;
+}
+
+// ---------------------------------------------------------------------------
+// UniversalOctree::findNode										  [protected]
+//
+//	The node an object with inCenter that fits on inLevel belongs to: down
+//	from the root through the cells containing inCenter until the level or a
+//	leaf is reached.
+// ---------------------------------------------------------------------------
+uint32_t UniversalOctree::findNode(const UniversalOctreeCoord inCenter[3], int inLevel) const
+{
+	uint32_t node = 0;
+	while ((mNodes[node].firstChild != kNoOctreeNode) && (mNodes[node].level < inLevel))
+	{
+		int bit = octreeCellBits(mNodes[node].level) - 1;
+		int octant = octreeBit(inCenter[0], bit) | (octreeBit(inCenter[1], bit) << 1) | (octreeBit(inCenter[2], bit) << 2);
+		node = mNodes[node].firstChild + octant;
+	}
+
+	return node;
+}
+
+// ---------------------------------------------------------------------------
+// UniversalOctree::split											  [protected]
+//
+//	Gives a leaf its 8 children and moves the objects that fit deeper down,
+//	splitting the children in turn if they are still too full.
+// ---------------------------------------------------------------------------
+void UniversalOctree::split(uint32_t inNode)
+{
+	int level = mNodes[inNode].level;
+	if ((level >= kUniversalOctreeMaxLevel) || (mNodes[inNode].firstChild != kNoOctreeNode))
+		return;
+
+	uint32_t firstChild = (uint32_t)mNodes.size();
+	UniversalOctreeCoord halfWidth = octreePowerOfTwo(octreeCellBits(level) - 1);
+	for (int octant = 0; octant < 8; octant++)
+	{
+		Node child;
+		for (int axis = 0; axis < 3; axis++)
+			child.min[axis] = (octant & (1 << axis)) ? octreeAdd(mNodes[inNode].min[axis], halfWidth) : mNodes[inNode].min[axis];
+		child.firstChild = kNoOctreeNode;
+		child.parent = inNode;
+		child.firstObject = kNoObject;
+		child.objectCount = 0;
+		child.subtreeObjectCount = 0;
+		child.level = level + 1;
+		mNodes.push_back(child);
+	}
+	mNodes[inNode].firstChild = firstChild;
+
+	int bit = octreeCellBits(level) - 1;
+	ObjectIndex object = mNodes[inNode].firstObject;
+	while (object != kNoObject)
+	{
+		ObjectIndex next = mObjectNext[object];
+		if (mObjectLevel[object] > level)
+		{
+			int octant = octreeBit(mObjectCenter[0][object], bit) | (octreeBit(mObjectCenter[1][object], bit) << 1) |
+						 (octreeBit(mObjectCenter[2][object], bit) << 2);
+			unlinkObject(object);
+			linkObject(object, firstChild + octant);
+		}
+		object = next;
+	}
+
+	for (int octant = 0; octant < 8; octant++)
+	{
+		if (needsSplit(firstChild + octant))
+			split(firstChild + octant);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// UniversalOctree::needsSplit										  [protected]
+//
+//	A leaf needs splitting when more than mMaxObjectsPerNode of its objects
+//	would fit in its children.
+// ---------------------------------------------------------------------------
+bool UniversalOctree::needsSplit(uint32_t inNode) const
+{
+	const Node& node = mNodes[inNode];
+	if ((node.firstChild != kNoOctreeNode) || (node.objectCount <= mMaxObjectsPerNode) || (node.level >= kUniversalOctreeMaxLevel))
+		return false;
+
+	uint32_t deeper = 0;
+	for (ObjectIndex object = node.firstObject; object != kNoObject; object = mObjectNext[object])
+	{
+		if (mObjectLevel[object] > node.level)
+			deeper++;
+	}
+
+	return deeper > mMaxObjectsPerNode;
+}
+
+void UniversalOctree::splitLeaf(uint32_t inNode)
+{
+	split(inNode);
+}
+
+bool UniversalOctree::insert(ObjectIndex inObject, const TUniversalVector3& inCenter, double inRadius)
+{
+	UniversalOctreeCoord center[3];
+	bool inside = octreeCoordFromUniversal(inCenter.x, center[0]) &&
+				  octreeCoordFromUniversal(inCenter.y, center[1]) &&
+				  octreeCoordFromUniversal(inCenter.z, center[2]);
+
+	reserveObject(inObject);
+	if (mObjectNode[inObject] != kNoOctreeNode)
+		unlinkObject(inObject);
+	if (!inside)
+		return false;
+
+	if (mNodes.empty())
+		createRoot();
+
+	setObject(inObject, center, inRadius);
+	uint32_t node = findNode(center, mObjectLevel[inObject]);
+	linkObject(inObject, node);
+	if (needsSplit(node))
+		split(node);
+
+	return true;
+}
+
+bool UniversalOctree::move(ObjectIndex inObject, const TUniversalVector3& inCenter, double inRadius)
+{
+	if (!contains(inObject))
+		return insert(inObject, inCenter, inRadius);
+
+	UniversalOctreeCoord center[3];
+	bool inside = octreeCoordFromUniversal(inCenter.x, center[0]) &&
+				  octreeCoordFromUniversal(inCenter.y, center[1]) &&
+				  octreeCoordFromUniversal(inCenter.z, center[2]);
+
+	// Most moves stay inside the cell: then only the object's own entries change
+	const Node& node = mNodes[mObjectNode[inObject]];
+	int level = octreeLevelForRadius(inRadius);
+	int cellBits = octreeCellBits(node.level);
+	bool stays = inside && (level >= node.level) && ((node.firstChild == kNoOctreeNode) || (level == node.level));
+	for (int axis = 0; stays && (axis < 3); axis++)
+		stays = octreeEqual(octreeClearBelow(center[axis], cellBits), node.min[axis]);
+
+	if (!stays)
+		return insert(inObject, inCenter, inRadius);
+
+	setObject(inObject, center, inRadius);
+	markNodeChanged(mObjectNode[inObject]);
+
+	return true;
+}
+
+void UniversalOctree::remove(ObjectIndex inObject)
+{
+	if (contains(inObject))
+		unlinkObject(inObject);
+}
+
+bool UniversalOctree::contains(ObjectIndex inObject) const
+{
+	return (inObject < mObjectNode.size()) && (mObjectNode[inObject] != kNoOctreeNode);
+}
+
+void UniversalOctree::build(const UniversalPointArrays& inCenters, const double* inRadii)
+{
+	clear();
+	if (inCenters.count == 0)
+		return;
+
+	reserveObject((ObjectIndex)(inCenters.count - 1));
+	mBuildObjects.clear();
+	mBuildObjects.reserve(inCenters.count);
+	for (size_t i = 0; i < inCenters.count; i++)
+	{
+		UniversalOctreeCoord center[3];
+		bool inside = true;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			UniversalCoord value;
+			value.table[0] = inCenters.lo[axis][i];
+			value.table[1] = (ttmath::uint)inCenters.hi[axis][i];
+			inside &= octreeCoordFromUniversal(value, center[axis]);
+		}
+
+		if (inside)
+		{
+			setObject((ObjectIndex)i, center, (inRadii != NULL) ? inRadii[i] : 0.0);
+			mBuildObjects.push_back((ObjectIndex)i);
+		}
+	}
+
+	mBuildScratch.resize(mBuildObjects.size());
+	buildNode(createRoot(), 0, mBuildObjects.size());
+	mObjectCount = mBuildObjects.size();
+}
+
+// ---------------------------------------------------------------------------
+// UniversalOctree::buildNode										  [protected]
+//
+//	mBuildObjects[inBegin, inEnd) are the objects in the cell of inNode. The
+//	ones that fit deeper are sorted by octant and handed to the children.
+//	Every count is set once, here, rather than up the parents per object.
+// ---------------------------------------------------------------------------
+void UniversalOctree::buildNode(uint32_t inNode, size_t inBegin, size_t inEnd)
+{
+	int level = mNodes[inNode].level;
+
+	// Objects that stay here first
+	size_t deeperBegin = inBegin;
+	for (size_t i = inBegin; i < inEnd; i++)
+	{
+		if (mObjectLevel[mBuildObjects[i]] <= level)
+			std::swap(mBuildObjects[i], mBuildObjects[deeperBegin++]);
+	}
+
+	bool leaf = ((inEnd - deeperBegin) <= mMaxObjectsPerNode) || (level >= kUniversalOctreeMaxLevel);
+	size_t linkEnd = leaf ? inEnd : deeperBegin;
+	for (size_t i = inBegin; i < linkEnd; i++)
+		threadObject(mBuildObjects[i], inNode);
+	mNodes[inNode].subtreeObjectCount = (uint32_t)(inEnd - inBegin);
+	if (leaf)
+		return;
+
+	// Counting sort of the rest by octant
+	int bit = octreeCellBits(level) - 1;
+	size_t octantBegin[9] = { 0 };
+	for (size_t i = deeperBegin; i < inEnd; i++)
+	{
+		ObjectIndex object = mBuildObjects[i];
+		int octant = octreeBit(mObjectCenter[0][object], bit) | (octreeBit(mObjectCenter[1][object], bit) << 1) |
+					 (octreeBit(mObjectCenter[2][object], bit) << 2);
+		octantBegin[octant + 1]++;
+	}
+	octantBegin[0] = deeperBegin;
+	for (int octant = 1; octant <= 8; octant++)
+		octantBegin[octant] += octantBegin[octant - 1];
+
+	size_t octantNext[8];
+	std::copy(octantBegin, octantBegin + 8, octantNext);
+	for (size_t i = deeperBegin; i < inEnd; i++)
+	{
+		ObjectIndex object = mBuildObjects[i];
+		int octant = octreeBit(mObjectCenter[0][object], bit) | (octreeBit(mObjectCenter[1][object], bit) << 1) |
+					 (octreeBit(mObjectCenter[2][object], bit) << 2);
+		mBuildScratch[octantNext[octant]++] = object;
+	}
+	std::copy(mBuildScratch.begin() + deeperBegin, mBuildScratch.begin() + inEnd, mBuildObjects.begin() + deeperBegin);
+
+	// split() of an empty leaf only creates the children
+	split(inNode);
+	uint32_t firstChild = mNodes[inNode].firstChild;
+	for (int octant = 0; octant < 8; octant++)
+		buildNode(firstChild + octant, octantBegin[octant], octantBegin[octant + 1]);
+}
+
+// ---------------------------------------------------------------------------
+// UniversalOctree::sphereInCone									  [protected]
+//
+//	Exact sphere against (infinite) cone test, cut off at the cone's range.
+//	Behind the apex the nearest point of the cone is the apex itself.
+// ---------------------------------------------------------------------------
+bool UniversalOctree::sphereInCone(const Cone& inCone, const UniversalOctreeCoord inCenter[3], double inRadius) const
+{
+	TVector3d v(octreeDifference(inCenter[0], inCone.apex[0]),
+				octreeDifference(inCenter[1], inCone.apex[1]),
+				octreeDifference(inCenter[2], inCone.apex[2]));
+	double length = v.Length();
+	if (length <= inRadius)
+		return true;
+	if (length - inRadius > inCone.range)
+		return false;
+
+	double along = v * inCone.axis;
+	double across = sqrt(std::max(0.0, length * length - along * along));
+	double distance = (along * inCone.cosHalfAngle + across * inCone.sinHalfAngle < 0.0) ? length :
+					  across * inCone.cosHalfAngle - along * inCone.sinHalfAngle;
+
+	return distance <= inRadius;
+}
+
+void UniversalOctree::queryBox(const TUniversalVector3& inMin, const TUniversalVector3& inMax,
+							   std::vector<ObjectIndex>& outObjects) const
+{
+	if (mNodes.empty())
+		return;
+
+	UniversalOctreeCoord queryMin[3], queryMax[3];
+	octreeCoordsFromVector(inMin, queryMin);
+	octreeCoordsFromVector(inMax, queryMax);
+
+	mStack.clear();
+	mStack.push_back(0);
+	while (!mStack.empty())
+	{
+		const Node& node = mNodes[mStack.back()];
+		mStack.pop_back();
+		if (node.subtreeObjectCount == 0)
+			continue;
+
+		// Loose bounds [min - width / 2, min + width * 3 / 2)
+		UniversalOctreeCoord halfWidth = octreePowerOfTwo(octreeCellBits(node.level) - 1);
+		UniversalOctreeCoord threeHalvesWidth = octreeAdd(halfWidth, octreePowerOfTwo(octreeCellBits(node.level)));
+		bool overlaps = true;
+		for (int axis = 0; overlaps && (axis < 3); axis++)
+		{
+			overlaps = !octreeLess(queryMax[axis], octreeSub(node.min[axis], halfWidth)) &&
+					   octreeLess(queryMin[axis], octreeAdd(node.min[axis], threeHalvesWidth));
+		}
+		if (!overlaps)
+			continue;
+
+		for (ObjectIndex object = node.firstObject; object != kNoObject; object = mObjectNext[object])
+		{
+			double distanceSquared = 0.0;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				double d = octreeDistanceOutside(mObjectCenter[axis][object], queryMin[axis], queryMax[axis]);
+				distanceSquared += d * d;
+			}
+			if (distanceSquared <= mObjectRadius[object] * mObjectRadius[object])
+				outObjects.push_back(object);
+		}
+
+		if (node.firstChild != kNoOctreeNode)
+		{
+			for (uint32_t child = 0; child < 8; child++)
+				mStack.push_back(node.firstChild + child);
+		}
+	}
+}
+
+void UniversalOctree::querySphere(const TUniversalVector3& inCenter, double inRadius,
+								  std::vector<ObjectIndex>& outObjects) const
+{
+	if (mNodes.empty())
+		return;
+
+	UniversalOctreeCoord query[3];
+	octreeCoordsFromVector(inCenter, query);
+
+	mStack.clear();
+	mStack.push_back(0);
+	while (!mStack.empty())
+	{
+		const Node& node = mNodes[mStack.back()];
+		mStack.pop_back();
+		if (node.subtreeObjectCount == 0)
+			continue;
+
+		// Distance to the loose bounds [min - width / 2, min + width * 3 / 2]
+		UniversalOctreeCoord halfWidth = octreePowerOfTwo(octreeCellBits(node.level) - 1);
+		UniversalOctreeCoord threeHalvesWidth = octreeAdd(halfWidth, octreePowerOfTwo(octreeCellBits(node.level)));
+		double distanceSquared = 0.0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			double d = octreeDistanceOutside(query[axis], octreeSub(node.min[axis], halfWidth),
+											 octreeAdd(node.min[axis], threeHalvesWidth));
+			distanceSquared += d * d;
+		}
+		if (distanceSquared > inRadius * inRadius)
+			continue;
+
+		for (ObjectIndex object = node.firstObject; object != kNoObject; object = mObjectNext[object])
+		{
+			TVector3d v(octreeDifference(mObjectCenter[0][object], query[0]),
+						octreeDifference(mObjectCenter[1][object], query[1]),
+						octreeDifference(mObjectCenter[2][object], query[2]));
+			double reach = inRadius + mObjectRadius[object];
+			if (v.LengthSquared() <= reach * reach)
+				outObjects.push_back(object);
+		}
+
+		if (node.firstChild != kNoOctreeNode)
+		{
+			for (uint32_t child = 0; child < 8; child++)
+				mStack.push_back(node.firstChild + child);
+		}
+	}
+}
+
+void UniversalOctree::queryCone(const TUniversalVector3& inApex, const TVector3d& inAxis, double inHalfAngle,
+								double inRange, std::vector<ObjectIndex>& outObjects) const
+{
+	if (mNodes.empty())
+		return;
+
+	Cone cone;
+	octreeCoordsFromVector(inApex, cone.apex);
+	cone.axis = inAxis;
+	cone.cosHalfAngle = cos(inHalfAngle);
+	cone.sinHalfAngle = sin(inHalfAngle);
+	cone.range = inRange;
+
+	mStack.clear();
+	mStack.push_back(0);
+	while (!mStack.empty())
+	{
+		const Node& node = mNodes[mStack.back()];
+		mStack.pop_back();
+		if (node.subtreeObjectCount == 0)
+			continue;
+
+		// Sphere around the loose bounds: same centre as the cell, sqrt(3) cell widths
+		UniversalOctreeCoord cellCenter[3];
+		UniversalOctreeCoord halfWidth = octreePowerOfTwo(octreeCellBits(node.level) - 1);
+		for (int axis = 0; axis < 3; axis++)
+			cellCenter[axis] = octreeAdd(node.min[axis], halfWidth);
+		if (!sphereInCone(cone, cellCenter, kSqrt3 * octreeCellWidth(node.level)))
+			continue;
+
+		for (ObjectIndex object = node.firstObject; object != kNoObject; object = mObjectNext[object])
+		{
+			UniversalOctreeCoord center[3] = { mObjectCenter[0][object], mObjectCenter[1][object], mObjectCenter[2][object] };
+			if (sphereInCone(cone, center, mObjectRadius[object]))
+				outObjects.push_back(object);
+		}
+
+		if (node.firstChild != kNoOctreeNode)
+		{
+			for (uint32_t child = 0; child < 8; child++)
+				mStack.push_back(node.firstChild + child);
+		}
+	}
+}
+
+void UniversalOctree::queryNearest(const TUniversalVector3& inPoint, size_t inCount,
+								   std::vector<ObjectIndex>& outObjects, std::vector<double>* outDistances) const
+{
+	if (mNodes.empty() || (inCount == 0))
+		return;
+
+	UniversalOctreeCoord query[3];
+	octreeCoordsFromVector(inPoint, query);
+
+	// Nodes nearest first (a min heap on the distance to the cell: centres never leave their
+	// cell, so nothing in the node can be nearer) and the best objects so far (a max heap)
+	typedef std::pair<double, uint32_t> Entry;
+	std::vector<Entry> nodes, best;
+	nodes.push_back(Entry(0.0, 0));
+	while (!nodes.empty())
+	{
+		std::pop_heap(nodes.begin(), nodes.end(), std::greater<Entry>());
+		Entry entry = nodes.back();
+		nodes.pop_back();
+		if ((best.size() == inCount) && (entry.first > best.front().first))
+			break;
+
+		const Node& node = mNodes[entry.second];
+		for (ObjectIndex object = node.firstObject; object != kNoObject; object = mObjectNext[object])
+		{
+			TVector3d v(octreeDifference(mObjectCenter[0][object], query[0]),
+						octreeDifference(mObjectCenter[1][object], query[1]),
+						octreeDifference(mObjectCenter[2][object], query[2]));
+			double distanceSquared = v.LengthSquared();
+			if (best.size() < inCount)
+			{
+				best.push_back(Entry(distanceSquared, object));
+				std::push_heap(best.begin(), best.end());
+			}
+			else if (distanceSquared < best.front().first)
+			{
+				std::pop_heap(best.begin(), best.end());
+				best.back() = Entry(distanceSquared, object);
+				std::push_heap(best.begin(), best.end());
+			}
+		}
+
+		if (node.firstChild == kNoOctreeNode)
+			continue;
+
+		UniversalOctreeCoord width = octreePowerOfTwo(octreeCellBits(node.level + 1));
+		for (uint32_t child = node.firstChild; child < node.firstChild + 8; child++)
+		{
+			if (mNodes[child].subtreeObjectCount == 0)
+				continue;
+
+			double distanceSquared = 0.0;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				double d = octreeDistanceOutside(query[axis], mNodes[child].min[axis],
+												 octreeAdd(mNodes[child].min[axis], width));
+				distanceSquared += d * d;
+			}
+			if ((best.size() < inCount) || (distanceSquared <= best.front().first))
+			{
+				nodes.push_back(Entry(distanceSquared, child));
+				std::push_heap(nodes.begin(), nodes.end(), std::greater<Entry>());
+			}
+		}
+	}
+
+	std::sort_heap(best.begin(), best.end());
+	for (size_t i = 0; i < best.size(); i++)
+	{
+		outObjects.push_back(best[i].second);
+		if (outDistances != NULL)
+			outDistances->push_back(sqrt(best[i].first));
+	}
+}
+
+void UniversalOctree::setTrackChanges(bool inTrackChanges)
+{
+	mTrackChanges = inTrackChanges;
+	mNodeChanged.clear();
+	mChangedNodes.clear();
+}
+
+void UniversalOctree::takeChangedNodes(std::vector<uint32_t>& outNodes)
+{
+	outNodes.swap(mChangedNodes);
+	mChangedNodes.clear();
+	for (size_t i = 0; i < outNodes.size(); i++)
+		mNodeChanged[outNodes[i]] = 0;
+}
+
+// ---------------------------------------------------------------------------
+// UniversalOctree::markNodeChanged									  [protected]
+// ---------------------------------------------------------------------------
+void UniversalOctree::markNodeChanged(uint32_t inNode)
+{
+	if (!mTrackChanges)
+		return;
+
+	if (inNode >= mNodeChanged.size())
+		mNodeChanged.resize(mNodes.size(), 0);
+	if (mNodeChanged[inNode] == 0)
+	{
+		mNodeChanged[inNode] = 1;
+		mChangedNodes.push_back(inNode);
+	}
+}
+
+TUniversalVector3 UniversalOctree::getNodeCenter(uint32_t inNode) const
+{
+	UniversalOctreeCoord halfWidth = octreePowerOfTwo(octreeCellBits(mNodes[inNode].level) - 1);
+	UniversalCoord axes[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		UniversalOctreeCoord center = octreeAdd(mNodes[inNode].min[axis], halfWidth);
+		axes[axis].table[0] = center.lo;
+		axes[axis].table[1] = (ttmath::uint)(center.hi - kOffsetHi);
+	}
+
+	return TUniversalVector3(axes[0], axes[1], axes[2]);
+}
+
+double UniversalOctree::getNodeWidth(uint32_t inNode) const
+{
+	return octreeCellWidth(mNodes[inNode].level);
+}
+
+TVector3d UniversalOctree::getObjectOffset(ObjectIndex inObject) const
+{
+	const Node& node = mNodes[mObjectNode[inObject]];
+	UniversalOctreeCoord halfWidth = octreePowerOfTwo(octreeCellBits(node.level) - 1);
+	double result[3];
+	for (int axis = 0; axis < 3; axis++)
+		result[axis] = octreeDifference(mObjectCenter[axis][inObject], octreeAdd(node.min[axis], halfWidth));
+
+	return TVector3d(result[0], result[1], result[2]);
+}
+
+void UniversalOctree::getStats(UniversalOctreeStats& outStats) const
+{
+	outStats.nodeCount = mNodes.size();
+	outStats.leafCount = 0;
+	outStats.emptyLeafCount = 0;
+	outStats.objectCount = mObjectCount;
+	outStats.maxObjectsInNode = 0;
+	outStats.deepestLevel = 0;
+	outStats.nodesPerLevel.clear();
+	outStats.objectsPerLevel.clear();
+	outStats.occupancyHistogram.clear();
+
+	for (size_t i = 0; i < mNodes.size(); i++)
+	{
+		const Node& node = mNodes[i];
+		if (node.firstChild == kNoOctreeNode)
+		{
+			outStats.leafCount++;
+			if (node.objectCount == 0)
+				outStats.emptyLeafCount++;
+		}
+		outStats.maxObjectsInNode = std::max(outStats.maxObjectsInNode, (size_t)node.objectCount);
+		outStats.deepestLevel = std::max(outStats.deepestLevel, node.level);
+
+		if (outStats.nodesPerLevel.size() <= (size_t)node.level)
+		{
+			outStats.nodesPerLevel.resize(node.level + 1, 0);
+			outStats.objectsPerLevel.resize(node.level + 1, 0);
+		}
+		outStats.nodesPerLevel[node.level]++;
+		outStats.objectsPerLevel[node.level] += node.objectCount;
+
+		size_t bucket = 0;
+		for (uint32_t count = node.objectCount; count > 0; count >>= 1)
+			bucket++;
+		if (outStats.occupancyHistogram.size() <= bucket)
+			outStats.occupancyHistogram.resize(bucket + 1, 0);
+		outStats.occupancyHistogram[bucket]++;
+	}
+}
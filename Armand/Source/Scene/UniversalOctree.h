@@ -0,0 +1,204 @@
+//----------------------------------------------------------------------
+//	File:		UniversalOctree.h
+//
+//	Contains:	Loose octree over 128-bit universal coordinates for
+//				range, cone and nearest neighbour queries.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "ObjectHierarchy.h"
+
+// The root cell spans [-2^kUniversalOctreeRootBits, 2^kUniversalOctreeRootBits) mm on every axis,
+// some 3 * 10^15 times the radius of the observable Universe. A cell on level n is
+// 2^(kUniversalOctreeRootBits + 1 - n) mm wide; cells stop splitting at kUniversalOctreeMaxLevel
+// (32 mm) however many objects share them.
+const int kUniversalOctreeRootBits = 120;
+const int kUniversalOctreeMaxLevel = 116;
+
+const uint32_t kNoOctreeNode = 0xffffffff;
+
+//----------------------------------------------------------------------
+//	Struct:		UniversalOctreeCoord
+//
+//	Purpose:	A universal coordinate offset by 3 * 2^kUniversalOctreeRootBits
+//				so it is unsigned and the root cell starts on a multiple of its
+//				width: cell bounds are then the coordinate with its low bits
+//				cleared, exactly, and even the loose bounds of the root never
+//				wrap.
+//
+//----------------------------------------------------------------------
+struct UniversalOctreeCoord
+{
+	uint64_t		lo;
+	uint64_t		hi;
+};
+
+//----------------------------------------------------------------------
+//	Struct:		UniversalOctreeStats
+//
+//	Purpose:	Occupancy of the tree, from UniversalOctree::getStats().
+//
+//----------------------------------------------------------------------
+struct UniversalOctreeStats
+{
+	size_t				nodeCount;
+	size_t				leafCount;
+	size_t				emptyLeafCount;
+	size_t				objectCount;
+	size_t				maxObjectsInNode;
+	int					deepestLevel;
+	std::vector<size_t>	nodesPerLevel;
+	std::vector<size_t>	objectsPerLevel;
+	std::vector<size_t>	occupancyHistogram;	// Nodes holding 0, 1, 2-3, 4-7, 8-15... objects
+};
+
+//----------------------------------------------------------------------
+//	Class:		UniversalOctree
+//
+//	Purpose:	Loose octree of bounding spheres, keyed by ObjectIndex.
+//
+//				An object is kept in the cell containing its centre on the
+//				deepest level whose cells are at least twice its radius wide,
+//				or higher up if the tree isn't that deep there. Its sphere then
+//				lies within the cell's loose bounds: the cell grown by half its
+//				width on every side. Cells split when they hold more than
+//				inMaxObjectsPerNode objects that could go deeper.
+//
+//				All cell bounds are exact 128-bit integers and every distance
+//				is taken as an exact 128-bit difference before it becomes a
+//				double, so queries are as precise at the edge of the Universe
+//				as they are at the origin.
+//
+//				Nodes are one table, the 8 children of a node contiguous in it;
+//				objects are tables indexed by ObjectIndex with their node's list
+//				threaded through them. Nothing is allocated per object.
+//
+//----------------------------------------------------------------------
+class UniversalOctree
+{
+	public:
+		UniversalOctree(uint32_t inMaxObjectsPerNode = 32);
+
+		void			clear();
+
+		// Replaces the contents with objects 0 .. inCenters.count - 1. inRadii may be NULL
+		// for points. Objects outside the root cell are left out.
+		void			build(const UniversalPointArrays& inCenters, const double* inRadii);
+
+		// Returns false if inCenter is outside the root cell. Inserting an object that is
+		// already in the tree moves it.
+		bool			insert(ObjectIndex inObject, const TUniversalVector3& inCenter, double inRadius = 0.0);
+		bool			move(ObjectIndex inObject, const TUniversalVector3& inCenter, double inRadius = 0.0);
+		void			remove(ObjectIndex inObject);
+		bool			contains(ObjectIndex inObject) const;
+
+		size_t			getObjectCount() const { return mObjectCount; };
+
+		// Queries append to outObjects, in no particular order except for the nearest
+		// neighbours which are nearest first. Spheres that touch the query count.
+		void			queryBox(const TUniversalVector3& inMin, const TUniversalVector3& inMax,
+								 std::vector<ObjectIndex>& outObjects) const;
+		void			querySphere(const TUniversalVector3& inCenter, double inRadius,
+									std::vector<ObjectIndex>& outObjects) const;
+		// Cone with its apex at inApex around the unit vector inAxis, out to inRange mm
+		void			queryCone(const TUniversalVector3& inApex, const TVector3d& inAxis, double inHalfAngle,
+								  double inRange, std::vector<ObjectIndex>& outObjects) const;
+		// The inCount objects with centres nearest inPoint; outDistances (mm) may be NULL
+		void			queryNearest(const TUniversalVector3& inPoint, size_t inCount,
+									 std::vector<ObjectIndex>& outObjects, std::vector<double>* outDistances = NULL) const;
+
+		void			getStats(UniversalOctreeStats& outStats) const;
+
+		// Splits a leaf however few objects it has, for callers that need smaller cells
+		// somewhere. Leaves at the deepest level are left as they are.
+		void			splitLeaf(uint32_t inNode);
+
+		// Read access to the nodes, for caches built over the tree. Node 0 is the root;
+		// the objects of a node are listed from getNodeFirstObject() through getNextObject().
+		// Child i of a node is octant i: bit 0 set for the upper half in x, bit 1 in y, bit 2 in z.
+		size_t			getNodeCount() const { return mNodes.size(); };
+		uint32_t		getNodeFirstChild(uint32_t inNode) const { return mNodes[inNode].firstChild; };
+		uint32_t		getNodeParent(uint32_t inNode) const { return mNodes[inNode].parent; };
+		int				getNodeLevel(uint32_t inNode) const { return mNodes[inNode].level; };
+		uint32_t		getNodeObjectCount(uint32_t inNode) const { return mNodes[inNode].objectCount; };
+		uint32_t		getNodeSubtreeObjectCount(uint32_t inNode) const { return mNodes[inNode].subtreeObjectCount; };
+		ObjectIndex		getNodeFirstObject(uint32_t inNode) const { return mNodes[inNode].firstObject; };
+		ObjectIndex		getNextObject(ObjectIndex inObject) const { return mObjectNext[inObject]; };
+		TUniversalVector3	getNodeCenter(uint32_t inNode) const;
+		double			getNodeWidth(uint32_t inNode) const;
+
+		// kNoOctreeNode if the object is not in the tree
+		uint32_t		getObjectNode(ObjectIndex inObject) const { return contains(inObject) ? mObjectNode[inObject] : kNoOctreeNode; };
+		double			getObjectRadius(ObjectIndex inObject) const { return mObjectRadius[inObject]; };
+		// Exact offset (mm) of the object's centre from the centre of its node
+		TVector3d		getObjectOffset(ObjectIndex inObject) const;
+
+		// With tracking on, insert(), move() and remove() record every node whose objects
+		// changed, including those that received objects when a node split. build() and
+		// clear() replace the whole tree, so they start the record afresh.
+		void			setTrackChanges(bool inTrackChanges);
+		void			takeChangedNodes(std::vector<uint32_t>& outNodes);
+
+	protected:
+		struct Node
+		{
+			UniversalOctreeCoord	min[3];			// Cell corner; the cell is 2^(kRootBits + 1 - level) wide
+			uint32_t				firstChild;		// 8 contiguous nodes, or kNoOctreeNode for a leaf
+			uint32_t				parent;
+			ObjectIndex				firstObject;
+			uint32_t				objectCount;
+			uint32_t				subtreeObjectCount;
+			int						level;
+		};
+
+		struct Cone
+		{
+			UniversalOctreeCoord	apex[3];
+			TVector3d				axis;
+			double					cosHalfAngle;
+			double					sinHalfAngle;
+			double					range;
+		};
+
+		uint32_t		createRoot();
+		void			split(uint32_t inNode);
+		bool			needsSplit(uint32_t inNode) const;
+		void			threadObject(ObjectIndex inObject, uint32_t inNode);
+		void			linkObject(ObjectIndex inObject, uint32_t inNode);
+		void			unlinkObject(ObjectIndex inObject);
+		uint32_t		findNode(const UniversalOctreeCoord inCenter[3], int inLevel) const;
+		void			buildNode(uint32_t inNode, size_t inBegin, size_t inEnd);
+		void			setObject(ObjectIndex inObject, const UniversalOctreeCoord inCenter[3], double inRadius);
+		void			reserveObject(ObjectIndex inObject);
+		void			markNodeChanged(uint32_t inNode);
+
+		bool			sphereInCone(const Cone& inCone, const UniversalOctreeCoord inCenter[3], double inRadius) const;
+
+		uint32_t					mMaxObjectsPerNode;
+		std::vector<Node>			mNodes;
+		size_t						mObjectCount;
+
+		// Per object
+		std::vector<uint32_t>		mObjectNode;		// kNoOctreeNode when not in the tree
+		std::vector<ObjectIndex>	mObjectNext;
+		std::vector<ObjectIndex>	mObjectPrevious;
+		std::vector<UniversalOctreeCoord>	mObjectCenter[3];
+		std::vector<double>			mObjectRadius;
+		std::vector<uint8_t>		mObjectLevel;		// Deepest level the object fits
+
+		bool						mTrackChanges;
+		std::vector<uint8_t>		mNodeChanged;
+		std::vector<uint32_t>		mChangedNodes;
+
+		// Scratch, reused between calls
+		std::vector<ObjectIndex>	mBuildObjects;
+		std::vector<ObjectIndex>	mBuildScratch;
+		mutable std::vector<uint32_t>	mStack;
+};
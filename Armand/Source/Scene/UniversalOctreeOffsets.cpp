@@ -0,0 +1,152 @@
+#include "stdafx.h"
+#include "UniversalOctreeOffsets.h"
+
+UniversalOctreeOffsets::UniversalOctreeOffsets() : mScale(1.0),
+												   mUnusedPointCount(0),
+												   mOffsetsRevision(0)
+{
+}
+
+void UniversalOctreeOffsets::clear()
+{
+	mNodeSlot.clear();
+	mSlotNode.clear();
+	mSlotFirst.clear();
+	mSlotPointCount.clear();
+	mSlotCapacity.clear();
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mCenterLo[axis].clear();
+		mCenterHi[axis].clear();
+	}
+	mSlotDelta.clear();
+	mOffsets.clear();
+	mPointObject.clear();
+	mUnusedPointCount = 0;
+	mOffsetsRevision++;
+}
+
+void UniversalOctreeOffsets::rebuild(const UniversalOctree& inOctree, double inScale)
+{
+	clear();
+	mScale = inScale;
+
+	const size_t nodeCount = inOctree.getNodeCount();
+	mNodeSlot.assign(nodeCount, kNoOffsetSlot);
+	mOffsets.reserve(inOctree.getObjectCount() * 3);
+	mPointObject.reserve(inOctree.getObjectCount());
+	for (size_t node = 0; node < nodeCount; node++)
+	{
+		if (inOctree.getNodeObjectCount((uint32_t)node) > 0)
+			fillSlot(inOctree, addSlot((uint32_t)node));
+	}
+}
+
+void UniversalOctreeOffsets::refreshNodes(const UniversalOctree& inOctree, const std::vector<uint32_t>& inNodes)
+{
+	for (size_t i = 0; i < inNodes.size(); i++)
+		refreshNode(inOctree, inNodes[i]);
+}
+
+void UniversalOctreeOffsets::refreshNode(const UniversalOctree& inOctree, uint32_t inNode)
+{
+	if (inNode >= mNodeSlot.size())
+		mNodeSlot.resize(inOctree.getNodeCount(), kNoOffsetSlot);
+
+	uint32_t slot = mNodeSlot[inNode];
+	if (slot == kNoOffsetSlot)
+	{
+		if (inOctree.getNodeObjectCount(inNode) == 0)
+			return;
+		slot = addSlot(inNode);
+	}
+
+	fillSlot(inOctree, slot);
+	mOffsetsRevision++;
+}
+
+// ---------------------------------------------------------------------------
+// UniversalOctreeOffsets::addSlot									  [protected]
+// ---------------------------------------------------------------------------
+uint32_t UniversalOctreeOffsets::addSlot(uint32_t inNode)
+{
+	uint32_t slot = (uint32_t)mSlotNode.size();
+	mNodeSlot[inNode] = slot;
+	mSlotNode.push_back(inNode);
+	mSlotFirst.push_back((uint32_t)mPointObject.size());
+	mSlotPointCount.push_back(0);
+	mSlotCapacity.push_back(0);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mCenterLo[axis].push_back(0);
+		mCenterHi[axis].push_back(0);
+	}
+	mSlotDelta.resize(mSlotDelta.size() + 3, 0.0f);
+
+	return slot;
+}
+
+// ---------------------------------------------------------------------------
+// UniversalOctreeOffsets::fillSlot									  [protected]
+//
+//	Writes the node centre and the offsets of the node's objects. A slot that
+//	no longer fits in its range gets a new one at the end of the arrays.
+// ---------------------------------------------------------------------------
+void UniversalOctreeOffsets::fillSlot(const UniversalOctree& inOctree, uint32_t inSlot)
+{
+	uint32_t node = mSlotNode[inSlot];
+	uint32_t count = inOctree.getNodeObjectCount(node);
+
+	mUnusedPointCount += mSlotPointCount[inSlot];
+	if (count > mSlotCapacity[inSlot])
+	{
+		mSlotFirst[inSlot] = (uint32_t)mPointObject.size();
+		mSlotCapacity[inSlot] = count;
+		mOffsets.resize(mOffsets.size() + count * 3);
+		mPointObject.resize(mPointObject.size() + count);
+	}
+	else
+	{
+		mUnusedPointCount -= count;
+	}
+	mSlotPointCount[inSlot] = count;
+
+	TUniversalVector3 center = inOctree.getNodeCenter(node);
+	const UniversalCoord* axes[3] = { &center.x, &center.y, &center.z };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mCenterLo[axis][inSlot] = axes[axis]->table[0];
+		mCenterHi[axis][inSlot] = (int64_t)axes[axis]->table[1];
+	}
+
+	uint32_t point = mSlotFirst[inSlot];
+	for (ObjectIndex object = inOctree.getNodeFirstObject(node); object != kNoObject; object = inOctree.getNextObject(object))
+	{
+		TVector3d offset = inOctree.getObjectOffset(object) * mScale;
+		mOffsets[point * 3 + 0] = (float)offset.x;
+		mOffsets[point * 3 + 1] = (float)offset.y;
+		mOffsets[point * 3 + 2] = (float)offset.z;
+		mPointObject[point] = object;
+		point++;
+	}
+}
+
+void UniversalOctreeOffsets::updateViewer(const TUniversalVector3& inViewer)
+{
+	if (mSlotNode.empty())
+		return;
+
+	UniversalPointArrays centers;
+	UniversalPointOrigin origin;
+	const UniversalCoord* viewer[3] = { &inViewer.x, &inViewer.y, &inViewer.z };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		centers.lo[axis] = &mCenterLo[axis][0];
+		centers.hi[axis] = &mCenterHi[axis][0];
+		origin.lo[axis] = viewer[axis]->table[0];
+		origin.hi[axis] = (int64_t)viewer[axis]->table[1];
+	}
+	centers.count = mSlotNode.size();
+
+	convertToViewerRelative(centers, origin, mScale, &mSlotDelta[0]);
+}
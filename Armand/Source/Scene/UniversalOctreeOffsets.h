@@ -0,0 +1,107 @@
+//----------------------------------------------------------------------
+//	File:		UniversalOctreeOffsets.h
+//
+//	Contains:	Per-node float32 offsets of the objects in a UniversalOctree,
+//				so only node centres need 128-bit work each frame.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include "UniversalOctree.h"
+
+const uint32_t kNoOffsetSlot = 0xffffffff;
+
+//----------------------------------------------------------------------
+//	Class:		UniversalOctreeOffsets
+//
+//	Purpose:	Caches, for every octree node holding objects (a slot), the
+//				positions of its objects as float32 offsets from the node
+//				centre, scaled to GL units. The offsets of a slot are one
+//				contiguous run of x,y,z triples in getOffsets(), ready to go
+//				into a VBO once.
+//
+//				Each frame updateViewer() converts just the node centres
+//				relative to the viewer (one exact 128-bit subtraction per
+//				node, batched as in UniversalPointBatch). Drawing a slot is
+//				then a translation by its delta, as a uniform or on the
+//				modelview matrix, and a draw of its range:
+//
+//					glTranslatef(delta[0], delta[1], delta[2]);
+//					glDrawArrays(GL_POINTS, getSlotFirst(slot), getSlotPointCount(slot));
+//
+//				The offsets are taken exactly before they are rounded. An
+//				object's centre lies in its node, so its offset is at most
+//				half the node's width and is off by less than the width
+//				/ 2^24: the error is relative to the node, not to the
+//				Universe. Nodes are sized by how many objects share them as
+//				well as by radii, so a sparse leaf of points (radius 0) may
+//				be far wider than anything in it and its error as coarse.
+//
+//				After objects move, refreshNodes() updates the nodes the
+//				octree recorded as changed (UniversalOctree::setTrackChanges()).
+//				Slots that grow move to the end of the arrays; rebuild()
+//				compacts them again.
+//
+//----------------------------------------------------------------------
+class UniversalOctreeOffsets
+{
+	public:
+		UniversalOctreeOffsets();
+
+		void			clear();
+
+		// Caches every node of inOctree that holds objects. inScale converts millimetres
+		// to GL units for the offsets and the deltas alike.
+		void			rebuild(const UniversalOctree& inOctree, double inScale);
+
+		// Brings the slots of inNodes up to date with the octree, adding or emptying them
+		void			refreshNodes(const UniversalOctree& inOctree, const std::vector<uint32_t>& inNodes);
+		void			refreshNode(const UniversalOctree& inOctree, uint32_t inNode);
+
+		// Node centres relative to inViewer, scaled, for every slot
+		void			updateViewer(const TUniversalVector3& inViewer);
+
+		double			getScale() const { return mScale; };
+		size_t			getSlotCount() const { return mSlotNode.size(); };
+		uint32_t		getSlot(uint32_t inNode) const { return (inNode < mNodeSlot.size()) ? mNodeSlot[inNode] : kNoOffsetSlot; };
+		uint32_t		getSlotNode(uint32_t inSlot) const { return mSlotNode[inSlot]; };
+		uint32_t		getSlotFirst(uint32_t inSlot) const { return mSlotFirst[inSlot]; };
+		uint32_t		getSlotPointCount(uint32_t inSlot) const { return mSlotPointCount[inSlot]; };
+		const float*	getSlotDelta(uint32_t inSlot) const { return &mSlotDelta[inSlot * 3]; };
+
+		// Every slot's points: x,y,z offsets and the objects they belong to. Points no slot
+		// refers to any longer are left in place until rebuild().
+		size_t			getPointCount() const { return mPointObject.size(); };
+		const float*	getOffsets() const { return mOffsets.empty() ? NULL : &mOffsets[0]; };
+		const ObjectIndex*	getPointObjects() const { return mPointObject.empty() ? NULL : &mPointObject[0]; };
+		size_t			getUnusedPointCount() const { return mUnusedPointCount; };
+
+		// Bumped whenever getOffsets() changes, so the VBO knows to upload it again
+		uint32_t		getOffsetsRevision() const { return mOffsetsRevision; };
+
+	protected:
+		uint32_t		addSlot(uint32_t inNode);
+		void			fillSlot(const UniversalOctree& inOctree, uint32_t inSlot);
+
+		double						mScale;
+
+		std::vector<uint32_t>		mNodeSlot;			// Per octree node
+
+		// Per slot
+		std::vector<uint32_t>		mSlotNode;
+		std::vector<uint32_t>		mSlotFirst;
+		std::vector<uint32_t>		mSlotPointCount;
+		std::vector<uint32_t>		mSlotCapacity;
+		std::vector<uint64_t>		mCenterLo[3];
+		std::vector<int64_t>		mCenterHi[3];
+		std::vector<float>			mSlotDelta;
+
+		// Per point
+		std::vector<float>			mOffsets;
+		std::vector<ObjectIndex>	mPointObject;
+		size_t						mUnusedPointCount;
+		uint32_t					mOffsetsRevision;
+};
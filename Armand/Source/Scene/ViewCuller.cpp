@@ -0,0 +1,347 @@
+#include "stdafx.h"
+#include "ViewCuller.h"
+#include <algorithm>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define VIEW_CULLER_SSE
+	#include <emmintrin.h>
+#endif
+
+static const double kSqrtThree = 1.7320508075688772;
+
+ViewCuller::ViewCuller() : mLevelRadiiScale(0.0)
+{
+	setFisheye(TVector3d(0.0, 0.0, -1.0), 3.14159265358979323846);
+	beginFrame();
+}
+
+void ViewCuller::setFisheye(const TVector3d& inGaze, double inAperture)
+{
+	mVolume.projection = eViewCullFisheye;
+	mVolume.gaze = inGaze;
+	mVolume.gaze.Normalize();
+	mVolume.halfAperture = 0.5 * inAperture;
+
+	mGaze[0] = (float)mVolume.gaze.x;
+	mGaze[1] = (float)mVolume.gaze.y;
+	mGaze[2] = (float)mVolume.gaze.z;
+	mCosHalfAperture = (float)cos(mVolume.halfAperture);
+	mSinHalfAperture = (float)sin(mVolume.halfAperture);
+}
+
+void ViewCuller::setPerspective(const TVector3d& inGaze, const TVector3d& inUp,
+								double inFieldOfViewY, double inAspectRatio)
+{
+	mVolume.projection = eViewCullPerspective;
+	mVolume.gaze = inGaze;
+	mVolume.gaze.Normalize();
+
+	TVector3d right = mVolume.gaze ^ inUp;
+	right.Normalize();
+	TVector3d up = right ^ mVolume.gaze;
+
+	// A side plane holds the edge direction gaze +- tan * axis; its inward normal is
+	// the axis tilted towards the gaze by the same tangent.
+	double tanY = tan(0.5 * inFieldOfViewY);
+	double tanX = tanY * inAspectRatio;
+	mVolume.planes[0] = right + tanX * mVolume.gaze;
+	mVolume.planes[1] = -right + tanX * mVolume.gaze;
+	mVolume.planes[2] = up + tanY * mVolume.gaze;
+	mVolume.planes[3] = -up + tanY * mVolume.gaze;
+	for (int plane = 0; plane < 4; plane++)
+	{
+		mVolume.planes[plane].Normalize();
+		mPlanes[plane][0] = (float)mVolume.planes[plane].x;
+		mPlanes[plane][1] = (float)mVolume.planes[plane].y;
+		mPlanes[plane][2] = (float)mVolume.planes[plane].z;
+	}
+	mGaze[0] = (float)mVolume.gaze.x;
+	mGaze[1] = (float)mVolume.gaze.y;
+	mGaze[2] = (float)mVolume.gaze.z;
+}
+
+void ViewCuller::beginFrame()
+{
+	mStats.spheresVisible = 0;
+	mStats.spheresCulled = 0;
+	mStats.pointsVisible = 0;
+	mStats.pointsCulled = 0;
+}
+
+// ---------------------------------------------------------------------------
+// ViewCuller::getViewDistance
+//
+//	Fisheye: with d the distance along the gaze and p the distance across it,
+//	p * cos(half) - d * sin(half) is the distance from the centre to the edge
+//	of the view cone, measured outwards. That holds on both sides of 180
+//	degrees, unless the centre is outside a narrow cone and nearest its apex,
+//	which is when d * cos(half) + p * sin(half) < 0 too; the distance is then
+//	the centre's. Perspective: the largest distance outside any side plane.
+// ---------------------------------------------------------------------------
+double ViewCuller::getViewDistance(const TVector3d& inCenter) const
+{
+	if (mVolume.projection == eViewCullFisheye)
+	{
+		double cosHalf = cos(mVolume.halfAperture);
+		double sinHalf = sin(mVolume.halfAperture);
+		double d = inCenter * mVolume.gaze;
+		double lengthSquared = inCenter.LengthSquared();
+		double p = sqrt(std::max(lengthSquared - d * d, 0.0));
+		double outwards = p * cosHalf - d * sinHalf;
+		if ((outwards > 0.0) && (d * cosHalf + p * sinHalf < 0.0))
+			return sqrt(lengthSquared);
+		else
+			return outwards;
+	}
+
+	double result = -(inCenter * mVolume.planes[0]);
+	for (int plane = 1; plane < 4; plane++)
+		result = std::max(result, -(inCenter * mVolume.planes[plane]));
+
+	return result;
+}
+
+// Angle between two unit vectors, accurate when they are close
+static double angleBetween(const TVector3d& a, const TVector3d& b)
+{
+	return atan2((a ^ b).Length(), a * b);
+}
+
+double ViewCuller::getRotationSince(const ViewCullVolume& inPrevious) const
+{
+	if (inPrevious.projection != mVolume.projection)
+		return std::numeric_limits<double>::infinity();
+
+	if (mVolume.projection == eViewCullFisheye)
+		return angleBetween(mVolume.gaze, inPrevious.gaze) + fabs(mVolume.halfAperture - inPrevious.halfAperture);
+
+	double result = 0.0;
+	for (int plane = 0; plane < 4; plane++)
+		result = std::max(result, angleBetween(mVolume.planes[plane], inPrevious.planes[plane]));
+
+	return result;
+}
+
+// The float counterpart of getViewDistance(), evaluated as the batches do
+bool ViewCuller::isSphereVisible(const float inCenter[3], float inRadius) const
+{
+	float x = inCenter[0];
+	float y = inCenter[1];
+	float z = inCenter[2];
+
+	if (mVolume.projection == eViewCullFisheye)
+	{
+		float d = x * mGaze[0] + y * mGaze[1] + z * mGaze[2];
+		float lengthSquared = x * x + y * y + z * z;
+		float across = lengthSquared - d * d;
+		float p = sqrtf(across > 0.0f ? across : 0.0f);
+		float outwards = p * mCosHalfAperture - d * mSinHalfAperture;
+		if ((outwards > 0.0f) && (d * mCosHalfAperture + p * mSinHalfAperture < 0.0f))
+			return (lengthSquared <= inRadius * inRadius);
+		else
+			return (outwards <= inRadius);
+	}
+
+	for (int plane = 0; plane < 4; plane++)
+	{
+		if (x * mPlanes[plane][0] + y * mPlanes[plane][1] + z * mPlanes[plane][2] < -inRadius)
+			return false;
+	}
+
+	return true;
+}
+
+bool ViewCuller::isPointVisible(const float inPoint[3]) const
+{
+	return isSphereVisible(inPoint, 0.0f);
+}
+
+#ifdef VIEW_CULLER_SSE
+
+// Three SSE registers of x,y,z triples (x0y0z0x1 y1z1x2y2 z2x3y3z3) split into x, y and z
+static inline void deinterleave4(const float* inXYZ, __m128& outX, __m128& outY, __m128& outZ)
+{
+	__m128 a = _mm_loadu_ps(inXYZ);
+	__m128 b = _mm_loadu_ps(inXYZ + 4);
+	__m128 c = _mm_loadu_ps(inXYZ + 8);
+
+	__m128 bc = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2));				// x2 y2 z2 x3
+	outX = _mm_shuffle_ps(a, bc, _MM_SHUFFLE(3, 0, 3, 0));
+	outY = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),		// y0 y0 y1 y1
+						  _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),		// y2 y2 y3 y3
+						  _MM_SHUFFLE(2, 0, 2, 0));
+	outZ = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),		// z0 z0 z1 z1
+						  _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),		// z2 z2 z3 z3
+						  _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// ViewCuller::cullBatch												  [protected]
+//
+//	isSphereVisible() on every sphere, four at a time. Every lane's index is
+//	stored and the output position advances only past the visible ones, so
+//	the list is compacted without branching on the results.
+// ---------------------------------------------------------------------------
+size_t ViewCuller::cullBatch(const float* inXYZ, const float* inRadii, size_t inCount,
+							 std::vector<uint32_t>& outVisible, bool inScalar)
+{
+	outVisible.resize(inCount);
+	if (inCount == 0)
+		return 0;
+
+	uint32_t* out = &outVisible[0];
+	size_t visible = 0;
+	size_t i = 0;
+
+#ifdef VIEW_CULLER_SSE
+	if (!inScalar)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 gazeX = _mm_set1_ps(mGaze[0]);
+		const __m128 gazeY = _mm_set1_ps(mGaze[1]);
+		const __m128 gazeZ = _mm_set1_ps(mGaze[2]);
+		const __m128 cosHalf = _mm_set1_ps(mCosHalfAperture);
+		const __m128 sinHalf = _mm_set1_ps(mSinHalfAperture);
+
+		for ( ; i + 4 <= inCount; i += 4)
+		{
+			__m128 x, y, z;
+			deinterleave4(inXYZ + i * 3, x, y, z);
+			__m128 radius = inRadii ? _mm_loadu_ps(inRadii + i) : zero;
+
+			__m128 inView;
+			if (mVolume.projection == eViewCullFisheye)
+			{
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, gazeX), _mm_mul_ps(y, gazeY)), _mm_mul_ps(z, gazeZ));
+				__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+				__m128 p = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lengthSquared, _mm_mul_ps(d, d)), zero));
+
+				__m128 outwards = _mm_sub_ps(_mm_mul_ps(p, cosHalf), _mm_mul_ps(d, sinHalf));
+				__m128 behind = _mm_and_ps(_mm_cmpgt_ps(outwards, zero),
+										   _mm_cmplt_ps(_mm_add_ps(_mm_mul_ps(d, cosHalf), _mm_mul_ps(p, sinHalf)), zero));
+				__m128 nearApex = _mm_cmple_ps(lengthSquared, _mm_mul_ps(radius, radius));
+				__m128 nearEdge = _mm_cmple_ps(outwards, radius);
+				inView = _mm_or_ps(_mm_and_ps(behind, nearApex), _mm_andnot_ps(behind, nearEdge));
+			}
+			else
+			{
+				__m128 negativeRadius = _mm_sub_ps(zero, radius);
+				inView = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (int plane = 0; plane < 4; plane++)
+				{
+					__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(mPlanes[plane][0])),
+															_mm_mul_ps(y, _mm_set1_ps(mPlanes[plane][1]))),
+												 _mm_mul_ps(z, _mm_set1_ps(mPlanes[plane][2])));
+					inView = _mm_and_ps(inView, _mm_cmpge_ps(distance, negativeRadius));
+				}
+			}
+
+			int mask = _mm_movemask_ps(inView);
+			for (int lane = 0; lane < 4; lane++)
+			{
+				out[visible] = (uint32_t)(i + lane);
+				visible += (mask >> lane) & 1;
+			}
+		}
+	}
+#endif
+
+	// Remaining spheres
+	for ( ; i < inCount; i++)
+	{
+		out[visible] = (uint32_t)i;
+		visible += isSphereVisible(inXYZ + i * 3, inRadii ? inRadii[i] : 0.0f) ? 1 : 0;
+	}
+
+	outVisible.resize(visible);
+
+	return visible;
+}
+
+void ViewCuller::countResults(size_t inVisible, size_t inCount, bool inSpheres)
+{
+	if (inSpheres)
+	{
+		mStats.spheresVisible += inVisible;
+		mStats.spheresCulled += inCount - inVisible;
+	}
+	else
+	{
+		mStats.pointsVisible += inVisible;
+		mStats.pointsCulled += inCount - inVisible;
+	}
+}
+
+size_t ViewCuller::cullSpheres(const float* inXYZ, const float* inRadii, size_t inCount,
+							   std::vector<uint32_t>& outVisible)
+{
+	size_t visible = cullBatch(inXYZ, inRadii, inCount, outVisible, false);
+	countResults(visible, inCount, true);
+
+	return visible;
+}
+
+size_t ViewCuller::cullPoints(const float* inXYZ, size_t inCount, std::vector<uint32_t>& outVisible)
+{
+	size_t visible = cullBatch(inXYZ, NULL, inCount, outVisible, false);
+	countResults(visible, inCount, false);
+
+	return visible;
+}
+
+size_t ViewCuller::cullSpheresScalar(const float* inXYZ, const float* inRadii, size_t inCount,
+									 std::vector<uint32_t>& outVisible)
+{
+	size_t visible = cullBatch(inXYZ, inRadii, inCount, outVisible, true);
+	countResults(visible, inCount, true);
+
+	return visible;
+}
+
+size_t ViewCuller::cullPointsScalar(const float* inXYZ, size_t inCount, std::vector<uint32_t>& outVisible)
+{
+	size_t visible = cullBatch(inXYZ, NULL, inCount, outVisible, true);
+	countResults(visible, inCount, false);
+
+	return visible;
+}
+
+size_t ViewCuller::cullOctreeSlots(const UniversalOctree& inOctree, const UniversalOctreeOffsets& inOffsets,
+								   std::vector<uint32_t>& outVisibleSlots)
+{
+	// Objects lie within their node's loose bounds: the cell grown by half its width
+	// on every side, so a cube twice the cell's width about its centre.
+	if (mLevelRadii.empty() || (mLevelRadiiScale != inOffsets.getScale()))
+	{
+		mLevelRadiiScale = inOffsets.getScale();
+		mLevelRadii.resize(kUniversalOctreeMaxLevel + 1);
+		for (int level = 0; level <= kUniversalOctreeMaxLevel; level++)
+			mLevelRadii[level] = (float)(kSqrtThree * ldexp(mLevelRadiiScale, kUniversalOctreeRootBits + 1 - level));
+	}
+
+	size_t slotCount = inOffsets.getSlotCount();
+	mSlotRadii.resize(slotCount);
+	for (size_t slot = 0; slot < slotCount; slot++)
+		mSlotRadii[slot] = mLevelRadii[inOctree.getNodeLevel(inOffsets.getSlotNode((uint32_t)slot))];
+
+	outVisibleSlots.clear();
+	if (slotCount == 0)
+		return 0;
+
+	cullBatch(inOffsets.getSlotDelta(0), &mSlotRadii[0], slotCount, outVisibleSlots, false);
+
+	// Emptied slots keep their place, so drop them here
+	size_t visible = 0;
+	for (size_t i = 0; i < outVisibleSlots.size(); i++)
+	{
+		outVisibleSlots[visible] = outVisibleSlots[i];
+		visible += (inOffsets.getSlotPointCount(outVisibleSlots[i]) > 0) ? 1 : 0;
+	}
+	outVisibleSlots.resize(visible);
+	countResults(visible, slotCount, true);
+
+	return visible;
+}
@@ -0,0 +1,143 @@
+//----------------------------------------------------------------------
+//	File:		ViewCuller.h
+//
+//	Contains:	Culling of bounding spheres and points against a fisheye
+//				dome or a perspective frustum, four at a time.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include "UniversalOctreeOffsets.h"
+
+//----------------------------------------------------------------------
+//	Struct:		ViewCullStats
+//
+//	Purpose:	What the culler tested since the last beginFrame().
+//
+//----------------------------------------------------------------------
+struct ViewCullStats
+{
+	size_t			spheresVisible;
+	size_t			spheresCulled;
+	size_t			pointsVisible;
+	size_t			pointsCulled;
+};
+
+enum ViewCullProjection
+{
+	eViewCullFisheye,		// Everything within half the aperture of the gaze
+	eViewCullPerspective	// The four side planes of a gluPerspective() frustum
+};
+
+//----------------------------------------------------------------------
+//	Struct:		ViewCullVolume
+//
+//	Purpose:	The shape and orientation of what the viewer sees, in double
+//				precision, as set on a ViewCuller.
+//
+//----------------------------------------------------------------------
+struct ViewCullVolume
+{
+	ViewCullProjection	projection;
+	TVector3d			gaze;
+	double				halfAperture;		// Fisheye
+	TVector3d			planes[4];			// Perspective: inward normals of the left, right, bottom and top planes
+};
+
+//----------------------------------------------------------------------
+//	Class:		ViewCuller
+//
+//	Purpose:	Decides what the viewer can see. Positions are float x,y,z
+//				triples relative to the viewer, on the world axes, as
+//				convertToViewerRelative() and UniversalOctreeOffsets produce
+//				them; the gaze and up vectors are on the same axes.
+//
+//				A fisheye sees every direction within half its aperture of
+//				the gaze. Past 180 degrees that is everything except a cone
+//				behind the viewer, and a sphere is culled only when it lies
+//				entirely inside that cone. Both cases come down to the same
+//				test on the sphere's distance along and across the gaze, so
+//				dome lenses of 180 to 230 degrees cost the same as narrower
+//				ones. A perspective view tests the four side planes of the
+//				frustum. Neither has near or far planes: everything in front
+//				of the viewer is drawn, however far away.
+//
+//				Tests run on four spheres or points at once with SSE, and the
+//				indices of the visible ones are written out contiguously.
+//
+//----------------------------------------------------------------------
+class ViewCuller
+{
+	public:
+		ViewCuller();
+
+		// inAperture is the full angle of the dome in radians: 180 to 230 degrees for dome lenses
+		void			setFisheye(const TVector3d& inGaze, double inAperture);
+		// As gluPerspective(): inFieldOfViewY is the full vertical angle in radians
+		void			setPerspective(const TVector3d& inGaze, const TVector3d& inUp,
+									   double inFieldOfViewY, double inAspectRatio);
+
+		ViewCullProjection	getProjection() const { return mVolume.projection; };
+		const TVector3d&	getGaze() const { return mVolume.gaze; };
+		const ViewCullVolume&	getVolume() const { return mVolume; };
+
+		// Signed distance from inCenter to the edge of the view, positive outside. It
+		// changes by no more than the distance the point moves, so a sphere of radius r
+		// is in view when this is at most r and wholly in view when it is below -r.
+		double			getViewDistance(const TVector3d& inCenter) const;
+
+		// The most the edge of the view has turned since inPrevious, in radians: a point
+		// at distance L moved by at most L times this relative to it. Infinite if the
+		// projections differ.
+		double			getRotationSince(const ViewCullVolume& inPrevious) const;
+
+		// Resets the counts
+		void			beginFrame();
+		const ViewCullStats&	getStats() const { return mStats; };
+
+		// Spheres with centres inXYZ (3 * inCount floats) and radii inRadii. Replaces the
+		// contents of outVisible with the indices of those at least partly in view, in
+		// order, and returns how many there are.
+		size_t			cullSpheres(const float* inXYZ, const float* inRadii, size_t inCount,
+									std::vector<uint32_t>& outVisible);
+
+		// Points at inXYZ; only their directions matter, so unit vectors will do
+		size_t			cullPoints(const float* inXYZ, size_t inCount, std::vector<uint32_t>& outVisible);
+
+		// The slots of inOffsets whose nodes' loose bounds are in view, from the deltas of
+		// its last updateViewer(). Slots without points are left out.
+		size_t			cullOctreeSlots(const UniversalOctree& inOctree, const UniversalOctreeOffsets& inOffsets,
+										std::vector<uint32_t>& outVisibleSlots);
+
+		// Single sphere and point tests, as the batches do them
+		bool			isSphereVisible(const float inCenter[3], float inRadius) const;
+		bool			isPointVisible(const float inPoint[3]) const;
+
+		// The individual paths, for testing and benchmarking
+		size_t			cullSpheresScalar(const float* inXYZ, const float* inRadii, size_t inCount,
+										  std::vector<uint32_t>& outVisible);
+		size_t			cullPointsScalar(const float* inXYZ, size_t inCount, std::vector<uint32_t>& outVisible);
+
+	protected:
+		size_t			cullBatch(const float* inXYZ, const float* inRadii, size_t inCount,
+								  std::vector<uint32_t>& outVisible, bool inScalar);
+		void			countResults(size_t inVisible, size_t inCount, bool inSpheres);
+
+		ViewCullVolume	mVolume;
+
+		// The volume in float, for the batches
+		float			mGaze[3];
+		float			mCosHalfAperture;
+		float			mSinHalfAperture;
+		float			mPlanes[4][3];
+
+		ViewCullStats	mStats;
+
+		// Scratch, reused between calls
+		std::vector<float>	mSlotRadii;
+		std::vector<float>	mLevelRadii;
+		double				mLevelRadiiScale;
+};
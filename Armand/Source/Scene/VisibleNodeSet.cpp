@@ -0,0 +1,293 @@
+#include "stdafx.h"
+#include "VisibleNodeSet.h"
+#include <algorithm>
+
+static const double kSqrtThree = 1.7320508075688772;
+
+VisibleNodeSet::VisibleNodeSet() : mValid(false),
+								   mLod(NULL),
+								   mFullTraversalFraction(0.25),
+								   mFullBoundaryCount(0),
+								   mTranslation(0.0),
+								   mRotation(0.0)
+{
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+void VisibleNodeSet::invalidate()
+{
+	mValid = false;
+}
+
+void VisibleNodeSet::setMagnitudeLod(const MagnitudeLod* inLod)
+{
+	mLod = inLod;
+	mValid = false;
+}
+
+void VisibleNodeSet::update(const UniversalOctree& inOctree, const ViewCuller& inCuller, const TUniversalVector3& inViewer)
+{
+	memset(&mStats, 0, sizeof(mStats));
+
+	bool full = !mValid || (inCuller.getProjection() != mPreviousVolume.projection);
+	if (!full)
+	{
+		mTranslation += inViewer.toVector3d(mPreviousViewer).Length();
+		mRotation += inCuller.getRotationSince(mPreviousVolume);
+	}
+	mPreviousVolume = inCuller.getVolume();
+	mPreviousViewer = inViewer;
+
+	if (!full)
+	{
+		for (size_t i = 0; i < mBoundary.size(); i++)
+			mStats.revisitedCount += isDue(mBoundary[i]) ? 1 : 0;
+		full = (mStats.revisitedCount > mFullTraversalFraction * mBoundary.size());
+	}
+
+	if (full)
+	{
+		mTranslation = 0.0;
+		mRotation = 0.0;
+		mBoundary.clear();
+		mVisible.clear();
+		mAggregated.clear();
+		if (inOctree.getNodeCount() > 0)
+			traverse(inOctree, inCuller, inViewer, 0);
+
+		mValid = true;
+		mFullBoundaryCount = mBoundary.size();
+		mStats.fullTraversal = true;
+		mStats.revisitedCount = 0;
+	}
+	else if (mStats.revisitedCount > 0)
+	{
+		// Keep the boundary nodes that cannot have changed, with their visible nodes,
+		// and replace the others by their new boundaries
+		mBoundary.swap(mPreviousBoundary);
+		mVisible.swap(mPreviousVisible);
+		mBoundary.clear();
+		mVisible.clear();
+		mAggregated.clear();
+		for (size_t i = 0; i < mPreviousBoundary.size(); i++)
+		{
+			const Boundary& boundary = mPreviousBoundary[i];
+			if (isDue(boundary))
+			{
+				if (boundary.ownObjectsOnly)
+					testOwnObjects(inOctree, inCuller, inViewer, boundary.node);
+				else
+					traverse(inOctree, inCuller, inViewer, boundary.node);
+			}
+			else
+			{
+				mBoundary.push_back(boundary);
+				mBoundary.back().visibleFirst = (uint32_t)mVisible.size();
+				mVisible.insert(mVisible.end(), mPreviousVisible.begin() + boundary.visibleFirst,
+								mPreviousVisible.begin() + boundary.visibleFirst + boundary.visibleCount);
+				if (boundary.aggregated)
+					mAggregated.push_back(boundary.node);
+			}
+		}
+	}
+
+	// Subtrees that have left view are still split up: merge them once the boundary doubles
+	if (mBoundary.size() > 2 * mFullBoundaryCount + 64)
+		mValid = false;
+
+	mStats.boundaryCount = mBoundary.size();
+	mStats.visibleCount = mVisible.size();
+	mStats.aggregatedCount = mAggregated.size();
+}
+
+// ---------------------------------------------------------------------------
+// VisibleNodeSet::isDue												  [protected]
+//
+//	A point at distance L from the viewer moves relative to the edge of the
+//	view by at most the viewer's translation plus L times the rotation of the
+//	view, and L itself grows by no more than the translation.
+// ---------------------------------------------------------------------------
+bool VisibleNodeSet::isDue(const Boundary& inBoundary) const
+{
+	double moved = mTranslation - inBoundary.translation;
+	double turned = mRotation - inBoundary.rotation;
+
+	return (moved + (inBoundary.range + moved) * turned >= inBoundary.slack);
+}
+
+// ---------------------------------------------------------------------------
+// VisibleNodeSet::traverse												  [protected]
+//
+//	Appends the boundary below inNode and its visible and aggregated nodes.
+//	A node's slack is the least of its slacks for each rule that decided it.
+//	With a MagnitudeLod a node wholly in view may still hold faint or small
+//	subtrees, so the traversal goes on below it.
+// ---------------------------------------------------------------------------
+void VisibleNodeSet::traverse(const UniversalOctree& inOctree, const ViewCuller& inCuller,
+							  const TUniversalVector3& inViewer, uint32_t inNode)
+{
+	size_t base = mStack.size();
+	mStack.push_back(inNode);
+	while (mStack.size() > base)
+	{
+		uint32_t node = mStack.back();
+		mStack.pop_back();
+		if (inOctree.getNodeSubtreeObjectCount(node) == 0)
+			continue;
+
+		// Objects lie within the node's loose bounds: a cube twice the cell's width
+		TVector3d center = inOctree.getNodeCenter(node).toVector3d(inViewer);
+		double radius = kSqrtThree * inOctree.getNodeWidth(node);
+		double distance = inCuller.getViewDistance(center);
+		mStats.nodesTested++;
+
+		Boundary boundary;
+		boundary.node = node;
+		boundary.visibleFirst = (uint32_t)mVisible.size();
+		boundary.ownObjectsOnly = false;
+		boundary.aggregated = false;
+		boundary.range = center.Length();
+		boundary.translation = mTranslation;
+		boundary.rotation = mRotation;
+
+		double nearest = boundary.range - radius;
+		double limitDistance = mLod ? mLod->getLimitDistance(node) : 0.0;
+		double aggregateRange = mLod ? radius / mLod->getAggregateAngle() : 0.0;
+
+		if (distance > radius)
+		{
+			boundary.slack = distance - radius;
+		}
+		else if (mLod && (boundary.range > aggregateRange) && (nearest > 0.0))
+		{
+			// Small enough to be one point, drawn if all its objects together are bright enough
+			double aggregateLimitDistance = mLod->getAggregateLimitDistance(node);
+			boundary.slack = boundary.range - aggregateRange;
+			if (nearest > aggregateLimitDistance)
+			{
+				boundary.slack = std::min(boundary.slack, nearest - aggregateLimitDistance);
+			}
+			else
+			{
+				boundary.aggregated = true;
+				boundary.slack = std::min(boundary.slack, std::min(radius - distance, aggregateLimitDistance - nearest));
+				mAggregated.push_back(node);
+			}
+		}
+		else if (mLod && (nearest > mLod->getAggregateLimitDistance(node)))
+		{
+			// Even all of it together is fainter than the limit, at least until it is
+			// small enough to be drawn as one point
+			boundary.slack = std::min(nearest - mLod->getAggregateLimitDistance(node), aggregateRange - boundary.range);
+		}
+		else if (!mLod && (distance < -radius))
+		{
+			boundary.slack = -radius - distance;
+			addSubtree(inOctree, node);
+		}
+		else
+		{
+			// Partly in view, or too faint one by one but not together: go on to the
+			// children, which may be small enough to be drawn as points
+			uint32_t firstChild = inOctree.getNodeFirstChild(node);
+			if (firstChild != kNoOctreeNode)
+			{
+				for (uint32_t child = 0; child < 8; child++)
+					mStack.push_back(firstChild + child);
+			}
+
+			// The node stays a boundary only for its own objects
+			if (inOctree.getNodeObjectCount(node) == 0)
+				continue;
+			boundary.ownObjectsOnly = true;
+			if (mLod && (std::max(nearest, 0.0) > limitDistance))
+			{
+				boundary.slack = nearest - limitDistance;
+			}
+			else
+			{
+				boundary.slack = radius - distance;
+				if (mLod)
+					boundary.slack = std::min(boundary.slack, limitDistance - std::max(nearest, 0.0));
+				mVisible.push_back(node);
+			}
+		}
+
+		boundary.visibleCount = (uint32_t)mVisible.size() - boundary.visibleFirst;
+		mBoundary.push_back(boundary);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// VisibleNodeSet::testOwnObjects										  [protected]
+//
+//	Tests again a node that was partly in view, for its own objects only. It
+//	is not aggregated here even if it has become small enough: that needs
+//	its children's boundaries gone, which the next full traversal sees to.
+// ---------------------------------------------------------------------------
+void VisibleNodeSet::testOwnObjects(const UniversalOctree& inOctree, const ViewCuller& inCuller,
+									const TUniversalVector3& inViewer, uint32_t inNode)
+{
+	if (inOctree.getNodeObjectCount(inNode) == 0)
+		return;
+
+	TVector3d center = inOctree.getNodeCenter(inNode).toVector3d(inViewer);
+	double radius = kSqrtThree * inOctree.getNodeWidth(inNode);
+	double distance = inCuller.getViewDistance(center);
+	mStats.nodesTested++;
+
+	Boundary boundary;
+	boundary.node = inNode;
+	boundary.visibleFirst = (uint32_t)mVisible.size();
+	boundary.ownObjectsOnly = true;
+	boundary.aggregated = false;
+	boundary.range = center.Length();
+	boundary.translation = mTranslation;
+	boundary.rotation = mRotation;
+
+	double nearest = std::max(boundary.range - radius, 0.0);
+	double limitDistance = mLod ? mLod->getLimitDistance(inNode) : 0.0;
+	if (distance > radius)
+	{
+		boundary.slack = distance - radius;
+	}
+	else if (mLod && (nearest > limitDistance))
+	{
+		boundary.slack = nearest - limitDistance;
+	}
+	else
+	{
+		boundary.slack = radius - distance;
+		if (mLod)
+			boundary.slack = std::min(boundary.slack, limitDistance - nearest);
+		mVisible.push_back(inNode);
+	}
+	boundary.visibleCount = (uint32_t)mVisible.size() - boundary.visibleFirst;
+	mBoundary.push_back(boundary);
+}
+
+// ---------------------------------------------------------------------------
+// VisibleNodeSet::addSubtree											  [protected]
+// ---------------------------------------------------------------------------
+void VisibleNodeSet::addSubtree(const UniversalOctree& inOctree, uint32_t inNode)
+{
+	size_t base = mStack.size();
+	mStack.push_back(inNode);
+	while (mStack.size() > base)
+	{
+		uint32_t node = mStack.back();
+		mStack.pop_back();
+		if (inOctree.getNodeSubtreeObjectCount(node) == 0)
+			continue;
+
+		if (inOctree.getNodeObjectCount(node) > 0)
+			mVisible.push_back(node);
+
+		uint32_t firstChild = inOctree.getNodeFirstChild(node);
+		if (firstChild != kNoOctreeNode)
+		{
+			for (uint32_t child = 0; child < 8; child++)
+				mStack.push_back(firstChild + child);
+		}
+	}
+}
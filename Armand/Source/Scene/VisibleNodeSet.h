@@ -0,0 +1,131 @@
+//----------------------------------------------------------------------
+//	File:		VisibleNodeSet.h
+//
+//	Contains:	The octree nodes in view, kept from frame to frame and
+//				revisited only where the viewer's motion could change them.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include "ViewCuller.h"
+#include "MagnitudeLod.h"
+
+//----------------------------------------------------------------------
+//	Struct:		VisibleNodeSetStats
+//
+//	Purpose:	What the last VisibleNodeSet::update() did.
+//
+//----------------------------------------------------------------------
+struct VisibleNodeSetStats
+{
+	bool			fullTraversal;
+	size_t			boundaryCount;		// Nodes where the traversal stopped
+	size_t			revisitedCount;		// Of those, the ones tested again
+	size_t			nodesTested;
+	size_t			visibleCount;
+	size_t			aggregatedCount;
+};
+
+//----------------------------------------------------------------------
+//	Class:		VisibleNodeSet
+//
+//	Purpose:	The nodes of a UniversalOctree holding objects that are at
+//				least partly in view, for viewers that move smoothly.
+//
+//				A traversal tests the loose bounds of nodes from the root and
+//				stops at each node that is wholly out of view, wholly in view,
+//				or partly in view with objects of its own. Those boundary nodes
+//				are kept with their slack: how far the viewer could move before
+//				their state could change, which getViewDistance() gives
+//				directly.
+//
+//				Each update() adds the distance the viewer moved and the angle
+//				the view turned to running totals. A boundary node is tested
+//				again only once the motion since its own test, the distance
+//				plus its range times the angle, could have used up its slack;
+//				its new boundary replaces it. Only when more than a fraction of
+//				the boundary needs revisiting, the projection changed, or
+//				invalidate() was called, is the tree traversed from the root.
+//
+//				With a MagnitudeLod, subtrees too faint to see are left out and
+//				those small enough are kept as one aggregated node, at their
+//				own boundaries: the distance to the magnitude limit or to the
+//				aggregation size is a slack like the distance to the edge of
+//				the view.
+//
+//				The boundary only ever gets finer between full traversals, so
+//				one is also made when it has doubled in size; that merges the
+//				subtrees that have left view entirely again. Call invalidate()
+//				after the octree changes.
+//
+//----------------------------------------------------------------------
+class VisibleNodeSet
+{
+	public:
+		VisibleNodeSet();
+
+		// The next update() traverses the whole tree
+		void			invalidate();
+
+		// Traverse from the root once more than inFraction of the boundary is due
+		// for revisiting. The default is a quarter.
+		void			setFullTraversalFraction(double inFraction) { mFullTraversalFraction = inFraction; };
+
+		// Skips faint subtrees and aggregates distant ones by inLod (which may be NULL),
+		// for the next update() on
+		void			setMagnitudeLod(const MagnitudeLod* inLod);
+
+		// Brings the set up to date for a viewer at inViewer seeing what inCuller is set to
+		void			update(const UniversalOctree& inOctree, const ViewCuller& inCuller, const TUniversalVector3& inViewer);
+
+		// Nodes holding objects, wholly or partly in view
+		const std::vector<uint32_t>&	getVisibleNodes() const { return mVisible; };
+		// Nodes to draw as one point each (MagnitudeLod::getAggregatePoints())
+		const std::vector<uint32_t>&	getAggregatedNodes() const { return mAggregated; };
+		const VisibleNodeSetStats&		getStats() const { return mStats; };
+
+	protected:
+		struct Boundary
+		{
+			uint32_t		node;
+			uint32_t		visibleFirst;		// Its nodes in mVisible
+			uint32_t		visibleCount;
+			bool			ownObjectsOnly;		// Partly in view: its children have boundaries of their own
+			bool			aggregated;			// Drawn as one point
+			double			slack;				// mm
+			double			range;				// Distance from the viewer (mm) when tested
+			double			translation;		// mTranslation and mRotation when tested
+			double			rotation;
+		};
+
+		void			traverse(const UniversalOctree& inOctree, const ViewCuller& inCuller,
+								 const TUniversalVector3& inViewer, uint32_t inNode);
+		void			testOwnObjects(const UniversalOctree& inOctree, const ViewCuller& inCuller,
+									   const TUniversalVector3& inViewer, uint32_t inNode);
+		void			addSubtree(const UniversalOctree& inOctree, uint32_t inNode);
+		bool			isDue(const Boundary& inBoundary) const;
+
+		bool						mValid;
+		const MagnitudeLod*			mLod;
+		double						mFullTraversalFraction;
+		size_t						mFullBoundaryCount;		// Boundary nodes after the last full traversal
+		ViewCullVolume				mPreviousVolume;
+		TUniversalVector3			mPreviousViewer;
+
+		// Total motion since the last full traversal
+		double						mTranslation;
+		double						mRotation;
+
+		std::vector<Boundary>		mBoundary;
+		std::vector<uint32_t>		mVisible;
+		std::vector<uint32_t>		mAggregated;
+		VisibleNodeSetStats			mStats;
+
+		// Scratch, reused between calls
+		std::vector<Boundary>		mPreviousBoundary;
+		std::vector<uint32_t>		mPreviousVisible;
+		std::vector<uint32_t>		mStack;
+};
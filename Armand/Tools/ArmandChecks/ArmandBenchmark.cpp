@@ -0,0 +1,1538 @@
+//----------------------------------------------------------------------
+//	File:		ArmandBenchmark.cpp
+//
+//	Contains:	Checks and timings of Armand's engine code.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "ArmandBenchmark.h"
+#include "UniversalPointBatch.h"
+#include "UniversalSpaceKey.h"
+#include "JobSystem.h"
+#include "ObjectTransforms.h"
+#include "UniversalOctree.h"
+#include "ViewCuller.h"
+#include "VisibleNodeSet.h"
+#include "MagnitudeLod.h"
+#include "ObjectPicker.h"
+#include "PackedCatalogWriter.h"
+#include "CatalogStreamer.h"
+
+#include <stdio.h>
+#include <float.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#ifndef _WIN32
+#include <chrono>
+#endif
+
+typedef unsigned long long	uint64;
+
+static const double kSqrtThree = 1.7320508075688772;
+
+// Deterministic xorshift generator so every run works on the same values
+static inline uint64 nextRandom(uint64& ioState)
+{
+	ioState ^= ioState << 13;
+	ioState ^= ioState >> 7;
+	ioState ^= ioState << 17;
+	return ioState;
+}
+
+// A signed value of roughly inBits bits. Universe coordinates need ~100 bits.
+static ttmath::Int<2> randomInt128(uint64& ioState, unsigned int inBits)
+{
+	ttmath::Int<2> result;
+	result.table[0] = nextRandom(ioState);
+	result.table[1] = nextRandom(ioState);
+	result.Rcr(128 - inBits);
+	if (nextRandom(ioState) & 1)
+		result.ChangeSign();
+
+	return result;
+}
+
+static long long randomInt64(uint64& ioState, unsigned int inBits)
+{
+	long long result = (long long)(nextRandom(ioState) >> (64 - inBits));
+	return (nextRandom(ioState) & 1) ? -result : result;
+}
+
+// Defined here too, as std::min() and std::max() take it by reference
+const size_t ArmandBenchmark::kWarmElementCount;
+
+ArmandBenchmark::ArmandBenchmark(std::ostream& inOutput, size_t inElementCount) : mOutput(inOutput),
+																				  mElementCount(inElementCount),
+																				  mFailedCount(0),
+																				  mSink(0)
+{
+	if (mElementCount < kWarmElementCount)
+		mElementCount = kWarmElementCount;
+
+	// Bigger than any last level cache we are likely to run on
+	const size_t kEvictionBufferSize = 64 * 1024 * 1024;
+	mEvictionBuffer.resize(kEvictionBufferSize, 1);
+}
+
+bool ArmandBenchmark::run()
+{
+	mOutput << "# elements " << mElementCount << ", warm elements " << kWarmElementCount
+			<< ", hardware threads " << std::thread::hardware_concurrency() << std::endl;
+	mOutput << "benchmark,type,cache,ops,seconds,ns_per_op,mops_per_second" << std::endl;
+
+	runViewerRelative();
+	runSpaceKeys();
+	runJobs();
+	runTransforms();
+	runOctreeQueries();
+	runViewCulling();
+	runVisibleNodes();
+	runPicking();
+	runStreaming();
+
+	// Keep the compiler from discarding the results
+	if (mSink == 42)
+		std::cerr << "";
+
+	mOutput << "# " << mFailedCount << " checks failed" << std::endl;
+	return (mFailedCount == 0);
+}
+
+void ArmandBenchmark::check(const char* inName, bool inPassed)
+{
+	mOutput << "# check " << inName << " " << (inPassed ? "ok" : "FAILED") << std::endl;
+	if (!inPassed)
+	{
+		std::cerr << "Check failed: " << inName << std::endl;
+		mFailedCount++;
+	}
+}
+
+// ---------------------------------------------------------------------------
+// ArmandBenchmark::measure											  [protected]
+//
+//	Runs inKernel(begin, end) once over inElementCount elements with cold caches,
+//	then repeatedly over a cache resident block for the same number of operations.
+//	The kernel returns a checksum which is folded into mSink.
+// ---------------------------------------------------------------------------
+template<class Kernel>
+void ArmandBenchmark::measure(const char* inBenchmark, const char* inType, size_t inElementCount, Kernel inKernel)
+{
+	evictCaches();
+	double startTime = getCurrentSeconds();
+	mSink += inKernel(0, inElementCount);
+	report(inBenchmark, inType, eCold, inElementCount, getCurrentSeconds() - startTime);
+
+	size_t warmCount = std::min(kWarmElementCount, inElementCount);
+	size_t passes = inElementCount / warmCount;
+	mSink += inKernel(0, warmCount);	// Bring the block into cache
+	startTime = getCurrentSeconds();
+	for (size_t pass = 0; pass < passes; pass++)
+		mSink += inKernel(0, warmCount);
+	report(inBenchmark, inType, eWarm, passes * warmCount, getCurrentSeconds() - startTime);
+}
+
+void ArmandBenchmark::report(const char* inBenchmark, const char* inType, CacheState inCache, size_t inOps, double inSeconds)
+{
+	double nsPerOp = (inOps > 0) ? (inSeconds * 1.0e9 / inOps) : 0.0;
+	double mops = (inSeconds > 0.0) ? (inOps / inSeconds * 1.0e-6) : 0.0;
+
+	mOutput << inBenchmark << ","
+			<< inType << ","
+			<< ((inCache == eCold) ? "cold" : "warm") << ","
+			<< inOps << ","
+			<< inSeconds << ","
+			<< nsPerOp << ","
+			<< mops << std::endl;
+}
+
+void ArmandBenchmark::evictCaches()
+{
+	// Touch every cache line of a buffer larger than the last level cache
+	const size_t kCacheLineSize = 64;
+	char sum = 0;
+	for (size_t i = 0; i < mEvictionBuffer.size(); i += kCacheLineSize)
+	{
+		mEvictionBuffer[i]++;
+		sum += mEvictionBuffer[i];
+	}
+	mSink += sum;
+}
+
+double ArmandBenchmark::getCurrentSeconds() const
+{
+#ifdef _WIN32
+	LARGE_INTEGER ticksPerSecond, tick;
+	QueryPerformanceFrequency(&ticksPerSecond);
+	QueryPerformanceCounter(&tick);
+	return (double)tick.QuadPart / ticksPerSecond.QuadPart;
+#else
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+typedef void (*ViewerRelativeConverter)(const UniversalPointArrays&, const UniversalPointOrigin&, double, float*);
+
+static ttmath::Int<2> makeInt128(int64_t inHi, uint64_t inLo)
+{
+	ttmath::Int<2> result;
+	result.table[0] = inLo;
+	result.table[1] = (uint64_t)inHi;
+	return result;
+}
+
+// inPoints relative to inViewer as x,y,z floats, with a batch kernel or, when inConvert
+// is NULL, with exact Int<2> subtraction followed by scaling
+static void convertPoints(const std::vector<ttmath::Int<2> >* const* inPoints, const ttmath::Int<2>* inViewer, double inScale,
+						  ViewerRelativeConverter inConvert, std::vector<float>& outXYZ)
+{
+	const size_t n = inPoints[0]->size();
+	outXYZ.resize(n * 3);
+	if (inConvert == NULL)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				ttmath::Int<2> d((*inPoints[axis])[i]);
+				d.Sub(inViewer[axis]);
+				outXYZ[i * 3 + axis] = (float)(d.ToDouble() * inScale);
+			}
+		}
+		return;
+	}
+
+	std::vector<uint64_t> lo[3];
+	std::vector<int64_t> hi[3];
+	UniversalPointArrays points;
+	UniversalPointOrigin origin;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		lo[axis].resize(n);
+		hi[axis].resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			lo[axis][i] = (*inPoints[axis])[i].table[0];
+			hi[axis][i] = (int64_t)(*inPoints[axis])[i].table[1];
+		}
+		points.lo[axis] = &lo[axis][0];
+		points.hi[axis] = &hi[axis][0];
+		origin.lo[axis] = inViewer[axis].table[0];
+		origin.hi[axis] = (int64_t)inViewer[axis].table[1];
+	}
+	points.count = n;
+	inConvert(points, origin, inScale, &outXYZ[0]);
+}
+
+// Whether every float is within two units in the last place of the exact one. The kernels
+// round each word to a double before adding them, so they may be off by one.
+static bool isCloseToExact(const std::vector<float>& inXYZ, const std::vector<float>& inExactXYZ)
+{
+	for (size_t i = 0; i < inXYZ.size(); i++)
+	{
+		if (fabs(inXYZ[i] - inExactXYZ[i]) > fabs(inExactXYZ[i]) * 2.0f * FLT_EPSILON)
+			return false;
+	}
+	return true;
+}
+
+void ArmandBenchmark::runViewerRelative()
+{
+	// One op is one point converted to viewer relative float x,y,z, so mops_per_second is
+	// millions of points per second.
+	const size_t n = mElementCount;
+	const double kScale = 1.0e-3;	// Millimetres to GL units
+	uint64 seed = 0x369DEA0F31A53F85ull;
+
+	std::vector<ttmath::Int<2> > x(n), y(n), z(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		x[i] = randomInt128(seed, 100);
+		y[i] = randomInt128(seed, 100);
+		z[i] = randomInt128(seed, 100);
+	}
+	ttmath::Int<2> viewer[3] = { randomInt128(seed, 100), randomInt128(seed, 100), randomInt128(seed, 100) };
+	std::vector<float> xyz(n * 3);
+
+	// Points and a viewer near opposite ends of the 128-bit range, so offsets are near 2^126
+	std::vector<ttmath::Int<2> > far[3];
+	ttmath::Int<2> farViewer[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		ttmath::Int<2> end = makeInt128(0x1fffffffffffffffll, 0xfedcba9876543210ull);
+		if (axis == 1)
+			end.ChangeSign();
+		farViewer[axis] = end;
+		for (int i = 0; i < 16; i++)
+		{
+			ttmath::Int<2> point(randomInt128(seed, 100));
+			point.Sub(end);
+			far[axis].push_back(point);
+		}
+	}
+
+	// Points around zero and +-2^63, +-2^64, against viewers that make their offsets
+	// borrow from or carry into the high word
+	const int64_t kCrossingHi[8] = { -1, -1, -1, -1, 0, 0, 1, -2 };
+	const uint64_t kCrossingLo[8] = { 0xffffffffffffffffull, 0, 0x8000000000000000ull, 0x7fffffffffffffffull,
+									  0x8000000000000000ull, 0xffffffffffffffffull, 0, 5 };
+	std::vector<ttmath::Int<2> > crossing[3];
+	ttmath::Int<2> crossingViewer[3] = { makeInt128(0, 3), makeInt128(-1, 0xfffffffffffffff0ull), makeInt128(1, 0) };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (int i = 0; i < 8; i++)
+			crossing[axis].push_back(makeInt128(kCrossingHi[(i + axis) % 8], kCrossingLo[(i + axis) % 8]));
+	}
+
+	const std::vector<ttmath::Int<2> >* randomPoints[3] = { &x, &y, &z };
+	const std::vector<ttmath::Int<2> >* farPoints[3] = { &far[0], &far[1], &far[2] };
+	const std::vector<ttmath::Int<2> >* crossingPoints[3] = { &crossing[0], &crossing[1], &crossing[2] };
+	const std::vector<ttmath::Int<2> >* const* checkPoints[3] = { randomPoints, farPoints, crossingPoints };
+	const ttmath::Int<2>* checkViewers[3] = { viewer, farViewer, crossingViewer };
+	const char* checkNames[3] = { "random", "far", "crossing" };
+	for (int c = 0; c < 3; c++)
+	{
+		std::vector<float> exactXYZ, scalarXYZ, avx2XYZ;
+		convertPoints(checkPoints[c], checkViewers[c], kScale, NULL, exactXYZ);
+		convertPoints(checkPoints[c], checkViewers[c], kScale, convertToViewerRelativeScalar, scalarXYZ);
+		char name[64];
+		sprintf(name, "viewer relative %s scalar against Int<2>", checkNames[c]);
+		check(name, isCloseToExact(scalarXYZ, exactXYZ));
+		if (convertToViewerRelativeHasAVX2())
+		{
+			convertPoints(checkPoints[c], checkViewers[c], kScale, convertToViewerRelative, avx2XYZ);
+			sprintf(name, "viewer relative %s avx2 against scalar", checkNames[c]);
+			check(name, avx2XYZ == scalarXYZ);
+		}
+	}
+
+	// One point at a time, as TUniversalVector3::toVector3f() does it
+	measure("ViewerRelative", "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+		const ttmath::Int<2>* source[3] = { &x[0], &y[0], &z[0] };
+		for (size_t i = inBegin; i < inEnd; i++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				ttmath::Int<2> d(source[axis][i]);
+				d.Sub(viewer[axis]);
+				xyz[i * 3 + axis] = (float)(d.ToDouble() * kScale);
+			}
+		}
+		return (uint64)(xyz[inBegin * 3] != 0.0f);
+	});
+
+	// The batch kernels want the words split into structure-of-arrays
+	std::vector<uint64_t> lo[3];
+	std::vector<int64_t> hi[3];
+	const std::vector<ttmath::Int<2> >* source[3] = { &x, &y, &z };
+	UniversalPointArrays points;
+	UniversalPointOrigin origin;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		lo[axis].resize(n);
+		hi[axis].resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			lo[axis][i] = (*source[axis])[i].table[0];
+			hi[axis][i] = (int64_t)(*source[axis])[i].table[1];
+		}
+		origin.lo[axis] = viewer[axis].table[0];
+		origin.hi[axis] = (int64_t)viewer[axis].table[1];
+	}
+
+	auto batchKernel = [&](void (*inConvert)(const UniversalPointArrays&, const UniversalPointOrigin&, double, float*)) {
+		return [&, inConvert](size_t inBegin, size_t inEnd) -> uint64 {
+			for (int axis = 0; axis < 3; axis++)
+			{
+				points.lo[axis] = &lo[axis][inBegin];
+				points.hi[axis] = &hi[axis][inBegin];
+			}
+			points.count = inEnd - inBegin;
+			inConvert(points, origin, kScale, &xyz[inBegin * 3]);
+			return (uint64)(xyz[inBegin * 3] != 0.0f);
+		};
+	};
+
+	measure("ViewerRelative", "batch scalar", n, batchKernel(convertToViewerRelativeScalar));
+	if (convertToViewerRelativeHasAVX2())
+		measure("ViewerRelative", "batch avx2", n, batchKernel(convertToViewerRelative));
+}
+
+void ArmandBenchmark::runSpaceKeys()
+{
+	// One op is one 384-bit key encoded or decoded. Points are 100-bit, as in a catalog.
+	const size_t n = mElementCount;
+	uint64 seed = 0x2545F4914F6CDD1Dull;
+
+	std::vector<uint64_t> lo[3], decodedLo[3];
+	std::vector<int64_t> hi[3], decodedHi[3];
+	UniversalPointArrays points;
+	uint64_t* outLo[3];
+	int64_t* outHi[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		lo[axis].resize(n);
+		hi[axis].resize(n);
+		decodedLo[axis].resize(n);
+		decodedHi[axis].resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			ttmath::Int<2> value = randomInt128(seed, 100);
+			lo[axis][i] = value.table[0];
+			hi[axis][i] = (int64_t)value.table[1];
+		}
+		outLo[axis] = &decodedLo[axis][0];
+		outHi[axis] = &decodedHi[axis][0];
+	}
+	std::vector<UniversalSpaceKey> keys(n);
+
+	typedef void (*Encoder)(const UniversalPointArrays&, UniversalSpaceCurve, UniversalSpaceKey*);
+	typedef void (*Decoder)(const UniversalSpaceKey*, size_t, UniversalSpaceCurve, uint64_t**, int64_t**);
+	auto encodeKernel = [&](Encoder inEncode, UniversalSpaceCurve inCurve) {
+		return [&, inEncode, inCurve](size_t inBegin, size_t inEnd) -> uint64 {
+			for (int axis = 0; axis < 3; axis++)
+			{
+				points.lo[axis] = &lo[axis][inBegin];
+				points.hi[axis] = &hi[axis][inBegin];
+			}
+			points.count = inEnd - inBegin;
+			inEncode(points, inCurve, &keys[inBegin]);
+			return keys[inBegin].word[5];
+		};
+	};
+	auto decodeKernel = [&](Decoder inDecode, UniversalSpaceCurve inCurve) {
+		return [&, inDecode, inCurve](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64_t* blockLo[3];
+			int64_t* blockHi[3];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				blockLo[axis] = outLo[axis] + inBegin;
+				blockHi[axis] = outHi[axis] + inBegin;
+			}
+			inDecode(&keys[inBegin], inEnd - inBegin, inCurve, blockLo, blockHi);
+			return decodedLo[0][inBegin];
+		};
+	};
+
+	const char* curveNames[2] = { "MortonKey", "HilbertKey" };
+	const char* decodeNames[2] = { "MortonDecode", "HilbertDecode" };
+	for (int curve = 0; curve < 2; curve++)
+	{
+		UniversalSpaceCurve spaceCurve = (UniversalSpaceCurve)curve;
+		measure(curveNames[curve], "table", n, encodeKernel(encodeUniversalSpaceKeysTable, spaceCurve));
+		if (universalSpaceKeyHasBMI2())
+			measure(curveNames[curve], "bmi2", n, encodeKernel(encodeUniversalSpaceKeys, spaceCurve));
+
+		// keys[] now holds every key of this curve
+		measure(decodeNames[curve], "table", n, decodeKernel(decodeUniversalSpaceKeysTable, spaceCurve));
+		if (universalSpaceKeyHasBMI2())
+			measure(decodeNames[curve], "bmi2", n, decodeKernel(decodeUniversalSpaceKeys, spaceCurve));
+
+		bool roundTrip = true;
+		for (int axis = 0; axis < 3; axis++)
+			roundTrip = roundTrip && (decodedLo[axis] == lo[axis]) && (decodedHi[axis] == hi[axis]);
+		char name[64];
+		sprintf(name, "%s round trip", curveNames[curve]);
+		check(name, roundTrip);
+	}
+
+	// Locality: the mean log2 distance (mm) between points that follow each other, in the order
+	// they were generated and in curve order. Lower means neighbours in memory are nearer in space.
+	const char* orderNames[3] = { "generated", "morton", "hilbert" };
+	std::vector<uint32_t> order(n);
+	for (int ordering = 0; ordering < 3; ordering++)
+	{
+		if (ordering == 0)
+		{
+			for (size_t i = 0; i < n; i++)
+				order[i] = (uint32_t)i;
+		}
+		else
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				points.lo[axis] = &lo[axis][0];
+				points.hi[axis] = &hi[axis][0];
+			}
+			points.count = n;
+			getUniversalSpaceKeyOrder(points, (UniversalSpaceCurve)(ordering - 1), order);
+		}
+
+		double sumLog2 = 0.0;
+		for (size_t i = 1; i < n; i++)
+		{
+			double distanceSquared = 0.0;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				ttmath::Int<2> a, b;
+				a.table[0] = lo[axis][order[i]];
+				a.table[1] = (ttmath::uint)hi[axis][order[i]];
+				b.table[0] = lo[axis][order[i - 1]];
+				b.table[1] = (ttmath::uint)hi[axis][order[i - 1]];
+				a.Sub(b);
+				double d = a.ToDouble();
+				distanceSquared += d * d;
+			}
+			sumLog2 += 0.5 * log(distanceSquared) / log(2.0);
+		}
+		mOutput << "# locality " << orderNames[ordering] << " order: mean log2 distance between consecutive points "
+				<< sumLog2 / (double)(n - 1) << std::endl;
+	}
+}
+
+static void countJob(void* ioData)
+{
+	(**(std::atomic<uint64>**)ioData)++;
+}
+
+// ---------------------------------------------------------------------------
+// ArmandBenchmark::runJobs										  [protected]
+//
+//	Scheduling overhead of the job system for jobs that do next to nothing,
+//	with one thread and with one per hardware thread. One op is one job, one
+//	parallelFor index or one link of a runAfter() chain; jobs are run in
+//	batches well within a thread's ring of jobs.
+// ---------------------------------------------------------------------------
+void ArmandBenchmark::runJobs()
+{
+	const size_t n = mElementCount;
+	const size_t kBatchSize = 1024;
+	unsigned threadCounts[2] = { 1, std::max(std::thread::hardware_concurrency(), 1u) };
+
+	for (int t = 0; t < ((threadCounts[1] > 1) ? 2 : 1); t++)
+	{
+		JobSystem jobs(threadCounts[t]);
+		char type[32];
+		sprintf(type, "%u threads", jobs.getThreadCount());
+
+		std::atomic<uint64> count(0);
+		std::atomic<uint64>* countPointer = &count;
+		double startTime = getCurrentSeconds();
+		for (size_t i = 0; i < n; i += kBatchSize)
+		{
+			JobCounter counter;
+			for (size_t j = i; j < std::min(i + kBatchSize, n); j++)
+				jobs.run(countJob, &countPointer, sizeof(countPointer), &counter);
+			jobs.wait(counter);
+		}
+		report("JobRunWait", type, eWarm, n, getCurrentSeconds() - startTime);
+		mSink += count;
+
+		// Every index its own job, then ranges big enough to hide the overhead
+		std::vector<uint64> values(n);
+		const size_t grains[2] = { 1, 1024 };
+		const char* names[2] = { "JobParallelFor(1)", "JobParallelFor(1024)" };
+		for (int g = 0; g < 2; g++)
+		{
+			startTime = getCurrentSeconds();
+			jobs.parallelFor(n, grains[g], [&](size_t inBegin, size_t inEnd) {
+				for (size_t i = inBegin; i < inEnd; i++)
+					values[i] += i;
+			});
+			report(names[g], type, eWarm, n, getCurrentSeconds() - startTime);
+			mSink += values[n - 1];
+		}
+
+		// Each job waits for the one before it
+		std::vector<JobCounter> counters(kBatchSize);
+		size_t links = 0;
+		startTime = getCurrentSeconds();
+		for (size_t i = 0; i < n; i += kBatchSize)
+		{
+			jobs.run(countJob, &countPointer, sizeof(countPointer), &counters[0]);
+			for (size_t j = 1; j < kBatchSize; j++)
+				jobs.runAfter(counters[j - 1], countJob, &countPointer, sizeof(countPointer), &counters[j]);
+			jobs.wait(counters[kBatchSize - 1]);
+			links += kBatchSize;
+		}
+		report("JobChain", type, eWarm, links, getCurrentSeconds() - startTime);
+		mSink += count;
+
+		JobSystemStats stats;
+		jobs.getStats(stats);
+		size_t executed = 0, stolen = 0;
+		for (size_t i = 0; i < stats.executed.size(); i++)
+		{
+			executed += stats.executed[i];
+			stolen += stats.stolen[i];
+		}
+		mOutput << "# jobs " << type << ": " << executed << " run, " << stolen << " stolen" << std::endl;
+
+		// Jobs see their own thread's index, and every index is run; a thread the
+		// system didn't start is none of its
+		bool jobThreadsOk = true;
+		std::vector<unsigned> jobThreads(kBatchSize, kNoJobThread);
+		jobs.parallelFor(kBatchSize, 1, [&](size_t inBegin, size_t inEnd) {
+			for (size_t i = inBegin; i < inEnd; i++)
+				jobThreads[i] = jobs.getCurrentThread();
+		});
+		for (size_t i = 0; i < kBatchSize; i++)
+		{
+			if (jobThreads[i] >= jobs.getThreadCount())
+				jobThreadsOk = false;
+		}
+		unsigned otherThread = 0;
+		std::thread other([&]() { otherThread = jobs.getCurrentThread(); });
+		other.join();
+		char name[64];
+		sprintf(name, "job threads %s", type);
+		check(name, jobThreadsOk && (jobs.getCurrentThread() == 0) && (otherThread == kNoJobThread));
+	}
+}
+
+// ---------------------------------------------------------------------------
+// ArmandBenchmark::runTransforms									  [protected]
+//
+//	ObjectTransforms split across a JobSystem against the same updates on one
+//	thread, over stars in rotated galaxies, some with planets and some
+//	spinning. The results must be identical. One op is one object.
+// ---------------------------------------------------------------------------
+void ArmandBenchmark::runTransforms()
+{
+	const size_t n = mElementCount;
+	const int kGalaxyCount = 16;
+	uint64 seed = 0x5C1A3F7E92B4D608ull;
+
+	ObjectHierarchy hierarchy;
+	hierarchy.reserve(n + n / 8 + kGalaxyCount + 1);
+	ObjectIndex universe = hierarchy.addObject(kNoObject, eObjectUniverse, TUniversalVector3());
+	std::vector<ObjectIndex> galaxies;
+	for (int galaxy = 0; galaxy < kGalaxyCount; galaxy++)
+	{
+		TUniversalVector3 origin(randomInt128(seed, 100), randomInt128(seed, 100), randomInt128(seed, 100));
+		galaxies.push_back(hierarchy.addObject(universe, eObjectGalaxy, origin, objectRotationAboutUp(0.4 * galaxy)));
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		TUniversalVector3 origin(randomInt128(seed, 70), randomInt128(seed, 70), randomInt128(seed, 70));
+		ObjectIndex star = hierarchy.addObject(galaxies[nextRandom(seed) % kGalaxyCount], eObjectStar, origin);
+		if (i % 8 == 0)
+			hierarchy.addObject(star, eObjectPlanet, TUniversalVector3(randomInt128(seed, 45), randomInt128(seed, 45), randomInt128(seed, 45)));
+	}
+	hierarchy.sortBreadthFirst();
+
+	JobSystem jobs(4);
+	ObjectTransforms serial(hierarchy), parallel(hierarchy);
+	parallel.setJobSystem(&jobs);
+	for (ObjectIndex object = 0; object < (ObjectIndex)hierarchy.getCount(); object += 2)
+	{
+		if (hierarchy.getType(object) == eObjectStar)
+		{
+			serial.setSpin(object, 1.0e-3 * (object % 7), 0.1 * (object % 5));
+			parallel.setSpin(object, 1.0e-3 * (object % 7), 0.1 * (object % 5));
+		}
+	}
+
+	// Everything, then the galaxies turned, then time alone
+	size_t wrongCount = 0;
+	for (int step = 0; step < 3; step++)
+	{
+		if (step == 1)
+		{
+			for (int galaxy = 0; galaxy < kGalaxyCount; galaxy++)
+			{
+				ObjectIndex object = hierarchy.getLevelBegin(1) + galaxy;
+				hierarchy.setLocalRotation(object, objectRotationAboutUp(0.4 * galaxy + 0.01));
+				serial.markLocalChanged(object);
+				parallel.markLocalChanged(object);
+			}
+		}
+		double seconds = 100.0 * step;
+		serial.update(seconds);
+		parallel.update(seconds);
+
+		if ((serial.getLastUpdateObjectCount() != parallel.getLastUpdateObjectCount()) ||
+			(serial.getLastUpdateSpinCount() != parallel.getLastUpdateSpinCount()))
+			wrongCount++;
+		UniversalPointArrays serialOrigins = serial.getOrigins();
+		UniversalPointArrays parallelOrigins = parallel.getOrigins();
+		for (ObjectIndex object = 0; object < (ObjectIndex)hierarchy.getCount(); object++)
+		{
+			ObjectRotation serialBody = serial.getBody(object);
+			ObjectRotation parallelBody = parallel.getBody(object);
+			if (memcmp(&serialBody, &parallelBody, sizeof(ObjectRotation)) != 0)
+				wrongCount++;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if ((serialOrigins.lo[axis][object] != parallelOrigins.lo[axis][object]) ||
+					(serialOrigins.hi[axis][object] != parallelOrigins.hi[axis][object]))
+					wrongCount++;
+			}
+		}
+	}
+	check("transforms on jobs against one thread", wrongCount == 0);
+
+	ObjectTransforms* transforms[2] = { &serial, &parallel };
+	const char* types[2] = { "1 thread", "4 threads" };
+	for (int t = 0; t < 2; t++)
+	{
+		transforms[t]->markLocalChanged(universe);
+		double startTime = getCurrentSeconds();
+		transforms[t]->update(1000.0);
+		report("TransformUpdate", types[t], eWarm, hierarchy.getCount(), getCurrentSeconds() - startTime);
+	}
+}
+
+// Exact a - b, rounded once to the nearest double
+static double coordDifference(const UniversalCoord& a, const UniversalCoord& b)
+{
+	UniversalCoord d(a);
+	d.Sub(b);
+	return d.ToDouble();
+}
+
+static double distanceSquared(const TUniversalVector3& a, const TUniversalVector3& b)
+{
+	TVector3d v(coordDifference(a.x, b.x), coordDifference(a.y, b.y), coordDifference(a.z, b.z));
+	return v.LengthSquared();
+}
+
+// ---------------------------------------------------------------------------
+// ArmandBenchmark::runOctreeQueries								  [protected]
+//
+//	Nearest neighbour, sphere and cone queries of UniversalOctree against
+//	testing every object, with queries made from within clusters of objects
+//	that straddle the faces of large cells. One op is one query.
+// ---------------------------------------------------------------------------
+void ArmandBenchmark::runOctreeQueries()
+{
+	const size_t n = std::min(mElementCount, (size_t)100000);
+	const size_t kClusterCount = 64;
+	const size_t kQueryCount = 200;
+	const size_t kNeighbourCount = 16;
+	uint64 seed = 0x7C3A1D5B9E24F681ull;
+
+	// Clusters sit on the corners of cells 2^80 to 2^110 mm wide, spread over a few times
+	// the resolution of a double that size, so the neighbours of a query near the corner
+	// are often across the faces of cells far wider than the distances between them
+	std::vector<TUniversalVector3> clusters(kClusterCount);
+	std::vector<int> clusterBits(kClusterCount);
+	for (size_t c = 0; c < kClusterCount; c++)
+	{
+		int cornerBits = 80 + 10 * (int)(c % 4);
+		UniversalCoord corner[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			corner[axis] = randomInt128(seed, 110);
+			corner[axis].Rcr(cornerBits);
+			corner[axis].Rcl(cornerBits);
+		}
+		clusters[c] = TUniversalVector3(corner[0], corner[1], corner[2]);
+		clusterBits[c] = cornerBits - 50;
+	}
+
+	// Half the objects are points, the rest spheres up to 1/256 of their cluster across
+	std::vector<TUniversalVector3> centers(n);
+	std::vector<uint64_t> lo[3];
+	std::vector<int64_t> hi[3];
+	std::vector<double> radii(n);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		lo[axis].resize(n);
+		hi[axis].resize(n);
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t c = nextRandom(seed) % kClusterCount;
+		int bits = clusterBits[c];
+		centers[i] = TUniversalVector3(clusters[c].x + randomInt128(seed, bits), clusters[c].y + randomInt128(seed, bits),
+									   clusters[c].z + randomInt128(seed, bits));
+		const UniversalCoord* axes[3] = { &centers[i].x, &centers[i].y, &centers[i].z };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			lo[axis][i] = axes[axis]->table[0];
+			hi[axis][i] = (int64_t)axes[axis]->table[1];
+		}
+		radii[i] = (i & 1) ? ldexp((double)(nextRandom(seed) >> 11), bits - 8 - 53) : 0.0;
+	}
+
+	UniversalPointArrays points;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		points.lo[axis] = &lo[axis][0];
+		points.hi[axis] = &hi[axis][0];
+	}
+	points.count = n;
+	UniversalOctree octree;
+	octree.build(points, &radii[0]);
+
+	std::vector<TUniversalVector3> queries(kQueryCount);
+	std::vector<int> queryBits(kQueryCount);
+	std::vector<TVector3d> axes(kQueryCount);
+	for (size_t q = 0; q < kQueryCount; q++)
+	{
+		size_t c = nextRandom(seed) % kClusterCount;
+		queryBits[q] = clusterBits[c] - 2;
+		queries[q] = TUniversalVector3(clusters[c].x + randomInt128(seed, queryBits[q]), clusters[c].y + randomInt128(seed, queryBits[q]),
+									   clusters[c].z + randomInt128(seed, queryBits[q]));
+		axes[q] = TVector3d((double)randomInt64(seed, 20), (double)randomInt64(seed, 20), (double)randomInt64(seed, 20));
+		axes[q].Normalize();
+	}
+
+	// Nearest neighbours. Equal distances may come back in either order, so the distances
+	// are compared rather than the objects.
+	std::vector<ObjectIndex> found;
+	std::vector<double> foundDistances, distances(n);
+	size_t wrongCount = 0;
+	double octreeSeconds = 0.0, bruteSeconds = 0.0;
+	for (size_t q = 0; q < kQueryCount; q++)
+	{
+		found.clear();
+		foundDistances.clear();
+		double startTime = getCurrentSeconds();
+		octree.queryNearest(queries[q], kNeighbourCount, found, &foundDistances);
+		octreeSeconds += getCurrentSeconds() - startTime;
+
+		startTime = getCurrentSeconds();
+		for (size_t i = 0; i < n; i++)
+			distances[i] = sqrt(distanceSquared(centers[i], queries[q]));
+		std::partial_sort(distances.begin(), distances.begin() + kNeighbourCount, distances.end());
+		bruteSeconds += getCurrentSeconds() - startTime;
+
+		bool same = (foundDistances.size() == kNeighbourCount);
+		for (size_t i = 0; same && (i < kNeighbourCount); i++)
+			same = (fabs(foundDistances[i] - distances[i]) <= 1.0e-9 * distances[i]);
+		if (!same)
+			wrongCount++;
+	}
+	report("OctreeNearest", "octree", eWarm, kQueryCount, octreeSeconds);
+	report("OctreeNearest", "brute force", eWarm, kQueryCount, bruteSeconds);
+	mOutput << "# octree nearest: " << wrongCount << " of " << kQueryCount << " queries wrong" << std::endl;
+	check("octree nearest against brute force", wrongCount == 0);
+
+	// Spheres reaching a few neighbours out and cones along random axes
+	std::vector<ObjectIndex> expected;
+	const char* shapeNames[2] = { "OctreeSphere", "OctreeCone" };
+	for (int shape = 0; shape < 2; shape++)
+	{
+		wrongCount = 0;
+		octreeSeconds = 0.0;
+		bruteSeconds = 0.0;
+		for (size_t q = 0; q < kQueryCount; q++)
+		{
+			double radius = ldexp(1.0, queryBits[q] - 2 + (int)(nextRandom(seed) % 4));
+			double halfAngle = 0.01 + 0.3 * (double)(nextRandom(seed) % 1000) / 1000.0;
+			double range = ldexp(1.0, queryBits[q] + (int)(nextRandom(seed) % 4));
+			found.clear();
+			double startTime = getCurrentSeconds();
+			if (shape == 0)
+				octree.querySphere(queries[q], radius, found);
+			else
+				octree.queryCone(queries[q], axes[q], halfAngle, range, found);
+			octreeSeconds += getCurrentSeconds() - startTime;
+
+			// The cone test as UniversalOctree::sphereInCone() makes it
+			expected.clear();
+			startTime = getCurrentSeconds();
+			for (size_t i = 0; i < n; i++)
+			{
+				TVector3d v(coordDifference(centers[i].x, queries[q].x), coordDifference(centers[i].y, queries[q].y),
+							coordDifference(centers[i].z, queries[q].z));
+				double length = v.Length();
+				bool inside;
+				if (shape == 0)
+					inside = (length <= radius + radii[i]);
+				else if (length <= radii[i])
+					inside = true;
+				else if (length - radii[i] > range)
+					inside = false;
+				else
+				{
+					double along = v * axes[q];
+					double across = sqrt(std::max(0.0, length * length - along * along));
+					double distance = (along * cos(halfAngle) + across * sin(halfAngle) < 0.0) ? length :
+									  across * cos(halfAngle) - along * sin(halfAngle);
+					inside = (distance <= radii[i]);
+				}
+				if (inside)
+					expected.push_back((ObjectIndex)i);
+			}
+			bruteSeconds += getCurrentSeconds() - startTime;
+
+			std::sort(found.begin(), found.end());
+			if (found != expected)
+				wrongCount++;
+		}
+		report(shapeNames[shape], "octree", eWarm, kQueryCount, octreeSeconds);
+		report(shapeNames[shape], "brute force", eWarm, kQueryCount, bruteSeconds);
+		mOutput << "# " << shapeNames[shape] << ": " << wrongCount << " of " << kQueryCount << " queries wrong" << std::endl;
+		check((shape == 0) ? "octree sphere against brute force" : "octree cone against brute force", wrongCount == 0);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// ArmandBenchmark::runViewCulling									  [protected]
+//
+//	ViewCuller's SSE batches against its scalar path, which must pick exactly
+//	the same spheres and points, and both against getViewDistance() in double
+//	wherever float rounding can't decide. One op is one sphere or point.
+// ---------------------------------------------------------------------------
+void ArmandBenchmark::runViewCulling()
+{
+	const size_t n = mElementCount;
+	uint64 seed = 0x5851F42D4C957F2Dull;
+
+	// Centres from 1 to 2^20 GL units away in every direction, radii up to a tenth of that
+	std::vector<float> xyz(n * 3), radii(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		TVector3d v((double)randomInt64(seed, 30), (double)randomInt64(seed, 30), (double)randomInt64(seed, 30));
+		v.Normalize();
+		double length = ldexp(1.0, (int)(nextRandom(seed) % 21));
+		xyz[i * 3] = (float)(v.x * length);
+		xyz[i * 3 + 1] = (float)(v.y * length);
+		xyz[i * 3 + 2] = (float)(v.z * length);
+		radii[i] = (float)(length * 0.1 * (double)(nextRandom(seed) % 1000) / 1000.0);
+	}
+
+	ViewCuller culler;
+	TVector3d gaze(0.3, -0.2, -1.0);
+	const char* volumeNames[3] = { "fisheye 180", "fisheye 230", "perspective 60" };
+	std::vector<uint32_t> visible, visibleScalar;
+	for (int volume = 0; volume < 3; volume++)
+	{
+		if (volume < 2)
+			culler.setFisheye(gaze, (volume == 0) ? 3.14159265358979323846 : 230.0 * 3.14159265358979323846 / 180.0);
+		else
+			culler.setPerspective(gaze, TVector3d(0.0, 1.0, 0.0), 60.0 * 3.14159265358979323846 / 180.0, 16.0 / 9.0);
+
+		char type[64];
+		for (int spheres = 0; spheres < 2; spheres++)
+		{
+			const char* benchmark = spheres ? "CullSpheres" : "CullPoints";
+			const float* inRadii = spheres ? &radii[0] : NULL;
+			sprintf(type, "%s sse", volumeNames[volume]);
+			measure(benchmark, type, n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+				return spheres ? culler.cullSpheres(&xyz[inBegin * 3], &radii[inBegin], inEnd - inBegin, visible) :
+								 culler.cullPoints(&xyz[inBegin * 3], inEnd - inBegin, visible);
+			});
+			sprintf(type, "%s scalar", volumeNames[volume]);
+			measure(benchmark, type, n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+				return spheres ? culler.cullSpheresScalar(&xyz[inBegin * 3], &radii[inBegin], inEnd - inBegin, visibleScalar) :
+								 culler.cullPointsScalar(&xyz[inBegin * 3], inEnd - inBegin, visibleScalar);
+			});
+
+			// The last call of each covered the warm block only, so cull everything again
+			if (spheres)
+			{
+				culler.cullSpheres(&xyz[0], inRadii, n, visible);
+				culler.cullSpheresScalar(&xyz[0], inRadii, n, visibleScalar);
+			}
+			else
+			{
+				culler.cullPoints(&xyz[0], n, visible);
+				culler.cullPointsScalar(&xyz[0], n, visibleScalar);
+			}
+			char name[96];
+			sprintf(name, "%s %s sse against scalar", benchmark, volumeNames[volume]);
+			check(name, visible == visibleScalar);
+
+			size_t wrongCount = 0;
+			size_t next = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				bool isVisible = (next < visible.size()) && (visible[next] == i);
+				if (isVisible)
+					next++;
+				TVector3d center(xyz[i * 3], xyz[i * 3 + 1], xyz[i * 3 + 2]);
+				double radius = spheres ? radii[i] : 0.0;
+				double distance = culler.getViewDistance(center);
+				double margin = 1.0e-5 * center.Length();
+				if ((isVisible && (distance > radius + margin)) || (!isVisible && (distance < radius - margin)))
+					wrongCount++;
+			}
+			sprintf(name, "%s %s against double", benchmark, volumeNames[volume]);
+			check(name, wrongCount == 0);
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+// ArmandBenchmark::runVisibleNodes									  [protected]
+//
+//	A VisibleNodeSet updated incrementally as the viewer flies through a
+//	cloud of stars against a full traversal from the root every frame. The
+//	view is a fisheye dome for the first half of the flight and a perspective
+//	frustum for the second. One op is one frame.
+//
+//	The flight is made twice. Without a MagnitudeLod both must find the same
+//	nodes. With one, the incremental set may keep nodes one by one that a
+//	full traversal would now aggregate, so instead every node it keeps must
+//	still pass the rule that put it there, and everything a full traversal
+//	would draw must be drawn, on its own or within an aggregated node.
+// ---------------------------------------------------------------------------
+void ArmandBenchmark::runVisibleNodes()
+{
+	const size_t n = std::min(mElementCount, (size_t)200000);
+	const size_t kFrameCount = 600;
+	uint64 seed = 0x2F6B8E3C91D4A057ull;
+
+	// Within 2^70 mm (some 40 parsecs) of the origin, denser towards it, with a
+	// quarter of them in 16 distant clusters a few hundred AU across, small
+	// enough in the sky to be aggregated
+	const int kClusterCount = 16;
+	ttmath::Int<2> clusters[kClusterCount][3];
+	for (int cluster = 0; cluster < kClusterCount; cluster++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+			clusters[cluster][axis] = randomInt128(seed, 69);
+	}
+	std::vector<uint64_t> lo[3];
+	std::vector<int64_t> hi[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		lo[axis].resize(n);
+		hi[axis].resize(n);
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		bool inCluster = (i % 4 == 0);
+		int cluster = (int)(nextRandom(seed) % kClusterCount);
+		unsigned int bits = inCluster ? 50 + (unsigned int)(nextRandom(seed) % 7) : 60 + (unsigned int)(nextRandom(seed) % 11);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			ttmath::Int<2> value = randomInt128(seed, bits);
+			if (inCluster)
+				value += clusters[cluster][axis];
+			lo[axis][i] = value.table[0];
+			hi[axis][i] = (int64_t)value.table[1];
+		}
+	}
+	UniversalPointArrays points;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		points.lo[axis] = &lo[axis][0];
+		points.hi[axis] = &hi[axis][0];
+	}
+	points.count = n;
+	UniversalOctree octree;
+	octree.build(points, NULL);
+
+	// Absolute magnitudes from -5 to 16, mostly faint as among real stars
+	std::vector<float> magnitudes(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		double u = (double)(nextRandom(seed) >> 11) / 9007199254740992.0;
+		magnitudes[i] = (float)(16.0 - 21.0 * u * u);
+	}
+	MagnitudeLod magnitudeLod;
+	double startTime = getCurrentSeconds();
+	magnitudeLod.rebuild(octree, &magnitudes[0], NULL);
+	report("MagnitudeLod", "rebuild", eWarm, octree.getNodeCount(), getCurrentSeconds() - startTime);
+
+	// The aggregates against sums over each object's ancestors
+	const size_t nodeCount = octree.getNodeCount();
+	std::vector<float> brightest(nodeCount, FLT_MAX);
+	std::vector<double> luminosity(nodeCount, 0.0);
+	std::vector<TVector3d> position(nodeCount);
+	for (size_t i = 0; i < n; i++)
+	{
+		ObjectIndex object = (ObjectIndex)i;
+		uint32_t node = octree.getObjectNode(object);
+		TUniversalVector3 center = octree.getNodeCenter(node);
+		TVector3d offset = octree.getObjectOffset(object);
+		double objectLuminosity = pow(10.0, -0.4 * magnitudes[i]);
+		for (uint32_t ancestor = node; ancestor != kNoOctreeNode; ancestor = octree.getNodeParent(ancestor))
+		{
+			brightest[ancestor] = std::min(brightest[ancestor], magnitudes[i]);
+			luminosity[ancestor] += objectLuminosity;
+			position[ancestor] += objectLuminosity * (offset + center.toVector3d(octree.getNodeCenter(ancestor)));
+		}
+	}
+	size_t wrongAggregates = 0;
+	for (uint32_t node = 0; node < nodeCount; node++)
+	{
+		if (luminosity[node] == 0.0)
+			continue;
+		const float* centroid = magnitudeLod.getNodeCentroid(node);
+		TVector3d centroidError = TVector3d(centroid[0], centroid[1], centroid[2]) - position[node] / luminosity[node];
+		if ((magnitudeLod.getNodeBrightestMagnitude(node) != brightest[node]) ||
+			(fabs(magnitudeLod.getNodeLuminosity(node) - luminosity[node]) > 1.0e-9 * luminosity[node]) ||
+			(centroidError.Length() > 1.0e-6 * octree.getNodeWidth(node)))
+			wrongAggregates++;
+	}
+	check("magnitude lod aggregates against sums over objects", wrongAggregates == 0);
+
+	VisibleNodeSet incremental, full;
+	ViewCuller culler;
+	std::vector<uint32_t> incrementalNodes, fullNodes;
+	std::vector<char> aggregated(nodeCount, 0);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		const MagnitudeLod* lod = pass ? &magnitudeLod : NULL;
+		incremental.setMagnitudeLod(lod);
+		full.setMagnitudeLod(lod);
+		incremental.invalidate();
+
+		TUniversalVector3 viewer;
+		TVector3d gaze(1.0, 0.0, 0.0);
+		TVector3d up(0.0, 0.0, 1.0);
+		TVector3d velocity(0.2, 1.0, 0.1);
+		velocity.Normalize();
+		double incrementalSeconds = 0.0, fullSeconds = 0.0;
+		size_t fullTraversals = 0, incrementalTested = 0, fullTested = 0, visibleCount = 0, aggregatedCount = 0, wrongCount = 0;
+		for (size_t frame = 0; frame < kFrameCount; frame++)
+		{
+			// 2^55 mm a frame, turning a quarter of a degree
+			double turn = 0.25 * 3.14159265358979323846 / 180.0;
+			gaze = gaze * cos(turn) + (up ^ gaze) * sin(turn);
+			gaze.Normalize();
+			velocity = velocity * cos(0.5 * turn) + (up ^ velocity) * sin(0.5 * turn);
+			viewer += TUniversalVector3(velocity * ldexp(1.0, 55));
+			if (frame < kFrameCount / 2)
+				culler.setFisheye(gaze, 3.14159265358979323846);
+			else
+				culler.setPerspective(gaze, up, 60.0 * 3.14159265358979323846 / 180.0, 16.0 / 9.0);
+
+			startTime = getCurrentSeconds();
+			incremental.update(octree, culler, viewer);
+			incrementalSeconds += getCurrentSeconds() - startTime;
+			full.invalidate();
+			startTime = getCurrentSeconds();
+			full.update(octree, culler, viewer);
+			fullSeconds += getCurrentSeconds() - startTime;
+
+			fullTraversals += incremental.getStats().fullTraversal ? 1 : 0;
+			incrementalTested += incremental.getStats().nodesTested;
+			fullTested += full.getStats().nodesTested;
+			visibleCount += full.getVisibleNodes().size();
+			aggregatedCount += full.getAggregatedNodes().size();
+
+			incrementalNodes = incremental.getVisibleNodes();
+			if (!lod)
+			{
+				fullNodes = full.getVisibleNodes();
+				std::sort(incrementalNodes.begin(), incrementalNodes.end());
+				std::sort(fullNodes.begin(), fullNodes.end());
+				if (incrementalNodes != fullNodes)
+					wrongCount++;
+				continue;
+			}
+
+			// The rules VisibleNodeSet applies, decided here in double with a margin for
+			// rounding either way
+			bool frameWrong = false;
+			const std::vector<uint32_t>& incrementalAggregated = incremental.getAggregatedNodes();
+			for (size_t i = 0; i < incrementalAggregated.size(); i++)
+			{
+				uint32_t node = incrementalAggregated[i];
+				TVector3d center = octree.getNodeCenter(node).toVector3d(viewer);
+				double radius = kSqrtThree * octree.getNodeWidth(node);
+				double range = center.Length();
+				double margin = 1.0e-9 * range;
+				if ((culler.getViewDistance(center) > radius + margin) ||
+					(range < radius / lod->getAggregateAngle() - margin) ||
+					(range - radius > lod->getAggregateLimitDistance(node) + margin))
+					frameWrong = true;
+				aggregated[node] = 1;
+			}
+			for (size_t i = 0; i < incrementalNodes.size(); i++)
+			{
+				uint32_t node = incrementalNodes[i];
+				TVector3d center = octree.getNodeCenter(node).toVector3d(viewer);
+				double radius = kSqrtThree * octree.getNodeWidth(node);
+				double range = center.Length();
+				double margin = 1.0e-9 * range;
+				if ((culler.getViewDistance(center) > radius + margin) ||
+					(std::max(range - radius, 0.0) > lod->getLimitDistance(node) + margin))
+					frameWrong = true;
+			}
+			std::sort(incrementalNodes.begin(), incrementalNodes.end());
+
+			// What a full traversal draws: its visible nodes, and every node that would be
+			// visible within its aggregated ones
+			fullNodes = full.getVisibleNodes();
+			const std::vector<uint32_t>& fullAggregated = full.getAggregatedNodes();
+			for (size_t i = 0; i < fullAggregated.size(); i++)
+			{
+				size_t next = fullNodes.size();
+				fullNodes.push_back(fullAggregated[i]);
+				while (next < fullNodes.size())
+				{
+					uint32_t node = fullNodes[next];
+					uint32_t firstChild = octree.getNodeFirstChild(node);
+					if (firstChild != kNoOctreeNode)
+					{
+						for (uint32_t child = firstChild; child < firstChild + 8; child++)
+						{
+							if (octree.getNodeSubtreeObjectCount(child) > 0)
+								fullNodes.push_back(child);
+						}
+					}
+
+					TVector3d center = octree.getNodeCenter(node).toVector3d(viewer);
+					double radius = kSqrtThree * octree.getNodeWidth(node);
+					double range = center.Length();
+					double margin = 1.0e-9 * range;
+					if ((octree.getNodeObjectCount(node) > 0) && (culler.getViewDistance(center) < radius - margin) &&
+						(std::max(range - radius, 0.0) < lod->getLimitDistance(node) - margin))
+						next++;
+					else
+						fullNodes.erase(fullNodes.begin() + next);
+				}
+			}
+			for (size_t i = 0; i < fullNodes.size(); i++)
+			{
+				uint32_t ancestor = fullNodes[i];
+				if (std::binary_search(incrementalNodes.begin(), incrementalNodes.end(), ancestor))
+					continue;
+				while ((ancestor != kNoOctreeNode) && !aggregated[ancestor])
+					ancestor = octree.getNodeParent(ancestor);
+				if (ancestor == kNoOctreeNode)
+					frameWrong = true;
+			}
+
+			for (size_t i = 0; i < incrementalAggregated.size(); i++)
+				aggregated[incrementalAggregated[i]] = 0;
+			if (frameWrong)
+				wrongCount++;
+		}
+
+		const char* name = lod ? "VisibleNodesLod" : "VisibleNodes";
+		report(name, "incremental", eWarm, kFrameCount, incrementalSeconds);
+		report(name, "full traversal", eWarm, kFrameCount, fullSeconds);
+		mOutput << "# " << (lod ? "visible nodes with magnitude lod: " : "visible nodes: ") << fullTraversals << " full traversals in "
+				<< kFrameCount << " frames, nodes tested per frame " << incrementalTested / kFrameCount << " incremental and "
+				<< fullTested / kFrameCount << " full, " << visibleCount / kFrameCount << " visible, "
+				<< aggregatedCount / kFrameCount << " aggregated, " << wrongCount << " frames different" << std::endl;
+		check(lod ? "visible nodes with magnitude lod incremental against full traversal" :
+					"visible nodes incremental against full traversal", wrongCount == 0);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// ArmandBenchmark::runPicking											  [protected]
+//
+//	ObjectPicker over mElementCount points in clusters around the viewer,
+//	half the picks aimed at objects and half at random pixels of a 1920 by
+//	1080 view, against testing every object. Picks are timed reading the
+//	octree and reading UniversalOctreeOffsets. One op is one pick.
+// ---------------------------------------------------------------------------
+void ArmandBenchmark::runPicking()
+{
+	const size_t n = mElementCount;
+	const size_t kClusterCount = 256;
+	const size_t kPickCount = 1000;
+	const size_t kCheckedPickCount = 32;
+	const double kTolerance = 3.0;
+	const int kWidth = 1920, kHeight = 1080;
+	uint64 seed = 0x1B7E5C9A3D2F8064ull;
+
+	// Clusters within 2^72 mm (a few hundred parsecs), each 2^52 to 2^66 mm across
+	std::vector<ttmath::Int<2> > clusters(kClusterCount * 3);
+	for (size_t i = 0; i < clusters.size(); i++)
+		clusters[i] = randomInt128(seed, 72);
+	std::vector<uint64_t> lo[3];
+	std::vector<int64_t> hi[3];
+	std::vector<TVector3d> positions(n);	// From the viewer at the origin
+	for (int axis = 0; axis < 3; axis++)
+	{
+		lo[axis].resize(n);
+		hi[axis].resize(n);
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t cluster = nextRandom(seed) % kClusterCount;
+		unsigned int bits = 52 + (unsigned int)(nextRandom(seed) % 15);
+		double xyz[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			ttmath::Int<2> value = clusters[cluster * 3 + axis] + randomInt128(seed, bits);
+			lo[axis][i] = value.table[0];
+			hi[axis][i] = (int64_t)value.table[1];
+			xyz[axis] = value.ToDouble();
+		}
+		positions[i] = TVector3d(xyz[0], xyz[1], xyz[2]);
+	}
+	UniversalPointArrays points;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		points.lo[axis] = &lo[axis][0];
+		points.hi[axis] = &hi[axis][0];
+	}
+	points.count = n;
+	UniversalOctree octree;
+	octree.build(points, NULL);
+	UniversalOctreeOffsets offsets;
+	offsets.rebuild(octree, 0.001);		// Millimetres to metres, as drawn
+
+	TUniversalVector3 viewer;
+	TVector3d gaze(0.3, -0.2, -1.0);
+	gaze.Normalize();
+	ObjectPicker picker;
+	picker.setPerspective(gaze, TVector3d(0.0, 1.0, 0.0), 60.0 * 3.14159265358979323846 / 180.0, kWidth, kHeight);
+
+	std::vector<double> pickX, pickY;
+	while (pickX.size() < kPickCount)
+	{
+		double x, y;
+		if (pickX.size() & 1)
+		{
+			x = (double)(nextRandom(seed) % kWidth);
+			y = (double)(nextRandom(seed) % kHeight);
+		}
+		else if (!picker.getScreenPosition(positions[nextRandom(seed) % n], x, y) ||
+				 (x < 0.0) || (x >= kWidth) || (y < 0.0) || (y >= kHeight))
+			continue;
+		pickX.push_back(x);
+		pickY.push_back(y);
+	}
+
+	// The nearest object whose centre is in the cone, of two at the same distance the one
+	// nearer the ray
+	size_t wrongCount = 0, hitCount = 0;
+	ViewCuller cone;
+	for (size_t pick = 0; pick < kCheckedPickCount; pick++)
+	{
+		TVector3d ray;
+		picker.getRay(pickX[pick], pickY[pick], ray);
+		cone.setFisheye(ray, 2.0 * picker.getConeAngle(pickX[pick], pickY[pick], kTolerance));
+		ObjectIndex best = kNoObject;
+		double bestDistance = DBL_MAX, bestCos = -1.0;
+		for (size_t i = 0; i < n; i++)
+		{
+			if (cone.getViewDistance(positions[i]) > 0.0)
+				continue;
+			double distance = positions[i].Length();
+			double cosine = (positions[i] * ray) / distance;
+			if ((distance < bestDistance) || ((distance == bestDistance) && (cosine > bestCos)))
+			{
+				best = (ObjectIndex)i;
+				bestDistance = distance;
+				bestCos = cosine;
+			}
+		}
+
+		for (int withOffsets = 0; withOffsets < 2; withOffsets++)
+		{
+			picker.setOffsets(withOffsets ? &offsets : NULL);
+			PickResult result;
+			picker.pick(octree, viewer, pickX[pick], pickY[pick], kTolerance, ePickNearest, result);
+			if (result.object == best)
+				continue;
+
+			// Positions read through the octree or its offsets round differently, so an
+			// object on the edge of the cone may be in for one and out for the other
+			bool edge = (result.object != kNoObject) && (fabs(cone.getViewDistance(positions[result.object])) < 1.0e-6 * result.distance);
+			if (best != kNoObject)
+				edge = edge || (fabs(cone.getViewDistance(positions[best])) < 1.0e-6 * bestDistance);
+			if (!edge)
+				wrongCount++;
+		}
+		hitCount += (best != kNoObject) ? 1 : 0;
+	}
+	check("picks against every object", wrongCount == 0);
+
+	const char* types[2] = { "octree", "offsets" };
+	for (int withOffsets = 0; withOffsets < 2; withOffsets++)
+	{
+		picker.setOffsets(withOffsets ? &offsets : NULL);
+		size_t nodesVisited = 0, objectsTested = 0;
+		double startTime = getCurrentSeconds();
+		for (size_t pick = 0; pick < kPickCount; pick++)
+		{
+			PickResult result;
+			picker.pick(octree, viewer, pickX[pick], pickY[pick], kTolerance, ePickNearest, result);
+			nodesVisited += result.nodesVisited;
+			objectsTested += result.objectsTested;
+			mSink += result.object;
+		}
+		report("Pick", types[withOffsets], eWarm, kPickCount, getCurrentSeconds() - startTime);
+		mOutput << "# picks " << types[withOffsets] << " over " << n << " objects: " << nodesVisited / kPickCount
+				<< " nodes visited and " << objectsTested / kPickCount << " objects tested per pick, " << hitCount
+				<< " of " << kCheckedPickCount << " checked picks hit" << std::endl;
+	}
+}
+
+// Updates inStreamer until nothing it wants is still being read, running the reads'
+// callbacks between frames. Returns false if that takes more than inMaxFrames.
+static bool convergeStreamer(CatalogStreamer& ioStreamer, AsyncFileReader& ioReader, const ViewCuller& inCuller,
+							 const TUniversalVector3& inViewer, double inMagnitudeLimit, size_t inMaxFrames,
+							 std::vector<StreamedNodeDraw>& outDraws)
+{
+	for (size_t frame = 0; frame < inMaxFrames; frame++)
+	{
+		ioStreamer.update(inCuller, inViewer, inMagnitudeLimit, outDraws);
+		CatalogStreamerStats stats;
+		ioStreamer.getStats(stats);
+		if (stats.readingCount == 0)
+			return true;
+
+		ioReader.runCompletions(NULL, NULL);
+		std::this_thread::yield();
+	}
+
+	return false;
+}
+
+// Whether the streamer draws exactly the nodes cullNodes() finds, each with its own points
+// and not its samples
+static bool isStreamerConverged(const PackedCatalog& inCatalog, const ViewCuller& inCuller, const TUniversalVector3& inViewer,
+								double inMagnitudeLimit, const std::vector<StreamedNodeDraw>& inDraws)
+{
+	std::vector<uint32_t> drawn, culled;
+	for (size_t i = 0; i < inDraws.size(); i++)
+	{
+		if (inDraws[i].pointCount != inCatalog.getNode(inDraws[i].node).pointCount)
+			return false;
+		drawn.push_back(inDraws[i].node);
+	}
+	inCatalog.cullNodes(inCuller, inViewer, inMagnitudeLimit, culled);
+	std::sort(drawn.begin(), drawn.end());
+	std::sort(culled.begin(), culled.end());
+
+	return (drawn == culled);
+}
+
+// ---------------------------------------------------------------------------
+// ArmandBenchmark::runStreaming										  [protected]
+//
+//	Writes a packed catalogue and streams it. With room for everything the
+//	streamer must settle on the nodes PackedCatalog::cullNodes() finds, and
+//	on a flight with a quarter of that room it must never go over. With the
+//	point data missing from the file, failed reads must be tried again, less
+//	often each time.
+// ---------------------------------------------------------------------------
+void ArmandBenchmark::runStreaming()
+{
+	const size_t n = std::min(mElementCount, (size_t)200000);
+	const size_t kFrameCount = 600;
+	const size_t kMaxSettleFrames = 100000;
+	const size_t kRetryFrameCount = 300;
+	const double kMagnitudeLimit = 8.0;
+	const char* kPath = "ArmandChecks.armcat";
+	const char* kTruncatedPath = "ArmandChecks-truncated.armcat";
+	uint64 seed = 0x7C3A91E5B2D40F68ull;
+
+	// Within 2^70 mm (some 40 parsecs) of the origin, denser towards it
+	std::vector<uint64_t> lo[3];
+	std::vector<int64_t> hi[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		lo[axis].resize(n);
+		hi[axis].resize(n);
+	}
+	std::vector<float> magnitudes(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		unsigned int bits = 56 + (unsigned int)(nextRandom(seed) % 15);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			ttmath::Int<2> value = randomInt128(seed, bits);
+			lo[axis][i] = value.table[0];
+			hi[axis][i] = (int64_t)value.table[1];
+		}
+		double u = (double)(nextRandom(seed) >> 11) / 9007199254740992.0;
+		magnitudes[i] = (float)(16.0 - 21.0 * u * u);
+	}
+	PackedCatalogSource source;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		source.positions.lo[axis] = &lo[axis][0];
+		source.positions.hi[axis] = &hi[axis][0];
+	}
+	source.positions.count = n;
+	source.absoluteMagnitudes = &magnitudes[0];
+	source.colourIndices = NULL;
+	source.labelOffsets = NULL;
+	source.labels = NULL;
+
+	PackedCatalog catalog;
+	bool written = writePackedCatalog(kPath, source, 32, 1.5e14, NULL) && catalog.open(kPath);
+	check("streamed catalogue written", written);
+	if (!written)
+		return;
+
+	AsyncFileReader reader;
+	reader.start();
+	CatalogStreamer streamer;
+	streamer.open(catalog, kPath, reader);
+	streamer.setMemoryBudget((size_t)-1);
+
+	ViewCuller culler;
+	TUniversalVector3 viewer;
+	TVector3d gaze(1.0, 0.0, 0.0);
+	TVector3d up(0.0, 0.0, 1.0);
+	culler.setPerspective(gaze, up, 60.0 * 3.14159265358979323846 / 180.0, 16.0 / 9.0);
+	std::vector<StreamedNodeDraw> draws;
+	bool settled = convergeStreamer(streamer, reader, culler, viewer, kMagnitudeLimit, kMaxSettleFrames, draws) &&
+				   isStreamerConverged(catalog, culler, viewer, kMagnitudeLimit, draws);
+	CatalogStreamerStats stats;
+	streamer.getStats(stats);
+	size_t settledBytes = stats.usedBytes;
+
+	// Flying through with a quarter of the room, turning a quarter of a degree and moving
+	// 2^62 mm a frame
+	size_t budget = settledBytes / 4;
+	streamer.setMemoryBudget(budget);
+	TVector3d velocity(0.2, 1.0, 0.1);
+	velocity.Normalize();
+	size_t overBudgetCount = 0, drawCount = 0;
+	double startTime = getCurrentSeconds();
+	for (size_t frame = 0; frame < kFrameCount; frame++)
+	{
+		double turn = 0.25 * 3.14159265358979323846 / 180.0;
+		gaze = gaze * cos(turn) + (up ^ gaze) * sin(turn);
+		gaze.Normalize();
+		viewer += TUniversalVector3(velocity * ldexp(1.0, 62));
+		culler.setPerspective(gaze, up, 60.0 * 3.14159265358979323846 / 180.0, 16.0 / 9.0);
+
+		streamer.update(culler, viewer, kMagnitudeLimit, draws);
+		streamer.getStats(stats);
+		if (stats.usedBytes > budget)
+			overBudgetCount++;
+		drawCount += draws.size();
+		reader.runCompletions(NULL, NULL);
+	}
+	report("StreamUpdate", "flight", eWarm, kFrameCount, getCurrentSeconds() - startTime);
+
+	// With room again it settles where the flight ended
+	streamer.setMemoryBudget((size_t)-1);
+	settled = settled && convergeStreamer(streamer, reader, culler, viewer, kMagnitudeLimit, kMaxSettleFrames, draws) &&
+			  isStreamerConverged(catalog, culler, viewer, kMagnitudeLimit, draws);
+	check("streamed nodes converge to cullNodes()", settled);
+	check("streamed nodes within the memory budget", overBudgetCount == 0);
+	streamer.getStats(stats);
+	mOutput << "# streamed " << catalog.getNodeCount() << " nodes: " << settledBytes << " bytes settled, "
+			<< drawCount / kFrameCount << " nodes drawn a frame in the flight, " << stats.loadedCount << " loaded, "
+			<< stats.evictedCount << " evicted" << std::endl;
+	streamer.close();
+
+	// A copy without the point data fails every read; the root is wanted every frame, and
+	// tried again after 8, 16, 32 frames and so on
+	std::vector<char> header((size_t)catalog.getPointDataOffset());
+	FILE* original = fopen(kPath, "rb");
+	FILE* truncated = fopen(kTruncatedPath, "wb");
+	bool copied = (original != NULL) && (truncated != NULL) && (fread(&header[0], 1, header.size(), original) == header.size()) &&
+				  (fwrite(&header[0], 1, header.size(), truncated) == header.size());
+	if (original != NULL)
+		fclose(original);
+	if (truncated != NULL)
+		copied = (fclose(truncated) == 0) && copied;
+
+	size_t failedCount = 0;
+	if (copied && streamer.open(catalog, kTruncatedPath, reader))
+	{
+		viewer = TUniversalVector3();
+		culler.setFisheye(gaze, 3.14159265358979323846);
+		for (size_t frame = 0; frame < kRetryFrameCount; frame++)
+		{
+			streamer.update(culler, viewer, kMagnitudeLimit, draws);
+			reader.runCompletions(NULL, NULL);
+		}
+		streamer.getStats(stats);
+		failedCount = stats.failedCount;
+		streamer.close();
+	}
+	check("failed streamed reads are retried with back-off", copied && (failedCount >= 4) && (failedCount <= 8));
+
+	reader.stop();
+	catalog.close();
+	remove(kPath);
+	remove(kTruncatedPath);
+}
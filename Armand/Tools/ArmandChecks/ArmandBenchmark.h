@@ -0,0 +1,73 @@
+//----------------------------------------------------------------------
+//	File:		ArmandBenchmark.h
+//
+//	Contains:	Checks and timings of Armand's engine code: viewer relative
+//				point batches, space keys, the job system, transforms,
+//				octree queries, view culling, the visible node set,
+//				magnitude LOD, picking and catalogue streaming.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include "ttmath/ttmath.h"
+
+//----------------------------------------------------------------------
+//	Class:		ArmandBenchmark
+//
+//	Purpose:	Runs each piece of the engine that has a fast path against
+//				the simple path it replaces, checking they agree before
+//				either is timed. Results are written as CSV in the same
+//				layout as BigInts' benchmark, one line per benchmark, type
+//				and cache state. Lines starting with '#' describe the run
+//				and the result of every check, and run() returns false if
+//				any check failed.
+//
+//				cold - a single pass over mElementCount elements after the
+//				       caches have been flushed.
+//				warm - many passes over kWarmElementCount elements that fit
+//				       in L1/L2.
+//
+//----------------------------------------------------------------------
+class ArmandBenchmark
+{
+	public:
+		enum CacheState { eCold, eWarm };
+
+		ArmandBenchmark(std::ostream& inOutput, size_t inElementCount);
+
+		// Returns false if any check failed
+		bool			run();
+
+		// Number of elements used by the warm cache runs
+		static const size_t	kWarmElementCount = 4096;
+
+	protected:
+		void			runViewerRelative();
+		void			runSpaceKeys();
+		void			runJobs();
+		void			runTransforms();
+		void			runOctreeQueries();
+		void			runViewCulling();
+		void			runVisibleNodes();
+		void			runPicking();
+		void			runStreaming();
+
+		void			check(const char* inName, bool inPassed);
+
+		template<class Kernel>
+		void			measure(const char* inBenchmark, const char* inType, size_t inElementCount, Kernel inKernel);
+		void			report(const char* inBenchmark, const char* inType, CacheState inCache, size_t inOps, double inSeconds);
+		void			evictCaches();
+		double			getCurrentSeconds() const;
+
+		std::ostream&		mOutput;
+		size_t				mElementCount;
+		size_t				mFailedCount;
+		std::vector<char>	mEvictionBuffer;
+		unsigned long long	mSink;			// Results are folded in here so nothing is optimized away
+};
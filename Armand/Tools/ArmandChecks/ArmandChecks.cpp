@@ -0,0 +1,35 @@
+//----------------------------------------------------------------------
+//	File:		ArmandChecks.cpp
+//
+//	Contains:	Entry point of ArmandChecks, which checks Armand's engine
+//				code against simple reference versions of it and times both.
+//				The BigInts project covers ttmath itself.
+//
+//				Build with Builds\VisualStudio\ArmandChecks\ArmandChecks.vcxproj
+//				and run:
+//					ArmandChecks [-n elements] > results.csv
+//
+//				The exit code is 1 if any check failed. The streaming checks
+//				write a catalogue to the current directory and delete it
+//				again.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include "ArmandBenchmark.h"
+
+int main(int argc, char* argv[])
+{
+	size_t elementCount = 4 * 1024 * 1024;
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc))
+			elementCount = (size_t)atoi(argv[++i]);
+	}
+
+	ArmandBenchmark benchmark(std::cout, elementCount);
+	return benchmark.run() ? 0 : 1;
+}
@@ -0,0 +1,26 @@
+//----------------------------------------------------------------------
+//	File:		stdafx.h
+//
+//	Contains:	What the Armand sources ArmandChecks builds expect to have
+//				been included, without GL.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#pragma once
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+using namespace std;
+
+#include "VectorTemplates.h"
+#include "UniversalVector.h"
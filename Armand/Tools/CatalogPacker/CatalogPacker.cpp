@@ -0,0 +1,218 @@
+//----------------------------------------------------------------------
+//	File:		CatalogPacker.cpp
+//
+//	Contains:	Offline converter from Digital Universe .speck catalogues to
+//				the packed binary format in PackedCatalog.h, which Armand
+//				maps at startup instead of parsing text.
+//
+//				Build with Builds\VisualStudio\CatalogPacker\CatalogPacker.vcxproj
+//				and run:
+//					CatalogPacker [-unit pc|kpc|mpc|ly] [-magnitude datavar] [-colour datavar]
+//						[-node points] [-tolerance au] in.speck out.armcat
+//
+//				Positions are read in parsecs unless -unit says otherwise.
+//				The absolute magnitude and colour index come from the
+//				datavars named absmag and colorb_v unless -magnitude and
+//				-colour name others; either may be missing. Labels are the
+//				text after each row's #. Positions are kept to within
+//				-tolerance AU (1 by default), and magnitudes and colour
+//				indices to within 0.005. Octree leaves are split until 21-bit
+//				offsets keep the tolerance; if any node still doesn't, it is
+//				reported and the exit code is 1. The written file is opened
+//				again and every point checked against the catalogue, to the
+//				same tolerance, before the exit code is 0.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <limits>
+
+#include "SpeckCatalog.h"
+#include "PackedCatalogWriter.h"
+#include "JobSystem.h"
+#include "UniversalCoord.h"
+
+static double secondsSince(const std::chrono::steady_clock::time_point& inStart)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - inStart).count();
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: CatalogPacker [-unit pc|kpc|mpc|ly] [-magnitude datavar] [-colour datavar] [-node points] [-tolerance au] in.speck out.armcat\n");
+}
+
+// Whether a decoded value is within half a step of the catalogue's
+static bool isValueClose(float inValue, float inDecoded)
+{
+	if (inValue != inValue)
+		return (inDecoded != inDecoded);
+
+	return fabs(inDecoded - inValue) <= kPackedValueStep * 0.5 + fabs(inValue) * 1e-6;
+}
+
+// Every point must be where the catalogue has it, to within inTolerance (mm), with its own data
+static bool verifyPacked(const PackedCatalog& inPacked, const SpeckCatalog& inCatalog, int inMagnitude, int inColour,
+						 double inTolerance)
+{
+	UniversalPointArrays positions;
+	inCatalog.getPositions(positions);
+
+	size_t failures = 0;
+	std::vector<float> offsets, magnitudes, colourIndices;
+	for (uint32_t node = 0; node < inPacked.getNodeCount(); node++)
+	{
+		const PackedCatalogNode& entry = inPacked.getNode(node);
+		TUniversalVector3 origin = inPacked.getNodeOrigin(node);
+		size_t count = (size_t)entry.pointCount + entry.sampleCount;
+		offsets.resize(count * 3 + 1);
+		magnitudes.resize(count + 1);
+		colourIndices.resize(count + 1);
+		if (!inPacked.decodeNode(node, 1.0, &offsets[0], &magnitudes[0], &colourIndices[0]))
+		{
+			fprintf(stderr, "node %u can't be decoded\n", node);
+			return false;
+		}
+
+		for (uint32_t point = entry.firstPoint; point < entry.firstPoint + entry.pointCount; point++)
+		{
+			uint32_t row = inPacked.getSourceRows()[point];
+			uint32_t index = point - entry.firstPoint;
+			UniversalCoord axes[3];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				axes[axis].table[0] = (ttmath::uint)positions.lo[axis][row];
+				axes[axis].table[1] = (ttmath::uint)positions.hi[axis][row];
+			}
+			TVector3d exact = TUniversalVector3(axes[0], axes[1], axes[2]).toVector3d(origin);
+			const float* offset = &offsets[index * 3];
+
+			bool good = (fabs(offset[0] - exact.x) <= inTolerance) && (fabs(offset[1] - exact.y) <= inTolerance) &&
+						(fabs(offset[2] - exact.z) <= inTolerance);
+			float magnitude = (inMagnitude >= 0) ? inCatalog.getColumn(inMagnitude)[row] : std::numeric_limits<float>::quiet_NaN();
+			float colour = (inColour >= 0) ? inCatalog.getColumn(inColour)[row] : std::numeric_limits<float>::quiet_NaN();
+			good &= isValueClose(magnitude, magnitudes[index]) && isValueClose(colour, colourIndices[index]);
+			const char* label = inCatalog.getLabel(row);
+			const char* packedLabel = inPacked.getLabel(point);
+			good &= (label == NULL) ? (packedLabel == NULL) : ((packedLabel != NULL) && (strcmp(label, packedLabel) == 0));
+
+			if (!good && (failures++ < 10))
+				fprintf(stderr, "point %u (row %u) doesn't match\n", point, row);
+		}
+	}
+
+	return failures == 0;
+}
+
+int main(int argc, char* argv[])
+{
+	UniversalLiteral unit = kUniversalParsec;
+	const char* magnitudeName = "absmag";
+	const char* colourName = "colorb_v";
+	uint32_t pointsPerNode = 32;
+	double tolerance = 1.0;
+	const char* inPath = NULL;
+	const char* outPath = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-unit") == 0) && (i + 1 < argc))
+		{
+			const char* name = argv[++i];
+			if (strcmp(name, "pc") == 0)
+				unit = kUniversalParsec;
+			else if (strcmp(name, "kpc") == 0)
+				unit = kUniversalKiloparsec;
+			else if (strcmp(name, "mpc") == 0)
+				unit = kUniversalMegaparsec;
+			else if (strcmp(name, "ly") == 0)
+				unit = kUniversalLightYear;
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+		else if ((strcmp(argv[i], "-magnitude") == 0) && (i + 1 < argc))
+			magnitudeName = argv[++i];
+		else if ((strcmp(argv[i], "-colour") == 0) && (i + 1 < argc))
+			colourName = argv[++i];
+		else if ((strcmp(argv[i], "-node") == 0) && (i + 1 < argc))
+			pointsPerNode = (uint32_t)atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-tolerance") == 0) && (i + 1 < argc))
+			tolerance = atof(argv[++i]);
+		else if (inPath == NULL)
+			inPath = argv[i];
+		else if (outPath == NULL)
+			outPath = argv[i];
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+	if ((outPath == NULL) || (pointsPerNode == 0))
+	{
+		usage();
+		return 1;
+	}
+
+	JobSystem jobs;
+	SpeckCatalog catalog;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!catalog.load(inPath, unit, &jobs))
+	{
+		fprintf(stderr, "can't read %s\n", inPath);
+		return 1;
+	}
+	printf("read %llu rows (%llu bad) in %.2f s\n", (unsigned long long)catalog.getCount(),
+		   (unsigned long long)catalog.getBadRowCount(), secondsSince(start));
+
+	int magnitude = catalog.findVariable(magnitudeName);
+	int colour = catalog.findVariable(colourName);
+	PackedCatalogSource source;
+	catalog.getPositions(source.positions);
+	source.absoluteMagnitudes = (magnitude >= 0) ? catalog.getColumn(magnitude) : NULL;
+	source.colourIndices = (colour >= 0) ? catalog.getColumn(colour) : NULL;
+	source.labelOffsets = catalog.getLabelOffsets();
+	source.labels = catalog.getLabels();
+
+	PackedCatalogWriteStats stats;
+	double auToMm = universalCoordToDouble(universalCoordFromLiteral(kUniversalAU));
+	start = std::chrono::steady_clock::now();
+	if (!writePackedCatalog(outPath, source, pointsPerNode, tolerance * auToMm, &stats))
+	{
+		fprintf(stderr, "can't write %s\n", outPath);
+		return 1;
+	}
+	printf("wrote %llu points (%llu outside the octree, %llu samples) in %llu nodes (%llu with 21-bit offsets), %llu bytes (%llu of points), in %.2f s; offsets within %g AU\n",
+		   (unsigned long long)stats.pointCount, (unsigned long long)stats.droppedCount, (unsigned long long)stats.sampleCount,
+		   (unsigned long long)stats.nodeCount, (unsigned long long)stats.wideNodeCount,
+		   (unsigned long long)stats.fileSize, (unsigned long long)stats.pointDataSize,
+		   secondsSince(start), stats.maxOffsetError / auToMm);
+	if (stats.overToleranceNodeCount > 0)
+	{
+		fprintf(stderr, "%llu nodes have %llu points beyond %g AU even with 21-bit offsets; use a larger -tolerance\n",
+				(unsigned long long)stats.overToleranceNodeCount, (unsigned long long)stats.overTolerancePointCount, tolerance);
+		return 1;
+	}
+
+	PackedCatalog packed;
+	start = std::chrono::steady_clock::now();
+	if (!packed.open(outPath))
+	{
+		fprintf(stderr, "can't open %s again\n", outPath);
+		return 1;
+	}
+	printf("opened in %.6f s\n", secondsSince(start));
+
+	if (!verifyPacked(packed, catalog, magnitude, colour, tolerance * auToMm))
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,401 @@
+//----------------------------------------------------------------------
+//	File:		UniversalSplitPrecision.cpp
+//
+//	Contains:	Precision harness for the split position encoding in
+//				UniversalSplit.h. The shader function is run through transform
+//				feedback on a headless GL context (Mesa llvmpipe through EGL) and
+//				compared with the CPU reference and with exact ttmath subtraction,
+//				for viewers anywhere within the radius of the observable Universe
+//				and offsets from 1 mm up to that radius.
+//
+//				Build and run on Linux with Mesa:
+//					g++ -O2 -I../../../BigInts -I../../Source/Math UniversalSplitPrecision.cpp -lEGL -lGL -o UniversalSplitPrecision
+//					./UniversalSplitPrecision [-n samples_per_distance] [-cpu]
+//
+//				-cpu skips the GPU and only checks the CPU reference. Results are
+//				written as CSV, one line per offset size. The exit code is 1 if an
+//				error bound is exceeded and 2 if no GL context could be created.
+//
+//	Authors:	Clint Weisbrod
+//
+//----------------------------------------------------------------------
+
+#define GL_GLEXT_PROTOTYPES
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "UniversalSplit.h"
+
+// The observable Universe has a radius of ~4.7e29 mm, just below 2^99
+const int kUniverseRadiusBits = 99;
+const int kViewersPerDistance = 16;
+
+// Offsets that fit in a float's mantissa must come out exact. Larger ones may be a few
+// float ulps out: every step of the shader's sum rounds once.
+const int kExactOffsetBits = 24;
+const double kMaxErrorUlps = 2.0;
+
+static unsigned long long nextRandom(unsigned long long& ioState)
+{
+	ioState ^= ioState << 13;
+	ioState ^= ioState >> 7;
+	ioState ^= ioState << 17;
+	return ioState;
+}
+
+// A signed value with a magnitude below 2^inBits
+static UniversalCoord randomCoord(unsigned long long& ioState, int inBits)
+{
+	UniversalCoord result;
+	result.table[0] = nextRandom(ioState);
+	result.table[1] = nextRandom(ioState);
+	result.Rcr(128 - inBits);
+	if (nextRandom(ioState) & 1)
+		result.ChangeSign();
+
+	return result;
+}
+
+// The spacing of floats around inValue
+static double floatUlp(double inValue)
+{
+	int exponent;
+	frexp(fabs(inValue), &exponent);
+	return ldexp(1.0, exponent - 24);
+}
+
+//----------------------------------------------------------------------
+//	Class:		SplitShaderRunner
+//
+//	Purpose:	Evaluates universalRelativeToViewer() from kUniversalSplitGLSL
+//				on the GPU and reads the offsets back with transform feedback.
+//
+//----------------------------------------------------------------------
+class SplitShaderRunner
+{
+	public:
+		SplitShaderRunner();
+		~SplitShaderRunner();
+
+		bool	init();
+		void	run(const vector<UniversalSplitVertex>& inVertices, const UniversalSplitVertex& inViewer,
+					vector<float>& outOffsets);
+
+	protected:
+		GLuint	compileShader(GLenum inType, const string& inSource);
+
+		EGLDisplay	mDisplay;
+		EGLContext	mContext;
+		GLuint		mProgram;
+		GLuint		mVertexArray;
+		GLuint		mVertexBuffer;
+		GLuint		mFeedbackBuffer;
+		GLuint		mFramebuffer;
+		GLuint		mRenderbuffer;
+		GLint		mViewerChunksLocation;
+};
+
+SplitShaderRunner::SplitShaderRunner() : mDisplay(EGL_NO_DISPLAY),
+										 mContext(EGL_NO_CONTEXT),
+										 mProgram(0),
+										 mVertexArray(0),
+										 mVertexBuffer(0),
+										 mFeedbackBuffer(0),
+										 mFramebuffer(0),
+										 mRenderbuffer(0),
+										 mViewerChunksLocation(-1)
+{
+}
+
+SplitShaderRunner::~SplitShaderRunner()
+{
+	if (mContext != EGL_NO_CONTEXT)
+	{
+		glDeleteFramebuffers(1, &mFramebuffer);
+		glDeleteRenderbuffers(1, &mRenderbuffer);
+		glDeleteBuffers(1, &mFeedbackBuffer);
+		glDeleteBuffers(1, &mVertexBuffer);
+		glDeleteVertexArrays(1, &mVertexArray);
+		glDeleteProgram(mProgram);
+		eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(mDisplay, mContext);
+	}
+	if (mDisplay != EGL_NO_DISPLAY)
+		eglTerminate(mDisplay);
+}
+
+bool SplitShaderRunner::init()
+{
+	// No window system: prefer Mesa's surfaceless platform
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay != NULL)
+		mDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (mDisplay == EGL_NO_DISPLAY)
+		mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if ((mDisplay == EGL_NO_DISPLAY) || !eglInitialize(mDisplay, NULL, NULL))
+	{
+		fprintf(stderr, "No EGL display\n");
+		return false;
+	}
+
+	const EGLint kConfigAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint configCount = 0;
+	if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(mDisplay, kConfigAttributes, &config, 1, &configCount) || (configCount == 0))
+	{
+		fprintf(stderr, "No EGL config for desktop OpenGL\n");
+		return false;
+	}
+
+	const EGLint kContextAttributes[] = { EGL_CONTEXT_MAJOR_VERSION, 4,
+										  EGL_CONTEXT_MINOR_VERSION, 0,
+										  EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+										  EGL_NONE };
+	mContext = eglCreateContext(mDisplay, config, EGL_NO_CONTEXT, kContextAttributes);
+	if ((mContext == EGL_NO_CONTEXT) || !eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, mContext))
+	{
+		fprintf(stderr, "Could not create a surfaceless OpenGL 4.0 context\n");
+		return false;
+	}
+	fprintf(stderr, "GL renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+
+	string source = "#version 400 core\n";
+	source += kUniversalSplitGLSL;
+	source += "in vec3 aUniversalChunk0;\n"
+			  "in vec3 aUniversalChunk1;\n"
+			  "in vec3 aUniversalChunk2;\n"
+			  "in vec3 aUniversalChunk3;\n"
+			  "in vec3 aUniversalChunk4;\n"
+			  "out vec3 vOffset;\n"
+			  "void main()\n"
+			  "{\n"
+			  "	vOffset = universalRelativeToViewer(aUniversalChunk0, aUniversalChunk1, aUniversalChunk2, aUniversalChunk3, aUniversalChunk4);\n"
+			  "	gl_Position = vec4(0.0, 0.0, 0.0, 1.0);\n"
+			  "}\n";
+	GLuint shader = compileShader(GL_VERTEX_SHADER, source);
+	if (shader == 0)
+		return false;
+
+	mProgram = glCreateProgram();
+	glAttachShader(mProgram, shader);
+	for (int i = 0; i < kUniversalSplitChunkCount; i++)
+	{
+		char name[32];
+		sprintf(name, "aUniversalChunk%d", i);
+		glBindAttribLocation(mProgram, i, name);
+	}
+	const GLchar* varyings[] = { "vOffset" };
+	glTransformFeedbackVaryings(mProgram, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+	glLinkProgram(mProgram);
+	glDeleteShader(shader);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(mProgram, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		char log[4096];
+		glGetProgramInfoLog(mProgram, sizeof(log), NULL, log);
+		fprintf(stderr, "Link failed:\n%s\n", log);
+		return false;
+	}
+	mViewerChunksLocation = glGetUniformLocation(mProgram, "uViewerChunks");
+
+	glGenVertexArrays(1, &mVertexArray);
+	glBindVertexArray(mVertexArray);
+	glGenBuffers(1, &mVertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+	for (int i = 0; i < kUniversalSplitChunkCount; i++)
+	{
+		glEnableVertexAttribArray(i);
+		glVertexAttribPointer(i, 3, GL_FLOAT, GL_FALSE, sizeof(UniversalSplitVertex),
+							  (const void*)(i * 3 * sizeof(float)));
+	}
+	glGenBuffers(1, &mFeedbackBuffer);
+
+	// Nothing is rasterized, but a surfaceless context has no default framebuffer and
+	// drawing needs a complete one
+	glGenRenderbuffers(1, &mRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 1, 1);
+	glGenFramebuffers(1, &mFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mRenderbuffer);
+
+	return (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) && (glGetError() == GL_NO_ERROR);
+}
+
+GLuint SplitShaderRunner::compileShader(GLenum inType, const string& inSource)
+{
+	GLuint shader = glCreateShader(inType);
+	const GLchar* source = inSource.c_str();
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	GLint compiled = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (!compiled)
+	{
+		char log[4096];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		fprintf(stderr, "Compile failed:\n%s\n", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+void SplitShaderRunner::run(const vector<UniversalSplitVertex>& inVertices, const UniversalSplitVertex& inViewer,
+							vector<float>& outOffsets)
+{
+	GLsizei count = (GLsizei)inVertices.size();
+	size_t feedbackSize = inVertices.size() * 3 * sizeof(float);
+
+	glUseProgram(mProgram);
+	glUniform3fv(mViewerChunksLocation, kUniversalSplitChunkCount, &inViewer.chunk[0][0]);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, inVertices.size() * sizeof(UniversalSplitVertex), &inVertices[0], GL_STREAM_DRAW);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, mFeedbackBuffer);
+	glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, feedbackSize, NULL, GL_STREAM_READ);
+
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, count);
+	glEndTransformFeedback();
+	glDisable(GL_RASTERIZER_DISCARD);
+
+	outOffsets.resize(inVertices.size() * 3);
+	glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedbackSize, &outOffsets[0]);
+}
+
+//----------------------------------------------------------------------
+//	Struct:		ErrorStats
+//
+//	Purpose:	Errors of one method against exact subtraction.
+//
+//----------------------------------------------------------------------
+struct ErrorStats
+{
+	ErrorStats() : maxErrorMillimetres(0.0), maxErrorUlps(0.0), exactCount(0) {}
+
+	void add(float inValue, const UniversalCoord& inExact)
+	{
+		double exact = inExact.ToDouble();
+		double error = fabs((double)inValue - exact);
+		if (error == 0.0)
+			exactCount++;
+		if (error > maxErrorMillimetres)
+			maxErrorMillimetres = error;
+		if (exact != 0.0 && error / floatUlp(exact) > maxErrorUlps)
+			maxErrorUlps = error / floatUlp(exact);
+	}
+
+	double	maxErrorMillimetres;
+	double	maxErrorUlps;
+	size_t	exactCount;
+};
+
+int main(int argc, char* argv[])
+{
+	size_t samplesPerDistance = 4096;
+	bool useGPU = true;
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc))
+			samplesPerDistance = (size_t)atol(argv[++i]);
+		else if (strcmp(argv[i], "-cpu") == 0)
+			useGPU = false;
+	}
+	size_t pointsPerViewer = (samplesPerDistance + kViewersPerDistance - 1) / kViewersPerDistance;
+
+	SplitShaderRunner gpu;
+	if (useGPU && !gpu.init())
+		return 2;
+
+	printf("offset_bits,values,cpu_max_error_mm,cpu_max_error_ulps,cpu_exact,gpu_max_error_mm,gpu_max_error_ulps,gpu_exact,gpu_cpu_mismatches\n");
+
+	unsigned long long seed = 0x9E3779B97F4A7C15ull;
+	bool passed = true;
+	for (int offsetBits = 1; offsetBits <= kUniverseRadiusBits; offsetBits++)
+	{
+		ErrorStats cpuStats, gpuStats;
+		size_t values = 0, mismatches = 0;
+
+		for (int viewerIndex = 0; viewerIndex < kViewersPerDistance; viewerIndex++)
+		{
+			// Anywhere in the Universe, keeping viewer + offset inside it too
+			int viewerBits = (int)(nextRandom(seed) % kUniverseRadiusBits);
+			UniversalCoord viewer[3], offsets[3];
+			for (int axis = 0; axis < 3; axis++)
+				viewer[axis] = randomCoord(seed, viewerBits);
+
+			UniversalSplitVertex splitViewer;
+			splitUniversalCoords(viewer[0], viewer[1], viewer[2], splitViewer);
+
+			vector<UniversalSplitVertex> vertices(pointsPerViewer);
+			vector<UniversalCoord> exact(pointsPerViewer * 3);
+			vector<float> cpuOffsets(pointsPerViewer * 3), gpuOffsets;
+			for (size_t i = 0; i < pointsPerViewer; i++)
+			{
+				UniversalCoord point[3];
+				for (int axis = 0; axis < 3; axis++)
+				{
+					exact[i * 3 + axis] = randomCoord(seed, offsetBits);
+					point[axis] = viewer[axis];
+					point[axis].Add(exact[i * 3 + axis]);
+				}
+				splitUniversalCoords(point[0], point[1], point[2], vertices[i]);
+				universalSplitRelativeToViewer(vertices[i], splitViewer, &cpuOffsets[i * 3]);
+			}
+			if (useGPU)
+				gpu.run(vertices, splitViewer, gpuOffsets);
+
+			for (size_t i = 0; i < pointsPerViewer * 3; i++)
+			{
+				cpuStats.add(cpuOffsets[i], exact[i]);
+				if (useGPU)
+				{
+					gpuStats.add(gpuOffsets[i], exact[i]);
+					if (memcmp(&gpuOffsets[i], &cpuOffsets[i], sizeof(float)) != 0)
+						mismatches++;
+				}
+			}
+			values += pointsPerViewer * 3;
+		}
+
+		printf("%d,%lu,%g,%g,%lu", offsetBits, (unsigned long)values,
+			   cpuStats.maxErrorMillimetres, cpuStats.maxErrorUlps, (unsigned long)cpuStats.exactCount);
+		if (useGPU)
+			printf(",%g,%g,%lu,%lu\n", gpuStats.maxErrorMillimetres, gpuStats.maxErrorUlps,
+				   (unsigned long)gpuStats.exactCount, (unsigned long)mismatches);
+		else
+			printf(",,,,\n");
+
+		const ErrorStats* stats[2] = { &cpuStats, useGPU ? &gpuStats : NULL };
+		for (int i = 0; i < 2; i++)
+		{
+			if (stats[i] == NULL)
+				continue;
+			if ((offsetBits <= kExactOffsetBits) && (stats[i]->exactCount != values))
+				passed = false;
+			if (stats[i]->maxErrorUlps > kMaxErrorUlps)
+				passed = false;
+		}
+	}
+
+	fprintf(stderr, passed ? "Passed\n" : "FAILED: error bounds exceeded\n");
+
+	return passed ? 0 : 1;
+}
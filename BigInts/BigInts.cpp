@@ -4,6 +4,7 @@
 #include "stdafx.h"
 #include <iostream>
 #include "ttmath/ttmath.h"
+#include "BigIntsBenchmark.h"
 
 /*
 See: http://www.ttmath.org/
@@ -33,24 +34,31 @@ yeilding the .obj file.
 
 See: http://www.ttmath.org/forum/how_to_compile_with_visual_studio_2010_64-bit for an
 explanation for why this is necessary. Essentially, without it we get link errors.
+
+Defining TTMATH_INTRINSICS (see ttmath/ttmathtypes.h) replaces the asm with compiler
+intrinsics, in which case the .obj file is not used.
 */
 
 int _tmain(int argc, _TCHAR* argv[])
 {
+	// Usage: BigInts [-n elements] > results.csv
+	size_t elementCount = 4 * 1024 * 1024;
+	for (int i = 1; i < argc; i++)
+	{
+		if ((_tcscmp(argv[i], _T("-n")) == 0) && (i + 1 < argc))
+			elementCount = (size_t)_tstoi(argv[++i]);
+	}
+
+	// Sanity check: the largest value possible with signed 128-bit integer.
 	ttmath::Int<2> a, b;	// On x64 we need 2 values to represent 128 bits.
-	ttmath::uint result;
-
-	// Compute the largest value possible with signed 128-bit integer.
 	a = 2;
 	b = 127;
-	result = a.Pow(b);	// result should be zero, meaning "no carry"
+	a.Pow(b);	// returns zero, meaning "no carry"
+	a--;		// We decrement because the maximum value is 2^127 - 1
+	std::cerr << "Int<2> max: " << a.ToString() << std::endl;
 
-	// We decrement because the maximum value is 2^127 - 1
-	a--;
-
-	// Spit out the value to the console
-	std::cout << a.ToString() << std::endl;
+	BigIntsBenchmark benchmark(std::cout, elementCount);
+	benchmark.run();
 
 	return 0;
 }
-
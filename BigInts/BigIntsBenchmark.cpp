@@ -0,0 +1,1040 @@
+// BigIntsBenchmark.cpp : Load testing of ttmath 128-bit integers against native types.
+//
+
+#include "stdafx.h"
+#include "BigIntsBenchmark.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#endif
+
+typedef long long			int64;
+typedef unsigned long long	uint64;
+
+// Deterministic xorshift generator so every run works on the same values
+static inline uint64 nextRandom(uint64& ioState)
+{
+	ioState ^= ioState << 13;
+	ioState ^= ioState >> 7;
+	ioState ^= ioState << 17;
+	return ioState;
+}
+
+// A signed value of roughly inBits bits. Universe coordinates need ~100 bits.
+static ttmath::Int<2> randomInt128(uint64& ioState, unsigned int inBits)
+{
+	ttmath::Int<2> result;
+	result.table[0] = nextRandom(ioState);
+	result.table[1] = nextRandom(ioState);
+	result.Rcr(128 - inBits);
+	if (nextRandom(ioState) & 1)
+		result.ChangeSign();
+
+	return result;
+}
+
+static int64 randomInt64(uint64& ioState, unsigned int inBits)
+{
+	int64 result = (int64)(nextRandom(ioState) >> (64 - inBits));
+	return (nextRandom(ioState) & 1) ? -result : result;
+}
+
+static bool isSigned(const ttmath::UInt<2>&)
+{
+	return false;
+}
+
+static bool isSigned(const ttmath::Int<2>&)
+{
+	return true;
+}
+
+#ifdef TTMATH_INT128
+static ttmath::sint128 toNative(const ttmath::Int<2>& inValue)
+{
+	return ttmath::SInt128FromTable(inValue.table);
+}
+#endif
+
+// Defined here too, as std::min() and std::max() take it by reference
+const size_t BigIntsBenchmark::kWarmElementCount;
+
+BigIntsBenchmark::BigIntsBenchmark(std::ostream& inOutput, size_t inElementCount) : mOutput(inOutput),
+																					  mElementCount(inElementCount),
+																					  mSink(0)
+{
+	if (mElementCount < kWarmElementCount)
+		mElementCount = kWarmElementCount;
+
+	// Bigger than any last level cache we are likely to run on
+	const size_t kEvictionBufferSize = 64 * 1024 * 1024;
+	mEvictionBuffer.resize(kEvictionBufferSize, 1);
+}
+
+void BigIntsBenchmark::run()
+{
+	mOutput << "# ttmath " << TTMATH_MAJOR_VER << "." << TTMATH_MINOR_VER << "." << TTMATH_REVISION_VER
+			<< " " << ttmath::UInt<2>::LibTypeStr();
+#ifdef TTMATH_INT128
+	mOutput << " int128";
+#endif
+	mOutput << std::endl;
+	mOutput << "# elements " << mElementCount << ", warm elements " << kWarmElementCount << std::endl;
+	if (!checkConversions())
+		std::cerr << "Conversion checks failed, see the # check lines" << std::endl;
+	mOutput << "benchmark,type,cache,ops,seconds,ns_per_op,mops_per_second" << std::endl;
+
+	runAddSub();
+	runMulInt();
+	runMul();
+	runDiv();
+	runDivInvariant();
+	runWide();
+	runToDouble();
+	runStrings();
+
+	// Keep the compiler from discarding the results
+	if (mSink == 42)
+		std::cerr << "";
+}
+
+// ---------------------------------------------------------------------------
+// BigIntsBenchmark::measure										  [protected]
+//
+//	Runs inKernel(begin, end) once over inElementCount elements with cold caches,
+//	then repeatedly over a cache resident block for the same number of operations.
+//	The kernel returns a checksum which is folded into mSink.
+// ---------------------------------------------------------------------------
+template<class Kernel>
+void BigIntsBenchmark::measure(const char* inBenchmark, const char* inType, size_t inElementCount, Kernel inKernel)
+{
+	evictCaches();
+	double startTime = getCurrentSeconds();
+	mSink += inKernel(0, inElementCount);
+	report(inBenchmark, inType, eCold, inElementCount, getCurrentSeconds() - startTime);
+
+	size_t warmCount = std::min(kWarmElementCount, inElementCount);
+	size_t passes = inElementCount / warmCount;
+	mSink += inKernel(0, warmCount);	// Bring the block into cache
+	startTime = getCurrentSeconds();
+	for (size_t pass = 0; pass < passes; pass++)
+		mSink += inKernel(0, warmCount);
+	report(inBenchmark, inType, eWarm, passes * warmCount, getCurrentSeconds() - startTime);
+}
+
+// ---------------------------------------------------------------------------
+// BigIntsBenchmark::checkConversions								  [protected]
+//
+//	Compares ToDouble() and FromDouble() of UInt<2> and Int<2> with results worked
+//	out through ttmath::Big. Every bit length is covered with the values that are
+//	hard to round (powers of two, all ones, exact ties and their neighbours), followed
+//	by mElementCount random values.
+// ---------------------------------------------------------------------------
+bool BigIntsBenchmark::checkConversions()
+{
+	uint64 seed = 0x8CB92BA72F3D8DD7ull;
+	size_t toDoubleValues = 0, toDoubleErrors = 0;
+	size_t fromDoubleValues = 0, fromDoubleErrors = 0;
+
+	for (unsigned int bits = 1; bits <= 128; bits++)
+	{
+		ttmath::UInt<2> top, half, low;
+		top.SetZero();
+		top.SetBit(bits - 1);
+		half.SetZero();
+		low.SetZero();
+		if (bits > 54)
+		{
+			half.SetBit(bits - 55);	// Half of the lowest mantissa bit a double keeps
+			low = half;
+			low.Rcl(1);
+			low.SubOne();			// The bits a double can't keep
+		}
+
+		for (int random = 0; random < 16; random++)
+		{
+			ttmath::UInt<2> mantissa(top);
+			if (random == 1)
+			{
+				mantissa.SetMax();
+				mantissa.Rcr(128 - bits);
+			}
+			else if (random > 1)
+			{
+				mantissa.table[0] = nextRandom(seed) & ~low.table[0];
+				mantissa.table[1] = nextRandom(seed) & ~low.table[1];
+				mantissa.Rcr(128 - bits);
+				mantissa.table[0] = (mantissa.table[0] & ~low.table[0]) | top.table[0];
+				mantissa.table[1] = (mantissa.table[1] & ~low.table[1]) | top.table[1];
+			}
+
+			std::vector<ttmath::UInt<2> > patterns;
+			ttmath::UInt<2> pattern(mantissa);
+			patterns.push_back(pattern);
+			pattern.AddOne();
+			patterns.push_back(pattern);
+			if (bits > 54)
+			{
+				ttmath::UInt<2> tie(mantissa);
+				tie.Add(half);
+				patterns.push_back(tie);
+				pattern = tie;
+				pattern.SubOne();
+				patterns.push_back(pattern);
+				pattern = tie;
+				pattern.AddOne();
+				patterns.push_back(pattern);
+			}
+
+			for (size_t i = 0; i < patterns.size(); i++)
+			{
+				toDoubleErrors += checkToDouble(patterns[i]);
+				toDoubleValues++;
+				if (!patterns[i].IsTheHighestBitSet())
+				{
+					ttmath::Int<2> value;
+					value.table[0] = patterns[i].table[0];
+					value.table[1] = patterns[i].table[1];
+					toDoubleErrors += checkToDouble(value);
+					value.ChangeSign();
+					toDoubleErrors += checkToDouble(value);
+					toDoubleValues += 2;
+				}
+
+				// Back again, with and without a fraction
+				double d = patterns[i].ToDouble();
+				fromDoubleErrors += checkFromDouble<ttmath::UInt<2> >(d);
+				fromDoubleErrors += checkFromDouble<ttmath::Int<2> >(d);
+				fromDoubleErrors += checkFromDouble<ttmath::Int<2> >(-d);
+				fromDoubleErrors += checkFromDouble<ttmath::Int<2> >(ldexp(-d, -20));
+				fromDoubleValues += 4;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < mElementCount; i++)
+	{
+		ttmath::Int<2> value = randomInt128(seed, 1 + (unsigned int)(nextRandom(seed) % 127));
+		toDoubleErrors += checkToDouble(value);
+		toDoubleValues++;
+
+		double d = ldexp((double)(int64)nextRandom(seed), (int)(nextRandom(seed) % 140) - 70);
+		fromDoubleErrors += checkFromDouble<ttmath::Int<2> >(d);
+		fromDoubleErrors += checkFromDouble<ttmath::UInt<2> >(d);
+		fromDoubleValues += 2;
+	}
+
+	// Values at and beyond the limits
+	const double kLimitValues[] = { 1.0e39, -1.0e39, ldexp(1.0, 127), -ldexp(1.0, 127), ldexp(1.0, 128) };
+	for (size_t i = 0; i < sizeof(kLimitValues) / sizeof(kLimitValues[0]); i++)
+	{
+		fromDoubleErrors += checkFromDouble<ttmath::Int<2> >(kLimitValues[i]);
+		fromDoubleErrors += checkFromDouble<ttmath::UInt<2> >(kLimitValues[i]);
+		fromDoubleValues += 2;
+	}
+
+	// Big::FromDouble() doesn't handle these, they must give zero with a carry
+	const double kSpecialValues[] = { HUGE_VAL, -HUGE_VAL, sqrt(-1.0) };
+	for (size_t i = 0; i < sizeof(kSpecialValues) / sizeof(kSpecialValues[0]); i++)
+	{
+		ttmath::Int<2> result;
+		ttmath::UInt<2> unsignedResult;
+		fromDoubleErrors += (result.FromDouble(kSpecialValues[i]) == 1 && result.IsZero()) ? 0 : 1;
+		fromDoubleErrors += (unsignedResult.FromDouble(kSpecialValues[i]) == 1 && unsignedResult.IsZero()) ? 0 : 1;
+		fromDoubleValues += 2;
+	}
+
+	mOutput << "# check ToDouble against Big: " << toDoubleValues << " values, " << toDoubleErrors << " errors" << std::endl;
+	mOutput << "# check FromDouble against Big: " << fromDoubleValues << " values, " << fromDoubleErrors << " errors" << std::endl;
+
+	return (toDoubleErrors == 0) && (fromDoubleErrors == 0);
+}
+
+// ---------------------------------------------------------------------------
+// BigIntsBenchmark::checkToDouble									  [protected]
+//
+//	Big::ToDouble() cuts the mantissa off, so the correctly rounded result is either
+//	that or the next double away from zero: whichever is nearer to the exact value,
+//	or the one with an even mantissa on a tie. Returns the number of errors (0 or 1).
+// ---------------------------------------------------------------------------
+template<class IntType>
+size_t BigIntsBenchmark::checkToDouble(const IntType& inValue)
+{
+	ttmath::Big<1, 4> exact;
+	exact.FromInt(inValue);
+	double truncated = exact.ToDouble();
+	double away = nextafter(truncated, (truncated < 0.0) ? -HUGE_VAL : HUGE_VAL);
+
+	ttmath::Big<1, 4> truncatedError(exact), awayError;
+	ttmath::Big<1, 4> temp;
+	temp.FromDouble(truncated);
+	truncatedError.Sub(temp);
+	truncatedError.Abs();
+	awayError.FromDouble(away);
+	awayError.Sub(exact);
+	awayError.Abs();
+
+	double expected;
+	if (truncatedError.IsZero() || truncatedError < awayError)
+		expected = truncated;
+	else if (awayError < truncatedError)
+		expected = away;
+	else
+	{
+		uint64 bits;
+		memcpy(&bits, &truncated, sizeof(bits));
+		expected = ((bits & 1) == 0) ? truncated : away;
+	}
+
+	return (inValue.ToDouble() == expected) ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// BigIntsBenchmark::checkFromDouble								  [protected]
+//
+//	FromDouble() has to give the same value and carry as Big::FromDouble()
+//	followed by Big::ToInt() (both cut the fraction off). Returns the number of
+//	errors (0 or 1).
+// ---------------------------------------------------------------------------
+template<class IntType>
+size_t BigIntsBenchmark::checkFromDouble(double inValue)
+{
+	ttmath::Big<1, 2> big;
+	IntType expected, result;
+	big.FromDouble(inValue);
+	uint64 expectedCarry = big.ToInt(expected);
+	uint64 carry = result.FromDouble(inValue);
+
+	// Big::ToInt() reports a carry for negative values whose integer part is zero
+	if (inValue < 0.0 && inValue > -1.0 && isSigned(expected))
+		expectedCarry = 0;
+
+	if (carry != expectedCarry)
+		return 1;
+
+	return (carry != 0 || result == expected) ? 0 : 1;
+}
+
+void BigIntsBenchmark::report(const char* inBenchmark, const char* inType, CacheState inCache, size_t inOps, double inSeconds)
+{
+	double nsPerOp = (inOps > 0) ? (inSeconds * 1.0e9 / inOps) : 0.0;
+	double mops = (inSeconds > 0.0) ? (inOps / inSeconds * 1.0e-6) : 0.0;
+
+	mOutput << inBenchmark << ","
+			<< inType << ","
+			<< ((inCache == eCold) ? "cold" : "warm") << ","
+			<< inOps << ","
+			<< inSeconds << ","
+			<< nsPerOp << ","
+			<< mops << std::endl;
+}
+
+void BigIntsBenchmark::evictCaches()
+{
+	// Touch every cache line of a buffer larger than the last level cache
+	const size_t kCacheLineSize = 64;
+	char sum = 0;
+	for (size_t i = 0; i < mEvictionBuffer.size(); i += kCacheLineSize)
+	{
+		mEvictionBuffer[i]++;
+		sum += mEvictionBuffer[i];
+	}
+	mSink += sum;
+}
+
+double BigIntsBenchmark::getCurrentSeconds() const
+{
+#ifdef _WIN32
+	LARGE_INTEGER ticksPerSecond, tick;
+	QueryPerformanceFrequency(&ticksPerSecond);
+	QueryPerformanceCounter(&tick);
+	return (double)tick.QuadPart / ticksPerSecond.QuadPart;
+#else
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void BigIntsBenchmark::runAddSub()
+{
+	const size_t n = mElementCount;
+	uint64 seed = 0x9E3779B97F4A7C15ull;
+
+	{
+		std::vector<ttmath::Int<2> > a(n), b(n), r(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = randomInt128(seed, 100);
+			b[i] = randomInt128(seed, 100);
+		}
+
+		measure("Add", "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				r[i] = a[i];
+				c += r[i].Add(b[i]);
+			}
+			return c + r[inBegin].table[0];
+		});
+		measure("Sub", "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				r[i] = a[i];
+				c += r[i].Sub(b[i]);
+			}
+			return c + r[inBegin].table[0];
+		});
+
+#ifdef TTMATH_INT128
+		std::vector<ttmath::sint128> na(n), nb(n), nr(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			na[i] = toNative(a[i]);
+			nb[i] = toNative(b[i]);
+		}
+
+		measure("Add", "__int128", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				nr[i] = na[i] + nb[i];
+			return (uint64)nr[inBegin];
+		});
+		measure("Sub", "__int128", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				nr[i] = na[i] - nb[i];
+			return (uint64)nr[inBegin];
+		});
+#endif
+	}
+
+	{
+		std::vector<int64> a(n), b(n), r(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = randomInt64(seed, 62);
+			b[i] = randomInt64(seed, 62);
+		}
+
+		measure("Add", "int64_t", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = a[i] + b[i];
+			return (uint64)r[inBegin];
+		});
+		measure("Sub", "int64_t", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = a[i] - b[i];
+			return (uint64)r[inBegin];
+		});
+	}
+
+	{
+		std::vector<double> a(n), b(n), r(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = (double)randomInt64(seed, 62) * 1.0e11;
+			b[i] = (double)randomInt64(seed, 62) * 1.0e11;
+		}
+
+		measure("Add", "double", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = a[i] + b[i];
+			return (uint64)(r[inBegin] != 0.0);
+		});
+		measure("Sub", "double", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = a[i] - b[i];
+			return (uint64)(r[inBegin] != 0.0);
+		});
+	}
+}
+
+void BigIntsBenchmark::runMulInt()
+{
+	const size_t n = mElementCount;
+	const int kFactor = 1000;	// e.g. metres to millimetres
+	uint64 seed = 0xD1B54A32D192ED03ull;
+
+	{
+		std::vector<ttmath::Int<2> > a(n), r(n);
+		for (size_t i = 0; i < n; i++)
+			a[i] = randomInt128(seed, 100);
+
+		measure("MulInt", "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				r[i] = a[i];
+				c += r[i].MulInt(kFactor);
+			}
+			return c + r[inBegin].table[0];
+		});
+
+#ifdef TTMATH_INT128
+		std::vector<ttmath::sint128> na(n), nr(n);
+		for (size_t i = 0; i < n; i++)
+			na[i] = toNative(a[i]);
+
+		measure("MulInt", "__int128", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				nr[i] = na[i] * kFactor;
+			return (uint64)nr[inBegin];
+		});
+#endif
+	}
+
+	{
+		std::vector<int64> a(n), r(n);
+		for (size_t i = 0; i < n; i++)
+			a[i] = randomInt64(seed, 52);
+
+		measure("MulInt", "int64_t", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = a[i] * kFactor;
+			return (uint64)r[inBegin];
+		});
+	}
+
+	{
+		std::vector<double> a(n), r(n);
+		for (size_t i = 0; i < n; i++)
+			a[i] = (double)randomInt64(seed, 62);
+
+		measure("MulInt", "double", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = a[i] * kFactor;
+			return (uint64)(r[inBegin] != 0.0);
+		});
+	}
+}
+
+void BigIntsBenchmark::runMul()
+{
+	const size_t n = mElementCount;
+	uint64 seed = 0x2545F4914F6CDD1Dull;
+
+	{
+		// Keep the products within 128 bits so no algorithm takes an overflow shortcut
+		std::vector<ttmath::Int<2> > a(n), b(n), r(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = randomInt128(seed, 90);
+			b[i] = randomInt128(seed, 30);
+		}
+
+		measure("Mul", "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				r[i] = a[i];
+				c += r[i].Mul(b[i]);
+			}
+			return c + r[inBegin].table[0];
+		});
+
+		// The individual UInt algorithms work on magnitudes
+		std::vector<ttmath::UInt<2> > ua(n), ub(n), ur(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			ttmath::Int<2> absA(a[i]), absB(b[i]);
+			absA.Abs();
+			absB.Abs();
+			ua[i] = absA;
+			ub[i] = absB;
+		}
+
+		measure("Mul2Big", "UInt<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			ttmath::UInt<4> wide;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				ua[i].Mul2Big(ub[i], wide);
+				c += wide.table[1];
+			}
+			return c;
+		});
+		measure("Mul3", "UInt<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				ur[i] = ua[i];
+				c += ur[i].Mul3(ub[i]);
+			}
+			return c + ur[inBegin].table[0];
+		});
+		measure("MulFastestBig", "UInt<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			ttmath::UInt<4> wide;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				ua[i].MulFastestBig(ub[i], wide);
+				c += wide.table[1];
+			}
+			return c;
+		});
+
+#ifdef TTMATH_INT128
+		std::vector<ttmath::sint128> na(n), nb(n), nr(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			na[i] = toNative(a[i]);
+			nb[i] = toNative(b[i]);
+		}
+
+		measure("Mul", "__int128", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				nr[i] = na[i] * nb[i];
+			return (uint64)nr[inBegin];
+		});
+#endif
+	}
+
+	{
+		std::vector<int64> a(n), b(n), r(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = randomInt64(seed, 32);
+			b[i] = randomInt64(seed, 30);
+		}
+
+		measure("Mul", "int64_t", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = a[i] * b[i];
+			return (uint64)r[inBegin];
+		});
+	}
+
+	{
+		std::vector<double> a(n), b(n), r(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = (double)randomInt64(seed, 62);
+			b[i] = (double)randomInt64(seed, 30);
+		}
+
+		measure("Mul", "double", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = a[i] * b[i];
+			return (uint64)(r[inBegin] != 0.0);
+		});
+	}
+}
+
+void BigIntsBenchmark::runDiv()
+{
+	const size_t n = mElementCount;
+	uint64 seed = 0xBF58476D1CE4E5B9ull;
+
+	{
+		std::vector<ttmath::Int<2> > a(n), b(n), r(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = randomInt128(seed, 100);
+			do
+			{
+				b[i] = randomInt128(seed, 40);
+			} while (b[i].IsZero());
+		}
+
+		measure("Div", "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				r[i] = a[i];
+				c += r[i].Div(b[i]);
+			}
+			return c + r[inBegin].table[0];
+		});
+
+		std::vector<ttmath::UInt<2> > ua(n), ub(n), ur(n), rem(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			ttmath::Int<2> absA(a[i]), absB(b[i]);
+			absA.Abs();
+			absB.Abs();
+			ua[i] = absA;
+			ub[i] = absB;
+		}
+
+		measure("Div1", "UInt<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				ur[i] = ua[i];
+				c += ur[i].Div1(ub[i], rem[i]);
+			}
+			return c + ur[inBegin].table[0];
+		});
+		measure("Div2", "UInt<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				ur[i] = ua[i];
+				c += ur[i].Div2(ub[i], rem[i]);
+			}
+			return c + ur[inBegin].table[0];
+		});
+		measure("Div3", "UInt<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				ur[i] = ua[i];
+				c += ur[i].Div3(ub[i], rem[i]);
+			}
+			return c + ur[inBegin].table[0];
+		});
+
+#ifdef TTMATH_INT128
+		std::vector<ttmath::sint128> na(n), nb(n), nr(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			na[i] = toNative(a[i]);
+			nb[i] = toNative(b[i]);
+		}
+
+		measure("Div", "__int128", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				nr[i] = na[i] / nb[i];
+			return (uint64)nr[inBegin];
+		});
+#endif
+	}
+
+	{
+		std::vector<int64> a(n), b(n), r(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = randomInt64(seed, 62);
+			do
+			{
+				b[i] = randomInt64(seed, 20);
+			} while (b[i] == 0);
+		}
+
+		measure("Div", "int64_t", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = a[i] / b[i];
+			return (uint64)r[inBegin];
+		});
+	}
+
+	{
+		std::vector<double> a(n), b(n), r(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = (double)randomInt64(seed, 62);
+			b[i] = (double)randomInt64(seed, 20) + 0.5;
+		}
+
+		measure("Div", "double", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = a[i] / b[i];
+			return (uint64)(r[inBegin] != 0.0);
+		});
+	}
+}
+
+void BigIntsBenchmark::runDivInvariant()
+{
+	// Unit conversions: many coordinates divided by the same unit length in millimetres.
+	// A parsec needs two words, a light-year fits in one, which takes the other path.
+	const size_t n = mElementCount;
+	const char* kDivisors[2][2] = { { "DivInvariant(pc)", "30856775814913672789" },
+									{ "DivInvariant(ly)", "9460730472580800000" } };
+	uint64 seed = 0x2545F4914F6CDD1Dull;
+
+	std::vector<ttmath::Int<2> > a(n), r(n), rem(n);
+	for (size_t i = 0; i < n; i++)
+		a[i] = randomInt128(seed, 100);
+
+	for (int d = 0; d < 2; d++)
+	{
+		const char* benchmark = kDivisors[d][0];
+		ttmath::Int<2> divisor;
+		divisor.FromString(kDivisors[d][1]);
+		ttmath::IntDivider<2> divider(divisor);
+
+		measure(benchmark, "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				r[i] = a[i];
+				c += r[i].Div(divisor, &rem[i]);
+			}
+			return c + r[inBegin].table[0] + rem[inBegin].table[0];
+		});
+		measure(benchmark, "IntDivider<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				r[i] = a[i];
+				c += divider.Div(r[i], &rem[i]);
+			}
+			return c + r[inBegin].table[0] + rem[inBegin].table[0];
+		});
+		measure(benchmark, "IntDivider<2> array", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = divider.DivArray(&a[inBegin], &r[inBegin], &rem[inBegin], inEnd - inBegin);
+			return c + r[inBegin].table[0] + rem[inBegin].table[0];
+		});
+
+#ifdef TTMATH_INT128
+		{
+			std::vector<ttmath::sint128> na(n), nr(n), nrem(n);
+			for (size_t i = 0; i < n; i++)
+				na[i] = toNative(a[i]);
+			ttmath::sint128 nd = toNative(divisor);
+
+			measure(benchmark, "__int128", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+				for (size_t i = inBegin; i < inEnd; i++)
+				{
+					nr[i] = na[i] / nd;
+					nrem[i] = na[i] % nd;
+				}
+				return (uint64)(nr[inBegin] + nrem[inBegin]);
+			});
+		}
+#endif
+	}
+}
+
+// ---------------------------------------------------------------------------
+// BigIntsBenchmark::runWide										  [protected]
+//
+//	256-bit arithmetic. UInt<4> is never specialized, so these always go through
+//	the ttmath backend (asm, no_asm or intrinsics, see the # ttmath line) and are
+//	the ones to compare between builds with and without TTMATH_NOASM and
+//	TTMATH_INTRINSICS.
+// ---------------------------------------------------------------------------
+void BigIntsBenchmark::runWide()
+{
+	const size_t n = mElementCount;
+	uint64 seed = 0xD1B54A32D192ED03ull;
+
+	std::vector<ttmath::UInt<4> > a(n), b(n), r(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			a[i].table[j] = nextRandom(seed);
+			b[i].table[j] = nextRandom(seed);
+		}
+
+		// Keep products within 256 bits and give the division a 128-bit divisor
+		a[i].table[3] = 0;
+		a[i].table[2] = 0;
+		b[i].table[3] = 0;
+		b[i].table[2] = 0;
+	}
+
+	measure("Add", "UInt<4>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+		uint64 c = 0;
+		for (size_t i = inBegin; i < inEnd; i++)
+		{
+			r[i] = a[i];
+			c += r[i].Add(b[i]);
+		}
+		return c + r[inBegin].table[0];
+	});
+	measure("Sub", "UInt<4>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+		uint64 c = 0;
+		for (size_t i = inBegin; i < inEnd; i++)
+		{
+			r[i] = a[i];
+			c += r[i].Sub(b[i]);
+		}
+		return c + r[inBegin].table[0];
+	});
+	measure("Mul", "UInt<4>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+		uint64 c = 0;
+		for (size_t i = inBegin; i < inEnd; i++)
+		{
+			r[i] = a[i];
+			c += r[i].Mul(b[i]);
+		}
+		return c + r[inBegin].table[0];
+	});
+
+	for (size_t i = 0; i < n; i++)
+	{
+		r[i] = a[i];
+		r[i].Mul(b[i]);
+		a[i] = r[i];
+		b[i].table[1] >>= 1;
+		b[i].table[0] |= 1;
+	}
+	measure("Div", "UInt<4>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+		uint64 c = 0;
+		for (size_t i = inBegin; i < inEnd; i++)
+		{
+			r[i] = a[i];
+			c += r[i].Div(b[i]);
+		}
+		return c + r[inBegin].table[0];
+	});
+}
+
+void BigIntsBenchmark::runToDouble()
+{
+	const size_t n = mElementCount;
+	const size_t kStringElementCount = std::max(kWarmElementCount, n / 16);	// The string route is very slow
+	uint64 seed = 0x94D049BB133111EBull;
+
+	std::vector<ttmath::Int<2> > a(n);
+	std::vector<double> r(n);
+	for (size_t i = 0; i < n; i++)
+		a[i] = randomInt128(seed, 100);
+
+	measure("ToDouble", "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+		for (size_t i = inBegin; i < inEnd; i++)
+			r[i] = a[i].ToDouble();
+		return (uint64)(r[inBegin] != 0.0);
+	});
+	measure("ToDouble(Big<1,2>)", "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+		ttmath::Big<1, 2> big;
+		for (size_t i = inBegin; i < inEnd; i++)
+		{
+			big.FromInt(a[i]);
+			r[i] = big.ToDouble();
+		}
+		return (uint64)(r[inBegin] != 0.0);
+	});
+	measure("ToDouble(string)", "Int<2>", kStringElementCount, [&](size_t inBegin, size_t inEnd) -> uint64 {
+		std::string s;
+		for (size_t i = inBegin; i < inEnd; i++)
+		{
+			a[i].ToString(s);
+			r[i] = strtod(s.c_str(), NULL);
+		}
+		return (uint64)(r[inBegin] != 0.0);
+	});
+
+#ifdef TTMATH_INT128
+	{
+		std::vector<ttmath::sint128> na(n);
+		for (size_t i = 0; i < n; i++)
+			na[i] = toNative(a[i]);
+
+		measure("ToDouble", "__int128", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = (double)na[i];
+			return (uint64)(r[inBegin] != 0.0);
+		});
+	}
+#endif
+
+	{
+		std::vector<int64> na(n);
+		for (size_t i = 0; i < n; i++)
+			na[i] = randomInt64(seed, 62);
+
+		measure("ToDouble", "int64_t", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = (double)na[i];
+			return (uint64)(r[inBegin] != 0.0);
+		});
+	}
+}
+
+void BigIntsBenchmark::runStrings()
+{
+	const size_t n = std::max(kWarmElementCount, mElementCount / 16);
+	uint64 seed = 0x5851F42D4C957F2Dull;
+
+	{
+		std::vector<ttmath::Int<2> > a(n), r(n);
+		std::vector<std::string> s(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = randomInt128(seed, 100);
+			s[i] = a[i].ToString();
+		}
+
+		measure("ToString", "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			std::string str;
+			for (size_t i = inBegin; i < inEnd; i++)
+			{
+				a[i].ToString(str);
+				c += str.size();
+			}
+			return c;
+		});
+		measure("FromString", "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+				c += r[i].FromString(s[i]);
+			return c + r[inBegin].table[0];
+		});
+
+		// Into a caller's buffer, as catalog export and the HUD do it
+		measure("ToDecimalString", "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			char str[TTMATH_DECIMAL_STRING_SIZE(2)];
+			for (size_t i = inBegin; i < inEnd; i++)
+				c += a[i].ToDecimalString(str, sizeof(str));
+			return c;
+		});
+		measure("FromDecimalString", "Int<2>", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			for (size_t i = inBegin; i < inEnd; i++)
+				c += r[i].FromDecimalString(s[i].c_str());
+			return c + r[inBegin].table[0];
+		});
+	}
+
+	{
+		std::vector<int64> a(n), r(n);
+		std::vector<std::string> s(n);
+		char buffer[32];
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = randomInt64(seed, 62);
+			sprintf(buffer, "%lld", a[i]);
+			s[i] = buffer;
+		}
+
+		measure("ToString", "int64_t", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			char str[32];
+			for (size_t i = inBegin; i < inEnd; i++)
+				c += sprintf(str, "%lld", a[i]);
+			return c;
+		});
+		measure("FromString", "int64_t", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = strtoll(s[i].c_str(), NULL, 10);
+			return (uint64)r[inBegin];
+		});
+	}
+
+	{
+		std::vector<double> a(n), r(n);
+		std::vector<std::string> s(n);
+		char buffer[32];
+		for (size_t i = 0; i < n; i++)
+		{
+			a[i] = (double)randomInt64(seed, 62) * 1.0e11;
+			sprintf(buffer, "%.17g", a[i]);
+			s[i] = buffer;
+		}
+
+		measure("ToString", "double", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			uint64 c = 0;
+			char str[32];
+			for (size_t i = inBegin; i < inEnd; i++)
+				c += sprintf(str, "%.17g", a[i]);
+			return c;
+		});
+		measure("FromString", "double", n, [&](size_t inBegin, size_t inEnd) -> uint64 {
+			for (size_t i = inBegin; i < inEnd; i++)
+				r[i] = strtod(s[i].c_str(), NULL);
+			return (uint64)(r[inBegin] != 0.0);
+		});
+	}
+}
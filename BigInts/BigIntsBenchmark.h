@@ -0,0 +1,72 @@
+// BigIntsBenchmark.h : Load testing of ttmath 128-bit integers against native types.
+//
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include "ttmath/ttmath.h"
+#include "ttmath/ttmathdivider.h"
+
+/*
+Answers the "How much slower is it compared to native integers?" question from
+ProofOfConcept.txt. Every benchmark runs the same kernel over arrays of ttmath::Int<2>,
+int64_t, __int128 (GCC/Clang only) and double, twice:
+
+	cold - a single pass over mElementCount elements after the caches have been flushed,
+	       so the kernel is bound by memory bandwidth as it will be when we sweep catalogs.
+	warm - many passes over kWarmElementCount elements that fit in L1/L2, so we measure
+	       the arithmetic itself.
+
+Results are written as CSV (one header line, then one line per benchmark/type/cache) so
+runs can be diffed or plotted when the coordinate backend changes. Lines starting with '#'
+describe the build and the results of the conversion checks, which compare the direct
+ToDouble()/FromDouble() conversions with the (slow but simple) ttmath::Big route before
+anything is timed.
+
+The ttmath backend is chosen at compile time (asm by default, TTMATH_NOASM for pure C++,
+TTMATH_INTRINSICS for compiler intrinsics), so backends are compared by building the
+benchmark once per backend and diffing the results; the UInt<4> lines always exercise the
+backend, while with GCC/Clang UInt<2> and Int<2> only do so with TTMATH_NOINT128.
+*/
+
+class BigIntsBenchmark
+{
+	public:
+		enum CacheState { eCold, eWarm };
+
+		BigIntsBenchmark(std::ostream& inOutput, size_t inElementCount);
+
+		void			run();
+
+		// Number of elements used by the warm cache runs
+		static const size_t	kWarmElementCount = 4096;
+
+	protected:
+		bool			checkConversions();
+		template<class IntType>
+		size_t			checkToDouble(const IntType& inValue);
+		template<class IntType>
+		size_t			checkFromDouble(double inValue);
+
+		void			runAddSub();
+		void			runMulInt();
+		void			runMul();
+		void			runDiv();
+		void			runDivInvariant();
+		void			runWide();
+		void			runToDouble();
+		void			runStrings();
+
+		template<class Kernel>
+		void			measure(const char* inBenchmark, const char* inType, size_t inElementCount, Kernel inKernel);
+		void			report(const char* inBenchmark, const char* inType, CacheState inCache, size_t inOps, double inSeconds);
+		void			evictCaches();
+		double			getCurrentSeconds() const;
+
+		std::ostream&		mOutput;
+		size_t				mElementCount;
+		std::vector<char>	mEvictionBuffer;
+		unsigned long long	mSink;			// Results are folded in here so nothing is optimized away
+};
@@ -0,0 +1,739 @@
+/*
+ * This file is a part of TTMath Bignum Library
+ * and is distributed under the (new) BSD licence.
+ */
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef headerfilettmathdivider
+#define headerfilettmathdivider
+
+
+/*!
+	\file ttmathdivider.h
+    \brief division by an invariant divisor (UIntDivider<>, IntDivider<>)
+
+	when many values are divided by the same divisor (e.g. converting universal coordinates
+	in millimetres into parsecs) the expensive part of the division can be done once:
+	the divisor is normalized and its reciprocal is calculated when it is set,
+	and then every division is only a few multiplications
+	(N. Moller, T. Granlund, "Improved division by invariant integers", 2011)
+
+	the reciprocal method is used for UInt<2> on 64bit platforms, for other sizes
+	the dividers simply call UInt::Div() and Int::Div()
+
+	quotients, remainders and returned values are exactly the same as from
+	UInt::Div() and Int::Div() (also when dividing by zero)
+*/
+
+#include "ttmathint.h"
+
+#if defined(TTMATH_PLATFORM64) && !defined(TTMATH_INT128) && defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+
+namespace ttmath
+{
+
+
+template<uint value_size>
+class IntDivider;
+
+
+
+/*!
+	\brief dividing many unsigned values by the same divisor
+*/
+template<uint value_size>
+class UIntDivider
+{
+public:
+
+	UIntDivider()
+	{
+		divisor.SetOne();
+	}
+
+
+	UIntDivider(const UInt<value_size> & d)
+	{
+		SetDivisor(d);
+	}
+
+
+	/*!
+		setting the divisor
+		it returns 1 if the divisor is zero (the division will return 1 then too)
+	*/
+	uint SetDivisor(const UInt<value_size> & d)
+	{
+		divisor = d;
+
+	return divisor.IsZero() ? 1 : 0;
+	}
+
+
+	const UInt<value_size> & GetDivisor() const
+	{
+		return divisor;
+	}
+
+
+	/*!
+		value = value / divisor
+		the same as value.Div(divisor, remainder)
+	*/
+	uint Div(UInt<value_size> & value, UInt<value_size> * remainder = 0) const
+	{
+		return value.Div(divisor, remainder);
+	}
+
+
+	/*!
+		dividing count values: quotients[i] = values[i] / divisor, remainders[i] = values[i] % divisor
+
+		quotients can be the same array as values, remainders can be null
+		it returns 1 if the divisor is zero (the arrays are not changed then)
+	*/
+	uint DivArray(const UInt<value_size> * values, UInt<value_size> * quotients, UInt<value_size> * remainders, size_t count) const
+	{
+		if( divisor.IsZero() )
+			return 1;
+
+		for(size_t i=0 ; i<count ; ++i)
+		{
+			quotients[i] = values[i];
+			Div(quotients[i], remainders ? &remainders[i] : 0);
+		}
+
+	return 0;
+	}
+
+
+private:
+
+	UInt<value_size> divisor;
+};
+
+
+
+#ifdef TTMATH_PLATFORM64
+
+/*!
+	\brief dividing many unsigned 128 bit values by the same divisor
+
+	the divisor is shifted left until its highest bit is set (normalized) and a reciprocal
+	of it is calculated once; the dividend is shifted by the same amount and divided with
+	a 2-by-1 word division (a divisor smaller than 2^64) or a 3-by-2 word division
+	(a bigger divisor), each takes two multiplications and a few adds instead of a 'div'
+*/
+template<>
+class UIntDivider<2>
+{
+public:
+
+	UIntDivider()
+	{
+	UInt<2> one;
+
+		one.SetOne();
+		SetDivisor(one);
+	}
+
+
+	UIntDivider(const UInt<2> & d)
+	{
+		SetDivisor(d);
+	}
+
+
+	/*!
+		setting the divisor
+		it returns 1 if the divisor is zero (the division will return 1 then too)
+	*/
+	uint SetDivisor(const UInt<2> & d)
+	{
+	uint table_id, index;
+
+		divisor = d;
+		shift = 0;
+		d1 = d0 = reciprocal = 0;
+
+		if( !d.FindLeadingBit(table_id, index) )
+			return 1;
+
+		shift = TTMATH_BITS_PER_UINT - 1 - index;
+
+		if( table_id == 0 )
+		{
+			d1 = d.table[0] << shift;
+			reciprocal = Reciprocal2by1(d1);
+		}
+		else
+		{
+			d1 = (d.table[1] << shift) | ShiftRightRest(d.table[0], shift);
+			d0 = d.table[0] << shift;
+			reciprocal = Reciprocal3by2(d1, d0);
+		}
+
+	return 0;
+	}
+
+
+	const UInt<2> & GetDivisor() const
+	{
+		return divisor;
+	}
+
+
+	/*!
+		value = value / divisor
+		the same as value.Div(divisor, remainder)
+	*/
+	uint Div(UInt<2> & value, UInt<2> * remainder = 0) const
+	{
+	uint rest[2];
+
+		if( d1 == 0 )
+			return 1;
+
+		if( divisor.table[1] == 0 )
+			DivByOneWord(value.table, value.table, rest);
+		else
+			DivByTwoWords(value.table, value.table, rest);
+
+		if( remainder )
+		{
+			remainder->table[0] = rest[0];
+			remainder->table[1] = rest[1];
+		}
+
+	return 0;
+	}
+
+
+	/*!
+		dividing count values: quotients[i] = values[i] / divisor, remainders[i] = values[i] % divisor
+
+		quotients can be the same array as values, remainders can be null
+		it returns 1 if the divisor is zero (the arrays are not changed then)
+	*/
+	uint DivArray(const UInt<2> * values, UInt<2> * quotients, UInt<2> * remainders, size_t count) const
+	{
+	uint rest[2];
+
+		if( d1 == 0 )
+			return 1;
+
+		if( divisor.table[1] == 0 )
+		{
+			for(size_t i=0 ; i<count ; ++i)
+			{
+				DivByOneWord(values[i].table, quotients[i].table, remainders ? remainders[i].table : rest);
+			}
+		}
+		else
+		{
+			for(size_t i=0 ; i<count ; ++i)
+			{
+				DivByTwoWords(values[i].table, quotients[i].table, remainders ? remainders[i].table : rest);
+			}
+		}
+
+	return 0;
+	}
+
+
+private:
+
+	friend class IntDivider<2>;
+
+	UInt<2> divisor;
+	uint shift;				// how many bits the divisor is shifted left to be normalized
+	uint d1, d0;			// the normalized divisor (d0 is zero when the divisor has one word)
+	uint reciprocal;		// floor((2^128-1) / d1) - 2^64  or  floor((2^192-1) / (d1 d0)) - 2^64
+
+
+	/*!
+		the division by a divisor smaller than 2^64
+		(u2 u1 u0) / d1 with two 2-by-1 divisions, u2 < d1 because the shift is smaller than 64
+
+		quotient can be the same table as value
+	*/
+	void DivByOneWord(const uint * value, uint * quotient, uint * rest) const
+	{
+	uint u2 = ShiftRightRest(value[1], shift);
+	uint u1 = (value[1] << shift) | ShiftRightRest(value[0], shift);
+	uint u0 = value[0] << shift;
+	uint q1, q0, r;
+
+		q1 = Div2by1(u2, u1, r);
+		q0 = Div2by1(r, u0, r);
+
+		quotient[0] = q0;
+		quotient[1] = q1;
+		rest[0]     = r >> shift;
+		rest[1]     = 0;
+	}
+
+
+	/*!
+		the division by a divisor of two words
+		the quotient has only one word, (u2 u1) < (d1 d0) because the shift is smaller than 64
+
+		quotient can be the same table as value
+	*/
+	void DivByTwoWords(const uint * value, uint * quotient, uint * rest) const
+	{
+	uint u2 = ShiftRightRest(value[1], shift);
+	uint u1 = (value[1] << shift) | ShiftRightRest(value[0], shift);
+	uint u0 = value[0] << shift;
+	uint r1, r0;
+
+		quotient[0] = Div3by2(u2, u1, u0, r1, r0);
+		quotient[1] = 0;
+		rest[0]     = (r0 >> shift) | ShiftLeftRest(r1, shift);
+		rest[1]     = r1 >> shift;
+	}
+
+
+	/*!
+		x >> (64 - bits) for bits in <0;63> (x >> 64 is not defined in C++)
+	*/
+	static uint ShiftRightRest(uint x, uint bits)
+	{
+		return (x >> 1) >> (TTMATH_BITS_PER_UINT - 1 - bits);
+	}
+
+
+	/*!
+		x << (64 - bits) for bits in <0;63>
+	*/
+	static uint ShiftLeftRest(uint x, uint bits)
+	{
+		return (x << 1) << (TTMATH_BITS_PER_UINT - 1 - bits);
+	}
+
+
+	/*!
+		a full product of two words
+	*/
+	static void MulTwoWords(uint a, uint b, uint * result_high, uint * result_low)
+	{
+	#if defined(TTMATH_INT128)
+
+		uint128 result = uint128(a) * b;
+		*result_high = uint(result >> TTMATH_BITS_PER_UINT);
+		*result_low  = uint(result);
+
+	#elif defined(_MSC_VER)
+
+		*result_low = _umul128(a, b, result_high);
+
+	#elif defined(__GNUC__) && !defined(TTMATH_NOASM)
+
+		__asm__ (
+			"mulq %3"
+			: "=a" (*result_low), "=d" (*result_high)
+			: "0" (a), "rm" (b)
+			: "cc" );
+
+	#else
+
+		uint a1 = a >> 32, a0 = a & 0xffffffffu;
+		uint b1 = b >> 32, b0 = b & 0xffffffffu;
+		uint p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+		uint middle = (p00 >> 32) + (p01 & 0xffffffffu) + (p10 & 0xffffffffu);
+
+		*result_high = p11 + (p01 >> 32) + (p10 >> 32) + (middle >> 32);
+		*result_low  = (middle << 32) | (p00 & 0xffffffffu);
+
+	#endif
+	}
+
+
+	/*!
+		floor((2^128-1) / d) - 2^64 for a normalized d,
+		it's ((2^64-1-d) 2^64 + 2^64-1) / d which has only one word
+	*/
+	static uint Reciprocal2by1(uint d)
+	{
+	UInt<2> n, dd;
+
+		n.table[0]  = TTMATH_UINT_MAX_VALUE;
+		n.table[1]  = ~d;
+		dd.table[0] = d;
+		dd.table[1] = 0;
+		n.Div(dd);
+
+	return n.table[0];
+	}
+
+
+	/*!
+		floor((2^192-1) / (d1 d0)) - 2^64 for a normalized (d1 d0),
+		the quotient is in <2^64;2^65) so the reciprocal is its lower word
+	*/
+	static uint Reciprocal3by2(uint d1, uint d0)
+	{
+	UInt<3> n, dd;
+
+		n.SetMax();
+		dd.table[0] = d0;
+		dd.table[1] = d1;
+		dd.table[2] = 0;
+		n.Div(dd);
+
+	return n.table[0];
+	}
+
+
+	/*!
+		(u1 u0) / d1, u1 must be smaller than d1
+		(algorithm 4 in Moller, Granlund)
+	*/
+	uint Div2by1(uint u1, uint u0, uint & r) const
+	{
+	uint q1, q0;
+
+		MulTwoWords(reciprocal, u1, &q1, &q0);
+		q0 += u0;
+		q1 += u1 + ((q0 < u0) ? 1 : 0);
+		q1 += 1;
+
+		r = u0 - q1 * d1;
+
+		// r > q0 happens often so it's done without a branch
+		uint mask = (r > q0) ? TTMATH_UINT_MAX_VALUE : 0;
+		q1 += mask;
+		r  += mask & d1;
+
+		if( r >= d1 )
+		{
+			// very unlikely
+			q1 += 1;
+			r  -= d1;
+		}
+
+	return q1;
+	}
+
+
+	/*!
+		(u2 u1 u0) / (d1 d0), (u2 u1) must be smaller than (d1 d0)
+		(algorithm 5 in Moller, Granlund)
+	*/
+	uint Div3by2(uint u2, uint u1, uint u0, uint & r1, uint & r0) const
+	{
+	uint q1, q0, t1, t0, borrow;
+
+		MulTwoWords(reciprocal, u2, &q1, &q0);
+		q0 += u1;
+		q1 += u2 + ((q0 < u1) ? 1 : 0);
+
+		r1 = u1 - q1 * d1;
+		MulTwoWords(d0, q1, &t1, &t0);
+
+		// (r1 r0) = (r1 u0) - (t1 t0) - (d1 d0)
+		r0     = u0 - t0;
+		r1     = r1 - t1 - ((u0 < t0) ? 1 : 0);
+		borrow = (r0 < d0) ? 1 : 0;
+		r0    -= d0;
+		r1     = r1 - d1 - borrow;
+		q1    += 1;
+
+		// r1 >= q0 happens often so it's done without a branch
+		uint mask = (r1 >= q0) ? TTMATH_UINT_MAX_VALUE : 0;
+		uint add0 = mask & d0;
+		q1 += mask;
+		r0 += add0;
+		r1 += (mask & d1) + ((r0 < add0) ? 1 : 0);
+
+		if( r1 > d1 || (r1 == d1 && r0 >= d0) )
+		{
+			// very unlikely
+			borrow = (r0 < d0) ? 1 : 0;
+			q1 += 1;
+			r0 -= d0;
+			r1  = r1 - d1 - borrow;
+		}
+
+	return q1;
+	}
+};
+
+#endif
+
+
+
+/*!
+	\brief dividing many signed values by the same divisor
+
+	the same as Int::Div(): the quotient is truncated towards zero and the remainder
+	has the sign of the dividend
+*/
+template<uint value_size>
+class IntDivider
+{
+public:
+
+	IntDivider()
+	{
+		divisor.SetOne();
+		divisor_is_sign = false;
+	}
+
+
+	IntDivider(const Int<value_size> & d)
+	{
+		SetDivisor(d);
+	}
+
+
+	/*!
+		setting the divisor
+		it returns 1 if the divisor is zero (the division will return 1 then too)
+	*/
+	uint SetDivisor(const Int<value_size> & d)
+	{
+	Int<value_size> abs_divisor(d);
+
+		divisor = d;
+		divisor_is_sign = d.IsSign();
+		abs_divisor.Abs();
+
+	return abs_divider.SetDivisor(abs_divisor);
+	}
+
+
+	const Int<value_size> & GetDivisor() const
+	{
+		return divisor;
+	}
+
+
+	/*!
+		value = value / divisor
+		the same as value.Div(divisor, remainder)
+	*/
+	uint Div(Int<value_size> & value, Int<value_size> * remainder = 0) const
+	{
+	bool value_is_sign = value.IsSign();
+
+		value.Abs();
+
+		uint c = abs_divider.Div(value, remainder);
+
+		if( value_is_sign != divisor_is_sign )
+			value.SetSign();
+
+		if( value_is_sign && remainder )
+			remainder->SetSign();
+
+	return c;
+	}
+
+
+	/*!
+		dividing count values: quotients[i] = values[i] / divisor, remainders[i] = values[i] % divisor
+
+		quotients can be the same array as values, remainders can be null
+		it returns 1 if the divisor is zero (the arrays are not changed then)
+	*/
+	uint DivArray(const Int<value_size> * values, Int<value_size> * quotients, Int<value_size> * remainders, size_t count) const
+	{
+		if( divisor.IsZero() )
+			return 1;
+
+		if( remainders )
+		{
+			for(size_t i=0 ; i<count ; ++i)
+			{
+				quotients[i] = values[i];
+				Div(quotients[i], &remainders[i]);
+			}
+		}
+		else
+		{
+			for(size_t i=0 ; i<count ; ++i)
+			{
+				quotients[i] = values[i];
+				Div(quotients[i]);
+			}
+		}
+
+	return 0;
+	}
+
+
+private:
+
+	Int<value_size> divisor;
+	bool divisor_is_sign;
+	UIntDivider<value_size> abs_divider;
+};
+
+
+
+#ifdef TTMATH_PLATFORM64
+
+/*!
+	\brief dividing many signed 128 bit values by the same divisor
+
+	the signs are applied with masks instead of Abs() and SetSign(), the signs of
+	coordinates are random and the branches would be mispredicted half of the time
+*/
+template<>
+class IntDivider<2>
+{
+public:
+
+	IntDivider()
+	{
+	Int<2> one;
+
+		one.SetOne();
+		SetDivisor(one);
+	}
+
+
+	IntDivider(const Int<2> & d)
+	{
+		SetDivisor(d);
+	}
+
+
+	/*!
+		setting the divisor
+		it returns 1 if the divisor is zero (the division will return 1 then too)
+	*/
+	uint SetDivisor(const Int<2> & d)
+	{
+	Int<2> abs_divisor(d);
+
+		divisor = d;
+		divisor_sign_mask = d.IsSign() ? TTMATH_UINT_MAX_VALUE : 0;
+		abs_divisor.Abs();
+
+	return abs_divider.SetDivisor(abs_divisor);
+	}
+
+
+	const Int<2> & GetDivisor() const
+	{
+		return divisor;
+	}
+
+
+	/*!
+		value = value / divisor
+		the same as value.Div(divisor, remainder)
+	*/
+	uint Div(Int<2> & value, Int<2> * remainder = 0) const
+	{
+	uint rest[2];
+
+		if( abs_divider.d1 == 0 )
+			return value.Div(divisor, remainder);
+
+		DivSigned(value.table, value.table, remainder ? remainder->table : rest);
+
+	return 0;
+	}
+
+
+	/*!
+		dividing count values: quotients[i] = values[i] / divisor, remainders[i] = values[i] % divisor
+
+		quotients can be the same array as values, remainders can be null
+		it returns 1 if the divisor is zero (the arrays are not changed then)
+	*/
+	uint DivArray(const Int<2> * values, Int<2> * quotients, Int<2> * remainders, size_t count) const
+	{
+	uint rest[2];
+
+		if( abs_divider.d1 == 0 )
+			return 1;
+
+		for(size_t i=0 ; i<count ; ++i)
+			DivSigned(values[i].table, quotients[i].table, remainders ? remainders[i].table : rest);
+
+	return 0;
+	}
+
+
+private:
+
+	Int<2> divisor;
+	uint divisor_sign_mask;		// all bits set for a negative divisor
+	UIntDivider<2> abs_divider;
+
+
+	/*!
+		value = -value if mask has all bits set (mask is zero or TTMATH_UINT_MAX_VALUE)
+		-(-2^127) is -2^127 as in ChangeSign()
+	*/
+	static void NegateIf(uint * value, uint mask)
+	{
+	uint one  = mask & 1;
+	uint low  = (value[0] ^ mask) + one;
+
+		value[1] = (value[1] ^ mask) + ((low < one) ? 1 : 0);
+		value[0] = low;
+	}
+
+
+	/*!
+		the same as Int::Div(): dividing the absolute values, the quotient is negative
+		if the signs differ and the remainder has the sign of the dividend
+
+		the absolute value of -2^127 is 2^127 as an unsigned value so it's divided correctly
+		(the quotient of -2^127 / -1 is -2^127 as in Int::Div())
+	*/
+	void DivSigned(const uint * value, uint * quotient, uint * rest) const
+	{
+	uint value_sign_mask = uint(sint(value[1]) >> (TTMATH_BITS_PER_UINT - 1));
+	uint abs_value[2] = { value[0], value[1] };
+
+		NegateIf(abs_value, value_sign_mask);
+
+		if( abs_divider.divisor.table[1] == 0 )
+			abs_divider.DivByOneWord(abs_value, quotient, rest);
+		else
+			abs_divider.DivByTwoWords(abs_value, quotient, rest);
+
+		NegateIf(quotient, value_sign_mask ^ divisor_sign_mask);
+		NegateIf(rest, value_sign_mask);
+	}
+};
+
+#endif
+
+
+} //namespace
+
+#endif
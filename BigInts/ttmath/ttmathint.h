@@ -1179,6 +1179,56 @@ public:
 	}
 
 
+	/*!
+		this method converts the value to the nearest double (ties to even)
+
+		look at the description in UInt<>::ToDouble()
+	*/
+	double ToDouble() const
+	{
+		if( !IsSign() )
+			return UInt<value_size>::ToDouble();
+
+		Int<value_size> temp(*this);
+		temp.ChangeSign();
+		// the smallest value is not changed but read as an unsigned value it's its own magnitude
+
+	return -temp.UInt<value_size>::ToDouble();
+	}
+
+
+	/*!
+		this method converts a double to this class, the fraction is cut off
+		(the same as Big<>::ToInt() does)
+
+		if the value is NaN, infinity or too big to store it in this class
+		the result is zero and the method returns a carry (1)
+	*/
+	uint FromDouble(double value)
+	{
+		bool is_sign = value < 0.0;
+
+		if( UInt<value_size>::FromDouble(is_sign ? -value : value) )
+			return 1;
+
+		if( UInt<value_size>::IsTheHighestBitSet() )
+		{
+			if( is_sign && UInt<value_size>::IsOnlyTheHighestBitSet() )
+				// the smallest value, it's already correct
+				return 0;
+
+			UInt<value_size>::SetZero();
+
+		return 1;
+		}
+
+		if( is_sign )
+			ChangeSign();
+
+	return 0;
+	}
+
+
 #ifdef TTMATH_PLATFORM32
 
 	/*!
@@ -1371,6 +1421,24 @@ public:
 #endif
 
 
+	/*!
+		this method converts the value to a decimal string in a caller's buffer
+		(look at the description in UInt<>::ToDecimalString())
+	*/
+	size_t ToDecimalString(char * buffer, size_t buffer_size) const
+	{
+		if( IsSign() )
+		{
+			Int<value_size> temp(*this);
+			temp.Abs();
+
+		return temp.UInt<value_size>::ToDecimalString(buffer, buffer_size, true);
+		}
+
+	return UInt<value_size>::ToDecimalString(buffer, buffer_size, false);
+	}
+
+
 
 private:
 
@@ -1455,6 +1523,16 @@ public:
 	}
 
 
+	/*!
+		this method converts a decimal string into its value, it's the same as FromString(s, 10, ...)
+		(look at the description in UInt<>::FromDecimalString())
+	*/
+	uint FromDecimalString(const char * s, const char ** after_source = 0, bool * value_read = 0)
+	{
+		return FromStringBase(s, 10, after_source, value_read);
+	}
+
+
 	/*!
 		this method converts a string into its value
 	*/
@@ -1917,6 +1995,131 @@ public:
 
 };
 
+
+
+#ifdef TTMATH_INT128
+
+/*!
+	specialization of Int<2> methods using the native signed 128 bit integer type
+	(look at ttmathuint_int128.h for the unsigned part)
+
+	the carry means the same as in the generic methods: the result was too big
+	or too small to be held in a signed 128 bit value (an overflow)
+*/
+
+
+/*!
+	this = this + ss2
+
+	look at the description in Int<>::Add()
+*/
+template<>
+inline uint Int<2>::Add(const Int<2> & ss2)
+{
+sint128 r;
+
+	uint c = __builtin_add_overflow(SInt128FromTable(UInt<2>::table), SInt128FromTable(ss2.table), &r) ? 1 : 0;
+	SInt128ToTable(r, UInt<2>::table);
+
+	TTMATH_LOGC("Int::Add", c)
+
+return c;
+}
+
+
+/*!
+	this = this - ss2
+
+	look at the description in Int<>::Sub()
+*/
+template<>
+inline uint Int<2>::Sub(const Int<2> & ss2)
+{
+sint128 r;
+
+	uint c = __builtin_sub_overflow(SInt128FromTable(UInt<2>::table), SInt128FromTable(ss2.table), &r) ? 1 : 0;
+	SInt128ToTable(r, UInt<2>::table);
+
+	TTMATH_LOGC("Int::Sub", c)
+
+return c;
+}
+
+
+/*!
+	we change the sign of the value
+
+	look at the description in Int<>::ChangeSign()
+*/
+template<>
+inline uint Int<2>::ChangeSign()
+{
+	if( UInt<2>::IsOnlyTheHighestBitSet() )
+		return 1;
+
+	UInt128ToTable(uint128(0) - UInt128FromTable(UInt<2>::table), UInt<2>::table);
+
+return 0;
+}
+
+
+template<>
+inline bool Int<2>::operator<(const Int<2> & l) const
+{
+	return SInt128FromTable(UInt<2>::table) < SInt128FromTable(l.table);
+}
+
+
+template<>
+inline bool Int<2>::operator>(const Int<2> & l) const
+{
+	return SInt128FromTable(UInt<2>::table) > SInt128FromTable(l.table);
+}
+
+
+template<>
+inline bool Int<2>::operator<=(const Int<2> & l) const
+{
+	return SInt128FromTable(UInt<2>::table) <= SInt128FromTable(l.table);
+}
+
+
+template<>
+inline bool Int<2>::operator>=(const Int<2> & l) const
+{
+	return SInt128FromTable(UInt<2>::table) >= SInt128FromTable(l.table);
+}
+
+#endif //ifdef TTMATH_INT128
+
+
+
+#ifdef TTMATH_PLATFORM64
+
+/*!
+	the magnitude is taken without a branch: (value ^ mask) - mask
+	where mask is all ones for negative values
+
+	look at the description in UInt<>::ToDouble()
+*/
+template<>
+inline double Int<2>::ToDouble() const
+{
+	uint mask = uint(sint(UInt<2>::table[1]) >> (TTMATH_BITS_PER_UINT - 1));
+	UInt<2> magnitude;
+
+	magnitude.table[0] = (UInt<2>::table[0] ^ mask) - mask;
+	magnitude.table[1] = (UInt<2>::table[1] ^ mask) + ((magnitude.table[0] == 0) ? (mask & 1) : 0);
+	// the smallest value stays the same and read as an unsigned value it's its own magnitude
+
+	double result = magnitude.ToDouble();
+
+return (mask != 0) ? -result : result;
+}
+
+#endif //ifdef TTMATH_PLATFORM64
+
+
 } // namespace
 
 #endif
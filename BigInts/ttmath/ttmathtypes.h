@@ -143,6 +143,41 @@
 #endif
 
 
+/*!
+	you can replace the asm (or the pure C++ version) on 64 bit platforms with
+	compiler intrinsics by defining TTMATH_INTRINSICS macro (look at ttmathuint_intrinsics.h):
+	  _addcarry_u64/_subborrow_u64 on amd64 (Microsoft Visual and GCC/CLANG)
+	  __builtin_add_overflow/__builtin_sub_overflow on other GCC/CLANG platforms
+
+	the intrinsics version is built on the pure C++ version (TTMATH_NOASM is defined too)
+	and only the operations on single words are replaced, so the compiler sees the whole
+	loop and can keep the carry in the flags register; no .asm file is needed with
+	Microsoft Visual
+
+	on 32 bit platforms and with other compilers the macro is ignored
+*/
+#ifdef TTMATH_INTRINSICS
+
+	#if !defined TTMATH_PLATFORM64 || !((defined _MSC_VER && defined _M_X64) || (defined __GNUC__ && (__GNUC__ >= 5 || defined __clang__)))
+		#undef TTMATH_INTRINSICS
+	#elif !defined TTMATH_NOASM
+		#define TTMATH_NOASM
+	#endif
+
+#endif
+
+
+/*!
+	on amd64 UInt::FromDecimalString() checks 16 characters at once with SSE2
+	(every amd64 processor has it)
+
+	it's not used together with TTMATH_NOASM (but it is with TTMATH_INTRINSICS)
+*/
+#if (!defined TTMATH_NOASM || defined TTMATH_INTRINSICS) && (defined __x86_64__ || defined _M_X64)
+	#define TTMATH_DECIMAL_SSE2
+#endif
+
+
 namespace ttmath
 {
 
@@ -200,6 +235,13 @@ namespace ttmath
 	*/
 	#define TTMATH_BITS(min_bits) ((min_bits-1)/32 + 1)
 
+	/*!
+		the biggest power of ten which fits in one word (10^9) and its number of zeros,
+		decimal strings are converted in chunks of this many digits
+	*/
+	#define TTMATH_DECIMAL_CHUNK 1000000000u
+	#define TTMATH_DECIMAL_CHUNK_DIGITS 9u
+
 #else
 
 	/*!
@@ -248,7 +290,39 @@ namespace ttmath
 	*/
 	#define TTMATH_BITS(min_bits) ((min_bits-1)/64 + 1)
 
+	/*!
+		the biggest power of ten which fits in one word (10^19) and its number of zeros,
+		decimal strings are converted in chunks of this many digits
+	*/
+	#define TTMATH_DECIMAL_CHUNK 10000000000000000000ul
+	#define TTMATH_DECIMAL_CHUNK_DIGITS 19u
+
+
+	/*!
+		GCC and CLANG on amd64 have a native 128 bit integer type
+		UInt<2> and Int<2> are then specialized to use it (look at ttmathuint_int128.h)
+
+		you can turn it off by defining TTMATH_NOINT128 macro
+	*/
+	#if defined(__GNUC__) && defined(__SIZEOF_INT128__) && !defined(TTMATH_NOINT128)
+
+		#define TTMATH_INT128
+
+		__extension__ typedef unsigned __int128 uint128;
+		__extension__ typedef signed   __int128 sint128;
+
+	#endif
+
 #endif
+
+
+/*!
+	the size of a buffer which is always big enough for UInt<value_size>::ToDecimalString()
+	and Int<value_size>::ToDecimalString(): all the digits (log10(2) < 0.30103),
+	a hyphen and the terminating zero, e.g. 41 for 128 bit values
+*/
+#define TTMATH_DECIMAL_STRING_SIZE(value_size) ((value_size) * TTMATH_BITS_PER_UINT * 30103 / 100000 + 3)
+
 }
 
 
@@ -323,6 +397,8 @@ namespace ttmath
 		  asm_gcc_64  - with asm for GCC (64 bit)
 		  no_asm_32   - pure C++ version (32 bit) - without any asm code
 		  no_asm_64   - pure C++ version (64 bit) - without any asm code
+		  intrinsics_vc_64  - with compiler intrinsics for VC (64 bit)
+		  intrinsics_gcc_64 - with compiler intrinsics for GCC/CLANG (64 bit)
 	*/
 	enum LibTypeCode
 	{
@@ -331,7 +407,9 @@ namespace ttmath
 	  asm_vc_64,
 	  asm_gcc_64,
 	  no_asm_32,
-	  no_asm_64
+	  no_asm_64,
+	  intrinsics_vc_64,
+	  intrinsics_gcc_64
 	};
 
 
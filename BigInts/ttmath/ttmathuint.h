@@ -53,6 +53,12 @@
 #include "ttmathtypes.h"
 #include "ttmathmisc.h"
 
+#include <cstring>
+
+#ifdef TTMATH_DECIMAL_SSE2
+	#include <emmintrin.h>
+#endif
+
 
 
 /*!
@@ -3127,6 +3133,208 @@ public:
 	}
 
 
+	/*!
+		this method converts the value to the nearest double (ties to even)
+
+		the value doesn't go through Big<> or a string: the 64 bits from the leading
+		bit downwards are gathered into one word, all lower bits are folded into the
+		lowest bit of that word (it lies far below the 53 bits of a double's mantissa
+		so it can only decide a tie) and the hardware conversion does the rounding
+
+		if the value is too big for a double the result is infinity
+	*/
+	double ToDouble() const
+	{
+	#ifdef TTMATH_PLATFORM64
+
+		uint table_id, index;
+
+		if( !FindLeadingBit(table_id, index) )
+			return 0.0;
+
+		if( table_id == 0 )
+			return double(table[0]);
+
+		uint lower = table[table_id-1];
+		uint top   = (table[table_id] << (TTMATH_BITS_PER_UINT - 1 - index)) | ((lower >> 1) >> index);
+		uint rest  = lower << (TTMATH_BITS_PER_UINT - 1 - index);
+
+		for(uint i=0 ; i<table_id-1 ; ++i)
+			rest |= table[i];
+
+		if( rest != 0 )
+			top |= 1;
+
+		// the lowest bit of 'top' has the weight 2^((table_id-1)*64 + index + 1)
+	return ToDouble_Mul2Exp(double(top), sint((table_id-1) * TTMATH_BITS_PER_UINT + index + 1));
+
+	#else
+
+		if( value_size == 1 )
+			return double(table[0]);
+
+		UInt<value_size> temp(*this);
+
+		if( temp.IsZero() )
+			return 0.0;
+
+		uint moved = temp.CompensationToLeft();
+		ulint top  = (ulint(temp.table[value_size-1]) << TTMATH_BITS_PER_UINT) | temp.table[sint(value_size)-2];
+		// using casting into sint to get rid of a warning when value_size is 1
+
+		for(uint i=0 ; i+2<value_size ; ++i)
+			if( temp.table[i] != 0 )
+			{
+				top |= 1;
+				break;
+			}
+
+	return ToDouble_Mul2Exp(double(top), sint(value_size * TTMATH_BITS_PER_UINT) - sint(moved) - 64);
+
+	#endif
+	}
+
+
+	/*!
+		this method converts a double to this class, the fraction is cut off
+		(the same as Big<>::ToUInt() does)
+
+		if the value is negative (except -0.0), NaN, infinity or too big to store
+		it in this class the result is zero and the method returns a carry (1)
+	*/
+	uint FromDouble(double value)
+	{
+		SetZero();
+
+	#ifdef TTMATH_PLATFORM64
+
+		union 
+		{
+			double d;
+			uint u; // 64bit word
+		} temp;
+
+		temp.d = value;
+
+		uint e = (temp.u >> 52) & 0x7FFul;
+		uint m = (temp.u & 0xFFFFFFFFFFFFFul) | 0x10000000000000ul;
+		bool is_sign = (temp.u & 0x8000000000000000ul) != 0;
+
+	#else
+
+		union 
+		{
+			double d;
+			uint u[2]; // two 32bit words
+		} temp;
+
+		temp.d = value;
+
+		uint e = (temp.u[1] >> 20) & 0x7FFu;
+		ulint m = (ulint(temp.u[1] & 0xFFFFFu) << 32) | temp.u[0] | (ulint(1) << 52);
+		bool is_sign = (temp.u[1] & 0x80000000u) != 0;
+
+	#endif
+
+		if( e == 2047 || (is_sign && value != 0.0) )
+		{
+			TTMATH_LOGC("UInt::FromDouble", 1)
+			return 1;
+		}
+
+		if( e < 1023 )
+		{
+			// value < 1 (zero and denormalized values too)
+			TTMATH_LOG("UInt::FromDouble")
+			return 0;
+		}
+
+		if( e < 1075 )
+		{
+			// there is a fraction
+			FromUInt(m >> (1075 - e));
+			TTMATH_LOG("UInt::FromDouble")
+			return 0;
+		}
+
+		uint move = e - 1075;
+
+		if( move + 53 > value_size * TTMATH_BITS_PER_UINT )
+		{
+			TTMATH_LOGC("UInt::FromDouble", 1)
+			return 1;
+		}
+
+	#ifdef TTMATH_PLATFORM64
+
+		uint index = move / TTMATH_BITS_PER_UINT;
+		uint bits  = move % TTMATH_BITS_PER_UINT;
+
+		table[index] = m << bits;
+
+		if( index + 1 < value_size )
+			table[index+1] = (m >> 1) >> (TTMATH_BITS_PER_UINT - 1 - bits);
+
+	#else
+
+		FromUInt(m);
+		Rcl(move);
+
+	#endif
+
+		TTMATH_LOG("UInt::FromDouble")
+
+	return 0;
+	}
+
+
+private:
+
+	/*!
+		an auxiliary method for ToDouble(): returns value * 2^exponent
+
+		exponent should be greater than -1023 (the result is not denormalized),
+		too big exponents give infinity
+	*/
+	static double ToDouble_Mul2Exp(double value, sint exponent)
+	{
+		if( exponent > 1023 )
+		{
+			// 'value' is at least one so the result is infinity
+			value    *= 2.0;
+			exponent  = 1023;
+		}
+
+	#ifdef TTMATH_PLATFORM64
+
+		union 
+		{
+			double d;
+			uint u; // 64bit word
+		} temp;
+
+		temp.u = uint(exponent + 1023) << 52;
+
+	#else
+
+		union 
+		{
+			double d;
+			uint u[2]; // two 32bit words
+		} temp;
+
+		temp.u[0] = 0;
+		temp.u[1] = uint(exponent + 1023) << 20;
+
+	#endif
+
+	return value * temp.d;
+	}
+
+
+public:
+
+
 #ifdef TTMATH_PLATFORM32
 
 	/*!
@@ -3301,6 +3509,15 @@ public:
 		if( b<2 || b>16 )
 			return;
 
+		if( b == 10 )
+		{
+			char buffer[TTMATH_DECIMAL_STRING_SIZE(value_size)];
+			size_t length = ToDecimalString(buffer, sizeof(buffer), negative);
+			result.assign(buffer, buffer + length);
+
+			return;
+		}
+
 		if( !FindLeadingBit(table_id, index) )
 		{
 			result = '0';
@@ -3449,6 +3666,9 @@ public:
 	*/
 	uint FromString(const char * s, uint b = 10, const char ** after_source = 0, bool * value_read = 0)
 	{
+		if( b == 10 )
+			return FromDecimalString(s, after_source, value_read);
+
 		return FromStringBase(s, b, after_source, value_read);
 	}
 
@@ -3533,6 +3753,245 @@ public:
 #endif
 
 
+
+
+private:
+
+	/*!
+		an auxiliary method for the decimal conversions
+		it returns 10^digits, digits is in <0;TTMATH_DECIMAL_CHUNK_DIGITS>
+	*/
+	static uint DecimalPower(uint digits)
+	{
+		static const uint power_tab[] = {
+			1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u
+	#ifdef TTMATH_PLATFORM64
+			, 10000000000ul, 100000000000ul, 1000000000000ul, 10000000000000ul,
+			100000000000000ul, 1000000000000000ul, 10000000000000000ul, 100000000000000000ul,
+			1000000000000000000ul, 10000000000000000000ul
+	#endif
+		};
+
+	return power_tab[digits];
+	}
+
+
+	/*!
+		an auxiliary method for converting to a decimal string
+		it writes the digits of x backwards, finishing just before 'end',
+		with leading zeros to at least 'min_digits' digits,
+		and returns a pointer to the first digit
+	*/
+	static char * WordToDecimalString(uint x, char * end, uint min_digits)
+	{
+	static const char digit_pairs[] =
+		"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+		"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+		"8081828384858687888990919293949596979899";
+	char * begin = end - min_digits;
+	uint pair;
+
+		while( x >= 100 )
+		{
+			pair = (x % 100) * 2;
+			x   /= 100;
+			*--end = digit_pairs[pair + 1];
+			*--end = digit_pairs[pair];
+		}
+
+		if( x >= 10 )
+		{
+			pair = x * 2;
+			*--end = digit_pairs[pair + 1];
+			*--end = digit_pairs[pair];
+		}
+		else
+		{
+			*--end = static_cast<char>('0' + x);
+		}
+
+		while( end > begin )
+			*--end = '0';
+
+	return end;
+	}
+
+
+	/*!
+		an auxiliary method for converting from a decimal string
+		it returns how many decimal digits there are at the beginning of s
+		(but not more than max_digits)
+
+		with SSE2 16 characters are checked at once, the load can read past the end
+		of the string but it never crosses a page boundary so it cannot fault
+	*/
+	static uint DecimalDigitsCount(const char * s, uint max_digits)
+	{
+	uint count = 0;
+
+	#ifdef TTMATH_DECIMAL_SSE2
+
+		if( (reinterpret_cast<size_t>(s) & 4095) <= 4096 - 16 )
+		{
+			// c - '0' is in <0;9> only for digits (other characters wrap round to bigger bytes)
+			__m128i x = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s)), _mm_set1_epi8('0'));
+			__m128i digits = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(9)), x);
+			uint others = uint(~_mm_movemask_epi8(digits)) & 0xffff;
+
+			if( others != 0 )
+			{
+				count = uint(FindLowestBitInWord(others));
+
+			return (count < max_digits) ? count : max_digits;
+			}
+
+			count = 16;
+		}
+
+	#endif
+
+		while( count < max_digits && s[count] >= '0' && s[count] <= '9' )
+			++count;
+
+	return (count < max_digits) ? count : max_digits;
+	}
+
+
+	/*!
+		an auxiliary method for converting from a decimal string
+		it returns the value of 'digits' decimal digits (they have been checked already)
+
+		on amd64 eight digits are converted at once in a 64 bit register
+	*/
+	static uint DecimalStringToWord(const char * s, uint digits)
+	{
+	uint result = 0;
+
+	#ifdef TTMATH_DECIMAL_SSE2
+
+		for( ; digits >= 8 ; digits -= 8, s += 8 )
+		{
+		uint eight;
+
+			std::memcpy(&eight, s, 8);
+			eight -= 0x3030303030303030ul;
+			eight  = (eight * 10) + (eight >> 8);
+			eight  = (((eight & 0x000000ff000000fful) * 0x000f424000000064ul) +			// 100 + 1000000 * 2^32
+					 (((eight >> 16) & 0x000000ff000000fful) * 0x0000271000000001ul)) >> 32;	// 1 + 10000 * 2^32
+
+			result = result * 100000000u + eight;
+		}
+
+	#endif
+
+		for( ; digits > 0 ; --digits, ++s )
+			result = result * 10 + uint(*s - '0');
+
+	return result;
+	}
+
+
+public:
+
+
+	/*!
+		this method converts the value to a decimal string in a caller's buffer
+		(no memory is allocated)
+
+		the value is divided by TTMATH_DECIMAL_CHUNK (10^19 on 64bit platforms) so there
+		is only one division per 19 digits instead of one per digit as in ToString()
+
+		buffer_size includes the terminating zero, TTMATH_DECIMAL_STRING_SIZE(value_size)
+		is always enough; it returns the length of the string, or 0 if the buffer is too small
+		(an empty string is written then)
+
+		if negative is true a hyphen is put in front (used by Int::ToDecimalString())
+	*/
+	size_t ToDecimalString(char * buffer, size_t buffer_size, bool negative = false) const
+	{
+	char digits[TTMATH_DECIMAL_STRING_SIZE(value_size)];
+	char * end = digits + sizeof(digits);
+	char * first;
+	UInt<value_size> temp(*this);
+	uint chunk, i;
+
+		for( ; ; )
+		{
+			for(i=1 ; i<value_size && temp.table[i]==0 ; ++i);
+
+			if( i == value_size )
+				break;
+
+			// the lower chunks have all their digits
+			temp.DivInt(TTMATH_DECIMAL_CHUNK, &chunk);
+			end = WordToDecimalString(chunk, end, TTMATH_DECIMAL_CHUNK_DIGITS);
+		}
+
+		first = WordToDecimalString(temp.table[0], end, 0);
+
+		if( negative )
+			*--first = '-';
+
+		size_t length = (digits + sizeof(digits)) - first;
+
+		if( length >= buffer_size )
+		{
+			if( buffer_size > 0 )
+				buffer[0] = 0;
+
+		return 0;
+		}
+
+		std::memcpy(buffer, first, length);
+		buffer[length] = 0;
+
+	return length;
+	}
+
+
+	/*!
+		this method converts a decimal string into its value, it's the same as FromString(s, 10, ...)
+		(FromString() uses it with base 10)
+
+		up to TTMATH_DECIMAL_CHUNK_DIGITS digits are converted into one word at a time
+		and then the value is multiplied by 10^digits and the word is added
+
+		it returns carry=1 if the value is too big (the rest digits are skipped then)
+	*/
+	uint FromDecimalString(const char * s, const char ** after_source = 0, bool * value_read = 0)
+	{
+	uint c = 0;
+	uint digits;
+
+		SetZero();
+		Misc::SkipWhiteCharacters(s);
+
+		if( value_read )
+			*value_read = false;
+
+		for( ; (digits = DecimalDigitsCount(s, TTMATH_DECIMAL_CHUNK_DIGITS)) != 0 ; s += digits )
+		{
+			if( value_read )
+				*value_read = true;
+
+			if( c == 0 )
+			{
+				uint chunk = DecimalStringToWord(s, digits);
+
+				c += MulInt(DecimalPower(digits));
+				c += AddInt(chunk);
+			}
+		}
+
+		if( after_source )
+			*after_source = s;
+
+		TTMATH_LOGC("UInt::FromDecimalString", c)
+
+	return (c==0)? 0 : 1;
+	}
+
+
 	/*!
 	*
 	*	methods for comparing
@@ -4155,11 +4614,41 @@ public:
 };
 
 
+#ifdef TTMATH_PLATFORM64
+
+/*!
+	UInt<2> is used for 128 bit coordinates and is converted to double very often,
+	the leading bit is found directly in the higher word
+
+	look at the description in UInt<>::ToDouble()
+*/
+template<>
+inline double UInt<2>::ToDouble() const
+{
+	if( table[1] == 0 )
+		return double(table[0]);
+
+	uint move = TTMATH_BITS_PER_UINT - 1 - uint(FindLeadingBitInWord(table[1]));
+	uint top  = (table[1] << move) | ((table[0] >> 1) >> (TTMATH_BITS_PER_UINT - 1 - move));
+	uint rest = table[0] << move;
+
+	// 'top' has its highest bit set, shifting it by one lets the faster signed conversion
+	// be used (the lowest bit is still far below the double's mantissa)
+	top = (top >> 1) | (top & 1) | ((rest != 0) ? 1 : 0);
+
+return ToDouble_Mul2Exp(double(sint(top)), sint(TTMATH_BITS_PER_UINT + 1 - move));
+}
+
+#endif
+
+
 } //namespace
 
 
 #include "ttmathuint_x86.h"
 #include "ttmathuint_x86_64.h"
 #include "ttmathuint_noasm.h"
+#include "ttmathuint_intrinsics.h"
+#include "ttmathuint_int128.h"
 
 #endif
@@ -0,0 +1,519 @@
+/*
+ * This file is a part of TTMath Bignum Library
+ * and is distributed under the (new) BSD licence.
+ */
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef headerfilettmathuint_int128
+#define headerfilettmathuint_int128
+
+
+#ifdef TTMATH_INT128
+
+/*!
+	\file ttmathuint_int128.h
+    \brief specialization of UInt<2> methods using the native 128 bit integer type
+
+	this file is included at the end of ttmathuint.h
+
+	UInt<2> is exactly 128 bits on a 64bit platform, this is what Armand uses for
+	universal coordinates (millimetres). The generic methods loop over the table
+	(or go through asm blocks which the compiler can't see through), here we load
+	both words into an unsigned __int128 and let the compiler emit add/adc, sub/sbb
+	and mul directly. The layout of the table is not changed (table[0] is the lower word)
+	so all other methods keep working.
+
+	the semantics (carries, remainders, what happens on division by zero) are
+	the same as in the generic methods
+*/
+
+
+namespace ttmath
+{
+
+	/*!
+		reading a 128 bit value from a table of two words
+		(table[0] - lower word, table[1] - higher word)
+	*/
+	inline uint128 UInt128FromTable(const uint * table)
+	{
+		return (uint128(table[1]) << TTMATH_BITS_PER_UINT) | table[0];
+	}
+
+
+	/*!
+		writing a 128 bit value into a table of two words
+	*/
+	inline void UInt128ToTable(uint128 value, uint * table)
+	{
+		table[0] = uint(value);
+		table[1] = uint(value >> TTMATH_BITS_PER_UINT);
+	}
+
+
+	/*!
+		reading a signed 128 bit value from a table of two words
+	*/
+	inline sint128 SInt128FromTable(const uint * table)
+	{
+		return sint128(UInt128FromTable(table));
+	}
+
+
+	/*!
+		writing a signed 128 bit value into a table of two words
+	*/
+	inline void SInt128ToTable(sint128 value, uint * table)
+	{
+		UInt128ToTable(uint128(value), table);
+	}
+
+
+
+	/*!
+	*
+	*	basic mathematic functions
+	*
+	*/
+
+
+	/*!
+		this = this + ss2 + c
+
+		c must be zero or one (might be a bigger value than 1)
+		function returns carry (1) (if it was)
+	*/
+	template<>
+	inline uint UInt<2>::Add(const UInt<2> & ss2, uint c)
+	{
+	uint128 a = UInt128FromTable(table);
+	uint128 b = UInt128FromTable(ss2.table);
+	uint128 r;
+	uint carry;
+
+		carry  = __builtin_add_overflow(a, b, &r) ? 1 : 0;
+		carry |= __builtin_add_overflow(r, uint128(c != 0), &r) ? 1 : 0;
+		UInt128ToTable(r, table);
+
+		TTMATH_LOGC("UInt::Add", carry)
+
+	return carry;
+	}
+
+
+	/*!
+		this method adds one word (at a specific position)
+		and returns a carry (if it was)
+
+		index must be 0 or 1
+	*/
+	template<>
+	inline uint UInt<2>::AddInt(uint value, uint index)
+	{
+	uint128 r;
+
+		TTMATH_ASSERT( index < 2 )
+
+		uint c = __builtin_add_overflow(UInt128FromTable(table), uint128(value) << (index * TTMATH_BITS_PER_UINT), &r) ? 1 : 0;
+		UInt128ToTable(r, table);
+
+		TTMATH_LOGC("UInt::AddInt", c)
+
+	return c;
+	}
+
+
+	/*!
+		this method adds two words (x2 - higher, x1 - lower)
+
+		on UInt<2> index must be zero (index <= value_size-2)
+	*/
+	template<>
+	inline uint UInt<2>::AddTwoInts(uint x2, uint x1, uint index)
+	{
+	uint128 r;
+
+		TTMATH_ASSERT( index == 0 )
+		(void)index;	// only read by TTMATH_ASSERT, which may be compiled out
+
+		uint c = __builtin_add_overflow(UInt128FromTable(table), (uint128(x2) << TTMATH_BITS_PER_UINT) | x1, &r) ? 1 : 0;
+		UInt128ToTable(r, table);
+
+		TTMATH_LOGC("UInt::AddTwoInts", c)
+
+	return c;
+	}
+
+
+	/*!
+		this = this - ss2 - c
+
+		c must be zero or one (might be a bigger value than 1)
+		function returns carry (1) (if it was)
+	*/
+	template<>
+	inline uint UInt<2>::Sub(const UInt<2> & ss2, uint c)
+	{
+	uint128 a = UInt128FromTable(table);
+	uint128 b = UInt128FromTable(ss2.table);
+	uint128 r;
+	uint carry;
+
+		carry  = __builtin_sub_overflow(a, b, &r) ? 1 : 0;
+		carry |= __builtin_sub_overflow(r, uint128(c != 0), &r) ? 1 : 0;
+		UInt128ToTable(r, table);
+
+		TTMATH_LOGC("UInt::Sub", carry)
+
+	return carry;
+	}
+
+
+	/*!
+		this method subtracts one word (at a specific position)
+		and returns a carry (if it was)
+
+		index must be 0 or 1
+	*/
+	template<>
+	inline uint UInt<2>::SubInt(uint value, uint index)
+	{
+	uint128 r;
+
+		TTMATH_ASSERT( index < 2 )
+
+		uint c = __builtin_sub_overflow(UInt128FromTable(table), uint128(value) << (index * TTMATH_BITS_PER_UINT), &r) ? 1 : 0;
+		UInt128ToTable(r, table);
+
+		TTMATH_LOGC("UInt::SubInt", c)
+
+	return c;
+	}
+
+
+
+	/*!
+		moving all bits into the left side 'bits' times
+		return value <- this <- C
+
+		look at the description in UInt<>::Rcl()
+	*/
+	template<>
+	inline uint UInt<2>::Rcl(uint bits, uint c)
+	{
+	const uint all_bits = 2 * TTMATH_BITS_PER_UINT;
+	uint128 v = UInt128FromTable(table);
+	uint128 mask = c ? ~uint128(0) : uint128(0);
+	uint last_c = 0;
+
+		if( bits == 0 )
+			return 0;
+
+		if( bits >= all_bits )
+		{
+			if( bits == all_bits )
+				last_c = uint(v) & 1;
+
+			v = mask;
+		}
+		else
+		{
+			last_c = uint(v >> (all_bits - bits)) & 1;
+			v      = (v << bits) | (mask >> (all_bits - bits));
+		}
+
+		UInt128ToTable(v, table);
+
+		TTMATH_LOGC("UInt::Rcl", last_c)
+
+	return last_c;
+	}
+
+
+	/*!
+		moving all bits into the right side 'bits' times
+		c -> this -> return value
+
+		look at the description in UInt<>::Rcr()
+	*/
+	template<>
+	inline uint UInt<2>::Rcr(uint bits, uint c)
+	{
+	const uint all_bits = 2 * TTMATH_BITS_PER_UINT;
+	uint128 v = UInt128FromTable(table);
+	uint128 mask = c ? ~uint128(0) : uint128(0);
+	uint last_c = 0;
+
+		if( bits == 0 )
+			return 0;
+
+		if( bits >= all_bits )
+		{
+			if( bits == all_bits )
+				last_c = uint(v >> (all_bits - 1));
+
+			v = mask;
+		}
+		else
+		{
+			last_c = uint(v >> (bits - 1)) & 1;
+			v      = (v >> bits) | (mask << (all_bits - bits));
+		}
+
+		UInt128ToTable(v, table);
+
+		TTMATH_LOGC("UInt::Rcr", last_c)
+
+	return last_c;
+	}
+
+
+
+	/*!
+	 *
+	 * Multiplication
+	 *
+	 *
+	*/
+
+
+	/*!
+		multiplication: this = this * ss2
+
+		it can return a carry
+	*/
+	template<>
+	inline uint UInt<2>::MulInt(uint ss2)
+	{
+	uint128 low  = uint128(table[0]) * ss2;
+	uint128 high = uint128(table[1]) * ss2 + (low >> TTMATH_BITS_PER_UINT);
+
+		table[0] = uint(low);
+		table[1] = uint(high);
+
+		uint c = (high >> TTMATH_BITS_PER_UINT) != 0 ? 1 : 0;
+
+		TTMATH_LOGC("UInt::MulInt(uint)", c)
+
+	return c;
+	}
+
+
+	/*!
+		the multiplication 'this' = 'this' * ss2
+
+		algorithm: 100 - means automatically choose the fastest algorithm
+		(the native multiplication in this case)
+		the other algorithms are available for comparison
+	*/
+	template<>
+	inline uint UInt<2>::Mul(const UInt<2> & ss2, uint algorithm)
+	{
+		switch( algorithm )
+		{
+		case 1:
+			return Mul1(ss2);
+
+		case 2:
+			return Mul2(ss2);
+
+		case 3:
+			return Mul3(ss2);
+
+		case 100:
+		default:
+			break;
+		}
+
+	uint a0 = table[0], a1 = table[1];
+	uint b0 = ss2.table[0], b1 = ss2.table[1];
+
+		/*
+			(a1*2^64 + a0) * (b1*2^64 + b0) = a1*b1*2^128 + (a0*b1 + a1*b0)*2^64 + a0*b0
+
+			if both a1 and b1 are different from zero there is a carry for sure
+			and then the cross product can overflow too, but its lower word is
+			still correct (which is all we need for the lower 128 bits)
+		*/
+		uint128 low   = uint128(a0) * b0;
+		uint128 cross = uint128(a0) * b1 + uint128(a1) * b0 + (low >> TTMATH_BITS_PER_UINT);
+
+		table[0] = uint(low);
+		table[1] = uint(cross);
+
+		uint c = ((a1 != 0 && b1 != 0) || (cross >> TTMATH_BITS_PER_UINT) != 0) ? 1 : 0;
+
+		TTMATH_LOGC("UInt::Mul", c)
+
+	return c;
+	}
+
+
+
+	/*!
+	 *
+	 * Division
+	 *
+	 *
+	*/
+
+
+	/*!
+		division by one unsigned word
+
+		returns 1 when divisor is zero
+	*/
+	template<>
+	inline uint UInt<2>::DivInt(uint divisor, uint * remainder)
+	{
+		if( divisor == 0 )
+		{
+			if( remainder )
+				*remainder = 0;
+
+			TTMATH_LOG("UInt::DivInt")
+
+		return 1;
+		}
+
+		uint128 v = UInt128FromTable(table);
+
+		if( remainder )
+			*remainder = uint(v % divisor);
+
+		UInt128ToTable(v / divisor, table);
+
+		TTMATH_LOG("UInt::DivInt")
+
+	return 0;
+	}
+
+
+	/*!
+		division this = this / ss2
+
+		return values:
+			 0 - ok
+			 1 - division by zero
+			'this' will be the quotient
+			'remainder' - remainder
+
+		algorithm 3 (default) uses the native division,
+		algorithms 1 and 2 are available for comparison
+	*/
+	template<>
+	inline uint UInt<2>::Div(const UInt<2> & divisor, UInt<2> * remainder, uint algorithm)
+	{
+		switch( algorithm )
+		{
+		case 1:
+			return Div1(divisor, remainder);
+
+		case 2:
+			return Div2(divisor, remainder);
+
+		case 3:
+		default:
+			break;
+		}
+
+	uint128 d = UInt128FromTable(divisor.table);
+
+		if( d == 0 )
+		{
+			TTMATH_LOG("UInt::Div")
+			return 1;
+		}
+
+		uint128 v = UInt128FromTable(table);
+
+		if( remainder )
+			UInt128ToTable(v % d, remainder->table);
+
+		UInt128ToTable(v / d, table);
+
+		TTMATH_LOG("UInt::Div")
+
+	return 0;
+	}
+
+
+
+	/*!
+	*
+	*	operators for comparising
+	*
+	*/
+
+
+	template<>
+	inline bool UInt<2>::operator<(const UInt<2> & l) const
+	{
+		return UInt128FromTable(table) < UInt128FromTable(l.table);
+	}
+
+
+	template<>
+	inline bool UInt<2>::operator>(const UInt<2> & l) const
+	{
+		return UInt128FromTable(table) > UInt128FromTable(l.table);
+	}
+
+
+	template<>
+	inline bool UInt<2>::operator==(const UInt<2> & l) const
+	{
+		return UInt128FromTable(table) == UInt128FromTable(l.table);
+	}
+
+
+	template<>
+	inline bool UInt<2>::operator!=(const UInt<2> & l) const
+	{
+		return UInt128FromTable(table) != UInt128FromTable(l.table);
+	}
+
+
+	template<>
+	inline bool UInt<2>::operator<=(const UInt<2> & l) const
+	{
+		return UInt128FromTable(table) <= UInt128FromTable(l.table);
+	}
+
+
+	template<>
+	inline bool UInt<2>::operator>=(const UInt<2> & l) const
+	{
+		return UInt128FromTable(table) >= UInt128FromTable(l.table);
+	}
+
+
+} //namespace
+
+
+#endif //ifdef TTMATH_INT128
+#endif
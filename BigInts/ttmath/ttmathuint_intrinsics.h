@@ -0,0 +1,299 @@
+/*
+ * This file is a part of TTMath Bignum Library
+ * and is distributed under the (new) BSD licence.
+ */
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef headerfilettmathuint_intrinsics
+#define headerfilettmathuint_intrinsics
+
+
+#ifdef TTMATH_INTRINSICS
+
+/*!
+	\file ttmathuint_intrinsics.h
+    \brief template class UInt<uint> with methods using compiler intrinsics
+
+	this file is included at the end of ttmathuint.h
+
+	the intrinsics version is the pure C++ version (ttmathuint_noasm.h) where the
+	operations on single words are written with compiler intrinsics:
+	  carries   - _addcarry_u64/_subborrow_u64 on amd64, __builtin_add_overflow and
+	              __builtin_sub_overflow with GCC/CLANG on other platforms
+	  mul       - _mulx_u64 (when compiling for BMI2), _umul128 (Microsoft Visual),
+	              the native 128 bit integer type (GCC/CLANG)
+	  div       - _udiv128 (Microsoft Visual 2019), the native 128 bit integer type
+	              (GCC/CLANG), otherwise the pure C++ algorithm
+	  bit scans - _BitScanReverse64/_BitScanForward64, __builtin_clzll/__builtin_ctzll
+
+	unlike the asm blocks the intrinsics are visible to the optimizer, so the loops in
+	Add(), Sub(), AddVector() etc. become add/adc (sub/sbb) chains which are inlined,
+	unrolled for small tables and scheduled together with the surrounding code
+
+	define TTMATH_INTRINSICS macro to use it (look at ttmathtypes.h)
+*/
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#elif defined __x86_64__
+	#include <x86intrin.h>
+#endif
+
+
+namespace ttmath
+{
+
+	/*!
+		returning the string represents the currect type of the library
+		we have following types:
+		  intrinsics_vc_64  - with compiler intrinsics for Microsoft Visual C++ (64 bit)
+		  intrinsics_gcc_64 - with compiler intrinsics for GCC/CLANG (64 bit)
+	*/
+	template<uint value_size>
+	const char * UInt<value_size>::LibTypeStr()
+	{
+		#ifdef _MSC_VER
+			static const char info[] = "intrinsics_vc_64";
+		#else
+			static const char info[] = "intrinsics_gcc_64";
+		#endif
+
+	return info;
+	}
+
+
+	/*!
+		returning the currect type of the library
+	*/
+	template<uint value_size>
+	LibTypeCode UInt<value_size>::LibType()
+	{
+		#ifdef _MSC_VER
+			LibTypeCode info = intrinsics_vc_64;
+		#else
+			LibTypeCode info = intrinsics_gcc_64;
+		#endif
+
+	return info;
+	}
+
+
+	/*!
+		this method adds two words together
+		returns carry
+
+		carry can be any value (not only zero or one), a value other than zero is treated as one
+	*/
+	template<uint value_size>
+	inline uint UInt<value_size>::AddTwoWords(uint a, uint b, uint carry, uint * result)
+	{
+	#if defined _MSC_VER
+
+		return _addcarry_u64(carry != 0 ? 1 : 0, a, b, result);
+
+	#elif defined __x86_64__
+
+		unsigned long long temp;
+		uint c = _addcarry_u64(carry != 0 ? 1 : 0, a, b, &temp);
+		*result = temp;
+
+	return c;
+
+	#else
+
+		uint temp;
+		uint c1 = __builtin_add_overflow(a, b, &temp);
+		uint c2 = __builtin_add_overflow(temp, uint(carry != 0 ? 1 : 0), result);
+
+	return c1 | c2;
+
+	#endif
+	}
+
+
+	/*!
+		this method subtractes one word from the other
+		returns carry
+
+		carry can be any value (not only zero or one), a value other than zero is treated as one
+	*/
+	template<uint value_size>
+	inline uint UInt<value_size>::SubTwoWords(uint a, uint b, uint carry, uint * result)
+	{
+	#if defined _MSC_VER
+
+		return _subborrow_u64(carry != 0 ? 1 : 0, a, b, result);
+
+	#elif defined __x86_64__
+
+		unsigned long long temp;
+		uint c = _subborrow_u64(carry != 0 ? 1 : 0, a, b, &temp);
+		*result = temp;
+
+	return c;
+
+	#else
+
+		uint temp;
+		uint c1 = __builtin_sub_overflow(a, b, &temp);
+		uint c2 = __builtin_sub_overflow(temp, uint(carry != 0 ? 1 : 0), result);
+
+	return c1 | c2;
+
+	#endif
+	}
+
+
+	/*!
+		this method returns the number of the highest set bit in x
+		if the 'x' is zero this method returns '-1'
+	*/
+	template<uint value_size>
+	inline sint UInt<value_size>::FindLeadingBitInWord(uint x)
+	{
+		if( x == 0 )
+			return -1;
+
+	#ifdef _MSC_VER
+
+		unsigned long bit;
+		_BitScanReverse64(&bit, x);
+
+	return sint(bit);
+
+	#else
+
+	return sint(TTMATH_BITS_PER_UINT - 1) - __builtin_clzll(x);
+
+	#endif
+	}
+
+
+	/*!
+		this method returns the number of the lowest set bit in x
+		if the 'x' is zero this method returns '-1'
+	*/
+	template<uint value_size>
+	inline sint UInt<value_size>::FindLowestBitInWord(uint x)
+	{
+		if( x == 0 )
+			return -1;
+
+	#ifdef _MSC_VER
+
+		unsigned long bit;
+		_BitScanForward64(&bit, x);
+
+	return sint(bit);
+
+	#else
+
+	return sint(__builtin_ctzll(x));
+
+	#endif
+	}
+
+
+	/*!
+		multiplication: result_high:result_low = a * b
+		result_high - higher word of the result
+		result_low  - lower word of the result
+
+		this methos never returns a carry
+		this method is used in the second version of the multiplication algorithms
+	*/
+	template<uint value_size>
+	inline void UInt<value_size>::MulTwoWords(uint a, uint b, uint * result_high, uint * result_low)
+	{
+	#if defined __BMI2__ && (defined _MSC_VER || defined __x86_64__)
+
+		// mulx doesn't change the flags so it can be put between adc instructions
+		unsigned long long high;
+		*result_low  = _mulx_u64(a, b, &high);
+		*result_high = high;
+
+	#elif defined _MSC_VER
+
+		*result_low = _umul128(a, b, result_high);
+
+	#else
+
+		unsigned __int128 result = (unsigned __int128)a * b;
+		*result_high = uint(result >> TTMATH_BITS_PER_UINT);
+		*result_low  = uint(result);
+
+	#endif
+	}
+
+
+	/*!
+		this method calculates 128bits word a:b / 64bits c (a higher, b lower word)
+		r = a:b / c and rest - remainder
+
+		*
+		* WARNING:
+		* the c has to be suitably large for the result being keeped in one word,
+		* if c is equal zero there'll be a hardware interruption (0)
+		* and probably the end of your program
+		*
+	*/
+	template<uint value_size>
+	inline void UInt<value_size>::DivTwoWords(uint a, uint b, uint c, uint * r, uint * rest)
+	{
+	// (a < c ) for the result to be one word
+	TTMATH_ASSERT( c != 0 && a < c )
+
+		if( a == 0 )
+		{
+			*r    = b / c;
+			*rest = b % c;
+
+			return;
+		}
+
+	#if defined _MSC_VER && _MSC_VER >= 1920
+
+		*r = _udiv128(a, b, c, rest);
+
+	#elif defined __GNUC__
+
+		unsigned __int128 ab = ((unsigned __int128)a << TTMATH_BITS_PER_UINT) | b;
+		*r    = uint(ab / c);
+		*rest = uint(ab % c);
+
+	#else
+
+		DivTwoWords2(a, b, c, r, rest);
+
+	#endif
+	}
+
+
+} //namespace
+
+#endif //ifdef TTMATH_INTRINSICS
+#endif
@@ -52,6 +52,8 @@
 namespace ttmath
 {
 
+#ifndef TTMATH_INTRINSICS
+
 	/*!
 		returning the string represents the currect type of the library
 		we have following types:
@@ -127,6 +129,9 @@ namespace ttmath
 	return carry;
 	}
 
+#endif // #ifndef TTMATH_INTRINSICS
+
+
 
 
 	/*!
@@ -282,6 +287,8 @@ namespace ttmath
 
 
 
+#ifndef TTMATH_INTRINSICS
+
 	/*!
 		this method subtractes one word from the other
 		returns carry
@@ -310,6 +317,9 @@ namespace ttmath
 	return carry;
 	}
 
+#endif // #ifndef TTMATH_INTRINSICS
+
+
 
 
 
@@ -569,6 +579,8 @@ namespace ttmath
 
 
 
+#ifndef TTMATH_INTRINSICS
+
 	/*!
 		this method returns the number of the highest set bit in x
 		if the 'x' is zero this method returns '-1'
@@ -613,6 +625,9 @@ namespace ttmath
 	return bit;
 	}
 
+#endif // #ifndef TTMATH_INTRINSICS
+
+
 
 
 	/*!
@@ -655,6 +670,8 @@ namespace ttmath
 	*/
 
 
+#ifndef TTMATH_INTRINSICS
+
 	/*!
 		multiplication: result_high:result_low = a * b
 		result_high - higher word of the result
@@ -750,6 +767,9 @@ namespace ttmath
 	#endif
 	}
 
+#endif // #ifndef TTMATH_INTRINSICS
+
+
 
 
 
@@ -761,6 +781,8 @@ namespace ttmath
 	*/
 	
 
+#ifndef TTMATH_INTRINSICS
+
 	/*!
 		this method calculates 64bits word a:b / 32bits c (a higher, b lower word)
 		r = a:b / c and rest - remainder
@@ -838,6 +860,9 @@ namespace ttmath
 	#endif
 	}
 
+#endif // #ifndef TTMATH_INTRINSICS
+
+
 
 #ifdef TTMATH_PLATFORM64
 